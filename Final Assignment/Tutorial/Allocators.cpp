@@ -0,0 +1,251 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+using namespace std;
+
+#include "Allocators.h"
+
+static const size_t headerSize = 16;		// in front of each tagged allocation, keeps it 16-byte aligned
+
+// size and tag of a tagged allocation
+typedef struct AllocationHeader
+{
+	size_t bytes;
+	int tag;
+} AllocationHeader;
+
+static_assert(sizeof(AllocationHeader) <= headerSize, "the allocation header does not fit in front of the allocation");
+
+static const char* tagNames[NUMBER_OF_MEMORY_TAGS] = { "Mesh", "Load", "Frame" };
+
+static atomic<size_t> g_tagBytes[NUMBER_OF_MEMORY_TAGS];
+static atomic<size_t> g_tagPeakBytes[NUMBER_OF_MEMORY_TAGS];
+static atomic<int> g_tagAllocations[NUMBER_OF_MEMORY_TAGS];
+static atomic<int> g_tagTotalAllocations[NUMBER_OF_MEMORY_TAGS];
+static atomic<long long> g_heapAllocations(0);
+
+// every heap allocation made with new or memory_allocate goes through here, so the frame loop's can be counted
+static void* heap_allocate(size_t bytes)
+{
+	g_heapAllocations.fetch_add(1, memory_order_relaxed);
+
+	return malloc(bytes > 0 ? bytes : 1);
+}
+
+void* operator new(size_t bytes)
+{
+	void* pointer = heap_allocate(bytes);
+	if (pointer == NULL)
+		throw bad_alloc();
+
+	return pointer;
+}
+
+void* operator new[](size_t bytes)
+{
+	return operator new(bytes);
+}
+
+void* operator new(size_t bytes, const nothrow_t&) noexcept
+{
+	return heap_allocate(bytes);
+}
+
+void* operator new[](size_t bytes, const nothrow_t&) noexcept
+{
+	return heap_allocate(bytes);
+}
+
+void operator delete(void* pointer) noexcept
+{
+	free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+	free(pointer);
+}
+
+void operator delete(void* pointer, const nothrow_t&) noexcept
+{
+	free(pointer);
+}
+
+void operator delete[](void* pointer, const nothrow_t&) noexcept
+{
+	free(pointer);
+}
+
+void* memory_allocate(size_t bytes, int tag)
+{
+	unsigned char* block = static_cast<unsigned char*>(heap_allocate(headerSize + bytes));
+	if (block == NULL)
+		throw bad_alloc();
+
+	AllocationHeader* header = reinterpret_cast<AllocationHeader*>(block);
+	header->bytes = bytes;
+	header->tag = tag;
+
+	size_t inUse = g_tagBytes[tag].fetch_add(bytes, memory_order_relaxed) + bytes;
+	size_t peak = g_tagPeakBytes[tag].load(memory_order_relaxed);
+	while (inUse > peak && !g_tagPeakBytes[tag].compare_exchange_weak(peak, inUse, memory_order_relaxed))
+		;
+
+	g_tagAllocations[tag].fetch_add(1, memory_order_relaxed);
+	g_tagTotalAllocations[tag].fetch_add(1, memory_order_relaxed);
+
+	return block + headerSize;
+}
+
+void memory_free(void* pointer)
+{
+	if (pointer == NULL)
+		return;
+
+	unsigned char* block = static_cast<unsigned char*>(pointer) - headerSize;
+	const AllocationHeader* header = reinterpret_cast<const AllocationHeader*>(block);
+
+	g_tagBytes[header->tag].fetch_sub(header->bytes, memory_order_relaxed);
+	g_tagAllocations[header->tag].fetch_sub(1, memory_order_relaxed);
+
+	free(block);
+}
+
+MemoryStats get_memory_stats(int tag)
+{
+	MemoryStats stats;
+	stats.bytes = g_tagBytes[tag].load(memory_order_relaxed);
+	stats.peakBytes = g_tagPeakBytes[tag].load(memory_order_relaxed);
+	stats.allocations = g_tagAllocations[tag].load(memory_order_relaxed);
+	stats.totalAllocations = g_tagTotalAllocations[tag].load(memory_order_relaxed);
+
+	return stats;
+}
+
+const char* get_memory_tag_name(int tag)
+{
+	return tagNames[tag];
+}
+
+long long get_heap_allocations()
+{
+	return g_heapAllocations.load(memory_order_relaxed);
+}
+
+LinearArena::LinearArena()
+{
+	mBase = NULL;
+	mCapacity = 0;
+	mUsed = 0;
+	mOverflowBytes = 0;
+	mPeak = 0;
+	mOverflow = NULL;
+	mOverflows = 0;
+	mTag = MEMORY_FRAME;
+}
+
+LinearArena::~LinearArena()
+{
+}
+
+void LinearArena::init(size_t capacity, int tag)
+{
+	mTag = tag;
+	mCapacity = capacity;
+	mBase = static_cast<unsigned char*>(memory_allocate(capacity, tag));
+	mUsed = 0;
+	mOverflowBytes = 0;
+	mPeak = 0;
+	mOverflows = 0;
+}
+
+void LinearArena::destroy()
+{
+	// without a main block reset only frees the overflow
+	memory_free(mBase);
+	mBase = NULL;
+	mCapacity = 0;
+
+	reset();
+}
+
+// alignment is a power of two, at most 16
+void* LinearArena::allocate(size_t bytes, size_t alignment)
+{
+	size_t offset = (mUsed + alignment - 1) & ~(alignment - 1);
+
+	if (mBase != NULL && offset + bytes <= mCapacity)
+	{
+		mUsed = offset + bytes;
+		mPeak = max(mPeak, mUsed + mOverflowBytes);
+		return mBase + offset;
+	}
+
+	// the block header is 16 bytes too, so the data behind it keeps the alignment
+	unsigned char* block = static_cast<unsigned char*>(memory_allocate(headerSize + bytes, mTag));
+	OverflowBlock* overflow = reinterpret_cast<OverflowBlock*>(block);
+	overflow->next = mOverflow;
+	mOverflow = overflow;
+
+	mOverflowBytes += bytes;
+	mPeak = max(mPeak, mUsed + mOverflowBytes);
+	mOverflows++;
+
+	return block + headerSize;
+}
+
+// everything allocated is gone, the main block grows to hold what overflowed
+void LinearArena::reset()
+{
+	size_t used = mUsed + mOverflowBytes;
+
+	while (mOverflow != NULL)
+	{
+		OverflowBlock* next = mOverflow->next;
+		memory_free(mOverflow);
+		mOverflow = next;
+	}
+
+	// room for the alignment padding as well
+	if (mBase != NULL && used > mCapacity)
+	{
+		memory_free(mBase);
+		mCapacity = used + used / 4;
+		mBase = static_cast<unsigned char*>(memory_allocate(mCapacity, mTag));
+	}
+
+	mUsed = 0;
+	mOverflowBytes = 0;
+}
+
+size_t LinearArena::getUsed() const
+{
+	return mUsed + mOverflowBytes;
+}
+
+// most used between two resets since init
+size_t LinearArena::getPeak() const
+{
+	return mPeak;
+}
+
+size_t LinearArena::getCapacity() const
+{
+	return mCapacity;
+}
+
+int LinearArena::getOverflows() const
+{
+	return mOverflows;
+}
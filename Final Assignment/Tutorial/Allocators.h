@@ -0,0 +1,91 @@
+#ifndef __ALLOCATORS_H
+#define __ALLOCATORS_H
+
+#include <cstddef>
+#include <type_traits>
+
+#define FRAME_ARENA_SIZE (1 << 20)		// bytes of transient data a thread starts each frame with
+#define LOAD_ARENA_SIZE (16 << 20)		// scratch for the images and other data read while loading
+
+// what heap memory is for, it is counted per tag
+enum MemoryTag
+{
+	MEMORY_MESH,			// vertex and index arrays on the CPU, until they are uploaded
+	MEMORY_LOAD,			// load-time scratch, decoded images and the like
+	MEMORY_FRAME,			// per-frame transient data
+	NUMBER_OF_MEMORY_TAGS
+};
+
+// counters of one tag
+typedef struct MemoryStats
+{
+	size_t bytes;			// in use
+	size_t peakBytes;
+	int allocations;		// in use
+	int totalAllocations;	// since the start
+} MemoryStats;
+
+// heap memory counted against a tag, 16-byte aligned, released with memory_free
+void* memory_allocate(size_t bytes, int tag);
+void memory_free(void* pointer);
+
+// an array of plain data, left uninitialised
+template <typename T>
+T* memory_allocate_array(size_t count, int tag)
+{
+	static_assert(std::is_trivially_destructible<T>::value, "only plain data can be kept in tagged memory");
+	return static_cast<T*>(memory_allocate(count * sizeof(T), tag));
+}
+
+MemoryStats get_memory_stats(int tag);
+const char* get_memory_tag_name(int tag);
+
+// heap allocations through the global operator new and new[] or memory_allocate, arena growth included,
+// on every thread since the start; the frame loop should add none
+long long get_heap_allocations();
+
+// bump allocator for data that all dies at once: a frame's lists, or everything read while loading
+// allocations are a pointer increment into one block; whatever does not fit goes into overflow blocks, which
+// reset frees while growing the main block to the peak reached, so after the first few frames it never
+// allocates again
+// one thread at a time, nothing allocated from it is destructed
+class LinearArena {
+public:
+	LinearArena();
+	~LinearArena();
+
+	void init(size_t capacity, int tag);
+	void destroy();
+	void* allocate(size_t bytes, size_t alignment = 16);
+	void reset();
+
+	template <typename T>
+	T* allocateArray(size_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "an arena never runs destructors");
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+	}
+
+	size_t getUsed() const;
+	size_t getPeak() const;
+	size_t getCapacity() const;
+	int getOverflows() const;
+
+private:
+	// a block that did not fit, chained in front of the others
+	typedef struct OverflowBlock
+	{
+		OverflowBlock* next;
+	} OverflowBlock;
+
+	unsigned char* mBase;
+	size_t mCapacity;
+	size_t mUsed;				// of the main block
+	size_t mOverflowBytes;		// in the overflow blocks since the last reset
+	size_t mPeak;				// most used between two resets, overflow included
+	OverflowBlock* mOverflow;
+	int mOverflows;				// since the start
+	int mTag;
+};
+
+#endif
@@ -0,0 +1,668 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+using namespace std;
+
+#include "simd.h"
+#include "Animation.h"
+
+static const int minInstancesPerJob = 256;	// instances below which the batches are evaluated on the calling thread
+static const int batchesPerJob = 16;
+static const float slerpThreshold = 0.9995f;	// cosine above which the keys are too close to slerp, lerped instead
+
+// rest values of the channels, where a clip has no track for them
+static const float restValues[NUMBER_OF_CHANNELS][4] = {
+	{ 0.0f, 0.0f, 0.0f, 0.0f },
+	{ 0.0f, 0.0f, 0.0f, 1.0f },
+	{ 1.0f, 1.0f, 1.0f, 0.0f }
+};
+
+static double elapsed_ms(chrono::high_resolution_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+// arc cosine for x in 0 to 1, within 7e-5 (Abramowitz and Stegun 4.4.45), the same in both paths
+static float acos_approx(float x)
+{
+	return sqrt(1.0f - x) * (((-0.0187293f * x + 0.0742610f) * x - 0.2121144f) * x + 1.5707288f);
+}
+
+// sine for x in 0 to pi / 2, Taylor series to x^9
+static float sin_approx(float x)
+{
+	float x2 = x * x;
+	return x * (1.0f + x2 * (-1.0f / 6.0f + x2 * (1.0f / 120.0f + x2 * (-1.0f / 5040.0f + x2 * (1.0f / 362880.0f)))));
+}
+
+// one channel of one lane: the weighted sum of its four keys, after swapping in slerp weights where asked for
+static void interpolate_scalar(const Animator::ChannelSamples& samples, int lane, int components, float* result)
+{
+	float weights[4];
+	for (int k = 0; k < 4; k++)
+		weights[k] = samples.weights[k][lane];
+
+	float t = samples.slerp[lane];
+
+	if (t >= 0.0f)
+	{
+		float d = 0.0f;
+		for (int c = 0; c < 4; c++)
+			d += samples.values[1][c][lane] * samples.values[2][c][lane];
+
+		if (d < slerpThreshold)
+		{
+			float theta = acos_approx(max(d, 0.0f));
+			float inverseSin = 1.0f / sin_approx(theta);
+			weights[1] = sin_approx((1.0f - t) * theta) * inverseSin;
+			weights[2] = sin_approx(t * theta) * inverseSin;
+		}
+	}
+
+	for (int c = 0; c < components; c++)
+	{
+		result[c] = 0.0f;
+		for (int k = 0; k < 4; k++)
+			result[c] += weights[k] * samples.values[k][c][lane];
+	}
+}
+
+static void normalize_quaternion(float* q)
+{
+	float inverseLength = 1.0f / sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	for (int c = 0; c < 4; c++)
+		q[c] *= inverseLength;
+}
+
+static void evaluate_lanes_scalar(Animator::SampleBatch* batch, bool blending)
+{
+	for (int lane = 0; lane < ANIMATION_LANES; lane++)
+	{
+		float t[3], r[4], s[3];
+		interpolate_scalar(batch->channels[0][CHANNEL_TRANSLATION], lane, 3, t);
+		interpolate_scalar(batch->channels[0][CHANNEL_ROTATION], lane, 4, r);
+		interpolate_scalar(batch->channels[0][CHANNEL_SCALE], lane, 3, s);
+
+		if (blending)
+		{
+			float t1[3], r1[4], s1[3];
+			interpolate_scalar(batch->channels[1][CHANNEL_TRANSLATION], lane, 3, t1);
+			interpolate_scalar(batch->channels[1][CHANNEL_ROTATION], lane, 4, r1);
+			interpolate_scalar(batch->channels[1][CHANNEL_SCALE], lane, 3, s1);
+
+			float b = batch->blend[lane];
+			float d = r[0] * r1[0] + r[1] * r1[1] + r[2] * r1[2] + r[3] * r1[3];
+			float rb = (d < 0.0f) ? -b : b;
+
+			for (int c = 0; c < 3; c++)
+			{
+				t[c] += (t1[c] - t[c]) * b;
+				s[c] += (s1[c] - s[c]) * b;
+			}
+
+			// nlerp, the two layers' rotations are seldom far apart
+			for (int c = 0; c < 4; c++)
+				r[c] = r[c] * (1.0f - b) + r1[c] * rb;
+		}
+
+		normalize_quaternion(r);
+
+		float xx = r[0] * r[0], yy = r[1] * r[1], zz = r[2] * r[2];
+		float xy = r[0] * r[1], xz = r[0] * r[2], yz = r[1] * r[2];
+		float wx = r[3] * r[0], wy = r[3] * r[1], wz = r[3] * r[2];
+
+		float (*m)[ANIMATION_LANES] = batch->matrices;
+		m[0][lane] = (1.0f - 2.0f * (yy + zz)) * s[0];
+		m[1][lane] = 2.0f * (xy + wz) * s[0];
+		m[2][lane] = 2.0f * (xz - wy) * s[0];
+		m[3][lane] = 2.0f * (xy - wz) * s[1];
+		m[4][lane] = (1.0f - 2.0f * (xx + zz)) * s[1];
+		m[5][lane] = 2.0f * (yz + wx) * s[1];
+		m[6][lane] = 2.0f * (xz + wy) * s[2];
+		m[7][lane] = 2.0f * (yz - wx) * s[2];
+		m[8][lane] = (1.0f - 2.0f * (xx + yy)) * s[2];
+		m[9][lane] = t[0];
+		m[10][lane] = t[1];
+		m[11][lane] = t[2];
+	}
+}
+
+AVX2_FUNCTION static __m256 acos_avx2(__m256 x)
+{
+	__m256 p = _mm256_fmadd_ps(_mm256_set1_ps(-0.0187293f), x, _mm256_set1_ps(0.0742610f));
+	p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(-0.2121144f));
+	p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(1.5707288f));
+	return _mm256_mul_ps(_mm256_sqrt_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), x)), p);
+}
+
+AVX2_FUNCTION static __m256 sin_avx2(__m256 x)
+{
+	__m256 x2 = _mm256_mul_ps(x, x);
+	__m256 p = _mm256_fmadd_ps(x2, _mm256_set1_ps(1.0f / 362880.0f), _mm256_set1_ps(-1.0f / 5040.0f));
+	p = _mm256_fmadd_ps(x2, p, _mm256_set1_ps(1.0f / 120.0f));
+	p = _mm256_fmadd_ps(x2, p, _mm256_set1_ps(-1.0f / 6.0f));
+	p = _mm256_fmadd_ps(x2, p, _mm256_set1_ps(1.0f));
+	return _mm256_mul_ps(x, p);
+}
+
+// see interpolate_scalar, all the lanes at once
+AVX2_FUNCTION static void interpolate_avx2(const Animator::ChannelSamples& samples, int components, __m256* result)
+{
+	__m256 weights[4];
+	for (int k = 0; k < 4; k++)
+		weights[k] = _mm256_loadu_ps(samples.weights[k]);
+
+	__m256 t = _mm256_loadu_ps(samples.slerp);
+	__m256 zero = _mm256_setzero_ps();
+	__m256 slerped = _mm256_cmp_ps(t, zero, _CMP_GE_OQ);
+
+	if (_mm256_movemask_ps(slerped) != 0)
+	{
+		__m256 d = zero;
+		for (int c = 0; c < 4; c++)
+			d = _mm256_fmadd_ps(_mm256_loadu_ps(samples.values[1][c]), _mm256_loadu_ps(samples.values[2][c]), d);
+
+		slerped = _mm256_and_ps(slerped, _mm256_cmp_ps(d, _mm256_set1_ps(slerpThreshold), _CMP_LT_OQ));
+
+		if (_mm256_movemask_ps(slerped) != 0)
+		{
+			// lanes left out are computed as well, with harmless values, and then not used
+			__m256 theta = acos_avx2(_mm256_min_ps(_mm256_max_ps(d, zero), _mm256_set1_ps(slerpThreshold)));
+			__m256 inverseSin = _mm256_div_ps(_mm256_set1_ps(1.0f), sin_avx2(theta));
+			__m256 w1 = _mm256_mul_ps(sin_avx2(_mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), t), theta)), inverseSin);
+			__m256 w2 = _mm256_mul_ps(sin_avx2(_mm256_mul_ps(t, theta)), inverseSin);
+
+			weights[1] = _mm256_blendv_ps(weights[1], w1, slerped);
+			weights[2] = _mm256_blendv_ps(weights[2], w2, slerped);
+		}
+	}
+
+	for (int c = 0; c < components; c++)
+	{
+		result[c] = _mm256_mul_ps(weights[0], _mm256_loadu_ps(samples.values[0][c]));
+		for (int k = 1; k < 4; k++)
+			result[c] = _mm256_fmadd_ps(weights[k], _mm256_loadu_ps(samples.values[k][c]), result[c]);
+	}
+}
+
+AVX2_FUNCTION static void evaluate_lanes_avx2(Animator::SampleBatch* batch, bool blending)
+{
+	__m256 t[3], r[4], s[3];
+	interpolate_avx2(batch->channels[0][CHANNEL_TRANSLATION], 3, t);
+	interpolate_avx2(batch->channels[0][CHANNEL_ROTATION], 4, r);
+	interpolate_avx2(batch->channels[0][CHANNEL_SCALE], 3, s);
+
+	if (blending)
+	{
+		__m256 t1[3], r1[4], s1[3];
+		interpolate_avx2(batch->channels[1][CHANNEL_TRANSLATION], 3, t1);
+		interpolate_avx2(batch->channels[1][CHANNEL_ROTATION], 4, r1);
+		interpolate_avx2(batch->channels[1][CHANNEL_SCALE], 3, s1);
+
+		__m256 b = _mm256_loadu_ps(batch->blend);
+		__m256 d = _mm256_mul_ps(r[0], r1[0]);
+		for (int c = 1; c < 4; c++)
+			d = _mm256_fmadd_ps(r[c], r1[c], d);
+
+		// the sign of d flips the second rotation onto the same side as the first
+		__m256 signMask = _mm256_and_ps(d, _mm256_set1_ps(-0.0f));
+		__m256 rb = _mm256_xor_ps(b, signMask);
+		__m256 ra = _mm256_sub_ps(_mm256_set1_ps(1.0f), b);
+
+		for (int c = 0; c < 3; c++)
+		{
+			t[c] = _mm256_fmadd_ps(_mm256_sub_ps(t1[c], t[c]), b, t[c]);
+			s[c] = _mm256_fmadd_ps(_mm256_sub_ps(s1[c], s[c]), b, s[c]);
+		}
+
+		for (int c = 0; c < 4; c++)
+			r[c] = _mm256_fmadd_ps(r1[c], rb, _mm256_mul_ps(r[c], ra));
+	}
+
+	__m256 lengthSquared = _mm256_mul_ps(r[0], r[0]);
+	for (int c = 1; c < 4; c++)
+		lengthSquared = _mm256_fmadd_ps(r[c], r[c], lengthSquared);
+
+	__m256 inverseLength = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(lengthSquared));
+	for (int c = 0; c < 4; c++)
+		r[c] = _mm256_mul_ps(r[c], inverseLength);
+
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256 two = _mm256_set1_ps(2.0f);
+	__m256 xx = _mm256_mul_ps(r[0], r[0]), yy = _mm256_mul_ps(r[1], r[1]), zz = _mm256_mul_ps(r[2], r[2]);
+	__m256 xy = _mm256_mul_ps(r[0], r[1]), xz = _mm256_mul_ps(r[0], r[2]), yz = _mm256_mul_ps(r[1], r[2]);
+	__m256 wx = _mm256_mul_ps(r[3], r[0]), wy = _mm256_mul_ps(r[3], r[1]), wz = _mm256_mul_ps(r[3], r[2]);
+
+	float (*m)[ANIMATION_LANES] = batch->matrices;
+	_mm256_storeu_ps(m[0], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), s[0]));
+	_mm256_storeu_ps(m[1], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), s[0]));
+	_mm256_storeu_ps(m[2], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), s[0]));
+	_mm256_storeu_ps(m[3], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), s[1]));
+	_mm256_storeu_ps(m[4], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), s[1]));
+	_mm256_storeu_ps(m[5], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), s[1]));
+	_mm256_storeu_ps(m[6], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), s[2]));
+	_mm256_storeu_ps(m[7], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), s[2]));
+	_mm256_storeu_ps(m[8], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), s[2]));
+	_mm256_storeu_ps(m[9], t[0]);
+	_mm256_storeu_ps(m[10], t[1]);
+	_mm256_storeu_ps(m[11], t[2]);
+}
+
+// a channel held at its rest value, every key the same so the weights do not matter
+static void fill_rest(Animator::ChannelSamples* samples, int channel, int lane)
+{
+	for (int k = 0; k < 4; k++)
+	{
+		for (int c = 0; c < 4; c++)
+			samples->values[k][c][lane] = restValues[channel][c];
+
+		samples->weights[k][lane] = (k == 1) ? 1.0f : 0.0f;
+	}
+
+	samples->slerp[lane] = -1.0f;
+}
+
+Animator::Animator()
+{
+	mJobSystem = NULL;
+	mSimd = false;
+	mStats = AnimationStats();
+}
+
+Animator::~Animator()
+{
+}
+
+void Animator::init(JobSystem* jobSystem)
+{
+	mJobSystem = jobSystem;
+	mSimd = cpu_has_avx2();
+}
+
+void Animator::destroy()
+{
+	clearInstances();
+
+	mClips.clear();
+	mTracks.clear();
+	mKeyTimes.clear();
+	mKeyX.clear();
+	mKeyY.clear();
+	mKeyZ.clear();
+	mKeyW.clear();
+}
+
+// a clip with no tracks, every channel at rest until tracks are added
+int Animator::addClip(float duration)
+{
+	Clip clip;
+	clip.duration = duration;
+
+	for (int i = 0; i < NUMBER_OF_CHANNELS; i++)
+		clip.tracks[i] = -1;
+
+	mClips.push_back(clip);
+	return static_cast<int>(mClips.size()) - 1;
+}
+
+// keys in order of time, translation and scale in xyz, rotation as a unit quaternion
+void Animator::addTrack(int clip, int channel, int interpolation, const float* times, const glm::vec4* values, int count)
+{
+	if (count <= 0)
+		return;
+
+	Track track;
+	track.firstKey = static_cast<int>(mKeyTimes.size());
+	track.numberOfKeys = count;
+	track.interpolation = interpolation;
+
+	for (int i = 0; i < count; i++)
+	{
+		mKeyTimes.push_back(times[i]);
+		mKeyX.push_back(values[i].x);
+		mKeyY.push_back(values[i].y);
+		mKeyZ.push_back(values[i].z);
+		mKeyW.push_back(values[i].w);
+	}
+
+	mTracks.push_back(track);
+	mClips[clip].tracks[channel] = static_cast<int>(mTracks.size()) - 1;
+}
+
+// the matrix of transforms[transform] will be base times the animation, nothing plays until play is called
+int Animator::addInstance(int transform, const glm::mat4& base)
+{
+	mTransforms.push_back(transform);
+	mBases.push_back(base);
+
+	for (int layer = 0; layer < ANIMATION_LAYERS; layer++)
+	{
+		mInstanceClips[layer].push_back(-1);
+		mTimes[layer].push_back(0.0f);
+		mSpeeds[layer].push_back(1.0f);
+		mLoops[layer].push_back(0);
+
+		for (int channel = 0; channel < NUMBER_OF_CHANNELS; channel++)
+			mCursors[layer][channel].push_back(0);
+	}
+
+	mBlends.push_back(0.0f);
+	mBlendRates.push_back(0.0f);
+
+	return static_cast<int>(mTransforms.size()) - 1;
+}
+
+void Animator::clearInstances()
+{
+	mTransforms.clear();
+	mBases.clear();
+
+	for (int layer = 0; layer < ANIMATION_LAYERS; layer++)
+	{
+		mInstanceClips[layer].clear();
+		mTimes[layer].clear();
+		mSpeeds[layer].clear();
+		mLoops[layer].clear();
+
+		for (int channel = 0; channel < NUMBER_OF_CHANNELS; channel++)
+			mCursors[layer][channel].clear();
+	}
+
+	mBlends.clear();
+	mBlendRates.clear();
+}
+
+// play a clip from the given time, stopping any cross-fade
+void Animator::play(int instance, int clip, bool loop, float speed, float time)
+{
+	mInstanceClips[0][instance] = clip;
+	mTimes[0][instance] = wrapTime(clip, loop, time);
+	mSpeeds[0][instance] = speed;
+	mLoops[0][instance] = loop ? 1 : 0;
+
+	for (int channel = 0; channel < NUMBER_OF_CHANNELS; channel++)
+		mCursors[0][channel][instance] = 0;
+
+	mInstanceClips[1][instance] = -1;
+	mBlends[instance] = 0.0f;
+}
+
+// start a clip from its beginning and fade the one playing out over duration seconds
+void Animator::blendTo(int instance, int clip, bool loop, float duration)
+{
+	if (mInstanceClips[0][instance] < 0 || duration <= 0.0f)
+	{
+		play(instance, clip, loop, mSpeeds[0][instance]);
+		return;
+	}
+
+	// a clip already fading out is dropped, only the last two play
+	mInstanceClips[1][instance] = mInstanceClips[0][instance];
+	mTimes[1][instance] = mTimes[0][instance];
+	mSpeeds[1][instance] = mSpeeds[0][instance];
+	mLoops[1][instance] = mLoops[0][instance];
+
+	for (int channel = 0; channel < NUMBER_OF_CHANNELS; channel++)
+		mCursors[1][channel][instance] = mCursors[0][channel][instance];
+
+	mInstanceClips[0][instance] = clip;
+	mTimes[0][instance] = 0.0f;
+	mLoops[0][instance] = loop ? 1 : 0;
+
+	for (int channel = 0; channel < NUMBER_OF_CHANNELS; channel++)
+		mCursors[0][channel][instance] = 0;
+
+	mBlends[instance] = 1.0f;
+	mBlendRates[instance] = 1.0f / duration;
+}
+
+// move every instance on by delta seconds, scaled by its speed
+void Animator::advance(float delta)
+{
+	int numberOfInstances = getNumberOfInstances();
+	int blending = 0;
+
+	for (int layer = 0; layer < ANIMATION_LAYERS; layer++)
+	{
+		const int* clips = numberOfInstances > 0 ? &mInstanceClips[layer][0] : NULL;
+
+		for (int i = 0; i < numberOfInstances; i++)
+		{
+			if (clips[i] >= 0)
+				mTimes[layer][i] = wrapTime(clips[i], mLoops[layer][i] != 0, mTimes[layer][i] + delta * mSpeeds[layer][i]);
+		}
+	}
+
+	for (int i = 0; i < numberOfInstances; i++)
+	{
+		if (mInstanceClips[1][i] < 0)
+			continue;
+
+		mBlends[i] -= delta * mBlendRates[i];
+
+		if (mBlends[i] <= 0.0f)
+		{
+			mInstanceClips[1][i] = -1;
+			mBlends[i] = 0.0f;
+		}
+		else
+			blending++;
+	}
+
+	mStats.blendingInstances = blending;
+}
+
+// write every instance's matrix, timeOffset seconds from where advance left it (negative to look back part of a
+// step, for interpolation)
+void Animator::evaluate(float timeOffset, glm::mat4* transforms)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+	int numberOfInstances = getNumberOfInstances();
+	int numberOfBatches = (numberOfInstances + ANIMATION_LANES - 1) / ANIMATION_LANES;
+
+	if (mJobSystem != NULL && numberOfInstances >= minInstancesPerJob)
+	{
+		mJobSystem->parallelFor(numberOfBatches, batchesPerJob, [this, timeOffset, transforms](int begin, int end)
+		{
+			for (int batch = begin; batch < end; batch++)
+				evaluateBatch(batch, timeOffset, transforms);
+		});
+	}
+	else
+	{
+		for (int batch = 0; batch < numberOfBatches; batch++)
+			evaluateBatch(batch, timeOffset, transforms);
+	}
+
+	mStats.instances = numberOfInstances;
+	mStats.batches = numberOfBatches;
+	mStats.evaluateTime = static_cast<float>(elapsed_ms(start));
+}
+
+int Animator::getNumberOfInstances() const
+{
+	return static_cast<int>(mTransforms.size());
+}
+
+const AnimationStats& Animator::getStats() const
+{
+	return mStats;
+}
+
+bool Animator::isSimd() const
+{
+	return mSimd;
+}
+
+// a time in the clip, wrapped round if it loops and held at the ends if not
+float Animator::wrapTime(int clip, bool loop, float time) const
+{
+	float duration = mClips[clip].duration;
+
+	if (duration <= 0.0f)
+		return 0.0f;
+
+	if (!loop)
+		return min(max(time, 0.0f), duration);
+
+	time = fmod(time, duration);
+	return (time < 0.0f) ? time + duration : time;
+}
+
+// find the keys either side of the time, starting from the ones found last time, and put them in a lane
+void Animator::sampleTrack(int clip, int channel, float time, int* cursor, int lane, ChannelSamples* samples) const
+{
+	int trackIndex = mClips[clip].tracks[channel];
+
+	if (trackIndex < 0)
+	{
+		fill_rest(samples, channel, lane);
+		return;
+	}
+
+	const Track& track = mTracks[trackIndex];
+	const float* times = &mKeyTimes[track.firstKey];
+	int last = track.numberOfKeys - 1;
+	int key = 0;
+	float t = 0.0f;
+
+	if (last > 0)
+	{
+		key = min(max(*cursor, 0), last - 1);
+
+		// usually still between the same keys, or on to the next pair
+		if (time < times[key] || time >= times[key + 1])
+		{
+			if (key + 2 <= last && time >= times[key + 1] && time < times[key + 2])
+				key++;
+			else
+				key = min(max(static_cast<int>(upper_bound(times, times + last + 1, time) - times) - 1, 0), last - 1);
+		}
+
+		*cursor = key;
+
+		float span = times[key + 1] - times[key];
+		t = (span > 0.0f) ? min(max((time - times[key]) / span, 0.0f), 1.0f) : 1.0f;
+	}
+
+	int keys[4] = { max(key - 1, 0), key, min(key + 1, last), min(key + 2, last) };
+	const float* components[4] = { &mKeyX[track.firstKey], &mKeyY[track.firstKey], &mKeyZ[track.firstKey], &mKeyW[track.firstKey] };
+
+	for (int k = 0; k < 4; k++)
+	{
+		for (int c = 0; c < 4; c++)
+			samples->values[k][c][lane] = components[c][keys[k]];
+	}
+
+	// each rotation key on the same side as the one it is interpolated from, so they take the shorter way round
+	if (channel == CHANNEL_ROTATION)
+	{
+		static const int from[4] = { 1, 1, 1, 2 };
+
+		for (int k = 0; k < 4; k++)
+		{
+			if (k == 1)
+				continue;
+
+			float d = 0.0f;
+			for (int c = 0; c < 4; c++)
+				d += samples->values[k][c][lane] * samples->values[from[k]][c][lane];
+
+			if (d < 0.0f)
+			{
+				for (int c = 0; c < 4; c++)
+					samples->values[k][c][lane] = -samples->values[k][c][lane];
+			}
+		}
+	}
+
+	float* weights[4] = { &samples->weights[0][lane], &samples->weights[1][lane], &samples->weights[2][lane], &samples->weights[3][lane] };
+	samples->slerp[lane] = -1.0f;
+
+	if (track.interpolation == INTERPOLATION_STEP)
+	{
+		*weights[0] = 0.0f;
+		*weights[1] = (t < 1.0f) ? 1.0f : 0.0f;
+		*weights[2] = (t < 1.0f) ? 0.0f : 1.0f;
+		*weights[3] = 0.0f;
+	}
+	else if (track.interpolation == INTERPOLATION_LINEAR)
+	{
+		*weights[0] = 0.0f;
+		*weights[1] = 1.0f - t;
+		*weights[2] = t;
+		*weights[3] = 0.0f;
+
+		if (channel == CHANNEL_ROTATION)
+			samples->slerp[lane] = t;
+	}
+	else
+	{
+		// Catmull-Rom, the keys are treated as evenly spaced
+		float t2 = t * t;
+		float t3 = t2 * t;
+		*weights[0] = 0.5f * (-t3 + 2.0f * t2 - t);
+		*weights[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+		*weights[2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+		*weights[3] = 0.5f * (t3 - t2);
+	}
+}
+
+void Animator::evaluateBatch(int batch, float timeOffset, glm::mat4* transforms)
+{
+	SampleBatch samples;
+	int numberOfInstances = getNumberOfInstances();
+	bool blending = false;
+
+	for (int lane = 0; lane < ANIMATION_LANES; lane++)
+	{
+		int instance = batch * ANIMATION_LANES + lane;
+		samples.blend[lane] = 0.0f;
+
+		for (int layer = 0; layer < ANIMATION_LAYERS; layer++)
+		{
+			int clip = (instance < numberOfInstances) ? mInstanceClips[layer][instance] : -1;
+
+			if (clip < 0)
+			{
+				for (int channel = 0; channel < NUMBER_OF_CHANNELS; channel++)
+					fill_rest(&samples.channels[layer][channel], channel, lane);
+				continue;
+			}
+
+			float time = wrapTime(clip, mLoops[layer][instance] != 0, mTimes[layer][instance] + timeOffset * mSpeeds[layer][instance]);
+
+			for (int channel = 0; channel < NUMBER_OF_CHANNELS; channel++)
+				sampleTrack(clip, channel, time, &mCursors[layer][channel][instance], lane, &samples.channels[layer][channel]);
+
+			// looking back, the fade had further to go
+			if (layer == 1)
+			{
+				samples.blend[lane] = min(max(mBlends[instance] - timeOffset * mBlendRates[instance], 0.0f), 1.0f);
+				blending = true;
+			}
+		}
+	}
+
+	if (mSimd)
+		evaluate_lanes_avx2(&samples, blending);
+	else
+		evaluate_lanes_scalar(&samples, blending);
+
+	int lanes = min(ANIMATION_LANES, numberOfInstances - batch * ANIMATION_LANES);
+
+	for (int lane = 0; lane < lanes; lane++)
+	{
+		int instance = batch * ANIMATION_LANES + lane;
+		const float (*m)[ANIMATION_LANES] = samples.matrices;
+
+		glm::mat4 local(
+			glm::vec4(m[0][lane], m[1][lane], m[2][lane], 0.0f),
+			glm::vec4(m[3][lane], m[4][lane], m[5][lane], 0.0f),
+			glm::vec4(m[6][lane], m[7][lane], m[8][lane], 0.0f),
+			glm::vec4(m[9][lane], m[10][lane], m[11][lane], 1.0f));
+
+		transforms[mTransforms[instance]] = mBases[instance] * local;
+	}
+}
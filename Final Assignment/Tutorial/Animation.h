@@ -0,0 +1,126 @@
+#ifndef __ANIMATION_H
+#define __ANIMATION_H
+
+#include <vector>
+
+#include <glm/glm.hpp>	// include GLM (ideally should only use the GLM headers that are actually used)
+
+#include "JobSystem.h"
+
+#define ANIMATION_LANES 8			// instances evaluated together, one AVX2 register
+#define ANIMATION_LAYERS 2			// clips an instance can be playing at once, the second fading out
+
+// how the values between two keys are found
+enum Interpolation
+{
+	INTERPOLATION_STEP,			// the earlier key's value until the next key
+	INTERPOLATION_LINEAR,		// lerp, slerp for rotations
+	INTERPOLATION_CUBIC			// Catmull-Rom through the neighbouring keys, normalised for rotations
+};
+
+// what a track animates
+enum AnimationChannel
+{
+	CHANNEL_TRANSLATION,
+	CHANNEL_ROTATION,			// quaternion, x, y, z, w
+	CHANNEL_SCALE,
+	NUMBER_OF_CHANNELS
+};
+
+// counters for the last evaluate
+typedef struct AnimationStats
+{
+	int instances;
+	int blendingInstances;		// playing two clips
+	int batches;
+	float evaluateTime;			// milliseconds
+} AnimationStats;
+
+// keyframed translation, rotation and scale for many objects at once
+// clips are sets of tracks, one per channel, whose keys are kept in flat arrays of times and of each component;
+// instances play a clip, looping or not, and can cross-fade to another
+// evaluate works on ANIMATION_LANES instances at a time: the keys around each instance's time are found one
+// instance at a time (the last key found is remembered, so this is usually a single comparison) and gathered into
+// lanes with the weights of their interpolation, then interpolation, slerp, blending and building the matrices
+// are done for all the lanes together, with AVX2 when the CPU has it
+// the matrices are written into the caller's transform array, as the instance's base placement times the animation
+class Animator {
+public:
+	Animator();
+	~Animator();
+
+	void init(JobSystem* jobSystem = NULL);
+	void destroy();
+	int addClip(float duration);
+	void addTrack(int clip, int channel, int interpolation, const float* times, const glm::vec4* values, int count);
+	int addInstance(int transform, const glm::mat4& base);
+	void clearInstances();
+	void play(int instance, int clip, bool loop, float speed = 1.0f, float time = 0.0f);
+	void blendTo(int instance, int clip, bool loop, float duration);
+	void advance(float delta);
+	void evaluate(float timeOffset, glm::mat4* transforms);
+
+	int getNumberOfInstances() const;
+	const AnimationStats& getStats() const;
+	bool isSimd() const;
+
+	// keys around the instances' times and their weights for one batch, filled in one lane at a time
+	typedef struct ChannelSamples
+	{
+		float values[4][4][ANIMATION_LANES];	// key before the previous, previous, next, after the next; component
+		float weights[4][ANIMATION_LANES];
+		float slerp[ANIMATION_LANES];			// rotation: t for lanes slerped between the middle two keys, -1 otherwise
+	} ChannelSamples;
+
+	typedef struct SampleBatch
+	{
+		ChannelSamples channels[ANIMATION_LAYERS][NUMBER_OF_CHANNELS];
+		float blend[ANIMATION_LANES];			// weight of the second layer
+		float matrices[12][ANIMATION_LANES];	// results, the top three rows of each matrix by column
+	} SampleBatch;
+
+private:
+	typedef struct Track
+	{
+		int firstKey;
+		int numberOfKeys;
+		int interpolation;
+	} Track;
+
+	typedef struct Clip
+	{
+		float duration;			// seconds
+		int tracks[NUMBER_OF_CHANNELS];		// -1 where the channel keeps its rest value
+	} Clip;
+
+	float wrapTime(int clip, bool loop, float time) const;
+	void sampleTrack(int clip, int channel, float time, int* cursor, int lane, ChannelSamples* samples) const;
+	void evaluateBatch(int batch, float timeOffset, glm::mat4* transforms);
+
+	std::vector<Clip> mClips;
+	std::vector<Track> mTracks;
+
+	// keys of every track, one array per component
+	std::vector<float> mKeyTimes;
+	std::vector<float> mKeyX;
+	std::vector<float> mKeyY;
+	std::vector<float> mKeyZ;
+	std::vector<float> mKeyW;
+
+	// instances, one array per field
+	std::vector<int> mTransforms;
+	std::vector<glm::mat4> mBases;
+	std::vector<int> mInstanceClips[ANIMATION_LAYERS];		// -1 when the layer is not playing
+	std::vector<float> mTimes[ANIMATION_LAYERS];
+	std::vector<float> mSpeeds[ANIMATION_LAYERS];
+	std::vector<unsigned char> mLoops[ANIMATION_LAYERS];
+	std::vector<int> mCursors[ANIMATION_LAYERS][NUMBER_OF_CHANNELS];	// key last found in each track
+	std::vector<float> mBlends;								// weight of the second layer, falls to 0
+	std::vector<float> mBlendRates;							// per second
+
+	JobSystem* mJobSystem;
+	bool mSimd;								// AVX2 is available
+	AnimationStats mStats;
+};
+
+#endif
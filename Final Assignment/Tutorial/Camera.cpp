@@ -1,18 +1,27 @@
+#include <atomic>
+using namespace std;
+
 #include "Camera.h"
+#include "culling.h"
+
+// versions are handed out from here so no two states of any cameras share one, 0 is never used
+static atomic<unsigned int> g_nextCameraVersion(1);
 
 Camera::Camera()
 {
 	// initialise camera member variables
 	mPosition = glm::vec3(0.0f, 0.0f, 1.0f);
-	mLookAt = glm::vec3(0.0f, 0.0f, 0.0f);
-	mUp = glm::vec3(0.0f, 1.0f, 0.0f);
-	
+
 	mYaw = 0.0f;
 	mPitch = 0.0f;
 	mFOV = glm::radians(45.0f);
+	mAspectRatio = 1.0f;
+	mNear = 0.1f;
+	mFar = 100.0f;
 
-	mViewMatrix = glm::lookAt(mPosition, mLookAt, mUp);
-	mProjectionMatrix = glm::perspective(mFOV, 1.0f, 0.1f, 100.0f);
+	mViewDirty = true;
+	mProjectionDirty = true;
+	changed(true, true);
 }
 
 Camera::~Camera()
@@ -20,33 +29,36 @@ Camera::~Camera()
 
 void Camera::update(float moveForward, float moveRight)
 {
-	// rotate the respective unit vectors about the y-axis
-	glm::vec3 rotatedForwardVec = glm::rotateY(glm::vec3(0.0f, 0.0f, -1.0f), mYaw);
-	glm::vec3 rotatedRightVec = glm::rotateY(glm::vec3(1.0f, 0.0f, 0.0f), mYaw);
-	// rotate the rotated forward vector about the rotated right vector by the pitch
-	rotatedForwardVec = glm::vec3(glm::rotate(mPitch, rotatedRightVec)*glm::vec4(rotatedForwardVec, 0.0f));
+	// the view is rebuilt from the yaw and pitch when it is next needed, only movement has to be applied now
+	if (moveForward == 0.0f && moveRight == 0.0f)
+		return;
+
+	updateView();
 
-	// update camera position, look-at position and up vectors
-	mPosition += rotatedForwardVec * moveForward + rotatedRightVec * moveRight;
-	mLookAt = mPosition + rotatedForwardVec;
-	mUp = glm::cross(rotatedRightVec, rotatedForwardVec);
+	glm::vec3 rightVec = glm::rotateY(glm::vec3(1.0f, 0.0f, 0.0f), mYaw);
+	mPosition += mForward * moveForward + rightVec * moveRight;
 
-	// compute the new view matrix
-	mViewMatrix = glm::lookAt(mPosition, mLookAt, mUp);
+	changed(true, false);
 }
 
 void Camera::updateRotation(float yaw, float pitch)
 {
 	static const float limit = glm::radians(89.0f);
 
-	mYaw += yaw;
-	mPitch += pitch;
+	float newPitch = mPitch + pitch;
 
 	// keep pitch within limits
-	if (mPitch > limit)
-		mPitch = limit;
-	else if (mPitch < -limit)
-		mPitch = -limit;
+	if (newPitch > limit)
+		newPitch = limit;
+	else if (newPitch < -limit)
+		newPitch = -limit;
+
+	if (yaw == 0.0f && newPitch == mPitch)
+		return;
+
+	mYaw += yaw;
+	mPitch = newPitch;
+	changed(true, false);
 }
 
 void Camera::updateFOV(float zoom)
@@ -54,35 +66,61 @@ void Camera::updateFOV(float zoom)
 	static const float limitMin = glm::radians(15.0f);
 	static const float limitMax = glm::radians(60.0f);
 
-	mFOV += zoom;
+	float fov = mFOV + zoom;
 
 	// keep field of view within limits
-	if (mFOV > limitMax)
-		mFOV = limitMax;
-	else if (mFOV < limitMin)
-		mFOV = limitMin;
+	if (fov > limitMax)
+		fov = limitMax;
+	else if (fov < limitMin)
+		fov = limitMin;
 
-	// compute the new projection matrix
-	mProjectionMatrix = glm::perspective(mFOV, mAspectRatio, mNear, mFar);
+	if (fov == mFOV)
+		return;
+
+	mFOV = fov;
+	changed(false, true);
 }
 
 void Camera::setYaw(float yaw)
-{ 
-	mYaw = yaw; 
+{
+	if (yaw == mYaw)
+		return;
+
+	mYaw = yaw;
+	changed(true, false);
 }
 
 void Camera::setPitch(float pitch)
-{ 
-	mPitch = pitch; 
+{
+	if (pitch == mPitch)
+		return;
+
+	mPitch = pitch;
+	changed(true, false);
 }
 
-void Camera::setViewMatrix(glm::vec3 position, glm::vec3 lookAt, glm::vec3 up)
+void Camera::setPosition(glm::vec3 position)
 {
+	if (position == mPosition)
+		return;
+
 	mPosition = position;
-	mLookAt = lookAt;
-	mUp = up;
+	changed(true, false);
+}
 
-	mViewMatrix = glm::lookAt(mPosition, mLookAt, mUp);
+// the yaw and pitch are taken from the direction to lookAt, the camera always keeps the world's y axis up
+void Camera::setViewMatrix(glm::vec3 position, glm::vec3 lookAt)
+{
+	static const float limit = glm::radians(89.0f);
+
+	glm::vec3 direction = glm::normalize(lookAt - position);
+
+	// forward is (0, 0, -1) turned by the pitch about x, then by the yaw about y
+	mPosition = position;
+	mYaw = atan2(-direction.x, -direction.z);
+	mPitch = glm::clamp(asin(glm::clamp(direction.y, -1.0f, 1.0f)), -limit, limit);
+
+	changed(true, false);
 }
 
 void Camera::setProjection(float fov, float aspectRatio, float near, float far)
@@ -91,20 +129,150 @@ void Camera::setProjection(float fov, float aspectRatio, float near, float far)
 	mAspectRatio = aspectRatio;
 	mNear = near;
 	mFar = far;
-	mProjectionMatrix = glm::perspective(mFOV, mAspectRatio, mNear, mFar);
+
+	changed(false, true);
 }
 
-glm::mat4 Camera::getViewMatrix()
+const glm::mat4& Camera::getViewMatrix() const
 {
+	updateView();
 	return mViewMatrix;
 }
 
-glm::mat4 Camera::getProjectionMatrix()
+const glm::mat4& Camera::getProjectionMatrix() const
 {
+	updateProjection();
 	return mProjectionMatrix;
 }
 
-glm::vec3 Camera::getPosition()
+const glm::mat4& Camera::getViewProjectionMatrix() const
+{
+	updateDerived();
+	return mViewProjectionMatrix;
+}
+
+const glm::mat4& Camera::getInverseViewMatrix() const
+{
+	updateDerived();
+	return mInverseViewMatrix;
+}
+
+const glm::mat4& Camera::getInverseProjectionMatrix() const
+{
+	updateDerived();
+	return mInverseProjectionMatrix;
+}
+
+const glm::mat4& Camera::getInverseViewProjectionMatrix() const
+{
+	updateDerived();
+	return mInverseViewProjectionMatrix;
+}
+
+// six planes, see extract_frustum_planes
+const glm::vec4* Camera::getFrustumPlanes() const
+{
+	updateDerived();
+	return mFrustumPlanes;
+}
+
+// eight corners, near then far
+const glm::vec3* Camera::getFrustumCorners() const
+{
+	updateDerived();
+	return mFrustumCorners;
+}
+
+glm::vec3 Camera::getPosition() const
 {
 	return mPosition;
 }
+
+glm::vec3 Camera::getForward() const
+{
+	updateView();
+	return mForward;
+}
+
+float Camera::getYaw() const
+{
+	return mYaw;
+}
+
+float Camera::getPitch() const
+{
+	return mPitch;
+}
+
+float Camera::getFOV() const
+{
+	return mFOV;
+}
+
+unsigned int Camera::getVersion() const
+{
+	return mVersion;
+}
+
+void Camera::changed(bool view, bool projection)
+{
+	mViewDirty = mViewDirty || view;
+	mProjectionDirty = mProjectionDirty || projection;
+	mDerivedDirty = true;
+	mVersion = g_nextCameraVersion.fetch_add(1);
+}
+
+void Camera::updateView() const
+{
+	if (!mViewDirty)
+		return;
+
+	// rotate the respective unit vectors about the y-axis
+	glm::vec3 rotatedForwardVec = glm::rotateY(glm::vec3(0.0f, 0.0f, -1.0f), mYaw);
+	glm::vec3 rotatedRightVec = glm::rotateY(glm::vec3(1.0f, 0.0f, 0.0f), mYaw);
+	// rotate the rotated forward vector about the rotated right vector by the pitch
+	rotatedForwardVec = glm::vec3(glm::rotate(mPitch, rotatedRightVec)*glm::vec4(rotatedForwardVec, 0.0f));
+
+	mForward = rotatedForwardVec;
+	mViewMatrix = glm::lookAt(mPosition, mPosition + rotatedForwardVec, glm::cross(rotatedRightVec, rotatedForwardVec));
+	mViewDirty = false;
+}
+
+void Camera::updateProjection() const
+{
+	if (!mProjectionDirty)
+		return;
+
+	mProjectionMatrix = glm::perspective(mFOV, mAspectRatio, mNear, mFar);
+	mProjectionDirty = false;
+}
+
+void Camera::updateDerived() const
+{
+	if (!mDerivedDirty)
+		return;
+
+	updateView();
+	updateProjection();
+
+	mViewProjectionMatrix = mProjectionMatrix * mViewMatrix;
+	mInverseViewMatrix = glm::inverse(mViewMatrix);
+	mInverseProjectionMatrix = glm::inverse(mProjectionMatrix);
+	mInverseViewProjectionMatrix = mInverseViewMatrix * mInverseProjectionMatrix;
+
+	extract_frustum_planes(mViewProjectionMatrix, mFrustumPlanes);
+
+	// the corners of the clip-space cube taken back to world space
+	static const glm::vec3 clipCorners[8] = {
+		glm::vec3(-1.0f, -1.0f, -1.0f), glm::vec3(1.0f, -1.0f, -1.0f), glm::vec3(1.0f, 1.0f, -1.0f), glm::vec3(-1.0f, 1.0f, -1.0f),
+		glm::vec3(-1.0f, -1.0f, 1.0f), glm::vec3(1.0f, -1.0f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-1.0f, 1.0f, 1.0f)
+	};
+
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec4 corner = mInverseViewProjectionMatrix * glm::vec4(clipCorners[i], 1.0f);
+		mFrustumCorners[i] = glm::vec3(corner) / corner.w;
+	}
+
+	mDerivedDirty = false;
+}
@@ -6,6 +6,12 @@
 #include <glm/gtx/rotate_vector.hpp>
 using namespace glm;	// to avoid having to use glm::
 
+// first-person camera
+// the position, yaw, pitch and projection parameters are all that is stored; the matrices, their inverses and the
+// frustum are worked out from them when first asked for after a change, so a camera that has not moved costs nothing
+// every change gives the camera a new version, unique across all cameras, and copies keep the version of the camera
+// they were copied from, so anything derived from a camera can be kept until the version changes
+// the cached data is filled in by the getters, one camera must not be read from several threads at once
 class Camera {
 public:
 	Camera();
@@ -16,13 +22,30 @@ public:
 	void updateFOV(float zoom);
 	void setYaw(float yaw);
 	void setPitch(float pitch);
-	void setViewMatrix(glm::vec3 position, glm::vec3 lookAt, glm::vec3 up);
+	void setPosition(glm::vec3 position);
+	void setViewMatrix(glm::vec3 position, glm::vec3 lookAt);
 	void setProjection(float fov, float aspectRatio, float near, float far);
-	glm::mat4 getViewMatrix();
-	glm::mat4 getProjectionMatrix();
-	glm::vec3 getPosition();
+	const glm::mat4& getViewMatrix() const;
+	const glm::mat4& getProjectionMatrix() const;
+	const glm::mat4& getViewProjectionMatrix() const;
+	const glm::mat4& getInverseViewMatrix() const;
+	const glm::mat4& getInverseProjectionMatrix() const;
+	const glm::mat4& getInverseViewProjectionMatrix() const;
+	const glm::vec4* getFrustumPlanes() const;
+	const glm::vec3* getFrustumCorners() const;
+	glm::vec3 getPosition() const;
+	glm::vec3 getForward() const;
+	float getYaw() const;
+	float getPitch() const;
+	float getFOV() const;
+	unsigned int getVersion() const;
 
 private:
+	void changed(bool view, bool projection);
+	void updateView() const;
+	void updateProjection() const;
+	void updateDerived() const;
+
 	float mYaw;
 	float mPitch;
 	float mFOV;
@@ -30,10 +53,21 @@ private:
 	float mNear;
 	float mFar;
 	glm::vec3 mPosition;
-	glm::vec3 mLookAt;
-	glm::vec3 mUp;
-	glm::mat4 mViewMatrix;
-	glm::mat4 mProjectionMatrix;
+	unsigned int mVersion;
+
+	// worked out from the above when needed
+	mutable bool mViewDirty;
+	mutable bool mProjectionDirty;
+	mutable bool mDerivedDirty;
+	mutable glm::vec3 mForward;
+	mutable glm::mat4 mViewMatrix;
+	mutable glm::mat4 mProjectionMatrix;
+	mutable glm::mat4 mViewProjectionMatrix;
+	mutable glm::mat4 mInverseViewMatrix;
+	mutable glm::mat4 mInverseProjectionMatrix;
+	mutable glm::mat4 mInverseViewProjectionMatrix;
+	mutable glm::vec4 mFrustumPlanes[6];		// world space, left, right, bottom, top, near, far, pointing inwards
+	mutable glm::vec3 mFrustumCorners[8];		// world space, near then far, each bottom left, bottom right, top right, top left
 };
 
-#endif
\ No newline at end of file
+#endif
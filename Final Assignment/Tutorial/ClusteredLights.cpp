@@ -0,0 +1,326 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+using namespace std;
+
+#include <emmintrin.h>
+
+#include "ClusteredLights.h"
+#include "ResourceTracker.h"
+
+#define CLUSTER_COUNT (CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+
+static const int minLightsPerJob = 64;		// lights below which jobs cost more than they save
+
+static double elapsed_ms(chrono::high_resolution_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+// view-space distance to the near side of a depth slice
+static float slice_depth(int slice, float nearPlane, float farPlane)
+{
+	return nearPlane * powf(farPlane / nearPlane, static_cast<float>(slice) / CLUSTER_SLICES);
+}
+
+static GLuint create_texture_buffer(GLenum format, GLuint* buffer)
+{
+	GLuint texture;
+
+	glGenBuffers(1, buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, *buffer);
+	glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, *buffer);
+
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	return texture;
+}
+
+// replace the contents of a buffer, orphaning the old storage so the GPU can keep reading it
+static void upload_buffer(GLuint buffer, const void* data, size_t size)
+{
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+}
+
+ClusteredLights::ClusteredLights()
+{
+	mJobSystem = NULL;
+	mProjectionMatrix = glm::mat4(0.0f);
+	mNear = 0.1f;
+	mFar = 100.0f;
+	mLightBuffer = mLightTexture = 0;
+	mClusterBuffer = mClusterTexture = 0;
+	mIndexBuffer = mIndexTexture = 0;
+	mResource = 0;
+	mResourceBytes = 0;
+	mStats.lights = 0;
+	mStats.references = 0;
+	mStats.maxPerCluster = 0;
+	mStats.assignTime = 0.0f;
+}
+
+ClusteredLights::~ClusteredLights()
+{
+}
+
+// without a job system the slices are assigned on the calling thread
+void ClusteredLights::init(JobSystem* jobSystem)
+{
+	mJobSystem = jobSystem;
+
+	mClusterMin.resize(CLUSTER_COUNT);
+	mClusterMax.resize(CLUSTER_COUNT);
+	mRanges.resize(CLUSTER_COUNT);
+	mSliceIndices.resize(CLUSTER_SLICES);
+	mSliceCandidates.resize(CLUSTER_SLICES);
+
+	mLightTexture = create_texture_buffer(GL_RGBA32F, &mLightBuffer);
+	mClusterTexture = create_texture_buffer(GL_RG32UI, &mClusterBuffer);
+	mIndexTexture = create_texture_buffer(GL_R32UI, &mIndexBuffer);
+}
+
+void ClusteredLights::destroy()
+{
+	glDeleteTextures(1, &mLightTexture);
+	glDeleteTextures(1, &mClusterTexture);
+	glDeleteTextures(1, &mIndexTexture);
+	glDeleteBuffers(1, &mLightBuffer);
+	glDeleteBuffers(1, &mClusterBuffer);
+	glDeleteBuffers(1, &mIndexBuffer);
+
+	untrack_resource(mResource);
+	mResource = 0;
+	mResourceBytes = 0;
+}
+
+// view-space bounds of every cluster, only rebuilt when the projection changes
+void ClusteredLights::buildClusterBounds(const glm::mat4& projectionMatrix)
+{
+	mProjectionMatrix = projectionMatrix;
+
+	// recover the symmetric perspective projection's parameters
+	mNear = projectionMatrix[3][2] / (projectionMatrix[2][2] - 1.0f);
+	mFar = projectionMatrix[3][2] / (projectionMatrix[2][2] + 1.0f);
+	float tanX = 1.0f / projectionMatrix[0][0];
+	float tanY = 1.0f / projectionMatrix[1][1];
+
+	for (int slice = 0; slice < CLUSTER_SLICES; slice++)
+	{
+		float nearDepth = slice_depth(slice, mNear, mFar);
+		float farDepth = slice_depth(slice + 1, mNear, mFar);
+
+		for (int y = 0; y < CLUSTER_TILES_Y; y++)
+		{
+			float bottom = (2.0f * y / CLUSTER_TILES_Y - 1.0f) * tanY;
+			float top = (2.0f * (y + 1) / CLUSTER_TILES_Y - 1.0f) * tanY;
+
+			for (int x = 0; x < CLUSTER_TILES_X; x++)
+			{
+				float left = (2.0f * x / CLUSTER_TILES_X - 1.0f) * tanX;
+				float right = (2.0f * (x + 1) / CLUSTER_TILES_X - 1.0f) * tanX;
+				int cluster = (slice * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x;
+
+				// the tile's edges at the slice's near and far depths
+				mClusterMin[cluster] = glm::vec3(min(left * nearDepth, left * farDepth), min(bottom * nearDepth, bottom * farDepth), -farDepth);
+				mClusterMax[cluster] = glm::vec3(max(right * nearDepth, right * farDepth), max(top * nearDepth, top * farDepth), -nearDepth);
+			}
+		}
+	}
+}
+
+// test the lights reaching a depth slice against each of its clusters, four lights at a time
+void ClusteredLights::assignSlice(int slice)
+{
+	vector<GLuint>& indices = mSliceIndices[slice];
+	indices.clear();
+
+	float nearDepth = slice_depth(slice, mNear, mFar);
+	float farDepth = slice_depth(slice + 1, mNear, mFar);
+
+	// lights whose range overlaps the slice's depth, gathered into groups of four
+	SliceCandidates& scratch = mSliceCandidates[slice];
+	vector<GLuint>& candidates = scratch.lights;
+	vector<float>& x = scratch.x;
+	vector<float>& y = scratch.y;
+	vector<float>& z = scratch.z;
+	vector<float>& radius2 = scratch.radius2;
+	candidates.clear();
+	x.clear();
+	y.clear();
+	z.clear();
+	radius2.clear();
+
+	for (size_t i = 0; i < mLightData.size() / 2; i++)
+	{
+		float depth = -mLightZ[i];
+		if (depth + mLightRadius[i] < nearDepth || depth - mLightRadius[i] > farDepth)
+			continue;
+
+		candidates.push_back(static_cast<GLuint>(i));
+		x.push_back(mLightX[i]);
+		y.push_back(mLightY[i]);
+		z.push_back(mLightZ[i]);
+		radius2.push_back(mLightRadius[i] * mLightRadius[i]);
+	}
+
+	// padding lights can never touch a cluster
+	while (x.size() % 4 != 0)
+	{
+		x.push_back(0.0f);
+		y.push_back(0.0f);
+		z.push_back(0.0f);
+		radius2.push_back(-1.0f);
+	}
+
+	__m128 zero = _mm_setzero_ps();
+
+	for (int tile = 0; tile < CLUSTER_TILES_X * CLUSTER_TILES_Y; tile++)
+	{
+		int cluster = slice * CLUSTER_TILES_X * CLUSTER_TILES_Y + tile;
+		const glm::vec3& boundsMin = mClusterMin[cluster];
+		const glm::vec3& boundsMax = mClusterMax[cluster];
+		__m128 minX = _mm_set1_ps(boundsMin.x), minY = _mm_set1_ps(boundsMin.y), minZ = _mm_set1_ps(boundsMin.z);
+		__m128 maxX = _mm_set1_ps(boundsMax.x), maxY = _mm_set1_ps(boundsMax.y), maxZ = _mm_set1_ps(boundsMax.z);
+
+		mRanges[cluster].offset = static_cast<GLuint>(indices.size());
+
+		for (size_t i = 0; i < x.size(); i += 4)
+		{
+			__m128 cx = _mm_loadu_ps(&x[i]);
+			__m128 cy = _mm_loadu_ps(&y[i]);
+			__m128 cz = _mm_loadu_ps(&z[i]);
+
+			// squared distance from the sphere centre to the box
+			__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, cx), _mm_sub_ps(cx, maxX)), zero);
+			__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, cy), _mm_sub_ps(cy, maxY)), zero);
+			__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, cz), _mm_sub_ps(cz, maxZ)), zero);
+			__m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+			int mask = _mm_movemask_ps(_mm_cmple_ps(distance2, _mm_loadu_ps(&radius2[i])));
+
+			for (int lane = 0; mask != 0; lane++, mask >>= 1)
+			{
+				if (mask & 1)
+					indices.push_back(candidates[i + lane]);
+			}
+		}
+
+		mRanges[cluster].count = static_cast<GLuint>(indices.size()) - mRanges[cluster].offset;
+	}
+}
+
+void ClusteredLights::update(const vector<PointLight>& lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+	if (projectionMatrix != mProjectionMatrix)
+		buildClusterBounds(projectionMatrix);
+
+	// lights in view space, the shaders work in eye space
+	size_t padded = (lights.size() + 3) & ~static_cast<size_t>(3);
+	mLightX.assign(padded, 0.0f);
+	mLightY.assign(padded, 0.0f);
+	mLightZ.assign(padded, 0.0f);
+	mLightRadius.assign(padded, 0.0f);
+	mLightData.resize(lights.size() * 2);
+
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		glm::vec3 position = glm::vec3(viewMatrix * glm::vec4(lights[i].position, 1.0f));
+
+		mLightX[i] = position.x;
+		mLightY[i] = position.y;
+		mLightZ[i] = position.z;
+		mLightRadius[i] = lights[i].radius;
+		mLightData[i * 2] = glm::vec4(position, lights[i].radius);
+		mLightData[i * 2 + 1] = glm::vec4(lights[i].color, 0.0f);
+	}
+
+	// slices are independent, one job each
+	if (mJobSystem != NULL && static_cast<int>(lights.size()) >= minLightsPerJob)
+	{
+		mJobSystem->parallelFor(CLUSTER_SLICES, 1, [this](int begin, int end)
+		{
+			for (int slice = begin; slice < end; slice++)
+				assignSlice(slice);
+		});
+	}
+	else
+	{
+		for (int slice = 0; slice < CLUSTER_SLICES; slice++)
+			assignSlice(slice);
+	}
+
+	// merge the slices into one index list
+	mIndices.clear();
+	mStats.maxPerCluster = 0;
+
+	for (int slice = 0; slice < CLUSTER_SLICES; slice++)
+	{
+		GLuint base = static_cast<GLuint>(mIndices.size());
+		mIndices.insert(mIndices.end(), mSliceIndices[slice].begin(), mSliceIndices[slice].end());
+
+		for (int tile = 0; tile < CLUSTER_TILES_X * CLUSTER_TILES_Y; tile++)
+		{
+			ClusterRange& range = mRanges[slice * CLUSTER_TILES_X * CLUSTER_TILES_Y + tile];
+			range.offset += base;
+			mStats.maxPerCluster = max(mStats.maxPerCluster, static_cast<int>(range.count));
+		}
+	}
+
+	mStats.lights = static_cast<int>(lights.size());
+	mStats.references = static_cast<int>(mIndices.size());
+
+	// texture buffers cannot be empty
+	if (mIndices.empty())
+		mIndices.push_back(0);
+	if (mLightData.empty())
+		mLightData.push_back(glm::vec4(0.0f));
+
+	upload_buffer(mLightBuffer, &mLightData[0], sizeof(glm::vec4) * mLightData.size());
+	upload_buffer(mClusterBuffer, &mRanges[0], sizeof(ClusterRange) * mRanges.size());
+	upload_buffer(mIndexBuffer, &mIndices[0], sizeof(GLuint) * mIndices.size());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	// tracked again only when the sizes change, not every frame
+	size_t bytes = sizeof(glm::vec4) * mLightData.size() + sizeof(ClusterRange) * mRanges.size() + sizeof(GLuint) * mIndices.size();
+	if (bytes != mResourceBytes)
+	{
+		untrack_resource(mResource);
+		mResource = track_resource("Cluster light lists", RESOURCE_UNIFORM, bytes);
+		mResourceBytes = bytes;
+	}
+
+	mStats.assignTime = static_cast<float>(elapsed_ms(start));
+}
+
+// bind the lights, clusters and indices to three consecutive texture units
+void ClusteredLights::bind(GLuint firstTextureUnit)
+{
+	glActiveTexture(GL_TEXTURE0 + firstTextureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, mLightTexture);
+	glActiveTexture(GL_TEXTURE0 + firstTextureUnit + 1);
+	glBindTexture(GL_TEXTURE_BUFFER, mClusterTexture);
+	glActiveTexture(GL_TEXTURE0 + firstTextureUnit + 2);
+	glBindTexture(GL_TEXTURE_BUFFER, mIndexTexture);
+}
+
+// x, y = tiles across and down, z, w = scale and bias taking log(depth) to a slice
+glm::vec4 ClusteredLights::getShaderParams() const
+{
+	float scale = CLUSTER_SLICES / logf(mFar / mNear);
+	return glm::vec4(static_cast<float>(CLUSTER_TILES_X), static_cast<float>(CLUSTER_TILES_Y), scale, -logf(mNear) * scale);
+}
+
+const ClusterStats& ClusteredLights::getStats() const
+{
+	return mStats;
+}
@@ -0,0 +1,88 @@
+#ifndef __CLUSTERED_LIGHTS_H
+#define __CLUSTERED_LIGHTS_H
+
+#include <vector>
+
+#include <GLEW/glew.h>	// include GLEW
+#include <glm/glm.hpp>	// include GLM (ideally should only use the GLM headers that are actually used)
+
+#include "JobSystem.h"
+
+#define CLUSTER_TILES_X 16		// screen tiles across
+#define CLUSTER_TILES_Y 9		// screen tiles down
+#define CLUSTER_SLICES 24		// depth slices, exponentially spaced between the near and far planes
+
+// point light with a finite range
+typedef struct PointLight
+{
+	glm::vec3 position;		// world space
+	float radius;			// no light reaches past this distance
+	glm::vec3 color;
+} PointLight;
+
+// counters for the last update
+typedef struct ClusterStats
+{
+	int lights;				// lights assigned to clusters
+	int references;			// light indices written over all clusters
+	int maxPerCluster;		// most lights in any one cluster
+	float assignTime;		// milliseconds spent assigning lights
+} ClusterStats;
+
+// clustered forward lighting
+// the view frustum is split into screen tiles and exponential depth slices; every frame each light is tested
+// against the view-space bounds of the clusters, one depth slice per job and four lights at a time with SSE,
+// and the fragment shader only loops over the lights listed for its cluster
+// the results are read by the shaders through three texture buffers: the lights (view-space position and
+// radius, colour), the clusters (first index, count) and the light indices
+class ClusteredLights {
+public:
+	ClusteredLights();
+	~ClusteredLights();
+
+	void init(JobSystem* jobSystem = NULL);
+	void destroy();
+	void update(const std::vector<PointLight>& lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+	void bind(GLuint firstTextureUnit);
+	glm::vec4 getShaderParams() const;
+	const ClusterStats& getStats() const;
+
+private:
+	typedef struct ClusterRange
+	{
+		GLuint offset;
+		GLuint count;
+	} ClusterRange;
+
+	// lights whose range overlaps a slice's depth, in groups of four, kept between frames so they are not
+	// reallocated every frame
+	typedef struct SliceCandidates
+	{
+		std::vector<GLuint> lights;
+		std::vector<float> x, y, z, radius2;
+	} SliceCandidates;
+
+	void buildClusterBounds(const glm::mat4& projectionMatrix);
+	void assignSlice(int slice);
+
+	JobSystem* mJobSystem;
+	glm::mat4 mProjectionMatrix;					// projection the cluster bounds were built for
+	float mNear, mFar;
+	std::vector<glm::vec3> mClusterMin;				// view-space bounds of every cluster
+	std::vector<glm::vec3> mClusterMax;
+	std::vector<float> mLightX, mLightY, mLightZ, mLightRadius;	// view-space lights, padded to a multiple of four
+	std::vector<std::vector<GLuint> > mSliceIndices;	// light indices found by each slice, before merging
+	std::vector<SliceCandidates> mSliceCandidates;
+	std::vector<ClusterRange> mRanges;
+	std::vector<GLuint> mIndices;
+	std::vector<glm::vec4> mLightData;
+
+	GLuint mLightBuffer, mLightTexture;
+	GLuint mClusterBuffer, mClusterTexture;
+	GLuint mIndexBuffer, mIndexTexture;
+	int mResource;									// tracked size of the three buffers
+	size_t mResourceBytes;
+	ClusterStats mStats;
+};
+
+#endif
@@ -0,0 +1,182 @@
+#include <iostream>
+#include <algorithm>
+using namespace std;
+
+#include <glm/gtx/transform.hpp>
+
+#include "CubeMapCapture.h"
+#include "ResourceTracker.h"
+
+// look and up directions of the faces, in GL_TEXTURE_CUBE_MAP_POSITIVE_X + face order
+static const glm::vec3 faceDirections[CUBE_MAP_FACES] = {
+	glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+	glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+	glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+};
+
+static const glm::vec3 faceUps[CUBE_MAP_FACES] = {
+	glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+	glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+	glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+};
+
+glm::mat4 cube_face_view(const glm::vec3& position, int face)
+{
+	return glm::lookAt(position, position + faceDirections[face], faceUps[face]);
+}
+
+CubeMapCapture::CubeMapCapture()
+{
+	mFramebuffer = 0;
+	mTexture = 0;
+	mDepthBuffer = 0;
+	mTextureResource = 0;
+	mDepthResource = 0;
+	mFaceSize = 0;
+	mNumberOfMips = 1;
+	mNextFace = 0;
+	mValidFaces = 0;
+	mPosition = glm::vec3(0.0f);
+	mProjectionMatrix = glm::mat4(1.0f);
+}
+
+CubeMapCapture::~CubeMapCapture()
+{
+}
+
+void CubeMapCapture::init(GLuint faceSize, float nearPlane, float farPlane)
+{
+	mFaceSize = faceSize;
+	mProjectionMatrix = glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, farPlane);
+
+	glGenTextures(1, &mTexture);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, mTexture);
+
+	for (int i = 0; i < CUBE_MAP_FACES; i++)
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA8, mFaceSize, mFaceSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+	mNumberOfMips = 1;
+	while ((mFaceSize >> mNumberOfMips) > 0)
+		mNumberOfMips++;
+
+	// one depth buffer shared by all faces, they are rendered one after another
+	glGenRenderbuffers(1, &mDepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mFaceSize, mFaceSize);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	mTextureResource = track_texture("Reflection cube map", RESOURCE_RENDER_TARGET, mFaceSize, mFaceSize, CUBE_MAP_FACES, 4, 0);
+	mDepthResource = track_resource("Reflection cube map depth", RESOURCE_RENDER_TARGET, static_cast<size_t>(mFaceSize) * mFaceSize * 4);
+
+	glGenFramebuffers(1, &mFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X, mTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		cerr << "Cube map framebuffer incomplete" << endl;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	mNextFace = 0;
+	mValidFaces = 0;
+}
+
+void CubeMapCapture::destroy()
+{
+	glDeleteFramebuffers(1, &mFramebuffer);
+	glDeleteTextures(1, &mTexture);
+	glDeleteRenderbuffers(1, &mDepthBuffer);
+
+	mFramebuffer = 0;
+	mTexture = 0;
+	mDepthBuffer = 0;
+
+	untrack_resource(mTextureResource);
+	untrack_resource(mDepthResource);
+	mTextureResource = mDepthResource = 0;
+}
+
+void CubeMapCapture::setPosition(const glm::vec3& position)
+{
+	mPosition = position;
+}
+
+// pick the faces to render this frame, returns how many were written to faces
+int CubeMapCapture::scheduleFaces(int facesPerFrame, int faces[CUBE_MAP_FACES])
+{
+	int count = mValidFaces < CUBE_MAP_FACES ? CUBE_MAP_FACES - mValidFaces : 0;
+	count = min(max(count, facesPerFrame), CUBE_MAP_FACES);
+
+	for (int i = 0; i < count; i++)
+	{
+		faces[i] = mNextFace;
+		mNextFace = (mNextFace + 1) % CUBE_MAP_FACES;
+	}
+
+	mValidFaces = min(mValidFaces + count, CUBE_MAP_FACES);
+	return count;
+}
+
+void CubeMapCapture::bindFace(int face)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mTexture, 0);
+	glViewport(0, 0, mFaceSize, mFaceSize);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void CubeMapCapture::unbind(GLuint windowWidth, GLuint windowHeight)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, windowWidth, windowHeight);
+}
+
+// render every face again, e.g. after the capture point moved a long way
+void CubeMapCapture::invalidate()
+{
+	mValidFaces = 0;
+}
+
+void CubeMapCapture::generateMipmaps()
+{
+	glBindTexture(GL_TEXTURE_CUBE_MAP, mTexture);
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+}
+
+glm::vec3 CubeMapCapture::getPosition() const
+{
+	return mPosition;
+}
+
+glm::mat4 CubeMapCapture::getViewMatrix(int face) const
+{
+	return cube_face_view(mPosition, face);
+}
+
+glm::mat4 CubeMapCapture::getProjectionMatrix() const
+{
+	return mProjectionMatrix;
+}
+
+GLuint CubeMapCapture::getTexture() const
+{
+	return mTexture;
+}
+
+GLuint CubeMapCapture::getFaceSize() const
+{
+	return mFaceSize;
+}
+
+GLint CubeMapCapture::getNumberOfMips() const
+{
+	return mNumberOfMips;
+}
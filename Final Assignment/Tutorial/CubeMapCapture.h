@@ -0,0 +1,51 @@
+#ifndef __CUBE_MAP_CAPTURE_H
+#define __CUBE_MAP_CAPTURE_H
+
+#include <GLEW/glew.h>	// include GLEW
+#include <glm/glm.hpp>	// include GLM (ideally should only use the GLM headers that are actually used)
+
+#define CUBE_MAP_FACES 6
+
+// view matrix looking out of a cube map face from a point, with the up vector GL expects for that face
+glm::mat4 cube_face_view(const glm::vec3& position, int face);
+
+// environment cube map rendered at runtime from a point in the scene
+// blurrier mips for rough surfaces are box filtered from the faces after each update
+// faces are small and only a few are re-rendered each frame, in turn, so a full update is spread over several
+// frames; until the first full capture every face is rendered
+class CubeMapCapture {
+public:
+	CubeMapCapture();
+	~CubeMapCapture();
+
+	void init(GLuint faceSize, float nearPlane, float farPlane);
+	void destroy();
+	void setPosition(const glm::vec3& position);
+	int scheduleFaces(int facesPerFrame, int faces[CUBE_MAP_FACES]);
+	void bindFace(int face);
+	void unbind(GLuint windowWidth, GLuint windowHeight);
+	void invalidate();
+	void generateMipmaps();
+
+	glm::vec3 getPosition() const;
+	glm::mat4 getViewMatrix(int face) const;
+	glm::mat4 getProjectionMatrix() const;
+	GLuint getTexture() const;
+	GLuint getFaceSize() const;
+	GLint getNumberOfMips() const;
+
+private:
+	GLuint mFramebuffer;
+	GLuint mTexture;
+	GLuint mDepthBuffer;
+	int mTextureResource;		// tracked sizes of the cube map, with its mips, and the depth buffer
+	int mDepthResource;
+	GLuint mFaceSize;
+	GLint mNumberOfMips;
+	int mNextFace;					// next face in the round robin
+	int mValidFaces;				// faces rendered since the capture was invalidated
+	glm::vec3 mPosition;
+	glm::mat4 mProjectionMatrix;	// 90 degree field of view, one face each
+};
+
+#endif
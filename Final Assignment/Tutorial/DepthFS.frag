@@ -0,0 +1,6 @@
+#version 330 core
+
+// depth only, the colour writes are masked off
+void main()
+{
+}
@@ -0,0 +1,23 @@
+#version 330 core
+
+// input data (different for all executions of this shader)
+in vec3 aPosition;
+in uint aDrawID;		// index of this draw's data in uDrawData
+
+// uniform input data
+uniform samplerBuffer uDrawData;	// per-draw matrices and material, 11 texels per draw
+uniform int uDrawDataBase;			// texel where this frame's draw data starts
+
+// must produce exactly the depth NormalMapVS.vert does for the GL_EQUAL test of the main pass
+invariant gl_Position;
+
+void main()
+{
+	// fetch this draw's model-view-projection matrix
+	int base = uDrawDataBase + int(aDrawID) * 11;
+	mat4 modelViewProjectionMatrix = mat4(texelFetch(uDrawData, base), texelFetch(uDrawData, base + 1),
+		texelFetch(uDrawData, base + 2), texelFetch(uDrawData, base + 3));
+
+	// set vertex position
+    gl_Position = modelViewProjectionMatrix * vec4(aPosition, 1.0);
+}
@@ -0,0 +1,216 @@
+#include <iostream>
+#include <cstring>
+using namespace std;
+
+#include "DrawSubmitter.h"
+#include "ResourceTracker.h"
+
+DrawSubmitter::DrawSubmitter()
+{
+	mMeshPool = NULL;
+	mStreamBuffer = NULL;
+	mIndirect = false;
+	mUploaded = false;
+	mDrawIDIndex = 0;
+	mCapacity = 0;
+	mDrawIDBuffer = 0;
+	mDrawIDResource = 0;
+	mDrawDataTexture = 0;
+	mTextureBuffer = 0;
+	mDrawDataOffset = 0;
+	mIndirectOffset = 0;
+	mNumberOfCalls = 0;
+}
+
+DrawSubmitter::~DrawSubmitter()
+{}
+
+void DrawSubmitter::init(MeshPool* meshPool, StreamBuffer* streamBuffer, GLuint drawIDIndex, GLuint maxDraws)
+{
+	mMeshPool = meshPool;
+	mStreamBuffer = streamBuffer;
+	mDrawIDIndex = drawIDIndex;
+
+	// the draw ID comes from the base instance, so both extensions are needed
+	mIndirect = (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance) ? true : false;
+
+	glGenBuffers(1, &mDrawIDBuffer);
+	glGenTextures(1, &mDrawDataTexture);
+
+	reserve(maxDraws);
+
+	// per-instance draw ID attribute in both shared VAOs, the instance index starts at the base instance
+	for (int i = 0; i < 2; i++)
+	{
+		if (i == 0)
+			mMeshPool->bind();
+		else
+			mMeshPool->bindPositions();
+
+		glBindBuffer(GL_ARRAY_BUFFER, mDrawIDBuffer);
+		glVertexAttribIPointer(mDrawIDIndex, 1, GL_UNSIGNED_INT, sizeof(GLuint), 0);
+		glVertexAttribDivisor(mDrawIDIndex, 1);
+
+		// without indirect draws the ID is set as a constant attribute before each draw
+		if (mIndirect)
+			glEnableVertexAttribArray(mDrawIDIndex);
+		else
+			glDisableVertexAttribArray(mDrawIDIndex);
+	}
+
+	glBindVertexArray(0);
+
+	cout << "Draw submission: " << (mIndirect ? "multi-draw indirect" : "one draw call per object") << endl;
+}
+
+void DrawSubmitter::destroy()
+{
+	glDeleteBuffers(1, &mDrawIDBuffer);
+	glDeleteTextures(1, &mDrawDataTexture);
+
+	mDrawIDBuffer = mDrawDataTexture = mTextureBuffer = 0;
+	mCapacity = 0;
+
+	untrack_resource(mDrawIDResource);
+	mDrawIDResource = 0;
+}
+
+void DrawSubmitter::reserve(GLuint maxDraws)
+{
+	if (maxDraws <= mCapacity)
+		return;
+
+	mCapacity = maxDraws;
+
+	// the draw IDs never change, fill them once
+	vector<GLuint> drawIDs(mCapacity);
+	for (GLuint i = 0; i < mCapacity; i++)
+		drawIDs[i] = i;
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mDrawIDBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * mCapacity, &drawIDs[0], GL_STATIC_DRAW);
+
+	untrack_resource(mDrawIDResource);
+	mDrawIDResource = track_resource("Draw IDs", RESOURCE_VERTEX, sizeof(GLuint) * mCapacity);
+}
+
+void DrawSubmitter::clear()
+{
+	mCommands.clear();
+	mDrawData.clear();
+	mUploaded = false;
+	mNumberOfCalls = 0;
+}
+
+GLuint DrawSubmitter::addDraw(int mesh, const DrawData& data, int lod)
+{
+	const PoolMesh& poolMesh = mMeshPool->getMesh(mesh);
+	GLuint drawID = static_cast<GLuint>(mCommands.size());
+
+	DrawElementsIndirectCommand command;
+	command.count = poolMesh.lods[lod].count;
+	command.instanceCount = 1;
+	command.firstIndex = poolMesh.firstIndex + poolMesh.lods[lod].firstIndex;
+	command.baseVertex = poolMesh.baseVertex;
+	command.baseInstance = drawID;
+
+	mCommands.push_back(command);
+	mDrawData.push_back(data);
+
+	return drawID;
+}
+
+void DrawSubmitter::upload()
+{
+	if (mCommands.empty())
+		return;
+
+	GLuint numberOfDraws = static_cast<GLuint>(mCommands.size());
+
+	// grow in powers of two so the draw ID buffer settles after the first few frames
+	if (mIndirect && numberOfDraws > mCapacity)
+	{
+		GLuint capacity = (mCapacity > 0) ? mCapacity : 1;
+		while (capacity < numberOfDraws)
+			capacity *= 2;
+		reserve(capacity);
+	}
+
+	// the draw data is read as RGBA32F texels, so it has to start on a texel
+	void* drawData = mStreamBuffer->allocate(sizeof(DrawData) * numberOfDraws, sizeof(glm::vec4), &mDrawDataOffset);
+	if (drawData == NULL)
+		return;
+
+	memcpy(drawData, &mDrawData[0], sizeof(DrawData) * numberOfDraws);
+
+	if (mIndirect)
+	{
+		void* commands = mStreamBuffer->allocate(sizeof(DrawElementsIndirectCommand) * numberOfDraws, sizeof(GLuint), &mIndirectOffset);
+		if (commands == NULL)
+			return;
+
+		memcpy(commands, &mCommands[0], sizeof(DrawElementsIndirectCommand) * numberOfDraws);
+	}
+
+	// the stream buffer is recreated when it grows
+	if (mTextureBuffer != mStreamBuffer->getBuffer())
+	{
+		mTextureBuffer = mStreamBuffer->getBuffer();
+		glBindTexture(GL_TEXTURE_BUFFER, mDrawDataTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, mTextureBuffer);
+	}
+
+	mUploaded = true;
+}
+
+void DrawSubmitter::bindDrawData(GLuint textureUnit)
+{
+	glActiveTexture(GL_TEXTURE0 + textureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, mDrawDataTexture);
+}
+
+void DrawSubmitter::drawRange(GLuint first, GLuint count)
+{
+	// nothing is drawn for a frame whose data did not fit in the stream buffer
+	if (count == 0 || !mUploaded)
+		return;
+
+	if (mIndirect)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mStreamBuffer->getBuffer());
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+			reinterpret_cast<void*>(mIndirectOffset + sizeof(DrawElementsIndirectCommand) * first), count, 0);
+		mNumberOfCalls++;
+		return;
+	}
+
+	for (GLuint i = first; i < first + count; i++)
+	{
+		const DrawElementsIndirectCommand& command = mCommands[i];
+
+		glVertexAttribI1ui(mDrawIDIndex, i);
+		glDrawElementsBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+			reinterpret_cast<void*>(sizeof(GLuint) * command.firstIndex), command.baseVertex);
+		mNumberOfCalls++;
+	}
+}
+
+bool DrawSubmitter::isIndirect() const
+{
+	return mIndirect;
+}
+
+GLint DrawSubmitter::getDrawDataBase() const
+{
+	return static_cast<GLint>(mDrawDataOffset / sizeof(glm::vec4));
+}
+
+GLuint DrawSubmitter::getNumberOfDraws() const
+{
+	return static_cast<GLuint>(mCommands.size());
+}
+
+GLuint DrawSubmitter::getNumberOfCalls() const
+{
+	return mNumberOfCalls;
+}
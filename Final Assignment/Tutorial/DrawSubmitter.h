@@ -0,0 +1,72 @@
+#ifndef __DRAW_SUBMITTER_H
+#define __DRAW_SUBMITTER_H
+
+#include <vector>
+
+#include <GLEW/glew.h>	// include GLEW
+#include <glm/glm.hpp>	// include GLM (ideally should only use the GLM headers that are actually used)
+
+#include "MeshPool.h"
+#include "StreamBuffer.h"
+
+// layout of the commands read by glMultiDrawElementsIndirect
+typedef struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+} DrawElementsIndirectCommand;
+
+// per-draw data fetched by the shaders with the draw ID, must match NormalMapVS.vert and NormalMapFS.frag
+typedef struct DrawData
+{
+	glm::mat4 modelViewProjection;
+	glm::mat4 modelView;
+	glm::vec4 ambient;		// rgb = material ambient, a = alpha
+	glm::vec4 diffuse;		// rgb = material diffuse, a = 0 lit, 1 environment mapped, 2 planar mirror
+	glm::vec4 specular;		// rgb = material specular, a = shininess
+} DrawData;
+
+// submits the frame's draws from the mesh pool, one glMultiDrawElementsIndirect call per range of draws
+// falls back to one glDrawElementsBaseVertex per draw when ARB_multi_draw_indirect is not available
+// the draw data and commands are written into the stream buffer, the shaders offset the draw ID by getDrawDataBase()
+class DrawSubmitter {
+public:
+	DrawSubmitter();
+	~DrawSubmitter();
+
+	void init(MeshPool* meshPool, StreamBuffer* streamBuffer, GLuint drawIDIndex, GLuint maxDraws);
+	void destroy();
+	void clear();
+	GLuint addDraw(int mesh, const DrawData& data, int lod = 0);
+	void upload();
+	void bindDrawData(GLuint textureUnit);
+	void drawRange(GLuint first, GLuint count);
+	bool isIndirect() const;
+	GLint getDrawDataBase() const;
+	GLuint getNumberOfDraws() const;
+	GLuint getNumberOfCalls() const;
+
+private:
+	void reserve(GLuint maxDraws);
+
+	MeshPool* mMeshPool;
+	StreamBuffer* mStreamBuffer;
+	bool mIndirect;					// multi-draw indirect is available
+	bool mUploaded;					// this frame's draws are in the stream buffer
+	GLuint mDrawIDIndex;			// location of the aDrawID attribute
+	GLuint mCapacity;				// number of draws the draw ID buffer holds
+	GLuint mDrawIDBuffer;			// 0, 1, 2, ... read through the base instance
+	int mDrawIDResource;			// tracked size of the draw ID buffer
+	GLuint mDrawDataTexture;		// texture buffer view of the stream buffer
+	GLuint mTextureBuffer;			// buffer currently attached to the texture
+	GLuint mDrawDataOffset;			// byte offset of this frame's draw data in the stream buffer
+	GLuint mIndirectOffset;			// byte offset of this frame's commands in the stream buffer
+	GLuint mNumberOfCalls;			// draw calls issued since the last clear
+	std::vector<DrawElementsIndirectCommand> mCommands;
+	std::vector<DrawData> mDrawData;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#include "FrameGovernor.h"
+
+FrameGovernor::FrameGovernor()
+{
+	reset();
+}
+
+FrameGovernor::~FrameGovernor()
+{
+}
+
+// back to full resolution and quality
+void FrameGovernor::reset()
+{
+	mSmoothedTime = 0.0f;
+	mScale = 1.0f;
+	mLevel = 0;
+	mFramesOver = 0;
+	mFramesUnder = 0;
+	mCooldown = 0;
+	mDecisions = 0;
+}
+
+// fold in the latest GPU frame time, returns true if the resolution or the quality level changed
+bool FrameGovernor::update(float gpuTime, float targetTime)
+{
+	if (gpuTime <= 0.0f)
+		return false;
+
+	// after a change the average restarts, the frames timed before it are no guide any more
+	if (mCooldown > 0)
+	{
+		mCooldown--;
+		mSmoothedTime = gpuTime;
+		return false;
+	}
+
+	mSmoothedTime = (mSmoothedTime > 0.0f) ? mSmoothedTime * 0.9f + gpuTime * 0.1f : gpuTime;
+
+	if (mSmoothedTime > targetTime)
+	{
+		mFramesOver++;
+		mFramesUnder = 0;
+	}
+	else if (mSmoothedTime < targetTime * GOVERNOR_HEADROOM)
+	{
+		mFramesUnder++;
+		mFramesOver = 0;
+	}
+	else
+	{
+		mFramesOver = 0;
+		mFramesUnder = 0;
+	}
+
+	bool changed = false;
+
+	if (mFramesOver >= GOVERNOR_LOWER_FRAMES)
+	{
+		if (mScale > GOVERNOR_MIN_SCALE)
+		{
+			// pixels go with the square of the scale, at least one step down
+			float scale = mScale * sqrt(targetTime / mSmoothedTime);
+			scale = floor(scale / GOVERNOR_SCALE_STEP) * GOVERNOR_SCALE_STEP;
+			mScale = max(GOVERNOR_MIN_SCALE, min(scale, mScale - GOVERNOR_SCALE_STEP));
+			changed = true;
+		}
+		else if (mLevel < GOVERNOR_MAX_LEVEL)
+		{
+			mLevel++;
+			changed = true;
+		}
+	}
+	else if (mFramesUnder >= GOVERNOR_RAISE_FRAMES)
+	{
+		if (mLevel > 0)
+		{
+			mLevel--;
+			changed = true;
+		}
+		else if (mScale < 1.0f)
+		{
+			mScale = min(1.0f, mScale + GOVERNOR_SCALE_STEP);
+			changed = true;
+		}
+	}
+
+	if (changed)
+	{
+		mFramesOver = 0;
+		mFramesUnder = 0;
+		mCooldown = GOVERNOR_COOLDOWN;
+		mDecisions++;
+	}
+
+	return changed;
+}
+
+float FrameGovernor::getRenderScale() const
+{
+	return mScale;
+}
+
+int FrameGovernor::getQualityLevel() const
+{
+	return mLevel;
+}
+
+int FrameGovernor::getReflectionIntervalScale() const
+{
+	return mLevel >= 1 ? 2 : 1;
+}
+
+float FrameGovernor::getLodBias() const
+{
+	return mLevel >= 2 ? 2.0f : 1.0f;
+}
+
+int FrameGovernor::getShadowSizeShift() const
+{
+	return mLevel >= 3 ? 1 : 0;
+}
+
+float FrameGovernor::getSmoothedTime() const
+{
+	return mSmoothedTime;
+}
+
+int FrameGovernor::getNumberOfDecisions() const
+{
+	return mDecisions;
+}
@@ -0,0 +1,44 @@
+#ifndef __FRAME_GOVERNOR_H
+#define __FRAME_GOVERNOR_H
+
+#define GOVERNOR_MIN_SCALE 0.5f			// smallest render resolution, relative to the window
+#define GOVERNOR_SCALE_STEP 0.05f		// render scales are multiples of this
+#define GOVERNOR_MAX_LEVEL 3			// quality levels below full quality
+#define GOVERNOR_HEADROOM 0.8f			// raised only while frames take less than this fraction of the budget
+#define GOVERNOR_LOWER_FRAMES 3			// frames over budget before lowering
+#define GOVERNOR_RAISE_FRAMES 60		// frames under the headroom before raising
+#define GOVERNOR_COOLDOWN 8				// frames after a change before the next, the GPU timings lag a few frames
+
+// keeps the GPU frame time under a budget by trading render resolution, then quality, for time
+// over budget the resolution drops first, in proportion to the overshoot since the cost of a frame is mostly
+// per pixel; once it is at the minimum the quality level rises one step at a time: reflections updated half
+// as often, then the LOD error doubled, then shadow maps at half size
+// coming back is slower and in the reverse order; the dead band between the budget and the headroom, the
+// frames it takes to act and the cooldown after acting keep it from oscillating around the budget
+class FrameGovernor {
+public:
+	FrameGovernor();
+	~FrameGovernor();
+
+	void reset();
+	bool update(float gpuTime, float targetTime);
+
+	float getRenderScale() const;
+	int getQualityLevel() const;
+	int getReflectionIntervalScale() const;
+	float getLodBias() const;
+	int getShadowSizeShift() const;
+	float getSmoothedTime() const;
+	int getNumberOfDecisions() const;
+
+private:
+	float mSmoothedTime;		// exponential average of the GPU frame time, milliseconds
+	float mScale;
+	int mLevel;
+	int mFramesOver;
+	int mFramesUnder;
+	int mCooldown;
+	int mDecisions;				// changes made since the last reset
+};
+
+#endif
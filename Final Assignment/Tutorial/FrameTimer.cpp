@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+using namespace std;
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+#include "FrameTimer.h"
+
+static double seconds_between(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end)
+{
+	return chrono::duration<double>(end - start).count();
+}
+
+FrameTimer::FrameTimer()
+{
+	mDelta = 0.0;
+	mSmoothedDelta = 0.0;
+	mSleepTime = 0.0;
+	mSpinTime = 0.0;
+}
+
+FrameTimer::~FrameTimer()
+{
+}
+
+void FrameTimer::init()
+{
+#if defined(_WIN32)
+	// the default scheduler tick is about 15.6 ms, far too coarse to sleep part of a frame
+	timeBeginPeriod(1);
+#endif
+
+	mStart = chrono::steady_clock::now();
+	mFrameStart = mStart;
+	mDelta = 0.0;
+	mSmoothedDelta = 0.0;
+}
+
+void FrameTimer::destroy()
+{
+#if defined(_WIN32)
+	timeEndPeriod(1);
+#endif
+}
+
+// seconds since the last call
+double FrameTimer::beginFrame()
+{
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+	mDelta = seconds_between(mFrameStart, now);
+	mFrameStart = now;
+	mSmoothedDelta = (mSmoothedDelta > 0.0) ? mSmoothedDelta + (mDelta - mSmoothedDelta) * FRAME_TIMER_SMOOTHING : mDelta;
+
+	return mDelta;
+}
+
+// wait until frameTime seconds have passed since beginFrame, returns at once if they already have
+void FrameTimer::limit(double frameTime)
+{
+	chrono::steady_clock::time_point deadline = mFrameStart + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(frameTime));
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	// a millisecond at a time, so one oversleep cannot run far past the point where spinning takes over
+	while (seconds_between(chrono::steady_clock::now(), deadline) > FRAME_TIMER_SPIN_TIME)
+		this_thread::sleep_for(chrono::milliseconds(1));
+
+	chrono::steady_clock::time_point spinStart = chrono::steady_clock::now();
+
+	while (chrono::steady_clock::now() < deadline)
+		this_thread::yield();
+
+	chrono::steady_clock::time_point end = chrono::steady_clock::now();
+	mSleepTime = seconds_between(start, spinStart);
+	mSpinTime = seconds_between(spinStart, end);
+}
+
+// seconds since init
+double FrameTimer::getTime() const
+{
+	return seconds_between(mStart, chrono::steady_clock::now());
+}
+
+double FrameTimer::getDelta() const
+{
+	return mDelta;
+}
+
+double FrameTimer::getSmoothedDelta() const
+{
+	return mSmoothedDelta;
+}
+
+double FrameTimer::getSleepTime() const
+{
+	return mSleepTime;
+}
+
+double FrameTimer::getSpinTime() const
+{
+	return mSpinTime;
+}
+
+FixedTimestep::FixedTimestep()
+{
+	mStep = 1.0 / 60.0;
+	mMaxSteps = 1;
+	mAccumulator = 0.0;
+	mDroppedSteps = 0;
+}
+
+FixedTimestep::~FixedTimestep()
+{
+}
+
+void FixedTimestep::init(double step, int maxSteps)
+{
+	mStep = step;
+	mMaxSteps = max(1, maxSteps);
+	mAccumulator = 0.0;
+	mDroppedSteps = 0;
+}
+
+// add the time since the last call, returns the number of steps to run now
+int FixedTimestep::advance(double delta)
+{
+	mAccumulator += max(delta, 0.0);
+
+	int steps = static_cast<int>(mAccumulator / mStep);
+
+	if (steps > mMaxSteps)
+	{
+		mDroppedSteps += steps - mMaxSteps;
+		steps = mMaxSteps;
+		mAccumulator = fmod(mAccumulator, mStep);
+	}
+	else
+		mAccumulator -= steps * mStep;
+
+	return steps;
+}
+
+// the leftover time is kept, a different step only changes when the next ones fall
+void FixedTimestep::setStep(double step)
+{
+	mStep = step;
+}
+
+double FixedTimestep::getStep() const
+{
+	return mStep;
+}
+
+// how far the render time is between the last step and the next, 0 to 1
+float FixedTimestep::getAlpha() const
+{
+	return static_cast<float>(min(mAccumulator / mStep, 1.0));
+}
+
+int FixedTimestep::getDroppedSteps() const
+{
+	return mDroppedSteps;
+}
@@ -0,0 +1,59 @@
+#ifndef __FRAME_TIMER_H
+#define __FRAME_TIMER_H
+
+#include <chrono>
+
+#define FRAME_TIMER_SPIN_TIME 0.002		// seconds before a frame limit's deadline spent spinning instead of sleeping
+#define FRAME_TIMER_SMOOTHING 0.1		// weight of the newest frame in the smoothed delta
+
+// high-resolution frame timing on the steady clock
+// beginFrame gives the time since the last frame; limit holds the frame back to a given length by sleeping
+// while the deadline is far off, since the OS may oversleep by a millisecond or more, and spinning the rest
+class FrameTimer {
+public:
+	FrameTimer();
+	~FrameTimer();
+
+	void init();
+	void destroy();
+	double beginFrame();
+	void limit(double frameTime);
+
+	double getTime() const;
+	double getDelta() const;
+	double getSmoothedDelta() const;
+	double getSleepTime() const;
+	double getSpinTime() const;
+
+private:
+	std::chrono::steady_clock::time_point mStart;
+	std::chrono::steady_clock::time_point mFrameStart;
+	double mDelta;				// seconds, last frame
+	double mSmoothedDelta;
+	double mSleepTime;			// seconds the last limit slept and spun
+	double mSpinTime;
+};
+
+// fixed-step accumulator, the simulation runs whole steps of the same length whatever the frame rate and
+// the renderer interpolates between the last two by the fraction of a step left over
+// a long frame is capped at maxSteps so a hitch cannot make every following frame slower (the spiral of death)
+class FixedTimestep {
+public:
+	FixedTimestep();
+	~FixedTimestep();
+
+	void init(double step, int maxSteps);
+	int advance(double delta);
+	void setStep(double step);
+	double getStep() const;
+	float getAlpha() const;
+	int getDroppedSteps() const;
+
+private:
+	double mStep;				// seconds
+	int mMaxSteps;
+	double mAccumulator;		// seconds not yet simulated, less than a step after advance
+	int mDroppedSteps;			// steps skipped over because of the cap, since init
+};
+
+#endif
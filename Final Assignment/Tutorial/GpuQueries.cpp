@@ -0,0 +1,162 @@
+#include <iostream>
+using namespace std;
+
+#include "GpuQueries.h"
+
+GpuQueries::GpuQueries()
+{
+	mNumberOfPasses = 0;
+	mFrame = 0;
+	mFrameTime = 0.0f;
+
+	for (int i = 0; i < GPU_QUERY_FRAMES; i++)
+	{
+		mFrameQueries[i][0] = 0;
+		mFrameQueries[i][1] = 0;
+		mFrameIssued[i] = false;
+	}
+}
+
+GpuQueries::~GpuQueries()
+{
+}
+
+void GpuQueries::init(int numberOfPasses)
+{
+	mNumberOfPasses = numberOfPasses;
+	mFrame = 0;
+	mQueries.resize(GPU_QUERY_FRAMES * numberOfPasses);
+	mTimes.assign(numberOfPasses, 0.0f);
+	mSamples.assign(numberOfPasses, 0);
+
+	for (size_t i = 0; i < mQueries.size(); i++)
+	{
+		glGenQueries(1, &mQueries[i].timeQuery);
+		glGenQueries(1, &mQueries[i].sampleQuery);
+		mQueries[i].timeIssued = false;
+		mQueries[i].samplesIssued = false;
+	}
+
+	for (int i = 0; i < GPU_QUERY_FRAMES; i++)
+	{
+		glGenQueries(2, mFrameQueries[i]);
+		mFrameIssued[i] = false;
+	}
+}
+
+void GpuQueries::destroy()
+{
+	for (size_t i = 0; i < mQueries.size(); i++)
+	{
+		glDeleteQueries(1, &mQueries[i].timeQuery);
+		glDeleteQueries(1, &mQueries[i].sampleQuery);
+	}
+
+	for (int i = 0; i < GPU_QUERY_FRAMES; i++)
+		glDeleteQueries(2, mFrameQueries[i]);
+
+	mQueries.clear();
+	mNumberOfPasses = 0;
+}
+
+// move to the oldest set of queries, keeping whatever results it has ready, and start timing the frame
+void GpuQueries::beginFrame()
+{
+	mFrame = (mFrame + 1) % GPU_QUERY_FRAMES;
+
+	// the end timestamp is written last, once it is available so is the start
+	if (mFrameIssued[mFrame])
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(mFrameQueries[mFrame][1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (available)
+		{
+			GLuint64 start = 0;
+			GLuint64 end = 0;
+			glGetQueryObjectui64v(mFrameQueries[mFrame][0], GL_QUERY_RESULT, &start);
+			glGetQueryObjectui64v(mFrameQueries[mFrame][1], GL_QUERY_RESULT, &end);
+			mFrameTime = static_cast<float>((end - start) / 1.0e6);
+		}
+
+		mFrameIssued[mFrame] = false;
+	}
+
+	glQueryCounter(mFrameQueries[mFrame][0], GL_TIMESTAMP);
+
+	for (int pass = 0; pass < mNumberOfPasses; pass++)
+	{
+		PassQueries& queries = mQueries[mFrame * mNumberOfPasses + pass];
+		GLint available = 0;
+
+		if (queries.timeIssued)
+		{
+			glGetQueryObjectiv(queries.timeQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+
+			if (available)
+			{
+				GLuint64 nanoseconds = 0;
+				glGetQueryObjectui64v(queries.timeQuery, GL_QUERY_RESULT, &nanoseconds);
+				mTimes[pass] = static_cast<float>(nanoseconds / 1.0e6);
+			}
+		}
+
+		if (queries.samplesIssued)
+		{
+			glGetQueryObjectiv(queries.sampleQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+
+			if (available)
+				glGetQueryObjectui64v(queries.sampleQuery, GL_QUERY_RESULT, &mSamples[pass]);
+		}
+
+		// a result the GPU has not finished is dropped rather than waited for
+		queries.timeIssued = false;
+		queries.samplesIssued = false;
+	}
+}
+
+void GpuQueries::endFrame()
+{
+	glQueryCounter(mFrameQueries[mFrame][1], GL_TIMESTAMP);
+	mFrameIssued[mFrame] = true;
+}
+
+// passes cannot overlap, only one query of each kind can be active at a time
+void GpuQueries::begin(int pass, bool countSamples)
+{
+	PassQueries& queries = mQueries[mFrame * mNumberOfPasses + pass];
+
+	glBeginQuery(GL_TIME_ELAPSED, queries.timeQuery);
+	queries.timeIssued = true;
+
+	if (countSamples)
+	{
+		glBeginQuery(GL_SAMPLES_PASSED, queries.sampleQuery);
+		queries.samplesIssued = true;
+	}
+}
+
+void GpuQueries::end(int pass)
+{
+	PassQueries& queries = mQueries[mFrame * mNumberOfPasses + pass];
+
+	glEndQuery(GL_TIME_ELAPSED);
+
+	if (queries.samplesIssued)
+		glEndQuery(GL_SAMPLES_PASSED);
+}
+
+float GpuQueries::getTime(int pass) const
+{
+	return mTimes[pass];
+}
+
+GLuint64 GpuQueries::getSamples(int pass) const
+{
+	return mSamples[pass];
+}
+
+float GpuQueries::getFrameTime() const
+{
+	return mFrameTime;
+}
@@ -0,0 +1,49 @@
+#ifndef __GPU_QUERIES_H
+#define __GPU_QUERIES_H
+
+#include <vector>
+
+#include <GLEW/glew.h>	// include GLEW
+
+#define GPU_QUERY_FRAMES 4		// frames a result may take to come back before its queries are reused
+
+// GPU time and samples passed for a few passes of each frame, and the GPU time of the whole frame
+// every pass has a set of queries per frame in flight; results are read when the set comes around again, if
+// the GPU has finished them, so reading never stalls and the numbers are a few frames old
+// the frame is timed with timestamps rather than GL_TIME_ELAPSED, which cannot be nested around the passes
+class GpuQueries {
+public:
+	GpuQueries();
+	~GpuQueries();
+
+	void init(int numberOfPasses);
+	void destroy();
+	void beginFrame();
+	void endFrame();
+	void begin(int pass, bool countSamples);
+	void end(int pass);
+
+	float getTime(int pass) const;
+	GLuint64 getSamples(int pass) const;
+	float getFrameTime() const;
+
+private:
+	typedef struct PassQueries
+	{
+		GLuint timeQuery;
+		GLuint sampleQuery;
+		bool timeIssued;
+		bool samplesIssued;
+	} PassQueries;
+
+	int mNumberOfPasses;
+	int mFrame;									// set of queries used this frame
+	std::vector<PassQueries> mQueries;			// GPU_QUERY_FRAMES sets of mNumberOfPasses
+	std::vector<float> mTimes;					// milliseconds, last result read
+	std::vector<GLuint64> mSamples;
+	GLuint mFrameQueries[GPU_QUERY_FRAMES][2];	// timestamps at the start and end of each frame in flight
+	bool mFrameIssued[GPU_QUERY_FRAMES];
+	float mFrameTime;							// milliseconds, last result read
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include <GLFW/glfw3.h>
+
+#include "InputQueue.h"
+
+static bool is_release(const InputEvent& event)
+{
+	return event.type != INPUT_CURSOR && event.action == GLFW_RELEASE;
+}
+
+InputQueue::InputQueue()
+{
+	mHead = 0;
+	mTail = 0;
+	mDroppedEvents = 0;
+}
+
+InputQueue::~InputQueue()
+{
+}
+
+void InputQueue::push(const InputEvent& event)
+{
+	if (mTail - mHead == INPUT_QUEUE_SIZE)
+	{
+		InputEvent& newest = mEvents[(mTail - 1) & (INPUT_QUEUE_SIZE - 1)];
+		mDroppedEvents++;
+
+		// positions are absolute, so a move only loses the one in between
+		if (event.type == INPUT_CURSOR && newest.type == INPUT_CURSOR)
+		{
+			newest = event;
+			return;
+		}
+
+		if (!is_release(event))
+			return;
+
+		// a queue of nothing but releases gives up its oldest
+		if (!removeNewestNotRelease())
+			mHead++;
+	}
+
+	mEvents[mTail++ & (INPUT_QUEUE_SIZE - 1)] = event;
+}
+
+// the events after it move up, so the order is kept
+bool InputQueue::removeNewestNotRelease()
+{
+	for (unsigned int i = mTail; i != mHead; i--)
+	{
+		if (is_release(mEvents[(i - 1) & (INPUT_QUEUE_SIZE - 1)]))
+			continue;
+
+		for (unsigned int j = i; j != mTail; j++)
+			mEvents[(j - 1) & (INPUT_QUEUE_SIZE - 1)] = mEvents[j & (INPUT_QUEUE_SIZE - 1)];
+
+		mTail--;
+		return true;
+	}
+
+	return false;
+}
+
+// oldest first, returns false once the queue is empty
+bool InputQueue::pop(InputEvent* event)
+{
+	if (mHead == mTail)
+		return false;
+
+	*event = mEvents[mHead++ & (INPUT_QUEUE_SIZE - 1)];
+	return true;
+}
+
+int InputQueue::getSize() const
+{
+	return static_cast<int>(mTail - mHead);
+}
+
+int InputQueue::getDroppedEvents() const
+{
+	return mDroppedEvents;
+}
@@ -0,0 +1,47 @@
+#ifndef __INPUT_QUEUE_H
+#define __INPUT_QUEUE_H
+
+#define INPUT_QUEUE_SIZE 256		// events held between two reads, power of two
+
+enum InputEventType
+{
+	INPUT_CURSOR,
+	INPUT_MOUSE_BUTTON,
+	INPUT_KEY
+};
+
+// one raw event from a GLFW callback
+typedef struct InputEvent
+{
+	int type;
+	double time;		// seconds on the frame timer when the callback ran
+	double x, y;		// cursor position
+	int code;			// key or mouse button
+	int action;			// GLFW_PRESS, GLFW_RELEASE or GLFW_REPEAT
+} InputEvent;
+
+// raw input events in the order they arrived, each with its time, read once or twice a frame
+// GLFW calls back on the main thread from glfwPollEvents, which is also where the queue is read, so it needs
+// no locking; when it is full a cursor position replaces the newest queued one, new presses and repeats are
+// dropped, and releases take the place of the newest event that is not a release, so nothing is left held
+// down; every event lost that way is counted as dropped
+class InputQueue {
+public:
+	InputQueue();
+	~InputQueue();
+
+	void push(const InputEvent& event);
+	bool pop(InputEvent* event);
+	int getSize() const;
+	int getDroppedEvents() const;
+
+private:
+	bool removeNewestNotRelease();
+
+	InputEvent mEvents[INPUT_QUEUE_SIZE];
+	unsigned int mHead;			// next to read
+	unsigned int mTail;			// next to write
+	int mDroppedEvents;
+};
+
+#endif
@@ -0,0 +1,570 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+using namespace std;
+
+#include "JobSystem.h"
+
+static const int spinsBeforeSleep = 64;			// empty searches before an idle worker or a waiter sleeps
+static const chrono::microseconds waitSleep(50);	// a waiter's sleep, short since nothing wakes it when its job finishes
+static const chrono::milliseconds sleepTimeout(1);	// bounds the wait if a wake-up is missed
+static const double statsInterval = 0.5;		// seconds the utilisation is averaged over
+
+// slot of the calling thread, given out on first use and handed back when the thread exits
+struct ThreadSlot
+{
+	JobSystem* system;
+	int thread;
+
+	ThreadSlot()
+	{
+		system = NULL;
+		thread = -1;
+	}
+
+	~ThreadSlot()
+	{
+		if (system != NULL && thread >= 0)
+			system->detachThread(thread);
+	}
+};
+
+static thread_local ThreadSlot t_slot;
+
+JobSystem::WorkStealingQueue::WorkStealingQueue()
+{
+	mTop = 0;
+	mBottom = 0;
+
+	for (int i = 0; i < JOB_QUEUE_SIZE; i++)
+		mJobs[i] = NULL;
+}
+
+// owner only, returns false if the deque is full
+bool JobSystem::WorkStealingQueue::push(Job* job)
+{
+	long long bottom = mBottom.load(memory_order_relaxed);
+	long long top = mTop.load(memory_order_acquire);
+
+	if (bottom - top >= JOB_QUEUE_SIZE)
+		return false;
+
+	// the release publishes the job's fields to the thief that reads the new bottom
+	mJobs[bottom & (JOB_QUEUE_SIZE - 1)].store(job, memory_order_relaxed);
+	mBottom.store(bottom + 1, memory_order_release);
+
+	return true;
+}
+
+// owner only, newest first; the last job is raced for with the thieves
+Job* JobSystem::WorkStealingQueue::pop()
+{
+	long long bottom = mBottom.load(memory_order_relaxed) - 1;
+	mBottom.store(bottom, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	long long top = mTop.load(memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		mBottom.store(bottom + 1, memory_order_relaxed);
+		return NULL;
+	}
+
+	Job* job = mJobs[bottom & (JOB_QUEUE_SIZE - 1)].load(memory_order_relaxed);
+
+	if (top == bottom)
+	{
+		if (!mTop.compare_exchange_strong(top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+			job = NULL;
+
+		mBottom.store(bottom + 1, memory_order_relaxed);
+	}
+
+	return job;
+}
+
+// any thread, oldest first
+Job* JobSystem::WorkStealingQueue::steal()
+{
+	long long top = mTop.load(memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	long long bottom = mBottom.load(memory_order_acquire);
+
+	if (top >= bottom)
+		return NULL;
+
+	Job* job = mJobs[top & (JOB_QUEUE_SIZE - 1)].load(memory_order_relaxed);
+
+	if (!mTop.compare_exchange_strong(top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+		return NULL;
+
+	return job;
+}
+
+JobSystem::JobSystem()
+{
+	mNumWorkers = 0;
+	mRunning = false;
+	mOverflowCount = 0;
+	mSleeping = 0;
+}
+
+JobSystem::~JobSystem()
+{
+}
+
+// numWorkers = 0 leaves a core each for the main and simulation threads
+void JobSystem::init(unsigned int numWorkers)
+{
+	unsigned int cores = thread::hardware_concurrency();
+	mNumWorkers = (numWorkers > 0) ? numWorkers : max(1u, (cores > 2) ? cores - 2 : 1u);
+	mMainThread = this_thread::get_id();
+
+	for (unsigned int i = 0; i < mNumWorkers + JOB_MAX_EXTERNAL_THREADS; i++)
+	{
+		ThreadData* data = new ThreadData;
+		data->pool = vector<Job>(JOB_POOL_SIZE);
+		for (int j = 0; j < JOB_POOL_SIZE; j++)
+			data->pool[j].finished = true;
+		data->nextJob = 0;
+		data->random = i * 2654435761u + 1;
+		data->busyNanoseconds = 0;
+		data->jobs = 0;
+		data->steals = 0;
+		mThreads.push_back(data);
+	}
+
+	mAttached.assign(JOB_MAX_EXTERNAL_THREADS, false);
+	mLastBusy.assign(mNumWorkers, 0);
+	mStats.assign(mNumWorkers, WorkerStats());
+	mStatsStart = chrono::high_resolution_clock::now();
+
+	mRunning = true;
+	for (unsigned int i = 0; i < mNumWorkers; i++)
+		mWorkers.push_back(thread(&JobSystem::workerLoop, this, static_cast<int>(i)));
+
+	cout << "Job system: " << mNumWorkers << " workers" << endl;
+}
+
+// every job must have finished
+void JobSystem::destroy()
+{
+	mRunning = false;
+
+	{
+		lock_guard<mutex> lock(mSleepMutex);
+		mWake.notify_all();
+	}
+
+	for (size_t i = 0; i < mWorkers.size(); i++)
+		mWorkers[i].join();
+
+	mWorkers.clear();
+
+	// the calling thread's slot goes with the threads
+	if (t_slot.system == this)
+	{
+		t_slot.system = NULL;
+		t_slot.thread = -1;
+	}
+
+	for (size_t i = 0; i < mThreads.size(); i++)
+		delete mThreads[i];
+
+	mThreads.clear();
+	mAttached.clear();
+	mNumWorkers = 0;
+}
+
+int JobSystem::attachThread()
+{
+	lock_guard<mutex> lock(mAttachMutex);
+
+	for (int i = 0; i < JOB_MAX_EXTERNAL_THREADS; i++)
+	{
+		if (!mAttached[i])
+		{
+			mAttached[i] = true;
+			return static_cast<int>(mNumWorkers) + i;
+		}
+	}
+
+	cerr << "Job system: more than " << JOB_MAX_EXTERNAL_THREADS << " threads other than the workers" << endl;
+	exit(EXIT_FAILURE);
+}
+
+// jobs left in the deque stay there to be stolen, or popped by the next thread given the slot
+void JobSystem::detachThread(int thread)
+{
+	lock_guard<mutex> lock(mAttachMutex);
+
+	if (thread >= static_cast<int>(mNumWorkers) && thread - mNumWorkers < mAttached.size())
+		mAttached[thread - mNumWorkers] = false;
+}
+
+int JobSystem::getThread()
+{
+	if (t_slot.system != this)
+	{
+		t_slot.system = this;
+		t_slot.thread = attachThread();
+	}
+
+	return t_slot.thread;
+}
+
+// the next free job of the thread's pool, jobs still in flight are skipped; while the whole pool is in flight
+// the thread runs other jobs between rounds, so a thread must not hold more than a pool of jobs that are made
+// but not yet run
+Job* JobSystem::allocate(int thread)
+{
+	ThreadData* data = mThreads[thread];
+	Job* job = &data->pool[data->nextJob++ & (JOB_POOL_SIZE - 1)];
+	int spins = 0;
+
+	for (int i = 1; !job->finished.load(memory_order_acquire); i++)
+	{
+		if (i % JOB_POOL_SIZE == 0)
+			runOtherJob(thread, this_thread::get_id() == mMainThread, spins);
+
+		job = &data->pool[data->nextJob++ & (JOB_POOL_SIZE - 1)];
+	}
+
+	job->function = NULL;
+	job->rangeOwner = NULL;
+	job->begin = job->end = job->grain = 0;
+	job->parent = NULL;
+	job->unfinished = 1;
+	job->pending = 1;
+	job->numberOfDependents = 0;
+	job->lock.clear();
+	job->finished = false;
+	job->mainThread = false;
+	job->relay = false;
+
+	return job;
+}
+
+// the job's function is stored by the caller
+Job* JobSystem::create(Job* parent)
+{
+	Job* job = allocate(getThread());
+	job->parent = parent;
+
+	if (parent != NULL)
+		parent->unfinished++;
+
+	return job;
+}
+
+// must be called before the job is run, the dependency may already be running or finished
+// once a dependency's dependents are full its last one is moved into a relay job that takes its place, the relay
+// is released with the others and releases what it holds in turn, and later dependents go to the relay
+void JobSystem::addDependency(Job* job, Job* dependency)
+{
+	// taken before any lock, since allocating may run other jobs, and handed back if it is not needed
+	Job* relay = allocate(getThread());
+
+	while (dependency != NULL)
+	{
+		while (dependency->lock.test_and_set(memory_order_acquire))
+			;
+
+		int count = dependency->numberOfDependents.load(memory_order_relaxed);
+		Job* next = NULL;
+
+		if (count >= 0 && count < JOB_MAX_DEPENDENTS)
+		{
+			job->pending++;
+			dependency->dependents[count] = job;
+			dependency->numberOfDependents.store(count + 1, memory_order_relaxed);
+		}
+		else if (count >= 0)
+		{
+			next = dependency->dependents[JOB_MAX_DEPENDENTS - 1];
+
+			if (!next->relay)
+			{
+				// pending stays one, for the dependency that releases it; the relay has room, so one is enough
+				relay->relay = true;
+				relay->dependents[0] = next;
+				relay->numberOfDependents.store(1, memory_order_relaxed);
+				dependency->dependents[JOB_MAX_DEPENDENTS - 1] = relay;
+				next = relay;
+				relay = NULL;
+			}
+		}
+
+		dependency->lock.clear(memory_order_release);
+		dependency = next;
+	}
+
+	if (relay != NULL)
+		relay->finished.store(true, memory_order_release);
+}
+
+void JobSystem::run(Job* job)
+{
+	release(job);
+}
+
+void JobSystem::runOnMainThread(Job* job)
+{
+	job->mainThread = true;
+	release(job);
+}
+
+// one dependency (or the run call) is done, queue the job once none are left
+void JobSystem::release(Job* job)
+{
+	if (--job->pending == 0)
+		enqueue(job, getThread());
+}
+
+void JobSystem::enqueue(Job* job, int thread)
+{
+	if (job->mainThread)
+	{
+		lock_guard<mutex> lock(mMainMutex);
+		mMainJobs.push_back(job);
+		return;
+	}
+
+	submit(job, thread);
+}
+
+void JobSystem::submit(Job* job, int thread)
+{
+	if (!mThreads[thread]->queue.push(job))
+	{
+		lock_guard<mutex> lock(mOverflowMutex);
+		mOverflow.push_back(job);
+		mOverflowCount++;
+	}
+
+	// a worker that checked the queues just before this push may still go to sleep, for the timeout at most
+	if (mSleeping.load(memory_order_relaxed) > 0)
+		mWake.notify_one();
+}
+
+// own deque first, then the main thread's jobs (main thread only), the overflow, and the other deques
+Job* JobSystem::findJob(int thread, bool mainThread)
+{
+	ThreadData* data = mThreads[thread];
+	Job* job = data->queue.pop();
+
+	if (job != NULL)
+		return job;
+
+	if (mainThread)
+	{
+		lock_guard<mutex> lock(mMainMutex);
+
+		if (!mMainJobs.empty())
+		{
+			job = mMainJobs.front();
+			mMainJobs.pop_front();
+			return job;
+		}
+	}
+
+	if (mOverflowCount.load(memory_order_relaxed) > 0)
+	{
+		lock_guard<mutex> lock(mOverflowMutex);
+
+		if (!mOverflow.empty())
+		{
+			job = mOverflow.front();
+			mOverflow.pop_front();
+			mOverflowCount--;
+			return job;
+		}
+	}
+
+	// start at a random victim so thieves spread out
+	int numberOfThreads = static_cast<int>(mThreads.size());
+	data->random = data->random * 1664525u + 1013904223u;
+	int first = static_cast<int>((data->random >> 8) % numberOfThreads);
+
+	for (int i = 0; i < numberOfThreads; i++)
+	{
+		int victim = (first + i) % numberOfThreads;
+
+		if (victim == thread)
+			continue;
+
+		job = mThreads[victim]->queue.steal();
+
+		if (job != NULL)
+		{
+			data->steals.fetch_add(1, memory_order_relaxed);
+			return job;
+		}
+	}
+
+	return NULL;
+}
+
+void JobSystem::execute(Job* job, int thread)
+{
+	ThreadData* data = mThreads[thread];
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+	if (job->grain > 0)
+	{
+		// root of a parallel for, its chunks are its children so it finishes after the last of them
+		for (int begin = 0; begin < job->end; begin += job->grain)
+		{
+			Job* chunk = allocate(thread);
+			chunk->rangeOwner = job;
+			chunk->begin = begin;
+			chunk->end = min(begin + job->grain, job->end);
+			chunk->parent = job;
+			job->unfinished++;
+			chunk->pending = 0;
+			submit(chunk, thread);
+		}
+	}
+	else if (job->rangeOwner != NULL)
+		job->rangeOwner->function(job->rangeOwner->closure, job->begin, job->end);
+	else if (job->function != NULL)
+		job->function(job->closure, 0, 0);
+
+	long long nanoseconds = chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count();
+	data->busyNanoseconds.fetch_add(nanoseconds, memory_order_relaxed);
+	data->jobs.fetch_add(1, memory_order_relaxed);
+
+	finish(job);
+}
+
+// the job or one of its children is done; the last one releases the dependents and tells the parent
+void JobSystem::finish(Job* job)
+{
+	if (--job->unfinished > 0)
+		return;
+
+	Job* dependents[JOB_MAX_DEPENDENTS];
+
+	while (job->lock.test_and_set(memory_order_acquire))
+		;
+
+	int count = job->numberOfDependents.exchange(-1, memory_order_relaxed);
+	for (int i = 0; i < count; i++)
+		dependents[i] = job->dependents[i];
+
+	job->lock.clear(memory_order_release);
+
+	// a waiter may reuse the job as soon as it is marked, so everything needed from it is read before
+	Job* parent = job->parent;
+	job->finished.store(true, memory_order_release);
+
+	for (int i = 0; i < count; i++)
+		release(dependents[i]);
+
+	if (parent != NULL)
+		finish(parent);
+}
+
+// run other jobs until this one has finished
+void JobSystem::wait(Job* job)
+{
+	int thread = getThread();
+	bool mainThread = this_thread::get_id() == mMainThread;
+	int spins = 0;
+
+	while (!job->finished.load(memory_order_acquire))
+		runOtherJob(thread, mainThread, spins);
+}
+
+// one job if there is one, otherwise a yield, or a short sleep once the caller has found nothing spinsBeforeSleep times
+void JobSystem::runOtherJob(int thread, bool mainThread, int& spins)
+{
+	Job* job = findJob(thread, mainThread);
+
+	if (job != NULL)
+	{
+		execute(job, thread);
+		spins = 0;
+	}
+	else if (++spins < spinsBeforeSleep)
+		this_thread::yield();
+	else
+		this_thread::sleep_for(waitSleep);
+}
+
+void JobSystem::workerLoop(int thread)
+{
+	int spins = 0;
+
+	// workers have the first slots, jobs they release go to their own deques
+	t_slot.system = this;
+	t_slot.thread = thread;
+
+	while (mRunning.load(memory_order_relaxed))
+	{
+		Job* job = findJob(thread, false);
+
+		if (job != NULL)
+		{
+			execute(job, thread);
+			spins = 0;
+			continue;
+		}
+
+		if (++spins < spinsBeforeSleep)
+		{
+			this_thread::yield();
+			continue;
+		}
+
+		unique_lock<mutex> lock(mSleepMutex);
+		mSleeping++;
+		mWake.wait_for(lock, sleepTimeout);
+		mSleeping--;
+	}
+}
+
+// main thread, refreshes the per-worker counters every statsInterval
+void JobSystem::updateStats()
+{
+	chrono::high_resolution_clock::time_point now = chrono::high_resolution_clock::now();
+	double elapsed = chrono::duration<double>(now - mStatsStart).count();
+
+	if (elapsed < statsInterval)
+		return;
+
+	for (unsigned int i = 0; i < mNumWorkers; i++)
+	{
+		long long busy = mThreads[i]->busyNanoseconds.load(memory_order_relaxed);
+
+		mStats[i].utilisation = static_cast<float>((busy - mLastBusy[i]) / (elapsed * 1.0e9));
+		mStats[i].jobs = mThreads[i]->jobs.exchange(0, memory_order_relaxed);
+		mStats[i].steals = mThreads[i]->steals.exchange(0, memory_order_relaxed);
+		mLastBusy[i] = busy;
+	}
+
+	mStatsStart = now;
+}
+
+unsigned int JobSystem::getNumberOfWorkers() const
+{
+	return mNumWorkers;
+}
+
+const vector<WorkerStats>& JobSystem::getStats() const
+{
+	return mStats;
+}
+
+// average over the workers
+float JobSystem::getUtilisation() const
+{
+	if (mStats.empty())
+		return 0.0f;
+
+	float sum = 0.0f;
+	for (size_t i = 0; i < mStats.size(); i++)
+		sum += mStats[i].utilisation;
+
+	return sum / mStats.size();
+}
@@ -0,0 +1,228 @@
+#ifndef __JOB_SYSTEM_H
+#define __JOB_SYSTEM_H
+
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <new>
+#include <type_traits>
+
+#define JOB_QUEUE_SIZE 4096				// jobs a thread's deque holds, power of two
+#define JOB_POOL_SIZE 4096				// jobs a thread can have in flight before it runs others to make more
+#define JOB_MAX_DEPENDENTS 8			// jobs kept with any one job, more wait on it through relay jobs
+#define JOB_MAX_EXTERNAL_THREADS 4		// threads other than the workers that can create jobs (main, simulation)
+#define JOB_CLOSURE_SIZE 64				// bytes of a job's function object, kept in the job itself
+
+// a unit of work, made by createJob or createParallelFor and only valid until its thread's pool wraps around
+typedef struct Job Job;
+
+// calls the function object kept in a job, with the range for the body of a parallel for
+typedef void (*JobFunction)(const void* closure, int begin, int end);
+
+// counters of one worker since the last updateStats
+typedef struct WorkerStats
+{
+	float utilisation;			// fraction of the time spent running jobs
+	int jobs;					// jobs run
+	int steals;					// jobs taken from other threads' deques
+} WorkerStats;
+
+// work-stealing job system
+// every worker, and every other thread that makes jobs, has its own deque: the owner pushes and pops at the
+// bottom without locking, idle workers steal from the top of the others (Chase and Lev 2005, with the memory
+// orders of Le et al. 2013); a job finishes once its function and all of its children have, and only then
+// releases the jobs that depend on it
+// jobs marked for the main thread are never taken by workers, the main thread runs them while it waits, which
+// is where the GL calls go; threads that wait on a job run other jobs meanwhile, so jobs can wait on jobs
+// they made without tying up a worker
+// a job's function object is copied into the job rather than onto the heap, so it has to fit in
+// JOB_CLOSURE_SIZE bytes and need no destructor: capture pointers, references and small values
+class JobSystem {
+public:
+	JobSystem();
+	~JobSystem();
+
+	void init(unsigned int numWorkers = 0);
+	void destroy();
+
+	template <typename F> Job* createJob(const F& function, Job* parent = NULL);
+	template <typename F> Job* createParallelFor(int count, int grain, const F& body, Job* parent = NULL);
+	void addDependency(Job* job, Job* dependency);
+	void run(Job* job);
+	void runOnMainThread(Job* job);
+	void wait(Job* job);
+	template <typename F> void parallelFor(int count, int grain, const F& body);
+
+	void updateStats();
+	unsigned int getNumberOfWorkers() const;
+	const std::vector<WorkerStats>& getStats() const;
+	float getUtilisation() const;
+
+private:
+	// single-owner deque of fixed size, the owner works at the bottom and thieves at the top
+	class WorkStealingQueue {
+	public:
+		WorkStealingQueue();
+
+		bool push(Job* job);
+		Job* pop();
+		Job* steal();
+
+	private:
+		std::atomic<long long> mTop;
+		std::atomic<long long> mBottom;
+		std::atomic<Job*> mJobs[JOB_QUEUE_SIZE];
+	};
+
+	// per thread state, allocated separately so the counters of one thread are far from another's
+	typedef struct ThreadData
+	{
+		WorkStealingQueue queue;
+		std::vector<Job> pool;
+		unsigned int nextJob;
+		unsigned int random;					// steal victim selection
+		std::atomic<long long> busyNanoseconds;
+		std::atomic<int> jobs;
+		std::atomic<int> steals;
+	} ThreadData;
+
+	friend struct ThreadSlot;
+
+	int attachThread();
+	void detachThread(int thread);
+	int getThread();
+	Job* allocate(int thread);
+	Job* create(Job* parent);
+	template <typename F> static void store(Job* job, const F& function, JobFunction call);
+	template <typename F> static void callFunction(const void* closure, int, int);
+	template <typename F> static void callRange(const void* closure, int begin, int end);
+	void submit(Job* job, int thread);
+	void enqueue(Job* job, int thread);
+	void release(Job* job);
+	Job* findJob(int thread, bool mainThread);
+	void execute(Job* job, int thread);
+	void finish(Job* job);
+	void runOtherJob(int thread, bool mainThread, int& spins);
+	void workerLoop(int thread);
+
+	std::vector<ThreadData*> mThreads;			// the workers first, then the attached threads
+	std::vector<std::thread> mWorkers;
+	unsigned int mNumWorkers;
+	std::mutex mAttachMutex;
+	std::vector<bool> mAttached;				// slots of the attached threads in use
+	std::atomic<bool> mRunning;
+
+	std::mutex mOverflowMutex;					// jobs that did not fit in a full deque
+	std::deque<Job*> mOverflow;
+	std::atomic<int> mOverflowCount;
+	std::mutex mMainMutex;						// jobs only the main thread may run
+	std::deque<Job*> mMainJobs;
+	std::thread::id mMainThread;
+
+	std::mutex mSleepMutex;						// idle workers sleep here until more work is queued
+	std::condition_variable mWake;
+	std::atomic<int> mSleeping;
+
+	std::chrono::high_resolution_clock::time_point mStatsStart;
+	std::vector<long long> mLastBusy;
+	std::vector<WorkerStats> mStats;
+};
+
+// see JobSystem; internals, used through the member functions only
+struct Job
+{
+	JobFunction function;						// NULL for the chunks of a parallel for, which call their root's
+	alignas(16) unsigned char closure[JOB_CLOSURE_SIZE];	// copy of the function object
+	Job* rangeOwner;							// root job whose body a chunk runs
+	int begin, end, grain;						// grain is 0 except in the root of a parallel for
+	Job* parent;
+	std::atomic<int> unfinished;				// this job and its unfinished children
+	std::atomic<int> pending;					// unfinished dependencies, plus one until the job is run
+	std::atomic<int> numberOfDependents;		// -1 once finished, dependents added after that do not wait
+	Job* dependents[JOB_MAX_DEPENDENTS];
+	std::atomic_flag lock;						// guards the dependents
+	std::atomic<bool> finished;					// set last, after which the job is not touched again
+	bool mainThread;
+	bool relay;									// does nothing, holds the dependents that did not fit in another job
+};
+
+template <typename F>
+void JobSystem::store(Job* job, const F& function, JobFunction call)
+{
+	static_assert(sizeof(F) <= JOB_CLOSURE_SIZE, "job function too large, capture less or by reference");
+	static_assert(alignof(F) <= 16, "job function too strictly aligned");
+	static_assert(std::is_trivially_destructible<F>::value, "job functions are never destructed");
+
+	new (job->closure) F(function);
+	job->function = call;
+}
+
+template <typename F>
+void JobSystem::callFunction(const void* closure, int, int)
+{
+	(*static_cast<const F*>(closure))();
+}
+
+template <typename F>
+void JobSystem::callRange(const void* closure, int begin, int end)
+{
+	(*static_cast<const F*>(closure))(begin, end);
+}
+
+template <typename F>
+Job* JobSystem::createJob(const F& function, Job* parent)
+{
+	Job* job = create(parent);
+	store(job, function, &callFunction<F>);
+
+	return job;
+}
+
+// the body is called with ranges of at most grain indices, split off when the job runs
+template <typename F>
+Job* JobSystem::createParallelFor(int count, int grain, const F& body, Job* parent)
+{
+	Job* job = create(parent);
+	store(job, body, &callRange<F>);
+	job->end = count;
+	job->grain = (grain > 1) ? grain : 1;
+
+	return job;
+}
+
+// blocks, the calling thread takes part
+template <typename F>
+void JobSystem::parallelFor(int count, int grain, const F& body)
+{
+	if (count <= 0)
+		return;
+
+	// a single chunk is not worth queueing
+	if (count <= grain)
+	{
+		body(0, count);
+		return;
+	}
+
+	// the body outlives the job, so only a pointer to it is kept
+	const F* pointer = &body;
+	Job* job = createParallelFor(count, grain, [pointer](int begin, int end) { (*pointer)(begin, end); });
+	run(job);
+	wait(job);
+}
+
+// parallelFor on a job system, or the whole range on the calling thread without one
+template <typename F>
+void parallel_for(JobSystem* jobSystem, int count, int grain, const F& body)
+{
+	if (jobSystem != NULL)
+		jobSystem->parallelFor(count, grain, body);
+	else if (count > 0)
+		body(0, count);
+}
+
+#endif
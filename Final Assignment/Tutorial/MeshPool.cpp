@@ -0,0 +1,428 @@
+#include <iostream>
+#include <algorithm>
+#include <cstddef>
+using namespace std;
+
+#include "MeshPool.h"
+#include "ResourceTracker.h"
+
+RangeAllocator::RangeAllocator()
+{
+	mCapacity = 0;
+	mUsed = 0;
+}
+
+void RangeAllocator::reset(GLuint capacity)
+{
+	mFreeRanges.clear();
+	mCapacity = capacity;
+	mUsed = 0;
+
+	if (capacity > 0)
+	{
+		Range range = { 0, capacity };
+		mFreeRanges.push_back(range);
+	}
+}
+
+bool RangeAllocator::allocate(GLuint size, GLuint* offset)
+{
+	for (size_t i = 0; i < mFreeRanges.size(); i++)
+	{
+		if (mFreeRanges[i].size < size)
+			continue;
+
+		*offset = mFreeRanges[i].offset;
+		mFreeRanges[i].offset += size;
+		mFreeRanges[i].size -= size;
+
+		if (mFreeRanges[i].size == 0)
+			mFreeRanges.erase(mFreeRanges.begin() + i);
+
+		mUsed += size;
+		return true;
+	}
+
+	return false;
+}
+
+void RangeAllocator::release(GLuint offset, GLuint size)
+{
+	// find the insertion point that keeps the list sorted by offset
+	size_t i = 0;
+	while (i < mFreeRanges.size() && mFreeRanges[i].offset < offset)
+		i++;
+
+	Range range = { offset, size };
+	mFreeRanges.insert(mFreeRanges.begin() + i, range);
+	mUsed -= size;
+
+	// merge with the following range
+	if (i + 1 < mFreeRanges.size() && mFreeRanges[i].offset + mFreeRanges[i].size == mFreeRanges[i + 1].offset)
+	{
+		mFreeRanges[i].size += mFreeRanges[i + 1].size;
+		mFreeRanges.erase(mFreeRanges.begin() + i + 1);
+	}
+
+	// merge with the preceding range
+	if (i > 0 && mFreeRanges[i - 1].offset + mFreeRanges[i - 1].size == mFreeRanges[i].offset)
+	{
+		mFreeRanges[i - 1].size += mFreeRanges[i].size;
+		mFreeRanges.erase(mFreeRanges.begin() + i);
+	}
+}
+
+GLuint RangeAllocator::getCapacity() const
+{
+	return mCapacity;
+}
+
+GLuint RangeAllocator::getUsed() const
+{
+	return mUsed;
+}
+
+GLuint RangeAllocator::getLargestFreeRange() const
+{
+	GLuint largest = 0;
+
+	for (size_t i = 0; i < mFreeRanges.size(); i++)
+		largest = max(largest, mFreeRanges[i].size);
+
+	return largest;
+}
+
+MeshPool::MeshPool()
+{
+	mVBO = 0;
+	mIBO = 0;
+	mVAO = 0;
+	mPositionVBO = 0;
+	mPositionVAO = 0;
+	mVertexResource = 0;
+	mIndexResource = 0;
+
+	for (int i = 0; i < 4; i++)
+		mAttribIndex[i] = 0;
+}
+
+MeshPool::~MeshPool()
+{}
+
+void MeshPool::init(GLuint vertexCapacity, GLuint indexCapacity, GLuint positionIndex, GLuint normalIndex, GLuint tangentIndex, GLuint texCoordIndex)
+{
+	mAttribIndex[0] = positionIndex;
+	mAttribIndex[1] = normalIndex;
+	mAttribIndex[2] = tangentIndex;
+	mAttribIndex[3] = texCoordIndex;
+
+	// generate identifiers for the shared buffers and allocate their storage
+	glGenBuffers(1, &mVBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mVBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, sizeof(Vertex) * vertexCapacity, NULL, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &mIBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mIBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * indexCapacity, NULL, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &mPositionVBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mPositionVBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLfloat) * 3 * vertexCapacity, NULL, GL_STATIC_DRAW);
+
+	mVertexRanges.reset(vertexCapacity);
+	mIndexRanges.reset(indexCapacity);
+	trackBuffers(vertexCapacity, indexCapacity);
+
+	glGenVertexArrays(1, &mVAO);
+	glGenVertexArrays(1, &mPositionVAO);
+	setupVertexArray();
+}
+
+void MeshPool::destroy()
+{
+	glDeleteVertexArrays(1, &mVAO);
+	glDeleteVertexArrays(1, &mPositionVAO);
+	glDeleteBuffers(1, &mVBO);
+	glDeleteBuffers(1, &mIBO);
+	glDeleteBuffers(1, &mPositionVBO);
+
+	mVAO = mVBO = mIBO = 0;
+	mPositionVAO = mPositionVBO = 0;
+	trackBuffers(0, 0);
+	mMeshes.clear();
+	mFreeHandles.clear();
+}
+
+void MeshPool::setupVertexArray()
+{
+	// create VAO and specify VBO data
+	glBindVertexArray(mVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIBO);
+	glVertexAttribPointer(mAttribIndex[0], 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, position)));
+	glVertexAttribPointer(mAttribIndex[1], 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, normal)));
+	glVertexAttribPointer(mAttribIndex[2], 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, tangent)));
+	glVertexAttribPointer(mAttribIndex[3], 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, texCoord)));
+
+	glEnableVertexAttribArray(mAttribIndex[0]);	// enable vertex attributes
+	glEnableVertexAttribArray(mAttribIndex[1]);
+	glEnableVertexAttribArray(mAttribIndex[2]);
+	glEnableVertexAttribArray(mAttribIndex[3]);
+
+	// tightly packed positions for depth-only passes, sharing the index buffer
+	glBindVertexArray(mPositionVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, mPositionVBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIBO);
+	glVertexAttribPointer(mAttribIndex[0], 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3, 0);
+	glEnableVertexAttribArray(mAttribIndex[0]);
+
+	glBindVertexArray(0);
+}
+
+int MeshPool::addMesh(const Mesh* mesh)
+{
+	GLuint numberOfVertices = mesh->numberOfVertices;
+	GLuint numberOfIndices = mesh_index_count(mesh);
+	GLuint vertexOffset, indexOffset;
+
+	// compact first if that makes enough room, otherwise grow the shared buffers
+	if (mVertexRanges.getLargestFreeRange() < numberOfVertices || mIndexRanges.getLargestFreeRange() < numberOfIndices)
+	{
+		GLuint freeVertices = mVertexRanges.getCapacity() - mVertexRanges.getUsed();
+		GLuint freeIndices = mIndexRanges.getCapacity() - mIndexRanges.getUsed();
+
+		if (freeVertices >= numberOfVertices && freeIndices >= numberOfIndices)
+		{
+			defragment();
+		}
+		else
+		{
+			GLuint vertexCapacity = max(mVertexRanges.getCapacity(), 1u);
+			GLuint indexCapacity = max(mIndexRanges.getCapacity(), 1u);
+
+			while (vertexCapacity - mVertexRanges.getUsed() < numberOfVertices)
+				vertexCapacity *= 2;
+			while (indexCapacity - mIndexRanges.getUsed() < numberOfIndices)
+				indexCapacity *= 2;
+
+			resize(vertexCapacity, indexCapacity);
+		}
+	}
+
+	mVertexRanges.allocate(numberOfVertices, &vertexOffset);
+	mIndexRanges.allocate(numberOfIndices, &indexOffset);
+
+	// copy the mesh into its sub-ranges
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mVBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(Vertex) * vertexOffset, sizeof(Vertex) * numberOfVertices, mesh->pMeshVertices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mIBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * indexOffset, sizeof(GLuint) * numberOfIndices, mesh->pMeshIndices);
+
+	vector<GLfloat> positions(numberOfVertices * 3);
+	for (GLuint i = 0; i < numberOfVertices; i++)
+	{
+		positions[i * 3] = mesh->pMeshVertices[i].position[0];
+		positions[i * 3 + 1] = mesh->pMeshVertices[i].position[1];
+		positions[i * 3 + 2] = mesh->pMeshVertices[i].position[2];
+	}
+
+	if (!positions.empty())
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mPositionVBO);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(GLfloat) * 3 * vertexOffset, sizeof(GLfloat) * 3 * numberOfVertices, positions.data());
+	}
+
+	PoolMesh poolMesh;
+	poolMesh.baseVertex = vertexOffset;
+	poolMesh.firstIndex = indexOffset;
+	poolMesh.count = numberOfIndices;
+	poolMesh.numberOfVertices = numberOfVertices;
+	poolMesh.uvScale = mesh_uv_scale(mesh);
+	poolMesh.loaded = true;
+
+	poolMesh.numberOfLods = mesh->numberOfLods;
+	for (int i = 0; i < mesh->numberOfLods; i++)
+	{
+		poolMesh.lods[i].firstIndex = mesh->lods[i].firstIndex;
+		poolMesh.lods[i].count = mesh->lods[i].numberOfFaces * 3;
+		poolMesh.lods[i].error = mesh->lods[i].error;
+	}
+
+	// object-space bounds for culling
+	poolMesh.bounds.min = poolMesh.bounds.max = glm::vec3(0.0f);
+	for (GLuint i = 0; i < numberOfVertices; i++)
+	{
+		glm::vec3 position(mesh->pMeshVertices[i].position[0], mesh->pMeshVertices[i].position[1], mesh->pMeshVertices[i].position[2]);
+
+		poolMesh.bounds.min = (i == 0) ? position : glm::min(poolMesh.bounds.min, position);
+		poolMesh.bounds.max = (i == 0) ? position : glm::max(poolMesh.bounds.max, position);
+	}
+
+	// reuse the handle of an unloaded mesh if there is one
+	if (!mFreeHandles.empty())
+	{
+		int handle = mFreeHandles.back();
+		mFreeHandles.pop_back();
+		mMeshes[handle] = poolMesh;
+		return handle;
+	}
+
+	mMeshes.push_back(poolMesh);
+	return static_cast<int>(mMeshes.size()) - 1;
+}
+
+bool MeshPool::loadScene(const char* fileName, vector<int>* meshHandles, JobSystem* jobSystem)
+{
+	vector<Mesh> meshes;
+	vector<Material> materials;
+
+	// the scene's materials are not kept, objects take theirs from the application
+	if (!load_scene(fileName, &meshes, &materials, jobSystem))
+		return false;
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const Mesh& mesh = meshes[i];
+		const MeshLod& lastLod = mesh.lods[mesh.numberOfLods - 1];
+		size_t bytes = sizeof(Vertex) * mesh.numberOfVertices + sizeof(GLint) * (lastLod.firstIndex + 3 * lastLod.numberOfFaces);
+		int staging = track_resource(fileName, RESOURCE_CPU_STAGING, bytes);
+
+		meshHandles->push_back(addMesh(&meshes[i]));
+		mark_uploaded(staging);
+
+		// CPU copy is no longer needed once uploaded
+		free_mesh(&meshes[i]);
+		untrack_resource(staging);
+	}
+
+	return true;
+}
+
+void MeshPool::unload(int handle)
+{
+	PoolMesh& poolMesh = mMeshes[handle];
+
+	if (!poolMesh.loaded)
+		return;
+
+	mVertexRanges.release(poolMesh.baseVertex, poolMesh.numberOfVertices);
+	mIndexRanges.release(poolMesh.firstIndex, poolMesh.count);
+	poolMesh.loaded = false;
+	mFreeHandles.push_back(handle);
+}
+
+void MeshPool::defragment()
+{
+	resize(mVertexRanges.getCapacity(), mIndexRanges.getCapacity());
+}
+
+void MeshPool::resize(GLuint vertexCapacity, GLuint indexCapacity)
+{
+	GLuint newVBO, newIBO, newPositionVBO;
+
+	glGenBuffers(1, &newVBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, sizeof(Vertex) * vertexCapacity, NULL, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &newIBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newIBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * indexCapacity, NULL, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &newPositionVBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newPositionVBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLfloat) * 3 * vertexCapacity, NULL, GL_STATIC_DRAW);
+
+	mVertexRanges.reset(vertexCapacity);
+	mIndexRanges.reset(indexCapacity);
+
+	// copy each loaded mesh across, packing them from the start of the new buffers
+	for (size_t i = 0; i < mMeshes.size(); i++)
+	{
+		PoolMesh& poolMesh = mMeshes[i];
+
+		if (!poolMesh.loaded)
+			continue;
+
+		GLuint vertexOffset, indexOffset;
+		mVertexRanges.allocate(poolMesh.numberOfVertices, &vertexOffset);
+		mIndexRanges.allocate(poolMesh.count, &indexOffset);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, mVBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sizeof(Vertex) * poolMesh.baseVertex,
+			sizeof(Vertex) * vertexOffset, sizeof(Vertex) * poolMesh.numberOfVertices);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, mPositionVBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newPositionVBO);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sizeof(GLfloat) * 3 * poolMesh.baseVertex,
+			sizeof(GLfloat) * 3 * vertexOffset, sizeof(GLfloat) * 3 * poolMesh.numberOfVertices);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, mIBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newIBO);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sizeof(GLuint) * poolMesh.firstIndex,
+			sizeof(GLuint) * indexOffset, sizeof(GLuint) * poolMesh.count);
+
+		poolMesh.baseVertex = vertexOffset;
+		poolMesh.firstIndex = indexOffset;
+	}
+
+	glDeleteBuffers(1, &mVBO);
+	glDeleteBuffers(1, &mIBO);
+	glDeleteBuffers(1, &mPositionVBO);
+	mVBO = newVBO;
+	mIBO = newIBO;
+	mPositionVBO = newPositionVBO;
+	trackBuffers(vertexCapacity, indexCapacity);
+
+	// point the VAO at the new buffers
+	setupVertexArray();
+}
+
+// record the buffers' current sizes, nothing when they are gone
+void MeshPool::trackBuffers(GLuint vertexCapacity, GLuint indexCapacity)
+{
+	untrack_resource(mVertexResource);
+	untrack_resource(mIndexResource);
+	mVertexResource = mIndexResource = 0;
+
+	if (vertexCapacity > 0)
+		mVertexResource = track_resource("Mesh pool vertices", RESOURCE_VERTEX, (sizeof(Vertex) + sizeof(GLfloat) * 3) * vertexCapacity);
+	if (indexCapacity > 0)
+		mIndexResource = track_resource("Mesh pool indices", RESOURCE_INDEX, sizeof(GLuint) * indexCapacity);
+}
+
+void MeshPool::bind()
+{
+	glBindVertexArray(mVAO);		// make VAO active
+}
+
+void MeshPool::bindPositions()
+{
+	glBindVertexArray(mPositionVAO);
+}
+
+const PoolMesh& MeshPool::getMesh(int handle) const
+{
+	return mMeshes[handle];
+}
+
+GLuint MeshPool::getVertexBuffer() const
+{
+	return mVBO;
+}
+
+GLuint MeshPool::getIndexBuffer() const
+{
+	return mIBO;
+}
+
+float MeshPool::getFragmentation() const
+{
+	GLuint freeVertices = mVertexRanges.getCapacity() - mVertexRanges.getUsed();
+
+	if (freeVertices == 0)
+		return 0.0f;
+
+	// 0 when all free space is one block, approaching 1 as it splinters
+	return 1.0f - static_cast<float>(mVertexRanges.getLargestFreeRange()) / freeVertices;
+}
@@ -0,0 +1,97 @@
+#ifndef __MESH_POOL_H
+#define __MESH_POOL_H
+
+#include <vector>
+
+#include <GLEW/glew.h>	// include GLEW
+
+#include "mesh.h"
+#include "culling.h"
+
+// first-fit free-list allocator over a range of buffer elements
+class RangeAllocator {
+public:
+	RangeAllocator();
+
+	void reset(GLuint capacity);
+	bool allocate(GLuint size, GLuint* offset);
+	void release(GLuint offset, GLuint size);
+	GLuint getCapacity() const;
+	GLuint getUsed() const;
+	GLuint getLargestFreeRange() const;
+
+private:
+	typedef struct Range
+	{
+		GLuint offset;
+		GLuint size;
+	} Range;
+
+	std::vector<Range> mFreeRanges;	// sorted by offset, adjacent ranges are always merged
+	GLuint mCapacity;
+	GLuint mUsed;
+};
+
+// a level of detail of a pooled mesh
+typedef struct PoolLod
+{
+	GLuint firstIndex;			// first index relative to the mesh's first index
+	GLsizei count;				// number of indices
+	GLfloat error;				// object-space error of the level
+} PoolLod;
+
+// a mesh stored inside the pool's shared buffers
+typedef struct PoolMesh
+{
+	GLint baseVertex;			// first vertex in the shared vertex buffer
+	GLuint firstIndex;			// first index in the shared index buffer
+	GLsizei count;				// number of indices over every level
+	GLuint numberOfVertices;	// number of vertices
+	AABB bounds;				// object-space bounding box
+	GLfloat uvScale;			// object-space length of one unit of texture coordinate, see mesh_uv_scale
+	PoolLod lods[MAX_MESH_LODS];
+	GLuint numberOfLods;
+	bool loaded;
+} PoolMesh;
+
+// all meshes share one vertex buffer, one index buffer and one VAO, and are drawn with base-vertex draws
+// a second, position-only copy of the vertices has its own VAO for depth-only passes, so they do not fetch
+// the normals, tangents and texture coordinates along with the positions
+class MeshPool {
+public:
+	MeshPool();
+	~MeshPool();
+
+	void init(GLuint vertexCapacity, GLuint indexCapacity, GLuint positionIndex, GLuint normalIndex, GLuint tangentIndex, GLuint texCoordIndex);
+	void destroy();
+	int addMesh(const Mesh* mesh);
+	bool loadScene(const char* fileName, std::vector<int>* meshHandles, JobSystem* jobSystem = NULL);
+	void unload(int handle);
+	void defragment();
+	void bind();
+	void bindPositions();
+	const PoolMesh& getMesh(int handle) const;
+	GLuint getVertexBuffer() const;
+	GLuint getIndexBuffer() const;
+	float getFragmentation() const;
+
+private:
+	void resize(GLuint vertexCapacity, GLuint indexCapacity);
+	void setupVertexArray();
+	void trackBuffers(GLuint vertexCapacity, GLuint indexCapacity);
+
+	GLuint mVBO;
+	GLuint mIBO;
+	GLuint mVAO;
+	GLuint mPositionVBO;		// positions only, same vertex offsets as mVBO
+	GLuint mPositionVAO;
+	GLuint mAttribIndex[4];		// position, normal, tangent, texture coordinate
+	int mVertexResource;		// tracked sizes of the vertex (both VBOs) and index buffers
+	int mIndexResource;
+	RangeAllocator mVertexRanges;
+	RangeAllocator mIndexRanges;
+	std::vector<PoolMesh> mMeshes;
+	std::vector<int> mFreeHandles;
+};
+
+#endif
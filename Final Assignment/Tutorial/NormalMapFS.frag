@@ -4,7 +4,12 @@
 in vec3 vPosition;
 in vec3 vNormal;
 in vec3 vTangent;
+in float vTangentSign;
 in vec2 vTexCoord;
+flat in int vDrawID;
+in vec3 vBitangent;
+in vec3 vLightTangent;
+in vec3 vEyeTangent;
 
 // light and material structs
 struct Light
@@ -25,25 +30,132 @@ struct Material
 	float shininess;
 };
 
+// per-frame data, streamed into a uniform buffer
+layout(std140) uniform FrameData
+{
+	mat4 uViewMatrix;
+	Light uLight;
+	mat4 uReflectionMatrix;		// eye space to planar reflection texture coordinates
+	vec4 uReflectionParams;		// x = strength of the planar reflection
+	vec4 uIrradiance[9];		// SH9 irradiance of the environment, already divided by pi
+	vec4 uEnvironmentParams;	// x = highest mip of uEnvironmentMap
+	vec4 uClusterParams;		// x, y = tiles across and down, z, w = scale and bias taking log(depth) to a slice
+	vec4 uClusterScreen;		// xy = viewport size, z = 1 if the clustered lights apply to this view, w = depth slices
+	mat4 uShadowMatrices[4];	// eye space to cascade texture coordinates and depth
+	vec4 uShadowParams;			// x = 0 no shadows, 1 point cube, 2 cascades, y = PCF radius in texels, z = 1 / map size, w = cascades
+	vec4 uShadowBias;			// x = far plane of the cube, y = depth bias, z = normal offset
+};
+
 // uniform input data
-uniform mat4 uViewMatrix;
-uniform Light uLight;
-uniform Material uMaterial;
-uniform bool isReflective = false;
 uniform sampler2D uTextureSampler;
 uniform sampler2D uNormalSampler;
 uniform samplerCube uEnvironmentMap;
-uniform float uAlpha = 1.0f;
+uniform sampler2D uReflectionMap;
+uniform samplerBuffer uLights;			// 2 texels per light: eye-space position and radius, colour
+uniform usamplerBuffer uClusters;		// first index and number of lights per cluster
+uniform usamplerBuffer uLightIndices;	// lights of every cluster, one after another
+uniform sampler2DArrayShadow uShadowCascades;
+uniform samplerCubeShadow uShadowCube;
+uniform samplerBuffer uDrawData;	// per-draw matrices and material, 11 texels per draw
+uniform int uDrawDataBase;			// texel where this frame's draw data starts
+uniform int uTransparencyMode;		// 1 = accumulate into the weighted blended OIT targets
+uniform int uShadingMode;			// 0 = TBN per fragment, 1 = main light in tangent space per vertex
 
 // output data
-out vec4 fColor;
+layout(location = 0) out vec4 fColor;
+layout(location = 1) out vec4 fWeight;	// weighted blended OIT only
+
+// irradiance arriving at a world-space normal, from the spherical harmonics of the environment
+vec3 sh_irradiance(vec3 n)
+{
+	return uIrradiance[0].rgb * 0.282095f
+		+ uIrradiance[1].rgb * 0.488603f * n.y
+		+ uIrradiance[2].rgb * 0.488603f * n.z
+		+ uIrradiance[3].rgb * 0.488603f * n.x
+		+ uIrradiance[4].rgb * 1.092548f * n.x * n.y
+		+ uIrradiance[5].rgb * 1.092548f * n.y * n.z
+		+ uIrradiance[6].rgb * 0.315392f * (3.0f * n.z * n.z - 1.0f)
+		+ uIrradiance[7].rgb * 1.092548f * n.x * n.z
+		+ uIrradiance[8].rgb * 0.546274f * (n.x * n.x - n.y * n.y);
+}
+
+// fraction of the main light reaching an eye-space point, from the cube shadow map of a point light
+float point_shadow(vec3 position)
+{
+	// the cube is indexed by the world-space direction from the light
+	vec3 lightPosition = (uViewMatrix * vec4(uLight.position, 1.0f)).xyz;
+	vec3 toPosition = transpose(mat3(uViewMatrix)) * (position - lightPosition);
+	float distance = length(toPosition);
+	float depth = distance / uShadowBias.x - uShadowBias.y;
+
+	// PCF taps on a grid across the lookup direction, one texel apart where the face is straight ahead
+	vec3 axis = abs(toPosition.y) < 0.9f * distance ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+	vec3 axisU = normalize(cross(toPosition, axis));
+	vec3 axisV = normalize(cross(toPosition, axisU));
+	float texel = 2.0f * distance * uShadowParams.z;
+	int radius = int(uShadowParams.y);
+
+	float lit = 0.0f;
+	for(int y = -radius; y <= radius; y++){
+		for(int x = -radius; x <= radius; x++)
+			lit += texture(uShadowCube, vec4(toPosition + (axisU * float(x) + axisV * float(y)) * texel, depth));
+	}
+
+	return lit / float((2 * radius + 1) * (2 * radius + 1));
+}
+
+// the same for a directional light, from the first cascade that covers the point
+float cascade_shadow(vec3 position)
+{
+	int radius = int(uShadowParams.y);
+
+	for(int cascade = 0; cascade < int(uShadowParams.w); cascade++){
+		vec3 coord = (uShadowMatrices[cascade] * vec4(position, 1.0f)).xyz;
+
+		if(any(lessThan(coord, vec3(0.0f))) || any(greaterThan(coord, vec3(1.0f))))
+			continue;
+
+		float lit = 0.0f;
+		for(int y = -radius; y <= radius; y++){
+			for(int x = -radius; x <= radius; x++)
+				lit += texture(uShadowCascades, vec4(coord.xy + vec2(x, y) * uShadowParams.z, float(cascade), coord.z - uShadowBias.y));
+		}
+
+		return lit / float((2 * radius + 1) * (2 * radius + 1));
+	}
+
+	return 1.0f;
+}
+
+// shadowing of the main light, the point is moved off the surface along its normal to keep it from shadowing itself
+float main_light_shadow(vec3 position, vec3 normal)
+{
+	position += normal * uShadowBias.z;
+
+	if(uShadowParams.x > 1.5f)
+		return cascade_shadow(position);
+	if(uShadowParams.x > 0.5f)
+		return point_shadow(position);
+	return 1.0f;
+}
 
 void main()
 {
+	// fetch this draw's material
+	int base = uDrawDataBase + vDrawID * 11;
+	vec4 ambientAlpha = texelFetch(uDrawData, base + 8);
+	vec4 diffuseReflective = texelFetch(uDrawData, base + 9);
+	vec4 specularShininess = texelFetch(uDrawData, base + 10);
+
+	Material material = Material(ambientAlpha.rgb, diffuseReflective.rgb, specularShininess.rgb, specularShininess.a);
+	int surface = int(diffuseReflective.a + 0.5f);		// 0 = lit, 1 = environment mapped, 2 = planar mirror
+	bool isReflective = surface == 1;
+	float alpha = ambientAlpha.a;
+
 	if(isReflective){
 		vec3 normal = normalize(vNormal);
 		vec3 tangent = normalize(vTangent);
-		vec3 biTangent = normalize(cross(tangent, normal));
+		vec3 biTangent = normalize(cross(normal, tangent)) * vTangentSign;
 		vec3 normalMap = 2.0f * texture(uNormalSampler, vTexCoord).xyz - 1.0f;
 
 		normal = normalize(mat3(tangent, biTangent, normal) * normalMap);
@@ -60,50 +172,124 @@ void main()
 		vec3 H = normalize(L + E);
 
 		// calculate the ambient, diffuse and specular components
-		vec3 ambient  = uLight.ambient * uMaterial.ambient;
-		vec3 diffuse  = uLight.diffuse * uMaterial.diffuse * max(dot(L, normal), 0.0);
+		vec3 ambient  = uLight.ambient * material.ambient;
+		vec3 diffuse  = uLight.diffuse * material.diffuse * max(dot(L, normal), 0.0);
 		vec3 specular = vec3(0.0f, 0.0f, 0.0f);
 
 		if(dot(L, normal) > 0.0f)
-			specular = uLight.specular * uMaterial.specular * pow(max(dot(normal, H), 0.0), uMaterial.shininess);
+			specular = uLight.specular * material.specular * pow(max(dot(normal, H), 0.0), material.shininess);
+
+		// the cube map is in world space, take the normal and reflected direction out of eye space
+		mat3 eyeToWorld = transpose(mat3(uViewMatrix));
+		vec3 reflectEnvMap = eyeToWorld * reflect(-E, normal);
+
+		// roughness from the Blinn-Phong exponent, the mips are prefiltered for roughness rising linearly to 1
+		float roughness = sqrt(sqrt(2.0f / (material.shininess + 2.0f)));
+		vec3 prefiltered = textureLod(uEnvironmentMap, reflectEnvMap, roughness * uEnvironmentParams.x).rgb;
 
-		vec3 reflectEnvMap = reflect(-E, normal);
 		// set output color
-		vec3 sColor = texture(uEnvironmentMap, reflectEnvMap).rgb;
-		//sColor *= diffuse + specular + ambient;
-		fColor = vec4(sColor,uAlpha);
+		vec3 sColor = material.diffuse * sh_irradiance(eyeToWorld * normal) + prefiltered;
+		fColor = vec4(sColor, alpha);
 		//fColor *= diffuse + specular + ambient;
 	}else{
-		vec3 normal = normalize(vNormal);
-		vec3 tangent = normalize(vTangent);
-		vec3 biTangent = normalize(cross(tangent, normal));
 		vec3 normalMap = 2.0f * texture(uNormalSampler, vTexCoord).xyz - 1.0f;
+		vec3 normal;
+		vec3 L;
+		vec3 E;
 
-		normal = normalize(mat3(tangent, biTangent, normal) * normalMap);
+		if(uShadingMode == 1){
+			// the vertex shader moved the light and eye into tangent space, where the normal map already is
+			normal = normalize(normalMap);
+			L = normalize(vLightTangent);
+			E = normalize(vEyeTangent);
+		}else{
+			normal = normalize(vNormal);
+			vec3 tangent = normalize(vTangent);
+			vec3 biTangent = normalize(cross(normal, tangent)) * vTangentSign;
 
-		vec3 L;
+			normal = normalize(mat3(tangent, biTangent, normal) * normalMap);
 
-		// determine whether the light is a point light source or directional light
-		if(uLight.type == 0)
-			L = normalize((uViewMatrix * vec4(uLight.position, 1.0f)).xyz - vPosition);
-		else
-			L = normalize((uViewMatrix * vec4(-uLight.direction, 0.0f)).xyz);
+			// determine whether the light is a point light source or directional light
+			if(uLight.type == 0)
+				L = normalize((uViewMatrix * vec4(uLight.position, 1.0f)).xyz - vPosition);
+			else
+				L = normalize((uViewMatrix * vec4(-uLight.direction, 0.0f)).xyz);
+
+			E = normalize(-vPosition);
+		}
 
-		vec3 E = normalize(-vPosition);
 		vec3 H = normalize(L + E);
 
 		// calculate the ambient, diffuse and specular components
-		vec3 ambient  = uLight.ambient * uMaterial.ambient;
-		vec3 diffuse  = uLight.diffuse * uMaterial.diffuse * max(dot(L, normal), 0.0);
+		vec3 ambient  = uLight.ambient * material.ambient;
+		vec3 diffuse  = uLight.diffuse * material.diffuse * max(dot(L, normal), 0.0);
 		vec3 specular = vec3(0.0f, 0.0f, 0.0f);
 
 		if(dot(L, normal) > 0.0f)
-			specular = uLight.specular * uMaterial.specular * pow(max(dot(normal, H), 0.0), uMaterial.shininess);
+			specular = uLight.specular * material.specular * pow(max(dot(normal, H), 0.0), material.shininess);
+
+		// the main light's shadow, the surface normal is used for the offset so the normal map does not shift it
+		float shadow = main_light_shadow(vPosition, normalize(vNormal));
+		diffuse *= shadow;
+		specular *= shadow;
+
+		// add the fixtures listed for this fragment's cluster
+		if(uClusterScreen.z > 0.5f){
+			ivec3 cluster = ivec3(gl_FragCoord.xy / uClusterScreen.xy * uClusterParams.xy,
+				log(-vPosition.z) * uClusterParams.z + uClusterParams.w);
+			cluster = clamp(cluster, ivec3(0), ivec3(uClusterParams.xy, uClusterScreen.w) - 1);
+
+			uvec2 range = texelFetch(uClusters, (cluster.z * int(uClusterParams.y) + cluster.y) * int(uClusterParams.x) + cluster.x).rg;
+
+			// the fixtures are in eye space, in tangent space the normal is taken there only where there are any
+			if(uShadingMode == 1 && range.y > 0u){
+				normal = normalize(mat3(vTangent, vBitangent, vNormal) * normalMap);
+				E = normalize(-vPosition);
+			}
+
+			for(uint i = 0u; i < range.y; i++){
+				int light = int(texelFetch(uLightIndices, int(range.x + i)).r);
+				vec4 positionRadius = texelFetch(uLights, light * 2);
+				vec3 lightColor = texelFetch(uLights, light * 2 + 1).rgb;
+
+				vec3 toLight = positionRadius.xyz - vPosition;
+				float distance = length(toLight);
+				vec3 lightL = toLight / distance;
+
+				// smooth inverse-square falloff that reaches zero at the radius
+				float window = clamp(1.0f - pow(distance / positionRadius.w, 4.0f), 0.0f, 1.0f);
+				float attenuation = window * window / (distance * distance + 1.0f);
+
+				float NdotL = max(dot(lightL, normal), 0.0f);
+				vec3 lightH = normalize(lightL + E);
+				float highlight = NdotL > 0.0f ? pow(max(dot(normal, lightH), 0.0f), material.shininess) : 0.0f;
+
+				diffuse += lightColor * material.diffuse * NdotL * attenuation;
+				specular += lightColor * material.specular * highlight * attenuation;
+			}
+		}
 
 		// set output color
 		vec3 sColor = diffuse + specular + ambient;
 		sColor *= texture(uTextureSampler, vTexCoord).rgb;
-		fColor = vec4(sColor,uAlpha);
+
+		// mirrors blend in the planar reflection, looked up through the camera it was rendered with
+		if(surface == 2){
+			vec4 reflectionCoord = uReflectionMatrix * vec4(vPosition, 1.0f);
+			vec3 reflection = texture(uReflectionMap, reflectionCoord.xy / reflectionCoord.w).rgb;
+			sColor = mix(sColor, reflection, uReflectionParams.x);
+		}
+
+		fColor = vec4(sColor, alpha);
+	}
+
+	// weighted blended OIT, nearer and more opaque surfaces weigh more (McGuire and Bavoil, equation 7)
+	// the targets blend colour with (ONE, ONE) and alpha with (ZERO, ONE_MINUS_SRC_ALPHA)
+	if(uTransparencyMode == 1){
+		float depth = abs(vPosition.z);
+		float weight = fColor.a * clamp(10.0f / (1e-5f + pow(depth / 5.0f, 2.0f) + pow(depth / 200.0f, 6.0f)), 1e-2f, 3e3f);
+
+		fWeight = vec4(weight, 0.0f, 0.0f, 0.0f);
+		fColor = vec4(fColor.rgb * weight, fColor.a);
 	}
-    
 }
\ No newline at end of file
@@ -3,29 +3,95 @@
 // input data (different for all executions of this shader)
 in vec3 aPosition;
 in vec3 aNormal;
-in vec3 aTangent;
+in vec4 aTangent;		// xyz = tangent, w = bitangent sign
 in vec2 aTexCoord;
+in uint aDrawID;		// index of this draw's data in uDrawData
+
+// light struct
+struct Light
+{
+	vec3 position;
+	vec3 direction;
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+	int type;
+};
+
+// per-frame data, streamed into a uniform buffer (must match NormalMapFS.frag)
+layout(std140) uniform FrameData
+{
+	mat4 uViewMatrix;
+	Light uLight;
+	mat4 uReflectionMatrix;
+	vec4 uReflectionParams;
+	vec4 uIrradiance[9];
+	vec4 uEnvironmentParams;
+	vec4 uClusterParams;
+	vec4 uClusterScreen;
+	mat4 uShadowMatrices[4];
+	vec4 uShadowParams;
+	vec4 uShadowBias;
+};
 
 // uniform input data
-uniform mat4 uModelViewProjectionMatrix;
-uniform mat4 uModelViewMatrix;
+uniform samplerBuffer uDrawData;	// per-draw matrices and material, 11 texels per draw
+uniform int uDrawDataBase;			// texel where this frame's draw data starts
+uniform int uShadingMode;			// 0 = TBN per fragment, 1 = main light in tangent space per vertex
 
 // output data (will be interpolated for each fragment)
 out vec3 vPosition;
 out vec3 vNormal;
 out vec3 vTangent;
+out float vTangentSign;
 out vec2 vTexCoord;
+flat out int vDrawID;
+out vec3 vBitangent;		// tangent space per vertex only
+out vec3 vLightTangent;		// main light and eye vectors, unnormalised so they interpolate correctly
+out vec3 vEyeTangent;
+
+// the depth pre-pass in DepthVS.vert must produce exactly the same depth
+invariant gl_Position;
 
 void main()
 {
+	// fetch this draw's matrices
+	int base = uDrawDataBase + int(aDrawID) * 11;
+	mat4 modelViewProjectionMatrix = mat4(texelFetch(uDrawData, base), texelFetch(uDrawData, base + 1),
+		texelFetch(uDrawData, base + 2), texelFetch(uDrawData, base + 3));
+	mat4 modelViewMatrix = mat4(texelFetch(uDrawData, base + 4), texelFetch(uDrawData, base + 5),
+		texelFetch(uDrawData, base + 6), texelFetch(uDrawData, base + 7));
+
 	// set vertex position
-    gl_Position = uModelViewProjectionMatrix * vec4(aPosition, 1.0);
+    gl_Position = modelViewProjectionMatrix * vec4(aPosition, 1.0);
 
 	// eye/camera space
-	vPosition = (uModelViewMatrix * vec4(aPosition, 1.0)).xyz;
-	vNormal = (uModelViewMatrix * vec4(aNormal, 0.0)).xyz;
-	vTangent = (uModelViewMatrix * vec4(aTangent, 0.0)).xyz;
+	vPosition = (modelViewMatrix * vec4(aPosition, 1.0)).xyz;
+	vNormal = (modelViewMatrix * vec4(aNormal, 0.0)).xyz;
+	vTangent = (modelViewMatrix * vec4(aTangent.xyz, 0.0)).xyz;
+	vTangentSign = aTangent.w;
 
 	vTexCoord = aTexCoord;
+	vDrawID = int(aDrawID);
+
+	// the same basis the fragment shader builds, here once per vertex
+	if(uShadingMode == 1){
+		vec3 normal = normalize(vNormal);
+		vec3 tangent = normalize(vTangent);
+		vec3 biTangent = normalize(cross(normal, tangent)) * vTangentSign;
+		mat3 eyeToTangent = transpose(mat3(tangent, biTangent, normal));
+
+		vec3 L;
+
+		// determine whether the light is a point light source or directional light
+		if(uLight.type == 0)
+			L = (uViewMatrix * vec4(uLight.position, 1.0f)).xyz - vPosition;
+		else
+			L = (uViewMatrix * vec4(-uLight.direction, 0.0f)).xyz;
+
+		vBitangent = biTangent;
+		vLightTangent = eyeToTangent * L;
+		vEyeTangent = eyeToTangent * -vPosition;
+	}
 }
 
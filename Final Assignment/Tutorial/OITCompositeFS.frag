@@ -0,0 +1,20 @@
+#version 330 core
+
+// uniform input data
+uniform sampler2D uAccumulation;	// rgb = sum of colour * alpha * weight, a = product of (1 - alpha)
+uniform sampler2D uWeight;			// r = sum of alpha * weight
+
+// output data
+out vec4 fColor;
+
+void main()
+{
+	// the same texel as the pixel, the scene may only cover part of the targets
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	vec4 accumulation = texelFetch(uAccumulation, texel, 0);
+	float weight = texelFetch(uWeight, texel, 0).r;
+
+	// weighted average colour of the surfaces, over the opaque image by the coverage they add up to
+	vec3 average = accumulation.rgb / max(weight, 1e-5f);
+	fColor = vec4(average, 1.0f - accumulation.a);
+}
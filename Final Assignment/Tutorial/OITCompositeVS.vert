@@ -0,0 +1,9 @@
+#version 330 core
+
+void main()
+{
+	// one triangle covering the viewport, from the vertex index alone
+	vec2 position = vec2(float((gl_VertexID & 1) * 4 - 1), float((gl_VertexID & 2) * 2 - 1));
+
+	gl_Position = vec4(position, 0.0f, 1.0f);
+}
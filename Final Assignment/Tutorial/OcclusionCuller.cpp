@@ -0,0 +1,435 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+using namespace std;
+
+#include "simd.h"
+#include "OcclusionCuller.h"
+
+#define OCCLUSION_TILES_X (OCCLUSION_WIDTH / OCCLUSION_TILE_WIDTH)
+#define OCCLUSION_TILES_Y (OCCLUSION_HEIGHT / OCCLUSION_TILE_HEIGHT)
+
+static const int minTrianglesPerJob = 64;	// binned triangles below which jobs cost more than they save
+static const int minBoxesPerJob = 16;		// bounding boxes tested by each job
+
+static double elapsed_ms(chrono::high_resolution_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+// rasterise one triangle into the rows and columns of a tile, 8 pixels at a time
+AVX2_FUNCTION static void rasterize_span_avx2(float* depth, const float* edgeA, const float* edgeB, const float* edgeC,
+	float depthA, float depthB, float depthC, int x0, int x1, int y0, int y1)
+{
+	const __m256 laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	__m256 a0 = _mm256_set1_ps(edgeA[0]), a1 = _mm256_set1_ps(edgeA[1]), a2 = _mm256_set1_ps(edgeA[2]);
+	__m256 za = _mm256_set1_ps(depthA);
+
+	for (int y = y0; y <= y1; y++)
+	{
+		float py = y + 0.5f;
+		__m256 row0 = _mm256_set1_ps(edgeB[0] * py + edgeC[0]);
+		__m256 row1 = _mm256_set1_ps(edgeB[1] * py + edgeC[1]);
+		__m256 row2 = _mm256_set1_ps(edgeB[2] * py + edgeC[2]);
+		__m256 rowZ = _mm256_set1_ps(depthB * py + depthC);
+		float* line = depth + y * OCCLUSION_WIDTH;
+
+		for (int x = x0; x <= x1; x += 8)
+		{
+			__m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), laneOffsets);
+			__m256 e0 = _mm256_fmadd_ps(a0, px, row0);
+			__m256 e1 = _mm256_fmadd_ps(a1, px, row1);
+			__m256 e2 = _mm256_fmadd_ps(a2, px, row2);
+
+			__m256 inside = _mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ),
+				_mm256_and_ps(_mm256_cmp_ps(e1, zero, _CMP_GE_OQ), _mm256_cmp_ps(e2, zero, _CMP_GE_OQ)));
+
+			if (_mm256_testz_ps(inside, inside))
+				continue;
+
+			__m256 z = _mm256_fmadd_ps(za, px, rowZ);
+			__m256 old = _mm256_loadu_ps(line + x);
+			_mm256_storeu_ps(line + x, _mm256_blendv_ps(old, _mm256_min_ps(old, z), inside));
+		}
+	}
+}
+
+static void rasterize_span_scalar(float* depth, const float* edgeA, const float* edgeB, const float* edgeC,
+	float depthA, float depthB, float depthC, int x0, int x1, int y0, int y1)
+{
+	for (int y = y0; y <= y1; y++)
+	{
+		float py = y + 0.5f;
+		float* line = depth + y * OCCLUSION_WIDTH;
+
+		for (int x = x0; x <= x1 + 7; x++)
+		{
+			float px = x + 0.5f;
+
+			if (edgeA[0] * px + edgeB[0] * py + edgeC[0] < 0.0f || edgeA[1] * px + edgeB[1] * py + edgeC[1] < 0.0f
+				|| edgeA[2] * px + edgeB[2] * py + edgeC[2] < 0.0f)
+				continue;
+
+			line[x] = min(line[x], depthA * px + depthB * py + depthC);
+		}
+	}
+}
+
+// true if any depth in the rows and columns is at or behind minDepth
+AVX2_FUNCTION static bool test_rect_avx2(const float* depth, int x0, int x1, int y0, int y1, float minDepth)
+{
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256 objectDepth = _mm256_set1_ps(minDepth);
+	int start = x0 & ~7;
+
+	for (int y = y0; y <= y1; y++)
+	{
+		const float* line = depth + y * OCCLUSION_WIDTH;
+
+		for (int x = start; x <= x1; x += 8)
+		{
+			// only the lanes inside [x0, x1]
+			__m256i column = _mm256_add_epi32(_mm256_set1_epi32(x), lanes);
+			__m256i inRange = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(x0), column),
+				_mm256_andnot_si256(_mm256_cmpgt_epi32(column, _mm256_set1_epi32(x1)), _mm256_set1_epi32(-1)));
+
+			__m256 farther = _mm256_cmp_ps(_mm256_loadu_ps(line + x), objectDepth, _CMP_GE_OQ);
+
+			if (!_mm256_testz_ps(farther, _mm256_castsi256_ps(inRange)))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static bool test_rect_scalar(const float* depth, int x0, int x1, int y0, int y1, float minDepth)
+{
+	for (int y = y0; y <= y1; y++)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			if (depth[y * OCCLUSION_WIDTH + x] >= minDepth)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+OcclusionCuller::OcclusionCuller()
+{
+	mJobSystem = NULL;
+	mSimd = false;
+	mStats = OcclusionStats();
+}
+
+OcclusionCuller::~OcclusionCuller()
+{}
+
+// without a job system the tiles are rasterised on the calling thread
+void OcclusionCuller::init(JobSystem* jobSystem)
+{
+	mJobSystem = jobSystem;
+	mSimd = cpu_has_avx2();
+
+	mDepth.assign(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f);
+	mBins.resize(OCCLUSION_TILES_X * OCCLUSION_TILES_Y);
+
+	cout << "Occlusion culling: " << OCCLUSION_WIDTH << "x" << OCCLUSION_HEIGHT << ", "
+		<< (mJobSystem != NULL ? "jobs, " : "serial, ") << (mSimd ? "AVX2" : "scalar") << endl;
+}
+
+int OcclusionCuller::addOccluderMesh(const Vertex* vertices, GLint numberOfVertices, const GLint* indices, GLint numberOfFaces)
+{
+	OccluderMesh mesh;
+
+	mesh.positions.resize(numberOfVertices);
+	for (GLint i = 0; i < numberOfVertices; i++)
+		mesh.positions[i] = glm::vec3(vertices[i].position[0], vertices[i].position[1], vertices[i].position[2]);
+
+	mesh.indices.assign(indices, indices + numberOfFaces * 3);
+	mMeshes.push_back(mesh);
+
+	return static_cast<int>(mMeshes.size()) - 1;
+}
+
+void OcclusionCuller::beginFrame(const glm::mat4& viewProjection)
+{
+	mViewProjection = viewProjection;
+	mTriangles.clear();
+	mStats = OcclusionStats();
+}
+
+// test against the depth buffer of the last frame again, for when neither the view nor the occluders have changed
+void OcclusionCuller::keepFrame()
+{
+	mStats.testedObjects = 0;
+	mStats.culledObjects = 0;
+	mStats.rasterTime = 0.0f;
+	mStats.testTime = 0.0f;
+}
+
+void OcclusionCuller::addOccluder(int mesh, const glm::mat4& modelMatrix)
+{
+	const OccluderMesh& occluder = mMeshes[mesh];
+	glm::mat4 modelViewProjection = mViewProjection * modelMatrix;
+
+	for (size_t i = 0; i < occluder.indices.size(); i += 3)
+	{
+		glm::vec4 clip[3];
+		for (int c = 0; c < 3; c++)
+			clip[c] = modelViewProjection * glm::vec4(occluder.positions[occluder.indices[i + c]], 1.0f);
+
+		mStats.occluderTriangles++;
+
+		// clip against the near plane (z >= -w), leaving a triangle or a quad
+		glm::vec4 polygon[4];
+		int count = 0;
+
+		for (int c = 0; c < 3; c++)
+		{
+			const glm::vec4& a = clip[c];
+			const glm::vec4& b = clip[(c + 1) % 3];
+			float da = a.z + a.w;
+			float db = b.z + b.w;
+
+			if (da >= 0.0f)
+				polygon[count++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f))
+				polygon[count++] = a + (b - a) * (da / (da - db));
+		}
+
+		for (int c = 1; c + 1 < count; c++)
+			setupTriangle(polygon[0], polygon[c], polygon[c + 1]);
+	}
+}
+
+void OcclusionCuller::setupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2)
+{
+	const glm::vec4* v[3] = { &v0, &v1, &v2 };
+	float x[3], y[3], z[3];
+
+	// to depth buffer pixels and [0, 1] depth
+	for (int c = 0; c < 3; c++)
+	{
+		float w = max(v[c]->w, 1e-6f);
+		x[c] = (v[c]->x / w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		y[c] = (v[c]->y / w * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+		z[c] = v[c]->z / w * 0.5f + 0.5f;
+	}
+
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (fabs(area) < 1e-8f)
+		return;
+
+	// occluders are double sided, flip clockwise triangles
+	float sign = (area > 0.0f) ? 1.0f : -1.0f;
+
+	RasterTriangle triangle;
+	for (int e = 0; e < 3; e++)
+	{
+		int a = e;
+		int b = (e + 1) % 3;
+		triangle.edgeA[e] = sign * (y[a] - y[b]);
+		triangle.edgeB[e] = sign * (x[b] - x[a]);
+		triangle.edgeC[e] = sign * (x[a] * y[b] - x[b] * y[a]);
+	}
+
+	// depth plane through the three vertices
+	float dzdx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+	float dzdy = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+	triangle.depthA = dzdx;
+	triangle.depthB = dzdy;
+	triangle.depthC = z[0] - dzdx * x[0] - dzdy * y[0];
+
+	// pixels whose centres can be covered
+	float minX = min(x[0], min(x[1], x[2])), maxX = max(x[0], max(x[1], x[2]));
+	float minY = min(y[0], min(y[1], y[2])), maxY = max(y[0], max(y[1], y[2]));
+	triangle.minX = max(0, static_cast<int>(ceil(minX - 0.5f)));
+	triangle.maxX = min(OCCLUSION_WIDTH - 1, static_cast<int>(floor(maxX - 0.5f)));
+	triangle.minY = max(0, static_cast<int>(ceil(minY - 0.5f)));
+	triangle.maxY = min(OCCLUSION_HEIGHT - 1, static_cast<int>(floor(maxY - 0.5f)));
+
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		return;
+
+	mTriangles.push_back(triangle);
+}
+
+void OcclusionCuller::rasterize()
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+	// bin triangles by the tiles their bounds overlap
+	int binned = 0;
+	for (size_t i = 0; i < mBins.size(); i++)
+		mBins[i].clear();
+
+	for (size_t i = 0; i < mTriangles.size(); i++)
+	{
+		const RasterTriangle& triangle = mTriangles[i];
+
+		for (int ty = triangle.minY / OCCLUSION_TILE_HEIGHT; ty <= triangle.maxY / OCCLUSION_TILE_HEIGHT; ty++)
+		{
+			for (int tx = triangle.minX / OCCLUSION_TILE_WIDTH; tx <= triangle.maxX / OCCLUSION_TILE_WIDTH; tx++)
+			{
+				mBins[ty * OCCLUSION_TILES_X + tx].push_back(static_cast<int>(i));
+				binned++;
+			}
+		}
+	}
+
+	mStats.rasterizedTriangles = static_cast<int>(mTriangles.size());
+
+	// tiles are independent, one job each
+	int numberOfTiles = static_cast<int>(mBins.size());
+
+	if (mJobSystem != NULL && binned >= minTrianglesPerJob)
+	{
+		mJobSystem->parallelFor(numberOfTiles, 1, [this](int begin, int end)
+		{
+			for (int tile = begin; tile < end; tile++)
+				rasterizeTile(tile);
+		});
+	}
+	else
+	{
+		for (int tile = 0; tile < numberOfTiles; tile++)
+			rasterizeTile(tile);
+	}
+
+	mStats.rasterTime = static_cast<float>(elapsed_ms(start));
+}
+
+void OcclusionCuller::rasterizeTile(int tile)
+{
+	int tileX0 = (tile % OCCLUSION_TILES_X) * OCCLUSION_TILE_WIDTH;
+	int tileY0 = (tile / OCCLUSION_TILES_X) * OCCLUSION_TILE_HEIGHT;
+	int tileX1 = tileX0 + OCCLUSION_TILE_WIDTH - 1;
+	int tileY1 = tileY0 + OCCLUSION_TILE_HEIGHT - 1;
+
+	for (int y = tileY0; y <= tileY1; y++)
+		fill(mDepth.begin() + y * OCCLUSION_WIDTH + tileX0, mDepth.begin() + y * OCCLUSION_WIDTH + tileX1 + 1, 1.0f);
+
+	const vector<int>& bin = mBins[tile];
+
+	for (size_t i = 0; i < bin.size(); i++)
+	{
+		const RasterTriangle& triangle = mTriangles[bin[i]];
+
+		// the span starts on a multiple of 8 and stays inside the tile
+		int x0 = max(triangle.minX, tileX0) & ~7;
+		int x1 = min(triangle.maxX, tileX1) & ~7;
+		int y0 = max(triangle.minY, tileY0);
+		int y1 = min(triangle.maxY, tileY1);
+
+		if (mSimd)
+			rasterize_span_avx2(&mDepth[0], triangle.edgeA, triangle.edgeB, triangle.edgeC,
+				triangle.depthA, triangle.depthB, triangle.depthC, x0, x1, y0, y1);
+		else
+			rasterize_span_scalar(&mDepth[0], triangle.edgeA, triangle.edgeB, triangle.edgeC,
+				triangle.depthA, triangle.depthB, triangle.depthC, x0, x1, y0, y1);
+	}
+}
+
+// the test itself, only reads the depth buffer so any number of threads can run it
+bool OcclusionCuller::testBounds(const AABB& bounds) const
+{
+	float minX = 1e30f, maxX = -1e30f, minY = 1e30f, maxY = -1e30f;
+	float minDepth = 1.0f;
+	bool visible = false;
+	bool decided = false;
+
+	for (int c = 0; c < 8 && !decided; c++)
+	{
+		glm::vec3 corner((c & 1) ? bounds.max.x : bounds.min.x, (c & 2) ? bounds.max.y : bounds.min.y, (c & 4) ? bounds.max.z : bounds.min.z);
+		glm::vec4 clip = mViewProjection * glm::vec4(corner, 1.0f);
+
+		// a box crossing the near plane cannot be tested conservatively
+		if (clip.z < -clip.w || clip.w <= 0.0f)
+		{
+			visible = decided = true;
+			break;
+		}
+
+		float x = (clip.x / clip.w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		float y = (clip.y / clip.w * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+		minX = min(minX, x);
+		maxX = max(maxX, x);
+		minY = min(minY, y);
+		maxY = max(maxY, y);
+		minDepth = min(minDepth, clip.z / clip.w * 0.5f + 0.5f);
+	}
+
+	if (!decided)
+	{
+		// every pixel the box touches, not just the ones whose centres it covers
+		int x0 = max(0, static_cast<int>(floor(minX)));
+		int x1 = min(OCCLUSION_WIDTH - 1, static_cast<int>(floor(maxX)));
+		int y0 = max(0, static_cast<int>(floor(minY)));
+		int y1 = min(OCCLUSION_HEIGHT - 1, static_cast<int>(floor(maxY)));
+
+		if (x0 <= x1 && y0 <= y1)
+			visible = mSimd ? test_rect_avx2(&mDepth[0], x0, x1, y0, y1, minDepth) : test_rect_scalar(&mDepth[0], x0, x1, y0, y1, minDepth);
+	}
+
+	return visible;
+}
+
+bool OcclusionCuller::isVisible(const AABB& bounds)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	bool visible = testBounds(bounds);
+
+	mStats.testedObjects++;
+	if (!visible)
+		mStats.culledObjects++;
+	mStats.testTime += static_cast<float>(elapsed_ms(start));
+
+	return visible;
+}
+
+// many boxes at once, spread over jobs; visible[i] is set to 1 if box i may be seen, 0 if it is hidden
+void OcclusionCuller::testVisibility(const AABB* bounds, int count, unsigned char* visible)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+	auto test = [this, bounds, visible](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+			visible[i] = testBounds(bounds[i]) ? 1 : 0;
+	};
+
+	if (mJobSystem != NULL && count >= minBoxesPerJob)
+		mJobSystem->parallelFor(count, minBoxesPerJob, test);
+	else
+		test(0, count);
+
+	for (int i = 0; i < count; i++)
+	{
+		if (!visible[i])
+			mStats.culledObjects++;
+	}
+
+	mStats.testedObjects += count;
+	mStats.testTime += static_cast<float>(elapsed_ms(start));
+}
+
+const OcclusionStats& OcclusionCuller::getStats() const
+{
+	return mStats;
+}
+
+const float* OcclusionCuller::getDepthBuffer() const
+{
+	return &mDepth[0];
+}
+
+bool OcclusionCuller::isSimd() const
+{
+	return mSimd;
+}
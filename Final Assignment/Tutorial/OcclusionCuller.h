@@ -0,0 +1,78 @@
+#ifndef __OCCLUSION_CULLER_H
+#define __OCCLUSION_CULLER_H
+
+#include <vector>
+
+#include <GLEW/glew.h>	// include GLEW
+#include <glm/glm.hpp>	// include GLM (ideally should only use the GLM headers that are actually used)
+
+#include "mesh.h"
+#include "culling.h"
+#include "JobSystem.h"
+
+#define OCCLUSION_WIDTH 256			// depth buffer resolution, multiples of the tile size
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_TILE_WIDTH 64		// multiple of 8, one AVX2 register covers 8 pixels of a row
+#define OCCLUSION_TILE_HEIGHT 32
+
+// counters for the last frame
+typedef struct OcclusionStats
+{
+	int occluderTriangles;		// triangles submitted as occluders
+	int rasterizedTriangles;	// triangles left after near-plane clipping
+	int testedObjects;			// bounding boxes tested against the depth buffer
+	int culledObjects;			// bounding boxes found to be hidden
+	float rasterTime;			// milliseconds spent rasterising occluders
+	float testTime;				// milliseconds spent testing bounding boxes
+} OcclusionStats;
+
+// CPU occlusion culling against a low-resolution depth buffer
+// occluders are rasterised into screen tiles, one job per tile, 8 pixels at a time with AVX2
+// when the CPU supports it; objects are then tested by the nearest depth of their screen-space bounds
+class OcclusionCuller {
+public:
+	OcclusionCuller();
+	~OcclusionCuller();
+
+	void init(JobSystem* jobSystem = NULL);
+	int addOccluderMesh(const Vertex* vertices, GLint numberOfVertices, const GLint* indices, GLint numberOfFaces);
+	void beginFrame(const glm::mat4& viewProjection);
+	void keepFrame();
+	void addOccluder(int mesh, const glm::mat4& modelMatrix);
+	void rasterize();
+	bool isVisible(const AABB& bounds);
+	void testVisibility(const AABB* bounds, int count, unsigned char* visible);
+	const OcclusionStats& getStats() const;
+	const float* getDepthBuffer() const;
+	bool isSimd() const;
+
+private:
+	// screen-space triangle ready for rasterisation, inside where all three edge functions are >= 0
+	typedef struct RasterTriangle
+	{
+		float edgeA[3], edgeB[3], edgeC[3];		// edge function = A * x + B * y + C
+		float depthA, depthB, depthC;			// depth plane = A * x + B * y + C
+		int minX, maxX, minY, maxY;				// pixel bounds
+	} RasterTriangle;
+
+	typedef struct OccluderMesh
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<GLint> indices;
+	} OccluderMesh;
+
+	void setupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2);
+	void rasterizeTile(int tile);
+	bool testBounds(const AABB& bounds) const;
+
+	std::vector<OccluderMesh> mMeshes;
+	std::vector<RasterTriangle> mTriangles;
+	std::vector<std::vector<int> > mBins;		// triangles overlapping each tile
+	std::vector<float> mDepth;					// 0 = near plane, 1 = far plane
+	glm::mat4 mViewProjection;
+	JobSystem* mJobSystem;
+	bool mSimd;									// AVX2 is available
+	OcclusionStats mStats;
+};
+
+#endif
@@ -0,0 +1,208 @@
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#include <glm/gtx/transform.hpp>
+
+#include "PlanarReflection.h"
+#include "ResourceTracker.h"
+
+glm::mat4 reflection_matrix(const glm::vec4& plane)
+{
+	glm::vec3 n = glm::vec3(plane);
+	glm::mat4 matrix(1.0f);
+
+	// I - 2nn^T, then move back by twice the plane distance
+	for (int column = 0; column < 3; column++)
+	{
+		for (int row = 0; row < 3; row++)
+			matrix[column][row] -= 2.0f * n[row] * n[column];
+	}
+
+	matrix[3] = glm::vec4(-2.0f * plane.w * n, 1.0f);
+	return matrix;
+}
+
+glm::mat4 oblique_projection(const glm::mat4& projection, const glm::vec4& clipPlane)
+{
+	glm::mat4 result = projection;
+
+	// view-space corner of the frustum opposite the clip plane
+	glm::vec4 q;
+	q.x = ((clipPlane.x > 0.0f ? 1.0f : (clipPlane.x < 0.0f ? -1.0f : 0.0f)) + projection[2][0]) / projection[0][0];
+	q.y = ((clipPlane.y > 0.0f ? 1.0f : (clipPlane.y < 0.0f ? -1.0f : 0.0f)) + projection[2][1]) / projection[1][1];
+	q.z = -1.0f;
+	q.w = (1.0f + projection[2][2]) / projection[3][2];
+
+	// the third row becomes the scaled plane minus the fourth row, so near = row 3 + row 4 = plane
+	glm::vec4 c = clipPlane * (2.0f / glm::dot(clipPlane, q));
+	for (int column = 0; column < 4; column++)
+		result[column][2] = c[column] - projection[column][3];
+
+	return result;
+}
+
+PlanarReflection::PlanarReflection()
+{
+	mFramebuffer = 0;
+	mColorTexture = 0;
+	mDepthBuffer = 0;
+	mResource = 0;
+	mWidth = 0;
+	mHeight = 0;
+	mFramesSinceUpdate = 0;
+	mValid = false;
+	mViewMatrix = glm::mat4(1.0f);
+	mProjectionMatrix = glm::mat4(1.0f);
+	mTextureMatrix = glm::mat4(1.0f);
+}
+
+PlanarReflection::~PlanarReflection()
+{
+}
+
+void PlanarReflection::init(GLuint windowWidth, GLuint windowHeight, float scale)
+{
+	glGenFramebuffers(1, &mFramebuffer);
+	glGenTextures(1, &mColorTexture);
+	glGenRenderbuffers(1, &mDepthBuffer);
+
+	resize(windowWidth, windowHeight, scale);
+}
+
+void PlanarReflection::destroy()
+{
+	glDeleteFramebuffers(1, &mFramebuffer);
+	glDeleteTextures(1, &mColorTexture);
+	glDeleteRenderbuffers(1, &mDepthBuffer);
+
+	mFramebuffer = 0;
+	mColorTexture = 0;
+	mDepthBuffer = 0;
+	mValid = false;
+
+	untrack_resource(mResource);
+	mResource = 0;
+	mWidth = mHeight = 0;
+}
+
+// reallocate the render target when the scaled size changes, returns true if it did
+bool PlanarReflection::resize(GLuint windowWidth, GLuint windowHeight, float scale)
+{
+	GLuint width = max(1u, static_cast<GLuint>(windowWidth * scale));
+	GLuint height = max(1u, static_cast<GLuint>(windowHeight * scale));
+
+	if (width == mWidth && height == mHeight)
+		return false;
+
+	mWidth = width;
+	mHeight = height;
+	mValid = false;
+
+	glBindTexture(GL_TEXTURE_2D, mColorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, mWidth, mHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mWidth, mHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	untrack_resource(mResource);
+	mResource = track_resource("Planar reflection", RESOURCE_RENDER_TARGET, static_cast<size_t>(mWidth) * mHeight * (4 + 4));
+
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mColorTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		cerr << "Reflection framebuffer incomplete" << endl;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return true;
+}
+
+// count a frame, true if the reflection should be rendered in it
+bool PlanarReflection::isDue(int interval)
+{
+	mFramesSinceUpdate++;
+	return !mValid || mFramesSinceUpdate >= max(interval, 1);
+}
+
+// mirror the camera about a world-space plane, facing whichever side the camera is on
+void PlanarReflection::setView(const glm::vec4& plane, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
+{
+	glm::vec3 cameraPosition = glm::vec3(glm::inverse(viewMatrix)[3]);
+	glm::vec4 facingPlane = plane;
+
+	if (glm::dot(glm::vec3(plane), cameraPosition) + plane.w < 0.0f)
+		facingPlane = -plane;
+
+	mViewMatrix = viewMatrix * reflection_matrix(facingPlane);
+
+	// the mirrored camera is behind the plane, clip everything that was behind the mirror
+	glm::vec4 clipPlane = glm::transpose(glm::inverse(mViewMatrix)) * facingPlane;
+	mProjectionMatrix = oblique_projection(projectionMatrix, clipPlane);
+
+	// x, y and w of the oblique projection are unchanged, so a point on the mirror lands on the same pixel
+	// of the reflection as it does on screen
+	glm::mat4 bias = glm::translate(glm::vec3(0.5f)) * glm::scale(glm::vec3(0.5f));
+	mTextureMatrix = bias * projectionMatrix * viewMatrix;
+
+	mFramesSinceUpdate = 0;
+	mValid = true;
+}
+
+void PlanarReflection::bind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glViewport(0, 0, mWidth, mHeight);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void PlanarReflection::unbind(GLuint windowWidth, GLuint windowHeight)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, windowWidth, windowHeight);
+}
+
+// render again at the next opportunity
+void PlanarReflection::invalidate()
+{
+	mValid = false;
+}
+
+glm::mat4 PlanarReflection::getViewMatrix() const
+{
+	return mViewMatrix;
+}
+
+glm::mat4 PlanarReflection::getProjectionMatrix() const
+{
+	return mProjectionMatrix;
+}
+
+// eye space of a view to texture coordinates of the last reflection, divide by w after transforming
+glm::mat4 PlanarReflection::getTextureMatrix(const glm::mat4& viewMatrix) const
+{
+	return mTextureMatrix * glm::inverse(viewMatrix);
+}
+
+GLuint PlanarReflection::getTexture() const
+{
+	return mColorTexture;
+}
+
+GLuint PlanarReflection::getWidth() const
+{
+	return mWidth;
+}
+
+GLuint PlanarReflection::getHeight() const
+{
+	return mHeight;
+}
@@ -0,0 +1,53 @@
+#ifndef __PLANAR_REFLECTION_H
+#define __PLANAR_REFLECTION_H
+
+#include <GLEW/glew.h>	// include GLEW
+#include <glm/glm.hpp>	// include GLM (ideally should only use the GLM headers that are actually used)
+
+// matrix mirroring points about a plane, plane = (normal, d) with a unit normal
+glm::mat4 reflection_matrix(const glm::vec4& plane);
+
+// replace the near plane of a perspective projection with a view-space clip plane (Lengyel's oblique frustum)
+// the camera must be on the negative side of the plane, everything on the negative side is clipped
+glm::mat4 oblique_projection(const glm::mat4& projection, const glm::vec4& clipPlane);
+
+// offscreen render target for the reflection in a planar mirror
+// the reflection is rendered at a fraction of the window resolution and only every few frames; in between,
+// the mirror keeps sampling the last reflection through the camera it was rendered with, so it stays
+// attached to the mirror surface while the camera moves
+class PlanarReflection {
+public:
+	PlanarReflection();
+	~PlanarReflection();
+
+	void init(GLuint windowWidth, GLuint windowHeight, float scale);
+	void destroy();
+	bool resize(GLuint windowWidth, GLuint windowHeight, float scale);
+	bool isDue(int interval);
+	void setView(const glm::vec4& plane, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+	void bind();
+	void unbind(GLuint windowWidth, GLuint windowHeight);
+	void invalidate();
+
+	glm::mat4 getViewMatrix() const;
+	glm::mat4 getProjectionMatrix() const;
+	glm::mat4 getTextureMatrix(const glm::mat4& viewMatrix) const;
+	GLuint getTexture() const;
+	GLuint getWidth() const;
+	GLuint getHeight() const;
+
+private:
+	GLuint mFramebuffer;
+	GLuint mColorTexture;
+	GLuint mDepthBuffer;
+	int mResource;				// tracked size of the texture and depth buffer
+	GLuint mWidth;
+	GLuint mHeight;
+	int mFramesSinceUpdate;			// frames since the reflection was last rendered
+	bool mValid;					// the texture holds a reflection
+	glm::mat4 mViewMatrix;			// mirrored camera
+	glm::mat4 mProjectionMatrix;	// near plane on the mirror
+	glm::mat4 mTextureMatrix;		// world space to texture coordinates of the last reflection
+};
+
+#endif
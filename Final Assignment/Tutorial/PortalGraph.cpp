@@ -0,0 +1,242 @@
+#include <algorithm>
+using namespace std;
+
+#include "PortalGraph.h"
+
+static const ScreenRect fullScreen = { -1.0f, -1.0f, 1.0f, 1.0f };
+
+static bool rect_empty(const ScreenRect& rect)
+{
+	return rect.minX >= rect.maxX || rect.minY >= rect.maxY;
+}
+
+static bool rect_contains(const ScreenRect& outer, const ScreenRect& inner)
+{
+	return inner.minX >= outer.minX && inner.maxX <= outer.maxX && inner.minY >= outer.minY && inner.maxY <= outer.maxY;
+}
+
+static ScreenRect rect_intersection(const ScreenRect& a, const ScreenRect& b)
+{
+	ScreenRect result = { max(a.minX, b.minX), max(a.minY, b.minY), min(a.maxX, b.maxX), min(a.maxY, b.maxY) };
+	return result;
+}
+
+static ScreenRect rect_union(const ScreenRect& a, const ScreenRect& b)
+{
+	ScreenRect result = { min(a.minX, b.minX), min(a.minY, b.minY), max(a.maxX, b.maxX), max(a.maxY, b.maxY) };
+	return result;
+}
+
+static bool aabb_overlap(const AABB& a, const AABB& b)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		if (a.min[i] > b.max[i] || b.min[i] > a.max[i])
+			return false;
+	}
+
+	return true;
+}
+
+PortalGraph::PortalGraph()
+{
+	mViewProjection = glm::mat4(1.0f);
+	mStats.cameraCell = -1;
+	mStats.visibleCells = 0;
+	mStats.traversedPortals = 0;
+}
+
+void PortalGraph::clear()
+{
+	mCells.clear();
+	mPortals.clear();
+	mObjectCells.clear();
+	mStats.cameraCell = -1;
+}
+
+int PortalGraph::addCell(const AABB& bounds)
+{
+	Cell cell;
+	cell.bounds = bounds;
+	cell.onPath = false;
+
+	mCells.push_back(cell);
+	return static_cast<int>(mCells.size() - 1);
+}
+
+// the polygon is a convex outline of the opening, in world space and in either winding
+int PortalGraph::addPortal(int cellA, int cellB, const vector<glm::vec3>& polygon)
+{
+	Portal portal;
+	portal.cells[0] = cellA;
+	portal.cells[1] = cellB;
+	portal.polygon = polygon;
+
+	int index = static_cast<int>(mPortals.size());
+	mPortals.push_back(portal);
+	mCells[cellA].portals.push_back(index);
+	mCells[cellB].portals.push_back(index);
+
+	return index;
+}
+
+// register an object in every cell its bounds overlap
+// objects that are never registered, or overlap no cell, are treated as always visible
+void PortalGraph::addObject(int object, const AABB& bounds)
+{
+	if (object >= static_cast<int>(mObjectCells.size()))
+		mObjectCells.resize(object + 1);
+
+	mObjectCells[object].clear();
+
+	for (size_t i = 0; i < mCells.size(); i++)
+	{
+		if (aabb_overlap(bounds, mCells[i].bounds))
+			mObjectCells[object].push_back(static_cast<int>(i));
+	}
+}
+
+int PortalGraph::findCell(const glm::vec3& position) const
+{
+	for (size_t i = 0; i < mCells.size(); i++)
+	{
+		const AABB& bounds = mCells[i].bounds;
+
+		if (position.x >= bounds.min.x && position.y >= bounds.min.y && position.z >= bounds.min.z &&
+			position.x <= bounds.max.x && position.y <= bounds.max.y && position.z <= bounds.max.z)
+			return static_cast<int>(i);
+	}
+
+	return -1;
+}
+
+void PortalGraph::update(const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
+{
+	mViewProjection = viewProjection;
+	mStats.visibleCells = 0;
+	mStats.traversedPortals = 0;
+
+	for (size_t i = 0; i < mCells.size(); i++)
+	{
+		mCells[i].views.clear();
+		mCells[i].onPath = false;
+	}
+
+	// outside every cell nothing can be ruled out
+	mStats.cameraCell = findCell(cameraPosition);
+	if (mStats.cameraCell < 0)
+		return;
+
+	visitCell(mStats.cameraCell, fullScreen, 0);
+
+	for (size_t i = 0; i < mCells.size(); i++)
+	{
+		if (!mCells[i].views.empty())
+			mStats.visibleCells++;
+	}
+}
+
+// test an object against the views of the cells it is in
+// rect receives the union of the screen rectangles it can be seen through, usable as a scissor
+bool PortalGraph::isVisible(int object, const AABB& bounds, ScreenRect* rect) const
+{
+	if (mStats.cameraCell < 0 || object >= static_cast<int>(mObjectCells.size()) || mObjectCells[object].empty())
+	{
+		*rect = fullScreen;
+		return true;
+	}
+
+	const vector<int>& cells = mObjectCells[object];
+	bool visible = false;
+
+	for (size_t i = 0; i < cells.size(); i++)
+	{
+		const vector<CellView>& views = mCells[cells[i]].views;
+
+		for (size_t j = 0; j < views.size(); j++)
+		{
+			if (!aabb_in_frustum(bounds, views[j].planes))
+				continue;
+
+			*rect = visible ? rect_union(*rect, views[j].rect) : views[j].rect;
+			visible = true;
+		}
+	}
+
+	return visible;
+}
+
+bool PortalGraph::isCellVisible(int cell) const
+{
+	return mStats.cameraCell < 0 || !mCells[cell].views.empty();
+}
+
+const PortalStats& PortalGraph::getStats() const
+{
+	return mStats;
+}
+
+// follow every portal of a cell that shows up inside the rectangle the cell is seen through
+void PortalGraph::visitCell(int cell, const ScreenRect& rect, int depth)
+{
+	// nothing new if the cell was already reached through a larger opening
+	if (!addView(cell, rect) || depth >= PORTAL_MAX_DEPTH)
+		return;
+
+	mCells[cell].onPath = true;
+
+	for (size_t i = 0; i < mCells[cell].portals.size(); i++)
+	{
+		const Portal& portal = mPortals[mCells[cell].portals[i]];
+		int next = portal.cells[0] == cell ? portal.cells[1] : portal.cells[0];
+
+		// never look back into a cell already on the chain
+		if (mCells[next].onPath)
+			continue;
+
+		ScreenRect portalRect;
+		if (!projectPortal(portal, &portalRect))
+			continue;
+
+		// the view shrinks to the part of the portal seen through the openings so far
+		portalRect = rect_intersection(portalRect, rect);
+		if (rect_empty(portalRect))
+			continue;
+
+		mStats.traversedPortals++;
+		visitCell(next, portalRect, depth + 1);
+	}
+
+	mCells[cell].onPath = false;
+}
+
+// returns false if an existing view of the cell already covers the rectangle
+bool PortalGraph::addView(int cell, const ScreenRect& rect)
+{
+	vector<CellView>& views = mCells[cell].views;
+
+	for (size_t i = 0; i < views.size(); i++)
+	{
+		if (rect_contains(views[i].rect, rect))
+			return false;
+	}
+
+	// past the limit the last view grows to cover the new one, which stays conservative
+	if (views.size() < PORTAL_MAX_VIEWS)
+	{
+		CellView view;
+		view.rect = rect;
+		views.push_back(view);
+	}
+	else
+		views.back().rect = rect_union(views.back().rect, rect);
+
+	extract_rect_planes(mViewProjection, views.back().rect, views.back().planes);
+	return true;
+}
+
+// screen bounds of a portal polygon after clipping it to the near plane, false if none of it is in front
+bool PortalGraph::projectPortal(const Portal& portal, ScreenRect* rect) const
+{
+	return project_polygon(mViewProjection, &portal.polygon[0], static_cast<int>(portal.polygon.size()), rect);
+}
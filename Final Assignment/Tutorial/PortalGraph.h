@@ -0,0 +1,73 @@
+#ifndef __PORTAL_GRAPH_H
+#define __PORTAL_GRAPH_H
+
+#include <vector>
+
+#include <glm/glm.hpp>	// include GLM (ideally should only use the GLM headers that are actually used)
+
+#include "culling.h"
+
+#define PORTAL_MAX_DEPTH 16			// longest chain of portals followed from the camera's cell
+#define PORTAL_MAX_VIEWS 4			// separate views kept per cell before they are merged into one
+
+// counters for the last update
+typedef struct PortalStats
+{
+	int cameraCell;			// cell containing the camera, -1 if it is outside every cell
+	int visibleCells;		// cells reached through at least one portal or containing the camera
+	int traversedPortals;	// portals the view was clipped through
+} PortalStats;
+
+// cell-and-portal visibility
+// rooms are cells, doors and glass panes are portals between two cells; each update the view is
+// clipped through every portal it can see, recursively, and a cell is only visible through the
+// screen rectangles of the portals that lead to it
+class PortalGraph {
+public:
+	PortalGraph();
+
+	void clear();
+	int addCell(const AABB& bounds);
+	int addPortal(int cellA, int cellB, const std::vector<glm::vec3>& polygon);
+	void addObject(int object, const AABB& bounds);
+	int findCell(const glm::vec3& position) const;
+
+	void update(const glm::mat4& viewProjection, const glm::vec3& cameraPosition);
+	bool isVisible(int object, const AABB& bounds, ScreenRect* rect) const;
+	bool isCellVisible(int cell) const;
+	const PortalStats& getStats() const;
+
+private:
+	// part of the frustum seen through a chain of portals
+	typedef struct CellView
+	{
+		ScreenRect rect;
+		glm::vec4 planes[6];
+	} CellView;
+
+	typedef struct Cell
+	{
+		AABB bounds;
+		std::vector<int> portals;
+		std::vector<CellView> views;	// empty when the cell is not visible
+		bool onPath;					// cell is on the chain currently being followed
+	} Cell;
+
+	typedef struct Portal
+	{
+		int cells[2];
+		std::vector<glm::vec3> polygon;
+	} Portal;
+
+	void visitCell(int cell, const ScreenRect& rect, int depth);
+	bool addView(int cell, const ScreenRect& rect);
+	bool projectPortal(const Portal& portal, ScreenRect* rect) const;
+
+	std::vector<Cell> mCells;
+	std::vector<Portal> mPortals;
+	std::vector<std::vector<int> > mObjectCells;	// cells overlapped by each object, empty if not registered
+	glm::mat4 mViewProjection;
+	PortalStats mStats;
+};
+
+#endif
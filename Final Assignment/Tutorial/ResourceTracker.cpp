@@ -0,0 +1,200 @@
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <iomanip>
+#include <cstring>
+using namespace std;
+
+#include "ResourceTracker.h"
+
+static const char* categoryNames[NUMBER_OF_RESOURCE_CATEGORIES] = { "Texture", "Mip", "Render target", "Vertex", "Index",
+	"Uniform", "CPU staging" };
+
+// one tracked resource, its slot is reused once it is untracked
+typedef struct ResourceRecord
+{
+	char name[RESOURCE_NAME_LENGTH];
+	int category;
+	size_t bytes;
+	int mips;			// handle of the rest of a texture's mip chain, 0 if it has none
+	bool live;
+	bool uploaded;		// a CPU copy the GPU has
+} ResourceRecord;
+
+static mutex g_resourceMutex;
+static vector<ResourceRecord> g_resources;		// handle - 1
+static vector<int> g_freeResources;
+static ResourceStats g_resourceStats[NUMBER_OF_RESOURCE_CATEGORIES];
+
+static bool larger_resource(const ResourceRecord* a, const ResourceRecord* b)
+{
+	return a->bytes > b->bytes;
+}
+
+static int add_record(const char* name, int category, size_t bytes)
+{
+	ResourceRecord record;
+	strncpy(record.name, name, RESOURCE_NAME_LENGTH - 1);
+	record.name[RESOURCE_NAME_LENGTH - 1] = '\0';
+	record.category = category;
+	record.bytes = bytes;
+	record.mips = 0;
+	record.live = true;
+	record.uploaded = false;
+
+	ResourceStats& stats = g_resourceStats[category];
+	stats.bytes += bytes;
+	stats.peakBytes = max(stats.peakBytes, stats.bytes);
+	stats.resources++;
+
+	if (!g_freeResources.empty())
+	{
+		int handle = g_freeResources.back();
+		g_freeResources.pop_back();
+		g_resources[handle - 1] = record;
+		return handle;
+	}
+
+	g_resources.push_back(record);
+	return static_cast<int>(g_resources.size());
+}
+
+static void remove_record(int handle)
+{
+	if (handle <= 0 || handle > static_cast<int>(g_resources.size()))
+		return;
+
+	ResourceRecord& record = g_resources[handle - 1];
+
+	if (!record.live)
+		return;
+
+	ResourceStats& stats = g_resourceStats[record.category];
+	stats.bytes -= record.bytes;
+	stats.resources--;
+
+	record.live = false;
+	g_freeResources.push_back(handle);
+
+	remove_record(record.mips);
+}
+
+int track_resource(const char* name, int category, size_t bytes)
+{
+	lock_guard<mutex> lock(g_resourceMutex);
+	return add_record(name, category, bytes);
+}
+
+void untrack_resource(int handle)
+{
+	lock_guard<mutex> lock(g_resourceMutex);
+	remove_record(handle);
+}
+
+int track_texture(const char* name, int category, GLsizei width, GLsizei height, GLsizei layers, size_t bytesPerTexel, int levels)
+{
+	size_t levelBytes = static_cast<size_t>(width) * height * layers * bytesPerTexel;
+	size_t mipBytes = 0;
+
+	// the levels after the first, down to 1x1 at most
+	for (int level = 1; (levels == 0 || level < levels) && (width > 1 || height > 1); level++)
+	{
+		width = max(width / 2, 1);
+		height = max(height / 2, 1);
+		mipBytes += static_cast<size_t>(width) * height * layers * bytesPerTexel;
+	}
+
+	lock_guard<mutex> lock(g_resourceMutex);
+	int handle = add_record(name, category, levelBytes);
+
+	if (mipBytes > 0)
+	{
+		int mips = add_record(name, RESOURCE_MIP, mipBytes);
+		g_resources[handle - 1].mips = mips;
+	}
+
+	return handle;
+}
+
+void mark_uploaded(int handle)
+{
+	lock_guard<mutex> lock(g_resourceMutex);
+
+	if (handle > 0 && handle <= static_cast<int>(g_resources.size()))
+		g_resources[handle - 1].uploaded = true;
+}
+
+ResourceStats get_resource_stats(int category)
+{
+	lock_guard<mutex> lock(g_resourceMutex);
+	return g_resourceStats[category];
+}
+
+const char* get_resource_category_name(int category)
+{
+	return categoryNames[category];
+}
+
+int get_resident_copies(size_t* bytes)
+{
+	lock_guard<mutex> lock(g_resourceMutex);
+	int count = 0;
+	*bytes = 0;
+
+	for (size_t i = 0; i < g_resources.size(); i++)
+	{
+		if (g_resources[i].live && g_resources[i].uploaded)
+		{
+			count++;
+			*bytes += g_resources[i].bytes;
+		}
+	}
+
+	return count;
+}
+
+void report_resources(ostream& stream)
+{
+	lock_guard<mutex> lock(g_resourceMutex);
+
+	size_t gpuBytes = 0;
+	size_t cpuBytes = 0;
+
+	ios::fmtflags flags = stream.flags();
+	streamsize precision = stream.precision();
+	stream << fixed << setprecision(1);
+	stream << "Resources (KB)" << endl;
+
+	for (int i = 0; i < NUMBER_OF_RESOURCE_CATEGORIES; i++)
+	{
+		const ResourceStats& stats = g_resourceStats[i];
+		stream << "  " << left << setw(16) << categoryNames[i] << right << setw(12) << stats.bytes / 1024.0
+			<< "  peak " << setw(12) << stats.peakBytes / 1024.0 << "  " << stats.resources << endl;
+
+		if (i == RESOURCE_CPU_STAGING)
+			cpuBytes += stats.bytes;
+		else
+			gpuBytes += stats.bytes;
+	}
+
+	stream << "  GPU " << gpuBytes / 1024.0 << ", CPU " << cpuBytes / 1024.0 << endl;
+
+	vector<const ResourceRecord*> live;
+	for (size_t i = 0; i < g_resources.size(); i++)
+	{
+		if (g_resources[i].live)
+			live.push_back(&g_resources[i]);
+	}
+
+	sort(live.begin(), live.end(), larger_resource);
+
+	for (size_t i = 0; i < live.size(); i++)
+	{
+		const ResourceRecord& record = *live[i];
+		stream << "  " << setw(12) << record.bytes / 1024.0 << "  " << left << setw(16) << categoryNames[record.category]
+			<< right << record.name << (record.uploaded ? "  (still on the CPU after upload)" : "") << endl;
+	}
+
+	stream.flags(flags);
+	stream.precision(precision);
+}
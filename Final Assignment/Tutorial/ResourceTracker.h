@@ -0,0 +1,56 @@
+#ifndef __RESOURCE_TRACKER_H
+#define __RESOURCE_TRACKER_H
+
+#include <cstddef>
+#include <ostream>
+
+#include <GLEW/glew.h>	// include GLEW
+
+#define RESOURCE_NAME_LENGTH 48		// characters of a resource's name kept, the rest is cut off
+
+// what a resource's bytes are spent on
+enum ResourceCategory
+{
+	RESOURCE_TEXTURE,			// the first level of sampled textures
+	RESOURCE_MIP,				// the rest of their mip chains
+	RESOURCE_RENDER_TARGET,		// textures and renderbuffers that are drawn into
+	RESOURCE_VERTEX,
+	RESOURCE_INDEX,
+	RESOURCE_UNIFORM,			// uniform, stream and texture buffers of shader data
+	RESOURCE_CPU_STAGING,		// CPU copies of data meant for the GPU
+	NUMBER_OF_RESOURCE_CATEGORIES
+};
+
+// totals of one category
+typedef struct ResourceStats
+{
+	size_t bytes;
+	size_t peakBytes;			// high-water mark since the start
+	int resources;
+} ResourceStats;
+
+// resources are recorded by name and category when they are created and dropped when they are destroyed;
+// the sizes are what the GL was asked for, what the driver actually uses may be a little more
+// a resource that is resized is untracked and tracked again; the calls are safe from any thread
+// handles are never 0, so 0 can stand for a resource that is not tracked;
+// once untracked a handle may be given to another resource, so it must not be used again
+int track_resource(const char* name, int category, size_t bytes);
+void untrack_resource(int handle);
+
+// a texture's first level under the category, and its other levels, if it has any, as a second resource
+// under RESOURCE_MIP that goes with it; layers are cube faces or array slices, levels 0 is the whole chain
+int track_texture(const char* name, int category, GLsizei width, GLsizei height, GLsizei layers, size_t bytesPerTexel, int levels);
+
+// a CPU staging copy whose data the GPU now has; until it is untracked it is reported as still resident
+void mark_uploaded(int handle);
+
+ResourceStats get_resource_stats(int category);
+const char* get_resource_category_name(int category);
+
+// CPU copies still held after their upload, and their bytes
+int get_resident_copies(size_t* bytes);
+
+// the totals and high-water marks, then every resource largest first, with the resident copies flagged
+void report_resources(std::ostream& stream);
+
+#endif
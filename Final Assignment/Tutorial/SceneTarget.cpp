@@ -0,0 +1,84 @@
+#include <iostream>
+using namespace std;
+
+#include "SceneTarget.h"
+#include "ResourceTracker.h"
+
+SceneTarget::SceneTarget()
+{
+	mFramebuffer = 0;
+	mColorBuffer = 0;
+	mDepthBuffer = 0;
+	mResource = 0;
+	mWidth = 0;
+	mHeight = 0;
+}
+
+SceneTarget::~SceneTarget()
+{
+}
+
+void SceneTarget::init(GLuint width, GLuint height)
+{
+	mWidth = width;
+	mHeight = height;
+
+	glGenFramebuffers(1, &mFramebuffer);
+	glGenRenderbuffers(1, &mColorBuffer);
+	glGenRenderbuffers(1, &mDepthBuffer);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, mColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, mWidth, mHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, mWidth, mHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	mResource = track_resource("Scene target", RESOURCE_RENDER_TARGET, static_cast<size_t>(mWidth) * mHeight * (4 + 4));
+
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		cerr << "Scene framebuffer incomplete" << endl;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void SceneTarget::destroy()
+{
+	glDeleteFramebuffers(1, &mFramebuffer);
+	glDeleteRenderbuffers(1, &mColorBuffer);
+	glDeleteRenderbuffers(1, &mDepthBuffer);
+
+	mFramebuffer = 0;
+	mColorBuffer = 0;
+	mDepthBuffer = 0;
+
+	untrack_resource(mResource);
+	mResource = 0;
+}
+
+// render into the corner the size of this frame's resolution
+void SceneTarget::bind(GLuint renderWidth, GLuint renderHeight)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glViewport(0, 0, renderWidth, renderHeight);
+}
+
+// stretch the rendered corner over the window, filtered unless it is already the window's size
+void SceneTarget::present(GLuint renderWidth, GLuint renderHeight, GLuint windowWidth, GLuint windowHeight)
+{
+	GLenum filter = (renderWidth == windowWidth && renderHeight == windowHeight) ? GL_NEAREST : GL_LINEAR;
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, mFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, filter);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, windowWidth, windowHeight);
+}
+
+GLuint SceneTarget::getFramebuffer() const
+{
+	return mFramebuffer;
+}
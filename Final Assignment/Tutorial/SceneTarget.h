@@ -0,0 +1,30 @@
+#ifndef __SCENE_TARGET_H
+#define __SCENE_TARGET_H
+
+#include <GLEW/glew.h>	// include GLEW
+
+// offscreen colour and depth the size of the window, the scene is rendered into its lower-left corner at
+// whatever resolution the frame can afford and then stretched over the window
+// the depth has the window's format, so passes that copy the depth can read it the same way
+class SceneTarget {
+public:
+	SceneTarget();
+	~SceneTarget();
+
+	void init(GLuint width, GLuint height);
+	void destroy();
+	void bind(GLuint renderWidth, GLuint renderHeight);
+	void present(GLuint renderWidth, GLuint renderHeight, GLuint windowWidth, GLuint windowHeight);
+
+	GLuint getFramebuffer() const;
+
+private:
+	GLuint mFramebuffer;
+	GLuint mColorBuffer;	// RGBA8
+	GLuint mDepthBuffer;	// 24-bit depth, 8-bit stencil
+	int mResource;			// tracked size of both buffers
+	GLuint mWidth;
+	GLuint mHeight;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+using namespace std;
+
+#include "ShadingBenchmark.h"
+#include "ResourceTracker.h"
+
+ShadingBenchmark::ShadingBenchmark()
+{
+	mFramebuffer = 0;
+	mColorBuffer = 0;
+	mDepthBuffer = 0;
+	mTimeQuery = 0;
+	mResource = 0;
+	mWidth = 0;
+	mHeight = 0;
+}
+
+ShadingBenchmark::~ShadingBenchmark()
+{
+}
+
+void ShadingBenchmark::init(GLuint width, GLuint height)
+{
+	mWidth = width;
+	mHeight = height;
+
+	glGenFramebuffers(1, &mFramebuffer);
+	glGenRenderbuffers(1, &mColorBuffer);
+	glGenRenderbuffers(1, &mDepthBuffer);
+	glGenQueries(1, &mTimeQuery);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, mColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, mWidth, mHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, mWidth, mHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	mResource = track_resource("Shading benchmark target", RESOURCE_RENDER_TARGET, static_cast<size_t>(mWidth) * mHeight * (4 + 4));
+
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		cerr << "Shading benchmark framebuffer incomplete" << endl;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ShadingBenchmark::destroy()
+{
+	glDeleteFramebuffers(1, &mFramebuffer);
+	glDeleteRenderbuffers(1, &mColorBuffer);
+	glDeleteRenderbuffers(1, &mDepthBuffer);
+	glDeleteQueries(1, &mTimeQuery);
+
+	mFramebuffer = 0;
+	mColorBuffer = 0;
+	mDepthBuffer = 0;
+	mTimeQuery = 0;
+	mWidth = 0;
+	mHeight = 0;
+
+	untrack_resource(mResource);
+	mResource = 0;
+
+	for (int i = 0; i < SHADING_BENCHMARK_IMAGES; i++)
+		vector<unsigned char>().swap(mImages[i]);
+}
+
+// render into the target from here on, timed until end
+void ShadingBenchmark::begin()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glViewport(0, 0, mWidth, mHeight);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+	glBeginQuery(GL_TIME_ELAPSED, mTimeQuery);
+}
+
+// back to the window, returns the GPU milliseconds since begin
+float ShadingBenchmark::end(GLuint windowWidth, GLuint windowHeight)
+{
+	glEndQuery(GL_TIME_ELAPSED);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, windowWidth, windowHeight);
+
+	// waits for the GPU to finish
+	GLuint64 nanoseconds = 0;
+	glGetQueryObjectui64v(mTimeQuery, GL_QUERY_RESULT, &nanoseconds);
+
+	return static_cast<float>(nanoseconds / 1.0e6);
+}
+
+// keep a copy of what was last rendered
+void ShadingBenchmark::capture(int image)
+{
+	mImages[image].resize(mWidth * mHeight * 4);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, mFramebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, &mImages[image][0]);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+ImageDifference ShadingBenchmark::compare(int first, int second) const
+{
+	ImageDifference difference = { 0.0f, 0.0f, 0.0f };
+	const vector<unsigned char>& a = mImages[first];
+	const vector<unsigned char>& b = mImages[second];
+
+	if (a.empty() || a.size() != b.size())
+		return difference;
+
+	size_t pixels = a.size() / 4;
+	double total = 0.0;
+	int largest = 0;
+	size_t differing = 0;
+
+	for (size_t i = 0; i < pixels; i++)
+	{
+		int error = 0;
+		for (int channel = 0; channel < 3; channel++)
+			error = max(error, abs(static_cast<int>(a[i * 4 + channel]) - static_cast<int>(b[i * 4 + channel])));
+
+		total += error;
+		largest = max(largest, error);
+
+		if (error > 2)
+			differing++;
+	}
+
+	difference.meanError = static_cast<float>(total / (pixels * 255.0));
+	difference.maxError = largest / 255.0f;
+	difference.differingPixels = static_cast<float>(100.0 * differing / pixels);
+
+	return difference;
+}
+
+GLuint ShadingBenchmark::getWidth() const
+{
+	return mWidth;
+}
+
+GLuint ShadingBenchmark::getHeight() const
+{
+	return mHeight;
+}
@@ -0,0 +1,48 @@
+#ifndef __SHADING_BENCHMARK_H
+#define __SHADING_BENCHMARK_H
+
+#include <vector>
+
+#include <GLEW/glew.h>	// include GLEW
+
+#define SHADING_BENCHMARK_WIDTH 3840	// 4K
+#define SHADING_BENCHMARK_HEIGHT 2160
+#define SHADING_BENCHMARK_IMAGES 2		// images kept for comparison, one per shading mode
+
+// how far apart two captured images are, per pixel the largest difference of any channel
+typedef struct ImageDifference
+{
+	float meanError;		// 0 to 1
+	float maxError;			// 0 to 1
+	float differingPixels;	// percentage of pixels more than 2/255 apart
+} ImageDifference;
+
+// offscreen target for timing a pass at a fixed, high resolution and comparing what it drew
+// timing waits for the GPU, so it is only meant for a benchmark run, never for every frame
+class ShadingBenchmark {
+public:
+	ShadingBenchmark();
+	~ShadingBenchmark();
+
+	void init(GLuint width, GLuint height);
+	void destroy();
+	void begin();
+	float end(GLuint windowWidth, GLuint windowHeight);
+	void capture(int image);
+	ImageDifference compare(int first, int second) const;
+
+	GLuint getWidth() const;
+	GLuint getHeight() const;
+
+private:
+	GLuint mFramebuffer;
+	GLuint mColorBuffer;		// RGBA8
+	GLuint mDepthBuffer;
+	int mResource;				// tracked size of both buffers
+	GLuint mTimeQuery;
+	GLuint mWidth;
+	GLuint mHeight;
+	std::vector<unsigned char> mImages[SHADING_BENCHMARK_IMAGES];
+};
+
+#endif
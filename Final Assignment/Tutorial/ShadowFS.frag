@@ -0,0 +1,16 @@
+#version 330 core
+
+// interpolated values from the vertex shaders
+in vec3 vPosition;
+
+// uniform input data
+uniform float uFarPlane;	// far plane of a point light's cube faces, 0 for directional cascades
+
+void main()
+{
+	// point lights store the distance to the light, the same in every face, so any direction can be compared
+	if(uFarPlane > 0.0f)
+		gl_FragDepth = length(vPosition) / uFarPlane;
+	else
+		gl_FragDepth = gl_FragCoord.z;
+}
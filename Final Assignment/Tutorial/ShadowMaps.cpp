@@ -0,0 +1,374 @@
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#include <glm/gtx/transform.hpp>
+
+#include "ShadowMaps.h"
+#include "CubeMapCapture.h"
+#include "ResourceTracker.h"
+
+static const float pointNearPlane = 0.05f;		// near plane of the cube faces
+static const float cascadeSplitBlend = 0.75f;	// 0 = evenly spaced cascades, 1 = logarithmic
+
+ShadowMaps::ShadowMaps()
+{
+	mType = SHADOW_NONE;
+	mSize = 0;
+	mNumberOfCascades = 0;
+	mFramebuffer = 0;
+	mCopyFramebuffer = 0;
+	mTexture = 0;
+	mCacheTexture = 0;
+	mResource = 0;
+	mLightPosition = glm::vec3(0.0f);
+	mFarPlane = 1.0f;
+	mLightDirection = glm::vec3(0.0f);
+
+	for (int i = 0; i < SHADOW_MAX_VIEWS; i++)
+	{
+		mCacheValid[i] = false;
+		mDynamicContent[i] = false;
+		mViewMatrices[i] = glm::mat4(1.0f);
+		mProjectionMatrices[i] = glm::mat4(1.0f);
+	}
+}
+
+ShadowMaps::~ShadowMaps()
+{
+}
+
+void ShadowMaps::init()
+{
+	glGenFramebuffers(1, &mFramebuffer);
+	glGenFramebuffers(1, &mCopyFramebuffer);
+
+	// depth only, neither framebuffer has a colour attachment
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, mCopyFramebuffer);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ShadowMaps::destroy()
+{
+	release();
+
+	glDeleteFramebuffers(1, &mFramebuffer);
+	glDeleteFramebuffers(1, &mCopyFramebuffer);
+
+	mFramebuffer = 0;
+	mCopyFramebuffer = 0;
+}
+
+void ShadowMaps::release()
+{
+	glDeleteTextures(1, &mTexture);
+	glDeleteTextures(1, &mCacheTexture);
+
+	mTexture = 0;
+	mCacheTexture = 0;
+	mType = SHADOW_NONE;
+
+	untrack_resource(mResource);
+	mResource = 0;
+}
+
+// only the maps for the current light type are kept, switching type or size reallocates them
+void ShadowMaps::create(ShadowType type, GLuint size, int numberOfCascades)
+{
+	release();
+
+	mType = type;
+	mSize = size;
+	mNumberOfCascades = numberOfCascades;
+
+	GLuint textures[2];
+	glGenTextures(2, textures);
+	mTexture = textures[0];
+	mCacheTexture = textures[1];
+
+	GLenum target = (type == SHADOW_POINT) ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D_ARRAY;
+	GLsizei layers = (type == SHADOW_POINT) ? CUBE_MAP_FACES : mNumberOfCascades;
+	mResource = track_resource("Shadow maps", RESOURCE_RENDER_TARGET, static_cast<size_t>(mSize) * mSize * layers * 4 * 2);
+
+	for (int i = 0; i < 2; i++)
+	{
+		glBindTexture(target, textures[i]);
+
+		if (type == SHADOW_POINT)
+		{
+			for (int face = 0; face < CUBE_MAP_FACES; face++)
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, mSize, mSize, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		}
+		else
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, mSize, mSize, mNumberOfCascades, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, 0);
+	}
+
+	// the sampled map compares in hardware, with bilinear filtering of the four results
+	glBindTexture(target, mTexture);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	glBindTexture(target, mCacheTexture);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+	glBindTexture(target, 0);
+
+	cout << "Shadow maps: " << (type == SHADOW_POINT ? "cube " : "cascades ") << mSize << " x " << mSize << endl;
+
+	invalidate();
+}
+
+void ShadowMaps::setPointLight(const glm::vec3& position, float farPlane, GLuint size)
+{
+	bool created = (mType != SHADOW_POINT || mSize != size);
+	if (created)
+		create(SHADOW_POINT, size, 0);
+
+	// the cascades share the view matrices, they are rebuilt after switching back
+	if (!created && position == mLightPosition && farPlane == mFarPlane)
+		return;
+
+	mLightPosition = position;
+	mFarPlane = farPlane;
+
+	glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, pointNearPlane, mFarPlane);
+
+	for (int face = 0; face < CUBE_MAP_FACES; face++)
+	{
+		mViewMatrices[face] = cube_face_view(mLightPosition, face);
+		mProjectionMatrices[face] = projection;
+	}
+
+	invalidate();
+}
+
+void ShadowMaps::setDirectionalLight(const glm::vec3& lightDirection, const glm::mat4& cameraView, const glm::mat4& cameraProjection,
+	float shadowDistance, const AABB& sceneBounds, GLuint size, int numberOfCascades)
+{
+	numberOfCascades = min(max(numberOfCascades, 1), SHADOW_MAX_CASCADES);
+	glm::vec3 direction = glm::normalize(lightDirection);
+
+	if (mType != SHADOW_DIRECTIONAL || mSize != size || mNumberOfCascades != numberOfCascades)
+		create(SHADOW_DIRECTIONAL, size, numberOfCascades);
+
+	if (direction != mLightDirection)
+	{
+		mLightDirection = direction;
+		invalidate();
+	}
+
+	// light space, looking along the light from the origin
+	glm::vec3 up = fabs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+	// depth range of the whole scene along the light, so casters outside the camera frustum still cast
+	float sceneNear = 1e30f, sceneFar = -1e30f;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner((i & 1) ? sceneBounds.max.x : sceneBounds.min.x, (i & 2) ? sceneBounds.max.y : sceneBounds.min.y,
+			(i & 4) ? sceneBounds.max.z : sceneBounds.min.z);
+		float z = (lightView * glm::vec4(corner, 1.0f)).z;
+		sceneNear = min(sceneNear, -z);
+		sceneFar = max(sceneFar, -z);
+	}
+
+	// the camera's near and far planes, and its frustum corners at both
+	float cameraNear = cameraProjection[3][2] / (cameraProjection[2][2] - 1.0f);
+	float cameraFar = cameraProjection[3][2] / (cameraProjection[2][2] + 1.0f);
+	float farDepth = min(shadowDistance, cameraFar);
+
+	glm::mat4 inverseViewProjection = glm::inverse(cameraProjection * cameraView);
+	glm::vec3 nearCorners[4], farCorners[4];
+
+	for (int i = 0; i < 4; i++)
+	{
+		float x = (i & 1) ? 1.0f : -1.0f;
+		float y = (i & 2) ? 1.0f : -1.0f;
+		glm::vec4 nearPoint = inverseViewProjection * glm::vec4(x, y, -1.0f, 1.0f);
+		glm::vec4 farPoint = inverseViewProjection * glm::vec4(x, y, 1.0f, 1.0f);
+		nearCorners[i] = glm::vec3(nearPoint) / nearPoint.w;
+		farCorners[i] = glm::vec3(farPoint) / farPoint.w;
+	}
+
+	float splitStart = cameraNear;
+
+	for (int cascade = 0; cascade < mNumberOfCascades; cascade++)
+	{
+		// blend of logarithmic and even splits
+		float fraction = static_cast<float>(cascade + 1) / mNumberOfCascades;
+		float logSplit = cameraNear * powf(farDepth / cameraNear, fraction);
+		float evenSplit = cameraNear + (farDepth - cameraNear) * fraction;
+		float splitEnd = cascadeSplitBlend * logSplit + (1.0f - cascadeSplitBlend) * evenSplit;
+
+		// corners of the slice, view depth is linear along each corner ray
+		glm::vec3 corners[8];
+		glm::vec3 center(0.0f);
+
+		for (int i = 0; i < 4; i++)
+		{
+			glm::vec3 ray = farCorners[i] - nearCorners[i];
+			corners[i] = nearCorners[i] + ray * ((splitStart - cameraNear) / (cameraFar - cameraNear));
+			corners[i + 4] = nearCorners[i] + ray * ((splitEnd - cameraNear) / (cameraFar - cameraNear));
+			center += corners[i] + corners[i + 4];
+		}
+
+		center /= 8.0f;
+
+		// a sphere does not change size as the camera turns, rounded up so float noise does not change it either
+		float radius = 0.0f;
+		for (int i = 0; i < 8; i++)
+			radius = max(radius, glm::length(corners[i] - center));
+		radius = ceilf(radius * 16.0f) / 16.0f;
+
+		// move the sphere in whole texels so static edges do not crawl
+		glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+		float texel = 2.0f * radius / mSize;
+		lightCenter.x = floorf(lightCenter.x / texel) * texel;
+		lightCenter.y = floorf(lightCenter.y / texel) * texel;
+
+		float nearPlane = min(sceneNear, -lightCenter.z - radius);
+		float farPlane = max(sceneFar, -lightCenter.z + radius);
+
+		glm::mat4 projection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius, lightCenter.y + radius,
+			nearPlane, farPlane);
+
+		if (projection != mProjectionMatrices[cascade] || lightView != mViewMatrices[cascade])
+		{
+			mViewMatrices[cascade] = lightView;
+			mProjectionMatrices[cascade] = projection;
+			mCacheValid[cascade] = false;
+		}
+
+		splitStart = splitEnd;
+	}
+}
+
+// decide what a view needs this frame; dynamicDue is false on frames the dynamic casters may lag behind
+int ShadowMaps::scheduleView(int view, bool dynamicCasters, bool dynamicDue)
+{
+	int updates = 0;
+
+	if (!mCacheValid[view])
+	{
+		updates |= SHADOW_UPDATE_STATIC;
+		mCacheValid[view] = true;
+	}
+
+	// views the dynamic casters have left still need one update to clear them out
+	if ((updates & SHADOW_UPDATE_STATIC) || (dynamicDue && (dynamicCasters || mDynamicContent[view])))
+	{
+		updates |= SHADOW_UPDATE_DYNAMIC;
+		mDynamicContent[view] = dynamicCasters;
+	}
+
+	return updates;
+}
+
+void ShadowMaps::attach(GLenum target, GLuint texture, int view)
+{
+	if (mType == SHADOW_POINT)
+		glFramebufferTexture2D(target, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + view, texture, 0);
+	else
+		glFramebufferTextureLayer(target, GL_DEPTH_ATTACHMENT, texture, 0, view);
+}
+
+// render the static casters into the cache
+void ShadowMaps::beginStatic(int view)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	attach(GL_FRAMEBUFFER, mCacheTexture, view);
+	glViewport(0, 0, mSize, mSize);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+// start the sampled map from the cache, then render the dynamic casters
+void ShadowMaps::beginDynamic(int view)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, mCopyFramebuffer);
+	attach(GL_READ_FRAMEBUFFER, mCacheTexture, view);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mFramebuffer);
+	attach(GL_DRAW_FRAMEBUFFER, mTexture, view);
+
+	glBlitFramebuffer(0, 0, mSize, mSize, 0, 0, mSize, mSize, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glViewport(0, 0, mSize, mSize);
+}
+
+void ShadowMaps::end(GLuint windowWidth, GLuint windowHeight)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, windowWidth, windowHeight);
+}
+
+// re-render the static casters of every view
+void ShadowMaps::invalidate()
+{
+	for (int i = 0; i < SHADOW_MAX_VIEWS; i++)
+		mCacheValid[i] = false;
+}
+
+ShadowType ShadowMaps::getType() const
+{
+	return mType;
+}
+
+int ShadowMaps::getNumberOfViews() const
+{
+	if (mType == SHADOW_POINT)
+		return CUBE_MAP_FACES;
+	if (mType == SHADOW_DIRECTIONAL)
+		return mNumberOfCascades;
+	return 0;
+}
+
+glm::mat4 ShadowMaps::getViewMatrix(int view) const
+{
+	return mViewMatrices[view];
+}
+
+glm::mat4 ShadowMaps::getProjectionMatrix(int view) const
+{
+	return mProjectionMatrices[view];
+}
+
+// eye space of a view to the cascade's texture coordinates and depth
+glm::mat4 ShadowMaps::getShadowMatrix(int cascade, const glm::mat4& viewMatrix) const
+{
+	glm::mat4 bias = glm::translate(glm::vec3(0.5f)) * glm::scale(glm::vec3(0.5f));
+	return bias * mProjectionMatrices[cascade] * mViewMatrices[cascade] * glm::inverse(viewMatrix);
+}
+
+float ShadowMaps::getFarPlane() const
+{
+	return mFarPlane;
+}
+
+GLuint ShadowMaps::getCubeTexture() const
+{
+	return mType == SHADOW_POINT ? mTexture : 0;
+}
+
+GLuint ShadowMaps::getCascadeTexture() const
+{
+	return mType == SHADOW_DIRECTIONAL ? mTexture : 0;
+}
+
+GLuint ShadowMaps::getSize() const
+{
+	return mSize;
+}
@@ -0,0 +1,77 @@
+#ifndef __SHADOW_MAPS_H
+#define __SHADOW_MAPS_H
+
+#include <GLEW/glew.h>	// include GLEW
+#include <glm/glm.hpp>	// include GLM (ideally should only use the GLM headers that are actually used)
+
+#include "culling.h"
+
+#define SHADOW_MAX_CASCADES 4		// cascades for a directional light
+#define SHADOW_MAX_VIEWS 6			// cube faces for a point light
+
+// what a shadow view needs this frame, from scheduleView
+#define SHADOW_UPDATE_STATIC 1		// render the static casters into the cache
+#define SHADOW_UPDATE_DYNAMIC 2		// copy the cache into the shadow map and render the dynamic casters on top
+
+enum ShadowType
+{
+	SHADOW_NONE,
+	SHADOW_POINT,			// depth cube map, distance to the light divided by the far plane
+	SHADOW_DIRECTIONAL		// array of orthographic cascades fitted to slices of the camera frustum
+};
+
+// shadow maps for the main light
+// every view has two depth maps: a cache holding only the static casters, re-rendered when the light, the
+// settings or (for cascades) the cascade's fit changes, and the map that is sampled, made each frame it is
+// needed by copying the cache and drawing the dynamic casters over it
+// cascades are fitted to bounding spheres of the frustum slices and snapped to whole texels, so their matrices,
+// and the cache with them, stay put while the camera only turns or stands still
+class ShadowMaps {
+public:
+	ShadowMaps();
+	~ShadowMaps();
+
+	void init();
+	void destroy();
+	void setPointLight(const glm::vec3& position, float farPlane, GLuint size);
+	void setDirectionalLight(const glm::vec3& direction, const glm::mat4& cameraView, const glm::mat4& cameraProjection,
+		float shadowDistance, const AABB& sceneBounds, GLuint size, int numberOfCascades);
+	int scheduleView(int view, bool dynamicCasters, bool dynamicDue);
+	void beginStatic(int view);
+	void beginDynamic(int view);
+	void end(GLuint windowWidth, GLuint windowHeight);
+	void invalidate();
+
+	ShadowType getType() const;
+	int getNumberOfViews() const;
+	glm::mat4 getViewMatrix(int view) const;
+	glm::mat4 getProjectionMatrix(int view) const;
+	glm::mat4 getShadowMatrix(int cascade, const glm::mat4& viewMatrix) const;
+	float getFarPlane() const;
+	GLuint getCubeTexture() const;
+	GLuint getCascadeTexture() const;
+	GLuint getSize() const;
+
+private:
+	void create(ShadowType type, GLuint size, int numberOfCascades);
+	void release();
+	void attach(GLenum target, GLuint texture, int view);
+
+	ShadowType mType;
+	GLuint mSize;
+	int mNumberOfCascades;
+	GLuint mFramebuffer;				// renders into either map
+	GLuint mCopyFramebuffer;			// reads the cache when it is copied
+	GLuint mTexture;					// sampled by the shaders, a cube map or a 2D array
+	GLuint mCacheTexture;				// static casters only, same format
+	int mResource;						// tracked size of both maps
+	bool mCacheValid[SHADOW_MAX_VIEWS];
+	bool mDynamicContent[SHADOW_MAX_VIEWS];	// dynamic casters were drawn into the view when it was last made
+	glm::vec3 mLightPosition;
+	float mFarPlane;
+	glm::vec3 mLightDirection;
+	glm::mat4 mViewMatrices[SHADOW_MAX_VIEWS];
+	glm::mat4 mProjectionMatrices[SHADOW_MAX_VIEWS];
+};
+
+#endif
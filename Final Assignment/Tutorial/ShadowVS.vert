@@ -0,0 +1,28 @@
+#version 330 core
+
+// input data (different for all executions of this shader)
+in vec3 aPosition;
+in uint aDrawID;		// index of this draw's data in uDrawData
+
+// uniform input data
+uniform samplerBuffer uDrawData;	// per-draw matrices and material, 11 texels per draw
+uniform int uDrawDataBase;			// texel where this frame's draw data starts
+
+// output data (will be interpolated for each fragment)
+out vec3 vPosition;
+
+void main()
+{
+	// fetch this draw's matrices, the view is the light's
+	int base = uDrawDataBase + int(aDrawID) * 11;
+	mat4 modelViewProjectionMatrix = mat4(texelFetch(uDrawData, base), texelFetch(uDrawData, base + 1),
+		texelFetch(uDrawData, base + 2), texelFetch(uDrawData, base + 3));
+	mat4 modelViewMatrix = mat4(texelFetch(uDrawData, base + 4), texelFetch(uDrawData, base + 5),
+		texelFetch(uDrawData, base + 6), texelFetch(uDrawData, base + 7));
+
+	// set vertex position
+    gl_Position = modelViewProjectionMatrix * vec4(aPosition, 1.0);
+
+	// light space
+	vPosition = (modelViewMatrix * vec4(aPosition, 1.0)).xyz;
+}
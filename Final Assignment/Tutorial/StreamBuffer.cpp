@@ -0,0 +1,206 @@
+#include <iostream>
+#include <chrono>
+using namespace std;
+
+#include "StreamBuffer.h"
+#include "ResourceTracker.h"
+
+StreamBuffer::StreamBuffer()
+{
+	mPersistent = false;
+	mBuffer = 0;
+	mResource = 0;
+	mRegionSize = 0;
+	mRegion = 0;
+	mOffset = 0;
+	mMapped = NULL;
+	mOverflow = false;
+	mWaitTime = 0.0;
+
+	for (int i = 0; i < STREAM_BUFFER_REGIONS; i++)
+		mFences[i] = 0;
+}
+
+StreamBuffer::~StreamBuffer()
+{}
+
+void StreamBuffer::init(GLuint regionSize)
+{
+	mPersistent = GLEW_ARB_buffer_storage ? true : false;
+
+	create(regionSize);
+
+	cout << "Stream buffer: " << STREAM_BUFFER_REGIONS << " x " << regionSize / 1024 << " KB, "
+		<< (mPersistent ? "persistent mapping" : "orphan and map") << endl;
+}
+
+void StreamBuffer::destroy()
+{
+	release();
+}
+
+void StreamBuffer::create(GLuint regionSize)
+{
+	mRegionSize = regionSize;
+	mRegion = STREAM_BUFFER_REGIONS - 1;	// the first beginFrame moves to region 0
+	mOffset = 0;
+
+	glGenBuffers(1, &mBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+
+	if (mPersistent)
+	{
+		// map once for the lifetime of the buffer, coherent so no explicit flushes are needed
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, mRegionSize * STREAM_BUFFER_REGIONS, NULL, flags);
+		mMapped = static_cast<GLubyte*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, mRegionSize * STREAM_BUFFER_REGIONS, flags));
+	}
+	else
+	{
+		glBufferData(GL_COPY_WRITE_BUFFER, mRegionSize * STREAM_BUFFER_REGIONS, NULL, GL_STREAM_DRAW);
+	}
+
+	mResource = track_resource("Stream buffer", RESOURCE_UNIFORM, static_cast<size_t>(mRegionSize) * STREAM_BUFFER_REGIONS);
+}
+
+void StreamBuffer::release()
+{
+	for (int i = 0; i < STREAM_BUFFER_REGIONS; i++)
+	{
+		if (mFences[i])
+		{
+			glDeleteSync(mFences[i]);
+			mFences[i] = 0;
+		}
+	}
+
+	if (mMapped)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		mMapped = NULL;
+	}
+
+	glDeleteBuffers(1, &mBuffer);
+	mBuffer = 0;
+
+	untrack_resource(mResource);
+	mResource = 0;
+}
+
+void StreamBuffer::beginFrame()
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+	// last frame ran out of space, wait for the GPU to finish with the buffer and double the regions
+	if (mOverflow)
+	{
+		for (int i = 0; i < STREAM_BUFFER_REGIONS; i++)
+		{
+			if (mFences[i])
+				glClientWaitSync(mFences[i], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		}
+
+		GLuint regionSize = mRegionSize * 2;
+		release();
+		create(regionSize);
+		mOverflow = false;
+
+		cout << "Stream buffer: grown to " << STREAM_BUFFER_REGIONS << " x " << regionSize / 1024 << " KB" << endl;
+	}
+
+	mRegion = (mRegion + 1) % STREAM_BUFFER_REGIONS;
+	mOffset = 0;
+
+	// block until the GPU has finished the frame that last used this region
+	if (mFences[mRegion])
+	{
+		GLenum result = glClientWaitSync(mFences[mRegion], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		while (result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(mFences[mRegion], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);	// 1 ms
+
+		glDeleteSync(mFences[mRegion]);
+		mFences[mRegion] = 0;
+	}
+
+	if (!mPersistent)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+
+		// orphan the storage when wrapping around so the driver never has to synchronise
+		if (mRegion == 0)
+			glBufferData(GL_COPY_WRITE_BUFFER, mRegionSize * STREAM_BUFFER_REGIONS, NULL, GL_STREAM_DRAW);
+
+		mMapped = static_cast<GLubyte*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, mRegion * mRegionSize, mRegionSize,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+	}
+
+	mWaitTime = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+}
+
+void StreamBuffer::flush()
+{
+	// a persistent coherent mapping needs nothing, otherwise the region has to be unmapped before it is drawn from
+	if (!mPersistent && mMapped)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		mMapped = NULL;
+	}
+}
+
+void StreamBuffer::endFrame()
+{
+	flush();
+
+	// everything submitted from this region is covered by the fence
+	mFences[mRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void* StreamBuffer::allocate(GLuint size, GLuint alignment, GLuint* offset)
+{
+	GLuint aligned = (mOffset + alignment - 1) / alignment * alignment;
+
+	if (mMapped == NULL)
+		return NULL;
+
+	if (aligned + size > mRegionSize)
+	{
+		if (!mOverflow)
+			cerr << "Stream buffer: region full (" << mRegionSize << " bytes)" << endl;
+
+		mOverflow = true;
+		return NULL;
+	}
+
+	mOffset = aligned + size;
+	*offset = mRegion * mRegionSize + aligned;
+
+	// a persistent mapping covers every region, otherwise only the current one is mapped
+	return mMapped + (mPersistent ? *offset : aligned);
+}
+
+GLuint StreamBuffer::getBuffer() const
+{
+	return mBuffer;
+}
+
+GLuint StreamBuffer::getRegionSize() const
+{
+	return mRegionSize;
+}
+
+GLuint StreamBuffer::getUsed() const
+{
+	return mOffset;
+}
+
+bool StreamBuffer::isPersistent() const
+{
+	return mPersistent;
+}
+
+double StreamBuffer::getWaitTime() const
+{
+	return mWaitTime;
+}
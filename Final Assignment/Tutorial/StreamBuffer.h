@@ -0,0 +1,45 @@
+#ifndef __STREAM_BUFFER_H
+#define __STREAM_BUFFER_H
+
+#include <GLEW/glew.h>	// include GLEW
+
+#define STREAM_BUFFER_REGIONS 3		// frames the CPU may write ahead of the GPU
+
+// ring buffer for data written once per frame, split into one region per frame in flight
+// each region is fenced when its frame is submitted and only reused once the GPU has passed the fence
+// uses a persistently mapped buffer with ARB_buffer_storage, otherwise orphans and maps each region
+// per frame: beginFrame, allocate and write, flush before drawing from the data, endFrame after the last draw
+class StreamBuffer {
+public:
+	StreamBuffer();
+	~StreamBuffer();
+
+	void init(GLuint regionSize);
+	void destroy();
+	void beginFrame();
+	void flush();
+	void endFrame();
+	void* allocate(GLuint size, GLuint alignment, GLuint* offset);
+	GLuint getBuffer() const;
+	GLuint getRegionSize() const;
+	GLuint getUsed() const;
+	bool isPersistent() const;
+	double getWaitTime() const;
+
+private:
+	void create(GLuint regionSize);
+	void release();
+
+	bool mPersistent;						// ARB_buffer_storage is available
+	GLuint mBuffer;
+	int mResource;							// tracked size of the buffer
+	GLuint mRegionSize;						// bytes per frame
+	GLuint mRegion;							// region written this frame
+	GLuint mOffset;							// next free byte in the current region
+	GLubyte* mMapped;						// mapping of the whole buffer (persistent) or the current region
+	GLsync mFences[STREAM_BUFFER_REGIONS];	// one per region, 0 if the region is unused
+	bool mOverflow;							// an allocation failed, grow at the start of the next frame
+	double mWaitTime;						// seconds spent waiting for the GPU in the last beginFrame
+};
+
+#endif
@@ -0,0 +1,419 @@
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+using namespace std;
+
+#include "TextureStreamer.h"
+#include "ResourceTracker.h"
+#include "bmpfuncs.h"
+
+static GLint level_size(GLint size, int level)
+{
+	return max(size >> level, 1);
+}
+
+// RGB, unpadded
+static size_t level_bytes(GLint width, GLint height, int level)
+{
+	return static_cast<size_t>(level_size(width, level)) * level_size(height, level) * 3;
+}
+
+static size_t levels_bytes(GLint width, GLint height, int firstLevel, int lastLevel)
+{
+	size_t bytes = 0;
+	for (int level = firstLevel; level < lastLevel; level++)
+		bytes += level_bytes(width, height, level);
+
+	return bytes;
+}
+
+// halve an RGB image with a box filter, the last row or column of an odd size is repeated
+static void downsample(const unsigned char* source, GLint width, GLint height, unsigned char* destination)
+{
+	GLint halfWidth = max(width / 2, 1);
+	GLint halfHeight = max(height / 2, 1);
+
+	for (GLint y = 0; y < halfHeight; y++)
+	{
+		const unsigned char* row0 = source + min(y * 2, height - 1) * width * 3;
+		const unsigned char* row1 = source + min(y * 2 + 1, height - 1) * width * 3;
+
+		for (GLint x = 0; x < halfWidth; x++)
+		{
+			GLint x0 = min(x * 2, width - 1) * 3;
+			GLint x1 = min(x * 2 + 1, width - 1) * 3;
+
+			for (int channel = 0; channel < 3; channel++)
+				destination[(y * halfWidth + x) * 3 + channel] = static_cast<unsigned char>(
+					(row0[x0 + channel] + row0[x1 + channel] + row1[x0 + channel] + row1[x1 + channel] + 2) >> 2);
+		}
+	}
+}
+
+// levels first to last - 1 of an image one after another into levels, the coarser levels are made from the
+// finer ones and those before the first go into scratch
+static void build_levels(const unsigned char* image, GLint width, GLint height, int firstLevel, int lastLevel,
+	unsigned char* levels, LinearArena* scratch)
+{
+	const unsigned char* current = image;
+
+	for (int level = 0; level < lastLevel; level++)
+	{
+		size_t bytes = level_bytes(width, height, level);
+		unsigned char* target = (level >= firstLevel) ? levels : NULL;
+
+		if (level == 0)
+		{
+			if (target)
+				memcpy(target, image, bytes);
+		}
+		else
+		{
+			if (target == NULL)
+				target = scratch->allocateArray<unsigned char>(bytes);
+
+			downsample(current, level_size(width, level - 1), level_size(height, level - 1), target);
+			current = target;
+		}
+
+		if (level >= firstLevel)
+			levels += bytes;
+	}
+}
+
+// specify levels first to last - 1 of the bound texture and sample from the first
+static void upload_levels(const unsigned char* levels, GLint width, GLint height, int firstLevel, int lastLevel)
+{
+	// the small levels' rows are not multiples of four bytes
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	for (int level = firstLevel; level < lastLevel; level++)
+	{
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, level_size(width, level), level_size(height, level), 0, GL_BGR, GL_UNSIGNED_BYTE, levels);
+		levels += level_bytes(width, height, level);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, firstLevel);
+}
+
+TextureStreamer::TextureStreamer()
+{
+	mRunning = false;
+	mBias = 0;
+	mLoads = 0;
+	mReleases = 0;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+}
+
+void TextureStreamer::init()
+{
+	mArena.init(STREAM_ARENA_SIZE, MEMORY_LOAD);
+	mRunning = true;
+	mThread = thread(&TextureStreamer::streamLoop, this);
+}
+
+void TextureStreamer::destroy()
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mRunning = false;
+	}
+
+	mWake.notify_one();
+	mThread.join();
+
+	// loads that finished but were never uploaded
+	for (size_t i = 0; i < mResults.size(); i++)
+	{
+		memory_free(mResults[i].levels);
+		untrack_resource(mResults[i].staging);
+	}
+
+	for (size_t i = 0; i < mTextures.size(); i++)
+	{
+		glDeleteTextures(1, &mTextures[i].texture);
+		untrack_resource(mTextures[i].resource);
+	}
+
+	mRequests.clear();
+	mResults.clear();
+	mTextures.clear();
+	mArena.destroy();
+}
+
+int TextureStreamer::addTexture(const char* fileName, LinearArena* arena)
+{
+	GLint width, height;
+	unsigned char* image = readBitmapRGBImage(fileName, &width, &height, arena);
+
+	if (image == NULL)
+		return -1;
+
+	StreamedTexture texture;
+	texture.fileName = fileName;
+	texture.width = width;
+	texture.height = height;
+	texture.resource = 0;
+	texture.idleFrames = 0;
+	texture.pending = false;
+	texture.missing = false;
+
+	texture.numberOfLevels = 1;
+	while ((max(width, height) >> texture.numberOfLevels) > 0)
+		texture.numberOfLevels++;
+
+	texture.tailLevel = 0;
+	while (max(level_size(width, texture.tailLevel), level_size(height, texture.tailLevel)) > STREAM_TAIL_SIZE)
+		texture.tailLevel++;
+
+	texture.residentLevel = texture.requiredLevel = texture.tailLevel;
+
+	unsigned char* tail = arena->allocateArray<unsigned char>(levels_bytes(width, height, texture.tailLevel, texture.numberOfLevels));
+	build_levels(image, width, height, texture.tailLevel, texture.numberOfLevels, tail, arena);
+
+	glGenTextures(1, &texture.texture);
+	glBindTexture(GL_TEXTURE_2D, texture.texture);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.numberOfLevels - 1);
+	upload_levels(tail, width, height, texture.tailLevel, texture.numberOfLevels);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	track(texture);
+	mTextures.push_back(texture);
+
+	return static_cast<int>(mTextures.size()) - 1;
+}
+
+GLuint TextureStreamer::getTexture(int handle) const
+{
+	return mTextures[handle].texture;
+}
+
+int TextureStreamer::findTexture(GLuint texture) const
+{
+	for (size_t i = 0; i < mTextures.size(); i++)
+	{
+		if (mTextures[i].texture == texture)
+			return static_cast<int>(i);
+	}
+
+	return -1;
+}
+
+// nothing needs more than the tail until it is required again
+void TextureStreamer::beginFrame()
+{
+	for (size_t i = 0; i < mTextures.size(); i++)
+		mTextures[i].requiredLevel = mTextures[i].tailLevel;
+}
+
+// the level whose texels are about a pixel where the texture is seen closest, the sampler blends it with the
+// next coarser one there and only uses coarser ones further away
+void TextureStreamer::require(int handle, float uvPixels)
+{
+	StreamedTexture& texture = mTextures[handle];
+
+	float texelsPerPixel = max(texture.width, texture.height) / max(uvPixels, 1e-3f);
+	int level = static_cast<int>(floor(log2(max(texelsPerPixel, 1.0f)))) + mBias;
+	level = min(max(level, 0), texture.tailLevel);
+
+	texture.requiredLevel = min(texture.requiredLevel, level);
+}
+
+// binds textures on the active unit, GL_TEXTURE_2D is left unbound
+void TextureStreamer::update()
+{
+	// what the streaming thread has finished, a few at a time so one frame does not take all the uploads
+	for (int i = 0; i < STREAM_UPLOADS_PER_FRAME; i++)
+	{
+		StreamLoad load;
+
+		{
+			lock_guard<mutex> lock(mMutex);
+
+			if (mResults.empty())
+				break;
+
+			load = mResults.front();
+			mResults.pop_front();
+		}
+
+		upload(load);
+	}
+
+	for (size_t i = 0; i < mTextures.size(); i++)
+	{
+		StreamedTexture& texture = mTextures[i];
+
+		if (texture.pending || texture.missing)
+			continue;
+
+		if (texture.requiredLevel < texture.residentLevel)
+		{
+			// every level between the needed one and what is there, the resident levels stay until they arrive
+			StreamLoad load;
+			load.texture = static_cast<int>(i);
+			load.fileName = texture.fileName;
+			load.width = texture.width;
+			load.height = texture.height;
+			load.firstLevel = texture.requiredLevel;
+			load.lastLevel = texture.residentLevel;
+			load.levels = NULL;
+			load.staging = 0;
+
+			{
+				lock_guard<mutex> lock(mMutex);
+				mRequests.push_back(load);
+			}
+
+			mWake.notify_one();
+			texture.pending = true;
+			texture.idleFrames = 0;
+		}
+		else if (texture.requiredLevel > texture.residentLevel)
+		{
+			// only levels that stay unneeded for a while go, so turning the camera back does not load them again
+			if (++texture.idleFrames >= STREAM_RELEASE_FRAMES)
+			{
+				release(texture, texture.requiredLevel);
+				texture.idleFrames = 0;
+			}
+		}
+		else
+			texture.idleFrames = 0;
+	}
+}
+
+void TextureStreamer::setBias(int bias)
+{
+	mBias = bias;
+}
+
+int TextureStreamer::getResidentLevel(int handle) const
+{
+	return mTextures[handle].residentLevel;
+}
+
+StreamStats TextureStreamer::getStats() const
+{
+	StreamStats stats;
+	stats.textures = static_cast<int>(mTextures.size());
+	stats.pending = 0;
+	stats.loads = mLoads;
+	stats.releases = mReleases;
+	stats.residentBytes = 0;
+	stats.fullBytes = 0;
+
+	for (size_t i = 0; i < mTextures.size(); i++)
+	{
+		const StreamedTexture& texture = mTextures[i];
+
+		if (texture.pending)
+			stats.pending++;
+
+		// four bytes a texel on the GPU
+		stats.residentBytes += levels_bytes(texture.width, texture.height, texture.residentLevel, texture.numberOfLevels) / 3 * 4;
+		stats.fullBytes += levels_bytes(texture.width, texture.height, 0, texture.numberOfLevels) / 3 * 4;
+	}
+
+	return stats;
+}
+
+// reads the files again and builds the levels asked for, the scratch is reset after each
+void TextureStreamer::streamLoop()
+{
+	while (true)
+	{
+		StreamLoad load;
+
+		{
+			unique_lock<mutex> lock(mMutex);
+			mWake.wait(lock, [this] { return !mRunning || !mRequests.empty(); });
+
+			if (!mRunning)
+				return;
+
+			load = mRequests.front();
+			mRequests.pop_front();
+		}
+
+		GLint width, height;
+		unsigned char* image = readBitmapRGBImage(load.fileName.c_str(), &width, &height, &mArena);
+
+		// a file that has changed size since it was added is not used
+		if (image != NULL && width == load.width && height == load.height)
+		{
+			size_t bytes = levels_bytes(width, height, load.firstLevel, load.lastLevel);
+			load.levels = memory_allocate_array<unsigned char>(bytes, MEMORY_LOAD);
+			build_levels(image, width, height, load.firstLevel, load.lastLevel, load.levels, &mArena);
+			load.staging = track_resource(load.fileName.c_str(), RESOURCE_CPU_STAGING, bytes);
+		}
+
+		mArena.reset();
+
+		lock_guard<mutex> lock(mMutex);
+		mResults.push_back(load);
+	}
+}
+
+void TextureStreamer::upload(const StreamLoad& load)
+{
+	StreamedTexture& texture = mTextures[load.texture];
+	texture.pending = false;
+
+	// keep what is there and stop asking
+	if (load.levels == NULL)
+	{
+		cerr << "Texture streaming could not read " << load.fileName << " again" << endl;
+		texture.missing = true;
+		return;
+	}
+
+	// nothing was released while the load was pending, so the new levels join up with the resident ones
+	glBindTexture(GL_TEXTURE_2D, texture.texture);
+	upload_levels(load.levels, texture.width, texture.height, load.firstLevel, load.lastLevel);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	memory_free(load.levels);
+	untrack_resource(load.staging);
+
+	texture.residentLevel = load.firstLevel;
+	track(texture);
+	mLoads++;
+}
+
+// drop the levels finer than level, a zero-sized image frees a level's storage
+void TextureStreamer::release(StreamedTexture& texture, int level)
+{
+	glBindTexture(GL_TEXTURE_2D, texture.texture);
+
+	// the sampler moves off the levels before they go
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+
+	for (int i = texture.residentLevel; i < level; i++)
+		glTexImage2D(GL_TEXTURE_2D, i, GL_RGB, 0, 0, 0, GL_BGR, GL_UNSIGNED_BYTE, NULL);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	texture.residentLevel = level;
+	track(texture);
+	mReleases++;
+}
+
+// the resident levels, RGB8 is kept as four bytes a texel
+void TextureStreamer::track(StreamedTexture& texture)
+{
+	untrack_resource(texture.resource);
+	texture.resource = track_texture(texture.fileName.c_str(), RESOURCE_TEXTURE, level_size(texture.width, texture.residentLevel),
+		level_size(texture.height, texture.residentLevel), 1, 4, texture.numberOfLevels - texture.residentLevel);
+}
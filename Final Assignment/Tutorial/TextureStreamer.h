@@ -0,0 +1,109 @@
+#ifndef __TEXTURE_STREAMER_H
+#define __TEXTURE_STREAMER_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <GLEW/glew.h>	// include GLEW
+
+#include "Allocators.h"
+
+#define STREAM_TAIL_SIZE 64				// largest side of the levels every texture keeps resident
+#define STREAM_RELEASE_FRAMES 120		// frames levels go unneeded before they are released
+#define STREAM_UPLOADS_PER_FRAME 2		// finished loads uploaded in one update
+#define STREAM_ARENA_SIZE (4 << 20)		// the streaming thread's scratch for a decoded image and its levels
+
+// counters of the streamed textures
+typedef struct StreamStats
+{
+	int textures;
+	int pending;			// loads queued or running
+	int loads;				// since the start
+	int releases;
+	size_t residentBytes;	// of the levels on the GPU
+	size_t fullBytes;		// the textures would take with every level
+} StreamStats;
+
+// RGB bitmaps kept on the GPU only down to the level they are seen at
+// a texture starts with its mip tail, the levels of at most STREAM_TAIL_SIZE texels a side; each frame the
+// objects using it say how many pixels a unit of texture coordinate covers, which gives the finest level
+// needed, and a thread reads the file again and builds the missing levels from it; levels that have not been
+// needed for a while are dropped again
+// the levels present are base level to the last, GL_TEXTURE_BASE_LEVEL keeps the sampler off the rest
+// per frame: beginFrame, require for every visible use of a texture, then update, all on the GL thread
+class TextureStreamer {
+public:
+	TextureStreamer();
+	~TextureStreamer();
+
+	void init();
+	void destroy();
+
+	// read the file and upload its mip tail, the image is decoded into memory from the arena
+	// returns a handle, -1 if the file could not be read
+	int addTexture(const char* fileName, LinearArena* arena);
+	GLuint getTexture(int handle) const;
+	int findTexture(GLuint texture) const;		// handle of a GL texture, -1 if it is not streamed
+
+	void beginFrame();
+	void require(int handle, float uvPixels);	// uvPixels: screen pixels one unit of texture coordinate covers
+	void update();
+
+	void setBias(int bias);						// levels added to the required ones, negative is sharper
+	int getResidentLevel(int handle) const;
+	StreamStats getStats() const;
+
+private:
+	// one texture and what of it is on the GPU
+	typedef struct StreamedTexture
+	{
+		std::string fileName;
+		GLuint texture;
+		GLint width;
+		GLint height;
+		int numberOfLevels;
+		int tailLevel;			// first level of the mip tail
+		int residentLevel;		// finest level on the GPU, the base level
+		int requiredLevel;		// finest level needed this frame
+		int idleFrames;			// frames the resident levels have been finer than needed
+		bool pending;			// a load is queued or running
+		bool missing;			// the file could not be read again, no more loads
+		int resource;			// tracked size of the resident levels
+	} StreamedTexture;
+
+	// levels first to last - 1 of a texture, built on the streaming thread
+	typedef struct StreamLoad
+	{
+		int texture;
+		std::string fileName;	// copied, the textures may move while the thread reads
+		GLint width;			// what the file had when it was added
+		GLint height;
+		int firstLevel;
+		int lastLevel;
+		unsigned char* levels;	// one after another, tagged MEMORY_LOAD, NULL if the file could not be read
+		int staging;			// tracked size of the levels until they are uploaded
+	} StreamLoad;
+
+	void streamLoop();
+	void upload(const StreamLoad& load);
+	void release(StreamedTexture& texture, int level);
+	void track(StreamedTexture& texture);
+
+	std::vector<StreamedTexture> mTextures;
+	std::deque<StreamLoad> mRequests;		// guarded by mMutex
+	std::deque<StreamLoad> mResults;		// guarded by mMutex
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::thread mThread;
+	bool mRunning;							// guarded by mMutex
+	LinearArena mArena;						// the streaming thread's
+	int mBias;
+	int mLoads;
+	int mReleases;
+};
+
+#endif
@@ -0,0 +1,217 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <algorithm>
+using namespace std;
+
+#include "Transparency.h"
+#include "shader.h"
+#include "ResourceTracker.h"
+
+void sort_back_to_front(const float* depths, GLuint count, GLuint* order, LinearArena* arena)
+{
+	GLuint* keys = arena->allocateArray<GLuint>(count);
+	GLuint* scratchKeys = arena->allocateArray<GLuint>(count);
+	GLuint* scratchOrder = arena->allocateArray<GLuint>(count);
+	GLuint* sortedOrder = order;
+
+	// non-negative floats sort like their bits; inverting them makes an ascending sort put the farthest first
+	for (GLuint i = 0; i < count; i++)
+	{
+		float depth = depths[i] > 0.0f ? depths[i] : 0.0f;
+		GLuint bits;
+		memcpy(&bits, &depth, sizeof(bits));
+		keys[i] = ~bits;
+		sortedOrder[i] = i;
+	}
+
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		GLuint histogram[256];
+		memset(histogram, 0, sizeof(histogram));
+
+		for (GLuint i = 0; i < count; i++)
+			histogram[(keys[i] >> shift) & 0xFF]++;
+
+		// nothing to do if every key has the same digit
+		if (count == 0 || histogram[(keys[0] >> shift) & 0xFF] == count)
+			continue;
+
+		GLuint offset = 0;
+		for (int digit = 0; digit < 256; digit++)
+		{
+			GLuint digitCount = histogram[digit];
+			histogram[digit] = offset;
+			offset += digitCount;
+		}
+
+		// stable scatter, so equal depths keep their earlier (texture) order
+		for (GLuint i = 0; i < count; i++)
+		{
+			GLuint destination = histogram[(keys[i] >> shift) & 0xFF]++;
+			scratchKeys[destination] = keys[i];
+			scratchOrder[destination] = sortedOrder[i];
+		}
+
+		swap(keys, scratchKeys);
+		swap(sortedOrder, scratchOrder);
+	}
+
+	// an odd number of passes leaves the result in the scratch
+	if (sortedOrder != order)
+		memcpy(order, sortedOrder, sizeof(GLuint) * count);
+}
+
+WeightedBlendedOIT::WeightedBlendedOIT()
+{
+	mFramebuffer = 0;
+	mAccumulationTexture = 0;
+	mWeightTexture = 0;
+	mDepthBuffer = 0;
+	mResource = 0;
+	mCompositeProgram = 0;
+	mAccumulationIndex = 0;
+	mWeightIndex = 0;
+	mVAO = 0;
+	mWidth = 0;
+	mHeight = 0;
+}
+
+WeightedBlendedOIT::~WeightedBlendedOIT()
+{
+}
+
+void WeightedBlendedOIT::init(GLuint width, GLuint height)
+{
+	glGenFramebuffers(1, &mFramebuffer);
+	glGenTextures(1, &mAccumulationTexture);
+	glGenTextures(1, &mWeightTexture);
+	glGenRenderbuffers(1, &mDepthBuffer);
+	glGenVertexArrays(1, &mVAO);
+
+	mCompositeProgram = loadShaders("OITCompositeVS.vert", "OITCompositeFS.frag");
+	mAccumulationIndex = glGetUniformLocation(mCompositeProgram, "uAccumulation");
+	mWeightIndex = glGetUniformLocation(mCompositeProgram, "uWeight");
+
+	resize(width, height);
+}
+
+void WeightedBlendedOIT::destroy()
+{
+	glDeleteFramebuffers(1, &mFramebuffer);
+	glDeleteTextures(1, &mAccumulationTexture);
+	glDeleteTextures(1, &mWeightTexture);
+	glDeleteRenderbuffers(1, &mDepthBuffer);
+	glDeleteVertexArrays(1, &mVAO);
+	glDeleteProgram(mCompositeProgram);
+
+	mFramebuffer = 0;
+	mAccumulationTexture = 0;
+	mWeightTexture = 0;
+	mDepthBuffer = 0;
+	mVAO = 0;
+	mCompositeProgram = 0;
+
+	untrack_resource(mResource);
+	mResource = 0;
+	mWidth = mHeight = 0;
+}
+
+// reallocate the targets if the size changed, returns true if it did
+bool WeightedBlendedOIT::resize(GLuint width, GLuint height)
+{
+	if (width == mWidth && height == mHeight)
+		return false;
+
+	mWidth = width;
+	mHeight = height;
+
+	glBindTexture(GL_TEXTURE_2D, mAccumulationTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, mWidth, mHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glBindTexture(GL_TEXTURE_2D, mWeightTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, mWidth, mHeight, 0, GL_RED, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// the opaque depth is blitted in, which needs the same format as the source (24-bit depth, 8-bit stencil)
+	glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, mWidth, mHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	// RGBA16F, R16F and 24-bit depth with stencil
+	untrack_resource(mResource);
+	mResource = track_resource("Transparency targets", RESOURCE_RENDER_TARGET, static_cast<size_t>(mWidth) * mHeight * (8 + 2 + 4));
+
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mAccumulationTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, mWeightTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer);
+
+	GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		cerr << "Transparency framebuffer incomplete" << endl;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return true;
+}
+
+// copy the opaque depth across and start accumulating, the transparent draws follow with the OIT outputs on
+void WeightedBlendedOIT::begin(GLuint depthFramebuffer)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, depthFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mFramebuffer);
+	glBlitFramebuffer(0, 0, mWidth, mHeight, 0, 0, mWidth, mHeight, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+
+	const GLfloat clearAccumulation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	const GLfloat clearWeight[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	glClearBufferfv(GL_COLOR, 0, clearAccumulation);
+	glClearBufferfv(GL_COLOR, 1, clearWeight);
+
+	// tested against the opaque depth, never written
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
+	glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void WeightedBlendedOIT::end(GLuint framebuffer)
+{
+	glDisable(GL_BLEND);
+	glDepthMask(GL_TRUE);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+// blend the averaged transparent colour over the opaque image, by the coverage left after every surface
+void WeightedBlendedOIT::composite()
+{
+	glUseProgram(mCompositeProgram);
+	glBindVertexArray(mVAO);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, mAccumulationTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, mWeightTexture);
+	glUniform1i(mAccumulationIndex, 0);
+	glUniform1i(mWeightIndex, 1);
+
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendEquation(GL_FUNC_ADD);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+	glBindVertexArray(0);
+}
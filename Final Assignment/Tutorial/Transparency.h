@@ -0,0 +1,47 @@
+#ifndef __TRANSPARENCY_H
+#define __TRANSPARENCY_H
+
+#include <vector>
+
+#include <GLEW/glew.h>	// include GLEW
+
+#include "Allocators.h"
+
+// order draws back to front from their view depths (distance in front of the camera)
+// LSD radix sort over the bits of the depths, 8 bits per pass, passes where every key has the same digit are skipped
+// order receives count indices into depths; the keys and scratch come from the arena
+void sort_back_to_front(const float* depths, GLuint count, GLuint* order, LinearArena* arena);
+
+// weighted blended order-independent transparency (McGuire and Bavoil 2013)
+// transparent surfaces are drawn in any order into two floating-point targets, tested against a copy of the
+// opaque depth buffer: the first sums colour * alpha * weight in rgb and multiplies (1 - alpha) into a, the
+// second sums alpha * weight; the composite divides the two and blends the result over the opaque image
+// GL 3.3 has no per-target blend functions, so the blend is (ONE, ONE) for colour and (ZERO, ONE_MINUS_SRC_ALPHA)
+// for alpha on both targets, which the shader outputs are arranged around
+class WeightedBlendedOIT {
+public:
+	WeightedBlendedOIT();
+	~WeightedBlendedOIT();
+
+	void init(GLuint width, GLuint height);
+	void destroy();
+	bool resize(GLuint width, GLuint height);
+	void begin(GLuint depthFramebuffer);
+	void end(GLuint framebuffer);
+	void composite();
+
+private:
+	GLuint mFramebuffer;
+	GLuint mAccumulationTexture;	// RGBA16F, rgb = sum of colour * alpha * weight, a = product of (1 - alpha)
+	GLuint mWeightTexture;			// R16F, sum of alpha * weight
+	GLuint mDepthBuffer;			// copy of the opaque depth, same format as the window's
+	int mResource;					// tracked size of the three targets
+	GLuint mCompositeProgram;
+	GLuint mAccumulationIndex;
+	GLuint mWeightIndex;
+	GLuint mVAO;					// empty, the composite triangle comes from gl_VertexID
+	GLuint mWidth;
+	GLuint mHeight;
+};
+
+#endif
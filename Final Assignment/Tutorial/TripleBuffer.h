@@ -0,0 +1,59 @@
+#ifndef __TRIPLE_BUFFER_H
+#define __TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// lock-free hand-over of whole values from one producer thread to one consumer thread
+// the producer fills the back slot and swaps it with the middle one, the consumer swaps the middle slot with
+// its front one when something new was published; neither ever waits for the other, a value is never written
+// while it is being read, and the consumer always gets the latest value, skipping any it was too slow for
+// slots are reused as they are, so the producer must overwrite everything it publishes
+template <typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() : mMiddle(1), mBack(0), mFront(2)
+	{
+	}
+
+	// producer: the slot to fill, then publish it
+	T& beginWrite()
+	{
+		return mSlots[mBack];
+	}
+
+	void publish()
+	{
+		mBack = mMiddle.exchange(mBack | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// consumer: take the latest published value if there is one, returns false if there was nothing new
+	bool update()
+	{
+		if (!hasUpdate())
+			return false;
+
+		mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	bool hasUpdate() const
+	{
+		return (mMiddle.load(std::memory_order_acquire) & FRESH) != 0;
+	}
+
+	const T& read() const
+	{
+		return mSlots[mFront];
+	}
+
+private:
+	static const unsigned int INDEX = 3;
+	static const unsigned int FRESH = 4;	// set in mMiddle while it holds a value the consumer has not taken
+
+	T mSlots[3];
+	std::atomic<unsigned int> mMiddle;
+	unsigned int mBack;		// producer only
+	unsigned int mFront;	// consumer only
+};
+
+#endif
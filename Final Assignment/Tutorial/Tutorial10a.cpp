@@ -2,6 +2,14 @@
 #include <iostream>
 #include <string>
 #include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 using namespace std;	// to avoid having to use std::
 
 #include <GLEW/glew.h>	// include GLEW
@@ -11,25 +19,74 @@ using namespace std;	// to avoid having to use std::
 using namespace glm;	// to avoid having to use glm::
 
 #include <AntTweakBar.h>
-#include <assimp/cimport.h>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
 
 #include "shader.h"
 #include "bmpfuncs.h"
 #include "Camera.h"
+#include "mesh.h"
+#include "MeshPool.h"
+#include "DrawSubmitter.h"
+#include "StreamBuffer.h"
+#include "culling.h"
+#include "lod.h"
+#include "OcclusionCuller.h"
+#include "PortalGraph.h"
+#include "PlanarReflection.h"
+#include "CubeMapCapture.h"
+#include "environment.h"
+#include "ClusteredLights.h"
+#include "ShadowMaps.h"
+#include "GpuQueries.h"
+#include "Transparency.h"
+#include "ShadingBenchmark.h"
+#include "SceneTarget.h"
+#include "FrameGovernor.h"
+#include "TripleBuffer.h"
+#include "JobSystem.h"
+#include "FrameTimer.h"
+#include "InputQueue.h"
+#include "Animation.h"
+#include "Allocators.h"
+#include "ResourceTracker.h"
+#include "TextureStreamer.h"
 
 #define MOVEMENT_SENSITIVITY 3.0f		// camera movement sensitivity
 #define ROTATION_SENSITIVITY 0.3f		// camera rotation sensitivity
+#define MOUSE_LOOK_SCALE (ROTATION_SENSITIVITY / 60.0f)	// radians per pixel, what it used to be per frame at 60 Hz
+#define TORUS_SPIN_PERIOD 20.0f			// seconds per turn, 18 degrees a second as the torus used to turn per frame at 60 Hz
+#define MAX_ANIMATED_PROPS 20000		// props the animation can be measured with, evaluated but not drawn
+#define PROP_BLEND_TIME 0.5f			// seconds a prop takes to cross-fade to its next clip
+#define MAX_SIMULATION_STEPS 8			// steps run for one frame at most, the rest of a long frame is dropped
+#define LATE_LATCH_CULL_SCALE 0.85f		// projection scale the simulation culls with while the camera is latched late,
+										// about 6 degrees wider at 45, room for the turn between culling and drawing
+#define LATENCY_SMOOTHING 0.1f			// weight of the newest frame in the smoothed latencies
+#define NUMBER_OF_TRANSFORMS 19			// model matrices in the scene
+#define MAX_WORKER_STATS 16				// workers shown in the tweak bar
+#define MAX_SCENE_OBJECTS 256			// scene objects, reserved up front so the views' pointers to them stay valid
+
+// how the transparent objects are blended
+enum TransparencyMode
+{
+	TRANSPARENCY_SORTED,	// drawn back to front with ordinary alpha blending
+	TRANSPARENCY_OIT		// weighted blended, any order, composited over the opaque image
+};
 
-// struct for vertex attributes
-typedef struct Vertex
+// where the normal-map shader builds its tangent basis
+enum ShadingMode
 {
-	GLfloat position[3];
-	GLfloat normal[3];
-	GLfloat tangent[3];
-	GLfloat texCoord[2];
-} Vertex;
+	SHADING_FRAGMENT_TBN,		// per fragment, light and eye vectors in eye space
+	SHADING_VERTEX_TANGENT,		// per vertex, light and eye vectors moved into tangent space
+	NUMBER_OF_SHADING_MODES
+};
+
+// passes timed on the GPU
+enum GpuPass
+{
+	GPU_PASS_DEPTH,			// depth pre-pass
+	GPU_PASS_OPAQUE,		// opaque objects in the main view
+	GPU_PASS_TRANSPARENT,	// transparent objects, including the OIT composite
+	NUMBER_OF_GPU_PASSES
+};
 
 typedef struct Vertex2
 {
@@ -41,28 +98,175 @@ typedef struct Vertex2
 typedef struct Light
 {
 	glm::vec3 position;
+	glm::vec3 direction;	// direction the light travels in, for directional lights
 	glm::vec3 ambient;
 	glm::vec3 diffuse;
 	glm::vec3 specular;
 	int type;
 } Light;
 
-// struct for mesh properties
-typedef struct Mesh
+// struct for objects in the scene
+typedef struct SceneObject
 {
-	Vertex* pMeshVertices;		// pointer to mesh vertices
-	GLint numberOfVertices;		// number of vertices in the mesh
-	GLint* pMeshIndices;		// pointer to mesh indices
-	GLint numberOfFaces;		// number of faces in the mesh
-} Mesh;
+	int mesh;				// handle in the mesh pool
+	int transform;			// index into g_modelMatrix
+	int material;			// index into g_material
+	GLuint texture;			// colour texture
+	GLuint normalMap;		// normal map texture
+	int textureStream;		// handles of the textures in the texture streamer, -1 if not streamed
+	int normalMapStream;
+	bool reflective;		// shaded from the environment map
+	bool transparent;		// blended with g_alpha after the opaque objects
+	bool mirror;			// blends in the planar reflection
+	bool dynamic;			// moves, so it is drawn into the shadow maps every frame rather than cached
+	int lod;				// level of detail drawn last frame
+	float distance;			// from the camera to the nearest point of the bounds this frame
+	int occluder;			// occluder mesh in the occlusion culler, -1 if it does not hide other objects
+	ScreenRect scissor;		// screen rectangle of the portals it is seen through this frame
+} SceneObject;
+
+// a run of consecutive draws sharing the same textures and scissor rectangle
+typedef struct DrawBatch
+{
+	GLuint first;			// first draw in the draw submitter
+	GLuint count;			// number of draws
+	GLuint texture;
+	GLuint normalMap;
+	ScreenRect scissor;
+} DrawBatch;
+
+// an object the simulation found visible, with what it worked out for it
+typedef struct VisibleObject
+{
+	int object;				// index into g_objects
+	int lod;
+	float distance;			// from the camera to the nearest point of the bounds
+	float depth;			// view depth of the centre of the bounds
+	float uvPixels;			// screen pixels one unit of texture coordinate covers at the nearest point
+	ScreenRect scissor;		// screen rectangle of the portals it is seen through
+} VisibleObject;
+
+// kinds of view culled alongside the camera's
+enum ViewType
+{
+	VIEW_REFLECTION,
+	VIEW_CUBE_FACE,
+	VIEW_SHADOW
+};
 
-typedef struct Material
+// a view the render thread culls on the workers while it queues the camera's draws
+typedef struct CulledView
 {
-	glm::vec3 ambient;
-	glm::vec3 diffuse;
-	glm::vec3 specular;
-	float shininess;
-} Material;
+	int type;
+	int index;				// cube face or shadow view
+	glm::mat4 viewMatrix;
+	glm::mat4 projectionMatrix;
+	glm::vec4 planes[6];
+	vector<const SceneObject*> objects;			// what is kept, in scene order
+	vector<const SceneObject*> dynamicObjects;	// shadow views keep the dynamic casters apart
+} CulledView;
+
+// what the render thread hands the simulation each frame: the input and the settings the simulation reads
+typedef struct SimulationInput
+{
+	unsigned int frame;		// render frame it was taken in
+	double time;			// seconds on the frame timer when it was taken
+	double eventTime;		// of the newest input event it includes
+	double timestep;		// seconds per simulation step
+	bool interpolate;		// between the last two steps, rather than showing the last
+	float moveForward;		// -1, 0 or 1
+	float strafeRight;
+	double cursorX;
+	double cursorY;
+	bool rotating;			// right mouse button held
+	bool lateLatching;		// the render thread turns the camera by the cursor's latest movement
+	int animatedProps;
+	bool directional;
+	Light lightPoint;
+	Light lightDirectional;
+	bool portalCulling;
+	bool portalScissor;
+	bool occlusionCulling;
+	float lodThreshold;
+	float lodHysteresis;
+	float renderHeight;
+} SimulationInput;
+
+// everything the render thread needs from one simulation step, never changed once published
+typedef struct FramePacket
+{
+	unsigned int frame;		// simulation step
+	unsigned int inputFrame;	// render frame whose input it was simulated from
+	double eventTime;		// of the newest input event in that input
+	double cursorX;			// cursor position the camera's orientation was turned to
+	double cursorY;
+	bool rotating;
+	Camera camera;
+	glm::mat4 modelMatrices[NUMBER_OF_TRANSFORMS];
+	vector<AABB> bounds;	// world bounds of every object, in scene order
+	AABB sceneBounds;		// around all of them
+	bool directional;
+	Light lightPoint;
+	Light lightDirectional;
+	vector<VisibleObject> visible;	// in scene order
+	bool mirrorVisible;
+	int portalCulledObjects;
+	int visibleCells;
+	int occludedObjects;
+	float occlusionTime;
+	int steps;				// fixed steps run for this packet
+	int droppedSteps;		// skipped over since the start because frames were too long
+	float alpha;			// fraction of a step the camera and transforms were interpolated by
+	int animatedInstances;	// the scene's and the props'
+	int blendingInstances;
+	float animationTime;	// milliseconds evaluating them
+	float simulationTime;	// milliseconds the step took
+	float arenaUsed;		// KB of the simulation's frame arena the step used
+	int arenaOverflows;		// allocations that have not fitted in it since the start
+} FramePacket;
+
+// state only the simulation touches
+typedef struct SimulationState
+{
+	unsigned int frame;
+	double time;			// of the last input simulated
+	FixedTimestep timestep;
+	Camera camera;			// at the last step
+	glm::vec3 previousPosition;	// of the camera at the step before
+	glm::mat4 modelMatrices[NUMBER_OF_TRANSFORMS];	// as init placed them
+	Animator animator;		// the scene's moving objects, written over their model matrices
+	Animator propAnimator;	// props, into propMatrices
+	int propClips[3];		// spin, bob and pulse, in the prop animator
+	vector<unsigned char> propClip;	// clip each prop is playing
+	vector<glm::mat4> propMatrices;
+	int nextPropBlend;		// prop to cross-fade next
+	vector<int> lods;		// level of detail of every object, kept for the hysteresis
+	LinearArena frameArena;	// culling lists, emptied every step
+	double cursorX;
+	double cursorY;
+	bool rotating;
+} SimulationState;
+
+// per-frame shader data, laid out to match the std140 FrameData block in NormalMapFS.frag
+typedef struct FrameData
+{
+	glm::mat4 viewMatrix;
+	glm::vec4 lightPosition;
+	glm::vec4 lightDirection;
+	glm::vec4 lightAmbient;
+	glm::vec4 lightDiffuse;
+	glm::vec3 lightSpecular;
+	GLint lightType;			// shares a 16-byte slot with lightSpecular
+	glm::mat4 reflectionMatrix;	// eye space to planar reflection texture coordinates
+	glm::vec4 reflectionParams;	// x = strength of the planar reflection
+	glm::vec4 irradiance[9];	// SH9 irradiance of the environment, rgb
+	glm::vec4 environmentParams;	// x = highest mip of the bound environment map
+	glm::vec4 clusterParams;	// x, y = tiles across and down, z, w = scale and bias taking log(depth) to a slice
+	glm::vec4 clusterScreen;	// xy = viewport size, z = 1 if the clustered lights apply to this view, w = depth slices
+	glm::mat4 shadowMatrices[SHADOW_MAX_CASCADES];	// eye space to cascade texture coordinates and depth
+	glm::vec4 shadowParams;		// x = 0 no shadows, 1 point cube, 2 cascades, y = PCF radius in texels, z = 1 / map size, w = cascades
+	glm::vec4 shadowBias;		// x = far plane of the cube, y = depth bias, z = normal offset
+} FrameData;
 
 // Global variables
 Vertex g_vertices[] = {
@@ -70,91 +274,314 @@ Vertex g_vertices[] = {
 	// vertex 1
 	-1.0f, 1.0f, 0.0f,	// position
 	0.0f, 0.0f, -1.0f,	// normal
-	1.0f, 0.0f, 0.0f,	// tangent
+	1.0f, 0.0f, 0.0f, -1.0f,	// tangent, bitangent sign
 	0.0f, 1.0f,			// texture coordinate
 	// vertex 2
 	-1.0f, -1.0f, 0.0f,	// position
 	0.0f, 0.0f, -1.0f,	// normal
-	1.0f, 0.0f, 0.0f,	// tangent
+	1.0f, 0.0f, 0.0f, -1.0f,	// tangent, bitangent sign
 	0.0f, 0.0f,			// texture coordinate
 	// vertex 3
 	1.0f, 1.0f, 0.0f,	// position
 	0.0f, 0.0f, -1.0f,	// normal
-	1.0f, 0.0f, 0.0f,	// tangent
+	1.0f, 0.0f, 0.0f, -1.0f,	// tangent, bitangent sign
 	1.0f, 1.0f,			// texture coordinate
 
 	// triangle 2
 	// vertex 1
 	1.0f, 1.0f, 0.0f,	// position
 	0.0f, 0.0f, -1.0f,	// normal
-	1.0f, 0.0f, 0.0f,	// tangent
+	1.0f, 0.0f, 0.0f, -1.0f,	// tangent, bitangent sign
 	1.0f, 1.0f,			// texture coordinate
 	// vertex 2
 	-1.0f, -1.0f, 0.0f,	// position
 	0.0f, 0.0f, -1.0f,	// normal
-	1.0f, 0.0f, 0.0f,	// tangent
+	1.0f, 0.0f, 0.0f, -1.0f,	// tangent, bitangent sign
 	0.0f, 0.0f,			// texture coordinate
 	// vertex 3
 	1.0f, -1.0f, 0.0f,	// position
 	0.0f, 0.0f, -1.0f,	// normal
-	1.0f, 0.0f, 0.0f,	// tangent
+	1.0f, 0.0f, 0.0f, -1.0f,	// tangent, bitangent sign
 	1.0f, 0.0f,			// texture coordinate
 };
 
-Mesh g_mesh;					// mesh
+GLint g_indices[] = { 0, 1, 2, 3, 4, 5 };
 
-GLuint g_IBO = 0;				// index buffer object identifier
-GLuint g_VBO[3];				// vertex buffer object identifier
-GLuint g_VAO[3];				// vertex array object identifier
+const ScreenRect g_fullScreen = { -1.0f, -1.0f, 1.0f, 1.0f };
+
+MeshPool g_meshPool;			// shared vertex/index buffers for all meshes
+int g_quadMesh;					// handle of the quad in the mesh pool
+vector<int> g_torusMeshes;		// handles of the torus submeshes in the mesh pool
 GLuint g_shaderProgramID = 0;	// shader program identifier
+GLuint g_shadowProgramID = 0;	// depth-only program for the shadow maps
+GLuint g_depthProgramID = 0;	// depth-only program for the pre-pass
+
+vector<SceneObject> g_objects;				// everything that can be drawn
+DrawSubmitter g_drawSubmitter;				// per-frame draw list and submission
+StreamBuffer g_streamBuffer;				// ring buffer for everything written each frame
+OcclusionCuller g_occlusionCuller;			// CPU depth buffer of the walls and floor
+bool g_occlusionCulling = true;				// test objects against the occluders before drawing
+int g_occludedObjects = 0;					// objects hidden by occluders last frame
+float g_occlusionTime = 0.0f;				// milliseconds spent on occlusion culling last frame
+PortalGraph g_portalGraph;					// the room split into cells joined by portals
+bool g_portalCulling = true;				// only draw objects in cells seen through portals
+bool g_portalScissor = true;				// clip objects seen through portals to the portal's rectangle
+int g_visibleCells = 0;						// cells visible last frame
+int g_portalCulledObjects = 0;				// objects in cells that could not be seen last frame
+PlanarReflection g_reflection;				// offscreen reflection in the glass pane
+int g_mirrorObject = -1;					// scene object the reflection is seen in
+bool g_planarReflection = true;				// render the reflection at all
+float g_reflectionScale = 0.5f;				// reflection resolution relative to the window
+int g_reflectionInterval = 2;				// frames between reflection updates
+float g_reflectionStrength = 0.35f;			// how much of the reflection the glass shows
+bool g_reflectionUpdated = false;			// the reflection is rendered this frame
+int g_reflectedObjects = 0;					// objects drawn into the reflection when it was last updated
+CubeMapCapture g_cubeCapture;				// environment map captured from the torus
+int g_cubeMapObject = -1;					// scene object the cube map is captured from
+bool g_dynamicCubeMap = true;				// reflect the room instead of the static cube map
+int g_cubeFacesPerFrame = 1;				// cube faces re-rendered each frame
+int g_cubeFaces[CUBE_MAP_FACES];			// faces rendered this frame
+int g_numberOfCubeFaces = 0;
+int g_capturedObjects = 0;					// objects drawn into the cube faces this frame
+GLint g_uniformBufferAlignment = 256;		// required alignment of uniform buffer offsets
+bool g_depthPrePass = false;				// lay down depth first, then shade only the visible fragments
+bool g_frontToBack = false;					// sort opaque draws by distance instead of by texture
+GpuQueries g_gpuQueries;					// timings and fragment counts of the main passes
+float g_prePassTime = 0.0f;					// GPU milliseconds of the depth pre-pass
+float g_opaqueTime = 0.0f;					// GPU milliseconds of the opaque pass
+int g_shadedFragments = 0;					// fragments passing the depth test in the opaque pass
+float g_overdraw = 0.0f;					// shaded fragments per pixel
+int g_numberOfOpaqueBatches = 0;			// batches the opaque draws were split into
+vector<DrawBatch> g_opaqueBatches;			// visible opaque draws grouped by texture
+vector<DrawBatch> g_transparentBatches;		// visible transparent draws, back to front when sorted
+int g_transparencyMode = TRANSPARENCY_SORTED;	// how the transparent objects are blended
+WeightedBlendedOIT g_oit;					// accumulation targets for weighted blended transparency
+int g_numberOfTransparentDraws = 0;			// transparent objects drawn last frame
+float g_transparentSortTime = 0.0f;			// milliseconds spent sorting them
+float g_transparentTime = 0.0f;				// GPU milliseconds of the transparent pass
+int g_shadingMode = SHADING_FRAGMENT_TBN;	// where the normal-map shader builds its tangent basis
+ShadingBenchmark g_shadingBenchmark;		// 4K target the shading modes are timed and compared in
+bool g_runShadingBenchmark = false;			// run the benchmark on the next frame
+float g_shadingTimes[NUMBER_OF_SHADING_MODES] = { 0.0f, 0.0f };	// GPU milliseconds of the opaque pass at 4K, per mode
+ImageDifference g_shadingDifference = { 0.0f, 0.0f, 0.0f };		// between the two modes' images
+SceneTarget g_sceneTarget;					// the scene is rendered here at the render resolution, then upscaled
+FrameGovernor g_frameGovernor;				// trades resolution and quality to keep the GPU frame time in budget
+bool g_governor = true;						// let the governor pick the render scale and quality level
+float g_targetFrameTime = 15.0f;			// GPU milliseconds per frame to stay under, with headroom for 60 Hz
+float g_renderScale = 1.0f;					// render resolution relative to the window, set by hand when the governor is off
+GLuint g_renderWidth = 800;					// render resolution this frame
+GLuint g_renderHeight = 600;
+float g_gpuFrameTime = 0.0f;				// GPU milliseconds of a recent frame
+float g_smoothedFrameTime = 0.0f;			// the governor's average of it
+int g_qualityLevel = 0;						// 0 = full quality, each level gives up one more setting
+int g_activeReflectionInterval = 2;			// settings in effect after the quality level
+float g_activeLodThreshold = 1.0f;
+int g_activeShadowMapSize = 1024;
+int g_governorDecisions = 0;				// changes the governor has made
+vector<DrawBatch> g_reflectionBatches;		// opaque draws seen in the mirror
+vector<DrawBatch> g_cubeFaceBatches[CUBE_MAP_FACES];	// opaque draws seen from the torus, per cube face
+ShadowMaps g_shadowMaps;					// shadow maps of the main light
+bool g_shadows = true;						// the main light casts shadows
+int g_shadowMapSize = 1024;					// texels along each side of a face or cascade
+int g_shadowCascades = 3;					// cascades for the directional light
+int g_shadowPCF = 1;						// PCF kernel radius in texels, 0 = one hardware-filtered tap
+float g_shadowDistance = 40.0f;				// how far from the camera the cascades reach
+float g_shadowRange = 50.0f;				// far plane of the point light's cube faces
+float g_shadowBias = 0.002f;				// subtracted from the depth before comparing
+float g_shadowNormalOffset = 0.05f;			// receivers are moved this far along their normal before the lookup
+bool g_shadowCache = true;					// keep the static casters in a cache instead of re-rendering them each frame
+int g_shadowInterval = 1;					// frames between updates of the dynamic casters
+int g_shadowStaticViews = 0;				// faces or cascades whose static casters were rendered this frame
+int g_shadowDynamicViews = 0;				// faces or cascades updated for the dynamic casters this frame
+int g_shadowUpdates[SHADOW_MAX_VIEWS];		// what each view needs this frame
+vector<DrawBatch> g_shadowStaticBatches[SHADOW_MAX_VIEWS];	// static casters, per face or cascade
+vector<DrawBatch> g_shadowDynamicBatches[SHADOW_MAX_VIEWS];	// dynamic casters, per face or cascade
 
 // locations in shader
-GLuint g_MVP_Index = 0;
-GLuint g_MV_Index = 0;
-GLuint g_V_Index = 0;
 GLuint g_texSamplerIndex;
 GLuint g_normalSamplerIndex;
 GLuint g_envMapSamplerIndex;
-GLuint g_alphaIndex;
-GLuint g_lightPositionIndex = 0;
-GLuint g_lightDirectionIndex = 0;
-GLuint g_lightAmbientIndex = 0;
-GLuint g_lightDiffuseIndex = 0;
-GLuint g_lightSpecularIndex = 0;
-GLuint g_lightTypeIndex = 0;
-GLuint g_materialAmbientIndex = 0;
-GLuint g_materialDiffuseIndex = 0;
-GLuint g_materialSpecularIndex = 0;
-GLuint g_materialShininessIndex = 0;
-GLuint g_surfaceIsReflective = 0;
-
-
-glm::mat4 g_modelMatrix[14];		// object's model matrix
-
-enum CUBE_FACE { FRONT, BACK, LEFT, RIGHT, TOP, BOTTOM };
+GLuint g_reflectionSamplerIndex;
+GLuint g_lightsSamplerIndex;
+GLuint g_clusterSamplerIndex;
+GLuint g_lightIndexSamplerIndex;
+GLuint g_drawDataSamplerIndex;
+GLuint g_drawDataBaseIndex;
+GLuint g_transparencyModeIndex;
+GLuint g_shadingModeIndex;
+GLuint g_shadowCascadeSamplerIndex;
+GLuint g_shadowCubeSamplerIndex;
+GLuint g_shadowDrawDataSamplerIndex;
+GLuint g_shadowDrawDataBaseIndex;
+GLuint g_shadowFarPlaneIndex;
+GLuint g_depthDrawDataSamplerIndex;
+GLuint g_depthDrawDataBaseIndex;
+
+
+glm::mat4 g_modelMatrix[NUMBER_OF_TRANSFORMS];		// object's model matrix, from the packet being rendered
 
 Light g_lightPoint;				// light properties
 Light g_lightDirectional;		// light properties
-Material g_material[2];			// material properties
+Material g_material[3];			// material properties
 bool g_directional = false;		// directional light source on or off
 
-unsigned char* g_texImage[3];	//image data
-unsigned char* cube_texImage[6];	//image data
-unsigned char* floorImage[2];
+ClusteredLights g_clusteredLights;	// light fixtures binned into view-space clusters
+vector<PointLight> g_fixtures;		// point lights on top of the main light
+bool g_clusteredLighting = true;	// shade with the fixtures
+int g_numberOfFixtures = 256;		// fixtures scattered around the room
+int g_generatedFixtures = -1;		// fixtures in g_fixtures
+int g_maxLightsPerCluster = 0;		// most fixtures in one cluster last frame
+float g_clusterTime = 0.0f;			// milliseconds spent assigning fixtures last frame
+
+EnvironmentLighting g_environment;	// prefiltered lighting from the static cube map
 GLuint g_textureID[6];			//texture id
 
 GLuint g_windowWidth = 800;		// window dimensions
 GLuint g_windowHeight = 600;
 
-float g_frameTime = 0.0f;
+float g_frameTime = 0.0f;			// seconds, last frame
+FrameTimer g_frameTimer;			// per-frame delta and the frame limiter
+int g_simulationRate = 60;			// fixed simulation steps per second
+bool g_interpolation = true;		// draw between the last two steps
+bool g_frameLimiter = false;		// hold frames back to g_frameLimit per second
+int g_frameLimit = 144;
+bool g_vsync = true;				// swap interval 1
+float g_frameDelta = 0.0f;			// milliseconds, last frame
+float g_smoothedFrameDelta = 0.0f;
+int g_simulationSteps = 0;			// fixed steps behind the packet drawn
+float g_interpolationAlpha = 0.0f;
+int g_droppedSteps = 0;				// steps skipped because a frame was too long
+float g_limiterSleep = 0.0f;		// milliseconds the limiter slept and spun last frame
+float g_limiterSpin = 0.0f;
 float g_alpha = 0.5f;
-Camera g_camera;
+float g_lodThreshold = 1.0f;		// largest geometric error allowed on screen, in pixels
+float g_lodHysteresis = 0.25f;		// margin below the threshold before switching to a coarser level
+int g_drawnTriangles = 0;			// triangles submitted last frame
+Camera g_camera;					// the packet's camera, while it is rendered
 bool g_moveCamera = false;
+double g_cursorX = 0.0;				// last cursor position
+double g_cursorY = 0.0;
+
+InputQueue g_inputQueue;			// raw events from the callbacks, read by consume_input
+bool g_keyDown[4] = { false, false, false, false };	// W, S, A, D
+double g_lastEventTime = 0.0;		// newest event consumed
+double g_lastLookTime = 0.0;		// newest cursor movement consumed while the camera was turning
+bool g_lateLatching = true;			// turn the camera by the latest cursor movement just before the draws are built
+double g_latchedLookTime = 0.0;		// newest cursor movement in the frame being rendered
+double g_lastMoveTime = 0.0;		// input event times the latencies were last measured for
+double g_lastMeasuredLookTime = 0.0;
+double g_displayDelay = 0.5 / 60.0;	// seconds from the swap to the middle of the screen being scanned out
+int g_inputEvents = 0;				// events consumed last frame
+int g_droppedInputEvents = 0;
+float g_latchedYaw = 0.0f;			// degrees the camera was turned by when it was latched last frame
+float g_lookLatency = 0.0f;			// estimated milliseconds from a cursor movement to it being on screen
+float g_moveLatency = 0.0f;			// the same for the keys, through the simulation
+float g_smoothedLookLatency = 0.0f;
+float g_smoothedMoveLatency = 0.0f;
+
+SimulationState g_simulation;				// camera, transforms and visibility, on the simulation thread
+TripleBuffer<SimulationInput> g_inputBuffer;	// render thread to simulation
+TripleBuffer<FramePacket> g_packetBuffer;	// simulation to render thread
+const FramePacket* g_packet = NULL;			// packet being rendered
+thread g_simulationThread;
+atomic<bool> g_simulationRunning(false);
+mutex g_simulationMutex;					// only for waking the simulation, the data goes through the triple buffers
+condition_variable g_simulationWake;
+bool g_threadedSimulation = true;			// simulate frame N on its own thread while frame N - 1 is submitted
+unsigned int g_renderFrame = 0;				// frames rendered
+int g_packetAge = 0;						// render frames between the input of the packet drawn and the frame drawing it
+float g_simulationTime = 0.0f;				// milliseconds of the last simulation step
+int g_animatedProps = 0;					// props animated alongside the scene, to measure the animation cost
+int g_animatedInstances = 0;				// instances evaluated in the last step
+int g_blendingInstances = 0;				// of them, cross-fading between two clips
+float g_animationTime = 0.0f;				// milliseconds evaluating them
+bool g_animationSimd = false;				// evaluated with AVX2
+CulledView g_views[1 + CUBE_MAP_FACES + SHADOW_MAX_VIEWS];	// reflection, cube faces and shadow views this frame
+int g_numberOfViews = 0;
+ScreenRect g_mirrorRect;					// the mirror on screen, when the reflection is updated
+
+JobSystem g_jobSystem;						// workers for the culling and the other per-frame loops
+int g_numberOfWorkers = 0;
+float g_jobUtilisation = 0.0f;				// percent of the workers' time spent on jobs, averaged over them
+int g_jobsRun = 0;							// jobs run by the workers in the last stats interval
+int g_jobSteals = 0;						// of which taken from another thread's deque
+float g_workerUtilisation[MAX_WORKER_STATS];	// percent, per worker
+
+LinearArena g_frameArena;					// the render thread's lists, emptied every frame
+LinearArena g_loadArena;					// images while they are read and uploaded, released after
+long long g_heapAllocationCount = 0;		// heap allocations up to the start of the frame
+int g_frameAllocations = 0;					// heap allocations any thread made during the last frame
+float g_frameArenaUsed = 0.0f;				// KB, the render thread's and the simulation's last frame
+int g_arenaOverflows = 0;					// allocations that have not fitted in the frame arenas
+float g_meshMemory = 0.0f;					// KB of vertex and index arrays still on the CPU
+float g_meshPoolFragmentation = 0.0f;		// 0 when the pool's free vertices are one block, towards 1 as they splinter
+
+#define NUMBER_OF_IMAGES 5					// 2D textures read from bitmaps
+
+int g_environmentResource = 0;				// tracked size of the environment map
+
+TextureStreamer g_textureStreamer;			// the 2D textures, only as sharp as they are seen
+int g_streamBias = 0;						// levels added to the ones the textures are seen at
+float g_streamedMemory = 0.0f;				// KB of streamed texture levels on the GPU
+float g_streamedFullMemory = 0.0f;			// KB they would take with every level
+int g_pendingStreams = 0;
+int g_streamLoads = 0;
+int g_streamReleases = 0;
+float g_gpuResourceMemory = 0.0f;			// KB of tracked GPU resources
+float g_cpuResourceMemory = 0.0f;			// KB of CPU copies of GPU data
+int g_residentCopies = 0;					// CPU copies still held after their upload
+float g_reportInterval = 0.0f;				// seconds between resource reports on the console, 0 = none
+bool g_reportResources = false;				// print one report now
+double g_timeSinceReport = 0.0;
+
+static void add_object(int mesh, int transform, int material, GLuint texture, GLuint normalMap, bool reflective, bool transparent)
+{
+	SceneObject object;
+	object.mesh = mesh;
+	object.transform = transform;
+	object.material = material;
+	object.texture = texture;
+	object.normalMap = normalMap;
+	object.textureStream = g_textureStreamer.findTexture(texture);
+	object.normalMapStream = g_textureStreamer.findTexture(normalMap);
+	object.reflective = reflective;
+	object.transparent = transparent;
+	object.mirror = false;
+	object.dynamic = false;
+	object.lod = 0;
+	object.distance = 0.0f;
+	object.occluder = -1;
+	object.scissor = g_fullScreen;
+
+	// the array never grows past what init reserved, the views hold pointers into it
+	if (g_objects.size() >= MAX_SCENE_OBJECTS)
+	{
+		cerr << "More than " << MAX_SCENE_OBJECTS << " scene objects" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	g_objects.push_back(object);
+}
+
+// load a depth-only program that draws from the pool's position-only VAO
+// its attributes are bound to the main program's locations, which the VAOs were set up with, and it is relinked
+static GLuint load_depth_program(const char* vertexShaderFile, const char* fragmentShaderFile, GLuint positionIndex, GLuint drawIDIndex)
+{
+	GLuint programID = loadShaders(vertexShaderFile, fragmentShaderFile);
+
+	glBindAttribLocation(programID, positionIndex, "aPosition");
+	glBindAttribLocation(programID, drawIDIndex, "aDrawID");
+	glLinkProgram(programID);
 
-bool load_mesh(const char* fileName, Mesh* mesh);
+	return programID;
+}
 
 static void init(GLFWwindow* window)
 {
+	// workers for the loading, the culling, the occlusion tiles and the cluster slices
+	g_jobSystem.init();
+	g_numberOfWorkers = static_cast<int>(g_jobSystem.getNumberOfWorkers());
+
 	glEnable(GL_DEPTH_TEST);	// enable depth buffer test
 
 	// create and compile our GLSL program from the shader files
@@ -165,29 +592,35 @@ static void init(GLFWwindow* window)
 	GLuint normalIndex = glGetAttribLocation(g_shaderProgramID, "aNormal");
 	GLuint tangentIndex = glGetAttribLocation(g_shaderProgramID, "aTangent");
 	GLuint texCoordIndex = glGetAttribLocation(g_shaderProgramID, "aTexCoord");
+	GLuint drawIDIndex = glGetAttribLocation(g_shaderProgramID, "aDrawID");
 
-	g_MVP_Index = glGetUniformLocation(g_shaderProgramID, "uModelViewProjectionMatrix");
-	g_MV_Index = glGetUniformLocation(g_shaderProgramID, "uModelViewMatrix");
-	g_V_Index = glGetUniformLocation(g_shaderProgramID, "uViewMatrix");
-
-	g_surfaceIsReflective = glGetUniformLocation(g_shaderProgramID, "isReflective");
 	g_envMapSamplerIndex = glGetUniformLocation(g_shaderProgramID, "uEnvironmentMap");
-	g_alphaIndex = glGetUniformLocation(g_shaderProgramID, "uAlpha");
+	g_reflectionSamplerIndex = glGetUniformLocation(g_shaderProgramID, "uReflectionMap");
+	g_lightsSamplerIndex = glGetUniformLocation(g_shaderProgramID, "uLights");
+	g_clusterSamplerIndex = glGetUniformLocation(g_shaderProgramID, "uClusters");
+	g_lightIndexSamplerIndex = glGetUniformLocation(g_shaderProgramID, "uLightIndices");
+	g_drawDataSamplerIndex = glGetUniformLocation(g_shaderProgramID, "uDrawData");
+	g_drawDataBaseIndex = glGetUniformLocation(g_shaderProgramID, "uDrawDataBase");
+	g_transparencyModeIndex = glGetUniformLocation(g_shaderProgramID, "uTransparencyMode");
+	g_shadingModeIndex = glGetUniformLocation(g_shaderProgramID, "uShadingMode");
 
 	g_texSamplerIndex = glGetUniformLocation(g_shaderProgramID, "uTextureSampler");
 	g_normalSamplerIndex = glGetUniformLocation(g_shaderProgramID, "uNormalSampler");
+	g_shadowCascadeSamplerIndex = glGetUniformLocation(g_shaderProgramID, "uShadowCascades");
+	g_shadowCubeSamplerIndex = glGetUniformLocation(g_shaderProgramID, "uShadowCube");
+
+	g_shadowProgramID = load_depth_program("ShadowVS.vert", "ShadowFS.frag", positionIndex, drawIDIndex);
+	g_shadowDrawDataSamplerIndex = glGetUniformLocation(g_shadowProgramID, "uDrawData");
+	g_shadowDrawDataBaseIndex = glGetUniformLocation(g_shadowProgramID, "uDrawDataBase");
+	g_shadowFarPlaneIndex = glGetUniformLocation(g_shadowProgramID, "uFarPlane");
 
-	g_lightPositionIndex = glGetUniformLocation(g_shaderProgramID, "uLight.position");
-	g_lightDirectionIndex = glGetUniformLocation(g_shaderProgramID, "uLight.direction");
-	g_lightAmbientIndex = glGetUniformLocation(g_shaderProgramID, "uLight.ambient");
-	g_lightDiffuseIndex = glGetUniformLocation(g_shaderProgramID, "uLight.diffuse");
-	g_lightSpecularIndex = glGetUniformLocation(g_shaderProgramID, "uLight.specular");
-	g_lightTypeIndex = glGetUniformLocation(g_shaderProgramID, "uLight.type");
+	g_depthProgramID = load_depth_program("DepthVS.vert", "DepthFS.frag", positionIndex, drawIDIndex);
+	g_depthDrawDataSamplerIndex = glGetUniformLocation(g_depthProgramID, "uDrawData");
+	g_depthDrawDataBaseIndex = glGetUniformLocation(g_depthProgramID, "uDrawDataBase");
 
-	g_materialAmbientIndex = glGetUniformLocation(g_shaderProgramID, "uMaterial.ambient");
-	g_materialDiffuseIndex = glGetUniformLocation(g_shaderProgramID, "uMaterial.diffuse");
-	g_materialSpecularIndex = glGetUniformLocation(g_shaderProgramID, "uMaterial.specular");
-	g_materialShininessIndex = glGetUniformLocation(g_shaderProgramID, "uMaterial.shininess");
+	// the view matrix and light come from a uniform buffer range bound to binding point 0
+	glUniformBlockBinding(g_shaderProgramID, glGetUniformBlockIndex(g_shaderProgramID, "FrameData"), 0);
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &g_uniformBufferAlignment);
 
 	// initialise model matrix to the identity matrix
 	g_modelMatrix[0] = glm::mat4(1.0f);
@@ -204,6 +637,11 @@ static void init(GLFWwindow* window)
 	g_modelMatrix[11] = glm::mat4(1.0f);
 	g_modelMatrix[12] = glm::mat4(1.0f);
 	g_modelMatrix[13] = glm::mat4(1.0f);
+	g_modelMatrix[14] = glm::mat4(1.0f);
+	g_modelMatrix[15] = glm::mat4(1.0f);
+	g_modelMatrix[16] = glm::mat4(1.0f);
+	g_modelMatrix[17] = glm::mat4(1.0f);
+	g_modelMatrix[18] = glm::mat4(1.0f);
 	//floor
 	g_modelMatrix[0] = translate(vec3(0.0f, -6.0f, 12.0f)) * rotate(radians(90.0f), vec3(1.0f, 0.0f, 0.0f)) * scale(vec3(12.0f, 12.0f, 1.0f));
 	//walls
@@ -224,26 +662,53 @@ static void init(GLFWwindow* window)
 	//wallpaper
 	g_modelMatrix[12] = translate(vec3(0.0f, 0.0f, 0.1f)) * rotate(radians(180.0f), vec3(1.0f, 0.0f, 0.0f)) * scale(vec3(3.0f, 3.0f, 1.0f));
 	g_modelMatrix[13] = translate(vec3(0.0f, 0.0f, 23.9f)) * rotate(radians(0.0f), vec3(1.0f, 0.0f, 0.0f)) * scale(vec3(3.0f, 3.0f, 1.0f));
+	// glass case around the torus, resting on the pedestal
+	g_modelMatrix[14] = translate(vec3(0.0f, -2.5f, 13.5f)) * rotate(radians(0.0f), vec3(0.0f, 1.0f, 0.0f)) * scale(vec3(1.5f, 1.5f, 1.0f));
+	g_modelMatrix[15] = translate(vec3(0.0f, -2.5f, 10.5f)) * rotate(radians(180.0f), vec3(0.0f, 1.0f, 0.0f)) * scale(vec3(1.5f, 1.5f, 1.0f));
+	g_modelMatrix[16] = translate(vec3(1.5f, -2.5f, 12.0f)) * rotate(radians(90.0f), vec3(0.0f, 1.0f, 0.0f)) * scale(vec3(1.5f, 1.5f, 1.0f));
+	g_modelMatrix[17] = translate(vec3(-1.5f, -2.5f, 12.0f)) * rotate(radians(-90.0f), vec3(0.0f, 1.0f, 0.0f)) * scale(vec3(1.5f, 1.5f, 1.0f));
+	g_modelMatrix[18] = translate(vec3(0.0f, -1.0f, 12.0f)) * rotate(radians(-90.0f), vec3(1.0f, 0.0f, 0.0f)) * scale(vec3(1.5f, 1.5f, 1.0f));
 
 	// initialise view matrix
 	int width, height;
 	glfwGetFramebufferSize(window, &width, &height);
 	float aspectRatio = static_cast<float>(width) / height;
 
-	g_camera.setViewMatrix(glm::vec3(0.0f, -2.0f, 20.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	g_camera.setViewMatrix(glm::vec3(0.0f, -2.0f, 20.0f), glm::vec3(0.0f, 0.0f, 0.0f));
 	g_camera.setProjection(glm::radians(45.0f), aspectRatio, 0.1f, 100.0f);
 
-	// load mesh
-	//	load_mesh("models/sphere.obj", &g_mesh);
-	load_mesh("models/torus.obj", &g_mesh);
+	// create the shared mesh buffers
+	g_meshPool.init(1 << 16, 1 << 18, positionIndex, normalIndex, tangentIndex, texCoordIndex);
+
+	// add the quad used for walls, floor, frames and glass
+	Mesh quad;
+	quad.pMeshVertices = g_vertices;
+	quad.numberOfVertices = sizeof(g_vertices) / sizeof(Vertex);
+	quad.pMeshIndices = g_indices;
+	quad.numberOfFaces = sizeof(g_indices) / (3 * sizeof(GLint));
+	init_mesh_lods(&quad);
+	g_quadMesh = g_meshPool.addMesh(&quad);
+
+	// load every submesh of the model into the pool
+	//	g_meshPool.loadScene("models/sphere.obj", &g_torusMeshes, &g_jobSystem);
+	g_meshPool.loadScene("models/torus.obj", &g_torusMeshes, &g_jobSystem);
 
 	// initialise point light properties
 	g_lightPoint.position = glm::vec3(1.0f, 1.0f, 1.0f);
+	g_lightPoint.direction = glm::vec3(0.0f);
 	g_lightPoint.ambient = glm::vec3(1.0f, 1.0f, 1.0f);
 	g_lightPoint.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
 	g_lightPoint.specular = glm::vec3(1.0f, 1.0f, 1.0f);
 	g_lightPoint.type = 0;
 
+	// initialise directional light properties
+	g_lightDirectional.position = glm::vec3(0.0f);
+	g_lightDirectional.direction = glm::normalize(glm::vec3(0.3f, -1.0f, 0.4f));
+	g_lightDirectional.ambient = glm::vec3(0.6f, 0.6f, 0.6f);
+	g_lightDirectional.diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+	g_lightDirectional.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+	g_lightDirectional.type = 1;
+
 
 	// initialise material properties
 	g_material[0].ambient = glm::vec3(0.3f, 0.3f, 0.3f);
@@ -261,737 +726,1657 @@ static void init(GLFWwindow* window)
 	g_material[2].specular = glm::vec3(2.0f, 0.7f, 1.0f);
 	g_material[2].shininess = 40.0f;
 
-	// read the image data
-	GLint imageWidth[6];			//image width info
-	GLint imageHeight[6];			//image height info
-	g_texImage[0] = readBitmapRGBImage("images/Fieldstone.bmp", &imageWidth[0], &imageHeight[0]);
-	g_texImage[1] = readBitmapRGBImage("images/FieldstoneBumpDOT3.bmp", &imageWidth[1], &imageHeight[1]);
-	g_texImage[2] = readBitmapRGBImage("images/White.bmp", &imageWidth[5], &imageHeight[5]);
+	// the images are read into scratch memory that goes once the textures are uploaded
+	// the 2D textures start with only their small levels, the rest is streamed in as they are seen up close
+	const char* imageFiles[NUMBER_OF_IMAGES] = { "images/Fieldstone.bmp", "images/FieldstoneBumpDOT3.bmp", "images/Tile4.bmp",
+		"images/Tile4BumpDOT3.bmp", "images/White.bmp" };
+	const int imageTextures[NUMBER_OF_IMAGES] = { 0, 1, 2, 3, 5 };		// index in g_textureID, 4 is the environment
+	g_loadArena.init(LOAD_ARENA_SIZE, MEMORY_LOAD);
+	g_textureStreamer.init();
+
+	for (int i = 0; i < NUMBER_OF_IMAGES; i++)
+	{
+		int handle = g_textureStreamer.addTexture(imageFiles[i], &g_loadArena);
+		if (handle < 0)
+			exit(EXIT_FAILURE);
 
-	floorImage[0] = readBitmapRGBImage("images/Tile4.bmp", &imageWidth[2], &imageHeight[2]);
-	floorImage[1] = readBitmapRGBImage("images/Tile4BumpDOT3.bmp", &imageWidth[3], &imageHeight[3]);
+		g_textureID[imageTextures[i]] = g_textureStreamer.getTexture(handle);
+	}
 
-	cube_texImage[FRONT] = readBitmapRGBImage("images/cm_front.bmp", &imageWidth[4], &imageHeight[4]);
-	cube_texImage[BACK] = readBitmapRGBImage("images/cm_back.bmp", &imageWidth[4], &imageHeight[4]);
-	cube_texImage[LEFT] = readBitmapRGBImage("images/cm_left.bmp", &imageWidth[4], &imageHeight[4]);
-	cube_texImage[RIGHT] = readBitmapRGBImage("images/cm_right.bmp", &imageWidth[4], &imageHeight[4]);
-	cube_texImage[TOP] = readBitmapRGBImage("images/cm_top.bmp", &imageWidth[4], &imageHeight[4]);
-	cube_texImage[BOTTOM] = readBitmapRGBImage("images/cm_bottom.bmp", &imageWidth[4], &imageHeight[4]);
+	// irradiance and a GGX mip chain for the cube map, computed once and cached
+	const char* cubeFaceFiles[6] = { "images/cm_right.bmp", "images/cm_left.bmp", "images/cm_top.bmp",
+		"images/cm_bottom.bmp", "images/cm_back.bmp", "images/cm_front.bmp" };
+	if (!load_environment_lighting(cubeFaceFiles, "images/cm.env.cache", &g_environment, &g_loadArena, &g_jobSystem))
+		exit(EXIT_FAILURE);
 
+	size_t environmentBytes = 0;
+	for (int mip = 0; mip < g_environment.numberOfMips; mip++)
+		environmentBytes += sizeof(float) * g_environment.texels[mip].size();
+	int environmentStaging = track_resource("Environment texels", RESOURCE_CPU_STAGING, environmentBytes);
 
 	// generate identifier for texture object and set texture properties
-	glGenTextures(5, g_textureID);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[0]);
+	glGenTextures(1, &g_textureID[4]);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, g_textureID[4]);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth[0], imageHeight[0], 0, GL_BGR, GL_UNSIGNED_BYTE, g_texImage[0]);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	// each mip holds the environment prefiltered for a higher roughness
+	for (int mip = 0; mip < g_environment.numberOfMips; mip++)
+	{
+		GLint mipSize = std::max(g_environment.size >> mip, 1);
+		GLsizei faceTexels = mipSize * mipSize * 3;
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		for (int face = 0; face < 6; face++)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGB16F, mipSize, mipSize, 0, GL_RGB, GL_FLOAT, &g_environment.texels[mip][face * faceTexels]);
+	}
 
-	glBindTexture(GL_TEXTURE_2D, g_textureID[1]);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, g_environment.numberOfMips - 1);
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);		// blurred mips would show the face edges otherwise
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth[1], imageHeight[1], 0, GL_BGR, GL_UNSIGNED_BYTE, g_texImage[1]);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	// RGB16F is kept as RGBA16F
+	g_environmentResource = track_texture("Environment map", RESOURCE_TEXTURE, g_environment.size, g_environment.size, 6, 8, g_environment.numberOfMips);
+	mark_uploaded(environmentStaging);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// the GL has its own copies of the images now
+	g_loadArena.destroy();
 
-	glBindTexture(GL_TEXTURE_2D, g_textureID[2]);
+	// nor are the environment's texels needed, only its irradiance is read on the CPU
+	for (int mip = 0; mip < g_environment.numberOfMips; mip++)
+		vector<float>().swap(g_environment.texels[mip]);
+	untrack_resource(environmentStaging);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth[2], imageHeight[2], 0, GL_BGR, GL_UNSIGNED_BYTE, floorImage[0]);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	// per-frame data is streamed through a triple-buffered ring buffer
+	g_streamBuffer.init(256 * 1024);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// lists built and thrown away every frame
+	g_frameArena.init(FRAME_ARENA_SIZE, MEMORY_FRAME);
 
-	glBindTexture(GL_TEXTURE_2D, g_textureID[3]);
+	// per-draw data and indirect submission for the shared VAO
+	g_drawSubmitter.init(&g_meshPool, &g_streamBuffer, drawIDIndex, 64);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth[3], imageHeight[3], 0, GL_BGR, GL_UNSIGNED_BYTE, floorImage[1]);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	// reflection in the glass pane, rendered offscreen at a reduced resolution
+	g_reflection.init(g_windowWidth, g_windowHeight, g_reflectionScale);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// pre-pass and opaque pass timings
+	g_gpuQueries.init(NUMBER_OF_GPU_PASSES);
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, g_textureID[4]);
+	// targets for weighted blended transparency, the same size as the window
+	g_oit.init(g_windowWidth, g_windowHeight);
 
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_RGB, imageWidth[4], imageHeight[4], 0, GL_BGR, GL_UNSIGNED_BYTE, cube_texImage[RIGHT]);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, GL_RGB, imageWidth[4], imageHeight[4], 0, GL_BGR, GL_UNSIGNED_BYTE, cube_texImage[LEFT]);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, GL_RGB, imageWidth[4], imageHeight[4], 0, GL_BGR, GL_UNSIGNED_BYTE, cube_texImage[TOP]);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, GL_RGB, imageWidth[4], imageHeight[4], 0, GL_BGR, GL_UNSIGNED_BYTE, cube_texImage[BOTTOM]);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, GL_RGB, imageWidth[4], imageHeight[4], 0, GL_BGR, GL_UNSIGNED_BYTE, cube_texImage[BACK]);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, GL_RGB, imageWidth[4], imageHeight[4], 0, GL_BGR, GL_UNSIGNED_BYTE, cube_texImage[FRONT]);
+	// offscreen scene at up to the window's resolution
+	g_sceneTarget.init(g_windowWidth, g_windowHeight);
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-	glBindTexture(GL_TEXTURE_2D, g_textureID[5]);
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth[5], imageHeight[5], 0, GL_BGR, GL_UNSIGNED_BYTE, g_texImage[2]);
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	// generate identifier for VBOs and copy data to GPU
-	glGenBuffers(3, g_VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, g_VBO[0]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertices), g_vertices, GL_STATIC_DRAW);
-
-	// generate identifiers for VAO
-	glGenVertexArrays(3, g_VAO);
-
-	// create VAO and specify VBO data
-	glBindVertexArray(g_VAO[0]);
-	glBindBuffer(GL_ARRAY_BUFFER, g_VBO[0]);
-	glVertexAttribPointer(positionIndex, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, position)));
-	glVertexAttribPointer(normalIndex, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, normal)));
-	glVertexAttribPointer(tangentIndex, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, tangent)));
-	glVertexAttribPointer(texCoordIndex, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, texCoord)));
-
-	glEnableVertexAttribArray(positionIndex);	// enable vertex attributes
-	glEnableVertexAttribArray(normalIndex);
-	glEnableVertexAttribArray(tangentIndex);
-	glEnableVertexAttribArray(texCoordIndex);
-
-
-	glBindBuffer(GL_ARRAY_BUFFER, g_VBO[1]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertices), g_vertices, GL_STATIC_DRAW);
-	glBindVertexArray(g_VAO[1]);
-
-	glBindBuffer(GL_ARRAY_BUFFER, g_VBO[1]);
-	glVertexAttribPointer(positionIndex, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, position)));
-	glVertexAttribPointer(normalIndex, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, normal)));
-	glVertexAttribPointer(tangentIndex, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, tangent)));
-	glVertexAttribPointer(texCoordIndex, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, texCoord)));
-
-	glEnableVertexAttribArray(positionIndex);	// enable vertex attributes
-	glEnableVertexAttribArray(normalIndex);
-	glEnableVertexAttribArray(tangentIndex);
-	glEnableVertexAttribArray(texCoordIndex);
-
-
-	glBindBuffer(GL_ARRAY_BUFFER, g_VBO[2]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex)*g_mesh.numberOfVertices, g_mesh.pMeshVertices, GL_STATIC_DRAW);
-
-	// generate identifier for IBO and copy data to GPU
-	glGenBuffers(1, &g_IBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_IBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLint) * 3 * g_mesh.numberOfFaces, g_mesh.pMeshIndices, GL_STATIC_DRAW);
-
-	glBindVertexArray(g_VAO[2]);
-	glBindBuffer(GL_ARRAY_BUFFER, g_VBO[2]);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_IBO);
-	glVertexAttribPointer(positionIndex, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, position)));
-	glVertexAttribPointer(normalIndex, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, normal)));
-	glVertexAttribPointer(tangentIndex, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, tangent)));
-	glVertexAttribPointer(texCoordIndex, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, texCoord)));
-
-	glEnableVertexAttribArray(positionIndex);	// enable vertex attributes
-	glEnableVertexAttribArray(normalIndex);
-	glEnableVertexAttribArray(tangentIndex);
-	glEnableVertexAttribArray(texCoordIndex);
-}
+	// shadow maps are allocated for the main light's type when they are first needed
+	g_shadowMaps.init();
 
-// function used to update the scene
-static void update_scene(GLFWwindow* window, float frameTime)
-{
-	// variables to store forward/back and strafe movement
-	float moveForward = 0;
-	float strafeRight = 0;
+	// frame deltas from here on
+	g_frameTimer.init();
 
-	// update movement variables based on keyboard input
-	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-		moveForward += 1 * MOVEMENT_SENSITIVITY * frameTime;
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-		moveForward -= 1 * MOVEMENT_SENSITIVITY * frameTime;
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-		strafeRight -= 1 * MOVEMENT_SENSITIVITY * frameTime;
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-		strafeRight += 1 * MOVEMENT_SENSITIVITY * frameTime;
+	// half a refresh to scan out to the middle of the screen, for the latency estimates
+	const GLFWvidmode* videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+	if (videoMode != NULL && videoMode->refreshRate > 0)
+		g_displayDelay = 0.5 / videoMode->refreshRate;
 
-	g_modelMatrix[5] *= rotate(radians(ROTATION_SENSITIVITY), vec3(0.0f, 0.0f, 1.0f));
+	// light fixtures are assigned to clusters every frame
+	g_clusteredLights.init(&g_jobSystem);
 
+	// environment map of the room around the torus, a small face at a time
+	g_cubeCapture.init(128, 0.1f, 100.0f);
 
+	// the walls and floor hide whatever is behind them
+	g_occlusionCuller.init(&g_jobSystem);
+	int quadOccluder = g_occlusionCuller.addOccluderMesh(g_vertices, quad.numberOfVertices, g_indices, quad.numberOfFaces);
 
-	g_camera.update(moveForward, strafeRight);	// update camera
-}
+	// scene objects, in the order they used to be drawn; they and the views' lists of them never reallocate
+	g_objects.reserve(MAX_SCENE_OBJECTS);
 
-static void draw_walls(bool isReflect) {
+	for (int i = 0; i < 1 + CUBE_MAP_FACES + SHADOW_MAX_VIEWS; i++)
+	{
+		g_views[i].objects.reserve(MAX_SCENE_OBJECTS);
+		g_views[i].dynamicObjects.reserve(MAX_SCENE_OBJECTS);
+	}
 
-	glUseProgram(g_shaderProgramID);	// use the shaders associated with the shader program
+	add_object(g_quadMesh, 0, 1, g_textureID[2], g_textureID[3], false, false);	// floor
+	g_objects.back().occluder = quadOccluder;
 
-	glBindVertexArray(g_VAO[0]);		// make VAO active
+	for (int i = 1; i <= 4; i++)
+	{
+		add_object(g_quadMesh, i, 0, g_textureID[0], g_textureID[1], false, false);	// walls
+		g_objects.back().occluder = quadOccluder;
+	}
 
-	mat4 MVP[12];
-	mat4 MV[12];
-	glm::mat4 reflectMatrix = mat4(1.0f);
-	glm::mat4 modelMatrix = mat4(1.0f);
+	for (int i = 6; i <= 10; i++)
+		add_object(g_quadMesh, i, 0, g_textureID[0], g_textureID[1], false, false);	// pedestal
 
-	glm::vec3 lightPosition = g_lightPoint.position;
+	add_object(g_quadMesh, 12, 0, g_textureID[5], g_textureID[5], false, false);	// frames
+	add_object(g_quadMesh, 13, 0, g_textureID[5], g_textureID[5], false, false);
 
-	if (isReflect) {
-		reflectMatrix = glm::scale(vec3(1.0f, -1.0f, 1.0f));
-		lightPosition = vec3(reflectMatrix * vec4(lightPosition, 1.0f));
-	}
-	else {
-		reflectMatrix = mat4(1.0f);
+	g_cubeMapObject = static_cast<int>(g_objects.size());
+	for (size_t i = 0; i < g_torusMeshes.size(); i++)
+	{
+		add_object(g_torusMeshes[i], 5, 2, g_textureID[5], g_textureID[5], true, false);	// torus
+		g_objects.back().dynamic = true;
 	}
 
-	// set uniform shader variables
-	modelMatrix = reflectMatrix * g_modelMatrix[1];
-	MVP[0] = g_camera.getProjectionMatrix() * g_camera.getViewMatrix() * modelMatrix;
-	MV[0] = g_camera.getViewMatrix() * modelMatrix;
-	glm::mat4 V = g_camera.getViewMatrix();
-	glUniformMatrix4fv(g_MVP_Index, 1, GL_FALSE, &MVP[0][0][0]);
-	glUniformMatrix4fv(g_MV_Index, 1, GL_FALSE, &MV[0][0][0]);
-	glUniformMatrix4fv(g_V_Index, 1, GL_FALSE, &V[0][0]);
+	add_object(g_quadMesh, 11, 0, g_textureID[0], g_textureID[1], false, true);	// glass
+	g_objects.back().mirror = true;
+	g_mirrorObject = static_cast<int>(g_objects.size() - 1);
 
-	glUniform3fv(g_lightPositionIndex, 1, &g_lightPoint.position[0]);
-	glUniform3fv(g_lightAmbientIndex, 1, &g_lightPoint.ambient[0]);
-	glUniform3fv(g_lightDiffuseIndex, 1, &g_lightPoint.diffuse[0]);
-	glUniform3fv(g_lightSpecularIndex, 1, &g_lightPoint.specular[0]);
-	glUniform1i(g_lightTypeIndex, g_lightPoint.type);
+	for (int i = 14; i <= 18; i++)
+		add_object(g_quadMesh, i, 1, g_textureID[5], g_textureID[5], false, true);	// glass case
 
-	glUniform3fv(g_materialAmbientIndex, 1, &g_material[0].ambient[0]);
-	glUniform3fv(g_materialDiffuseIndex, 1, &g_material[0].diffuse[0]);
-	glUniform3fv(g_materialSpecularIndex, 1, &g_material[0].specular[0]);
-	glUniform1fv(g_materialShininessIndex, 1, &g_material[0].shininess);
+	// the glass pane splits the room into a gallery and an alcove behind it; the pane does not reach the
+	// walls, so the portal between the two cells is the whole cross-section of the room at z = 6
+	AABB gallery = { vec3(-12.0f, -6.0f, 6.0f), vec3(12.0f, 6.0f, 24.0f) };
+	AABB alcove = { vec3(-12.0f, -6.0f, 0.0f), vec3(12.0f, 6.0f, 6.0f) };
+	int galleryCell = g_portalGraph.addCell(gallery);
+	int alcoveCell = g_portalGraph.addCell(alcove);
 
-	glUniform1i(g_surfaceIsReflective, false);
+	vector<vec3> opening;
+	opening.push_back(vec3(-12.0f, -6.0f, 6.0f));
+	opening.push_back(vec3(12.0f, -6.0f, 6.0f));
+	opening.push_back(vec3(12.0f, 6.0f, 6.0f));
+	opening.push_back(vec3(-12.0f, 6.0f, 6.0f));
+	g_portalGraph.addPortal(galleryCell, alcoveCell, opening);
 
-	glUniform1i(g_texSamplerIndex, 0);
-	glUniform1i(g_normalSamplerIndex, 1);
+	for (size_t i = 0; i < g_objects.size(); i++)
+	{
+		const SceneObject& object = g_objects[i];
+		g_portalGraph.addObject(static_cast<int>(i), transform_aabb(g_meshPool.getMesh(object.mesh).bounds, g_modelMatrix[object.transform]));
+	}
+}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[0]);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[1]);
-
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-
-	// set uniform shader variables
-	modelMatrix = reflectMatrix * g_modelMatrix[2];
-	MVP[1] = g_camera.getProjectionMatrix() * g_camera.getViewMatrix() * modelMatrix;
-	MV[1] = g_camera.getViewMatrix() * modelMatrix;
-	V = g_camera.getViewMatrix();
-	glUniformMatrix4fv(g_MVP_Index, 1, GL_FALSE, &MVP[1][0][0]);
-	glUniformMatrix4fv(g_MV_Index, 1, GL_FALSE, &MV[1][0][0]);
-	glUniformMatrix4fv(g_V_Index, 1, GL_FALSE, &V[0][0]);
-
-	glUniform3fv(g_lightPositionIndex, 1, &g_lightPoint.position[0]);
-	glUniform3fv(g_lightAmbientIndex, 1, &g_lightPoint.ambient[0]);
-	glUniform3fv(g_lightDiffuseIndex, 1, &g_lightPoint.diffuse[0]);
-	glUniform3fv(g_lightSpecularIndex, 1, &g_lightPoint.specular[0]);
-	glUniform1i(g_lightTypeIndex, g_lightPoint.type);
-
-	glUniform3fv(g_materialAmbientIndex, 1, &g_material[0].ambient[0]);
-	glUniform3fv(g_materialDiffuseIndex, 1, &g_material[0].diffuse[0]);
-	glUniform3fv(g_materialSpecularIndex, 1, &g_material[0].specular[0]);
-	glUniform1fv(g_materialShininessIndex, 1, &g_material[0].shininess);
-
-	glUniform1i(g_surfaceIsReflective, false);
-	glUniform1i(g_texSamplerIndex, 0);
-	glUniform1i(g_normalSamplerIndex, 1);
+// apply the queued events to the input state, in the order they arrived
+static void consume_input()
+{
+	static const int keys[4] = { GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D };
+	InputEvent event;
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[0]);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[1]);
-
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-
-	// set uniform shader variables
-	modelMatrix = reflectMatrix * g_modelMatrix[3];
-	MVP[2] = g_camera.getProjectionMatrix() * g_camera.getViewMatrix() * modelMatrix;
-	MV[2] = g_camera.getViewMatrix() * modelMatrix;
-	V = g_camera.getViewMatrix();
-	glUniformMatrix4fv(g_MVP_Index, 1, GL_FALSE, &MVP[2][0][0]);
-	glUniformMatrix4fv(g_MV_Index, 1, GL_FALSE, &MV[2][0][0]);
-	glUniformMatrix4fv(g_V_Index, 1, GL_FALSE, &V[0][0]);
-
-	glUniform3fv(g_lightPositionIndex, 1, &g_lightPoint.position[0]);
-	glUniform3fv(g_lightAmbientIndex, 1, &g_lightPoint.ambient[0]);
-	glUniform3fv(g_lightDiffuseIndex, 1, &g_lightPoint.diffuse[0]);
-	glUniform3fv(g_lightSpecularIndex, 1, &g_lightPoint.specular[0]);
-	glUniform1i(g_lightTypeIndex, g_lightPoint.type);
-
-	glUniform3fv(g_materialAmbientIndex, 1, &g_material[0].ambient[0]);
-	glUniform3fv(g_materialDiffuseIndex, 1, &g_material[0].diffuse[0]);
-	glUniform3fv(g_materialSpecularIndex, 1, &g_material[0].specular[0]);
-	glUniform1fv(g_materialShininessIndex, 1, &g_material[0].shininess);
-
-	glUniform1i(g_surfaceIsReflective, false);
-	glUniform1i(g_texSamplerIndex, 0);
-	glUniform1i(g_normalSamplerIndex, 1);
+	while (g_inputQueue.pop(&event))
+	{
+		if (event.type == INPUT_CURSOR)
+		{
+			g_cursorX = event.x;
+			g_cursorY = event.y;
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[0]);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[1]);
-
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-
-	// set uniform shader variables
-	modelMatrix = reflectMatrix * g_modelMatrix[4];
-	MVP[3] = g_camera.getProjectionMatrix() * g_camera.getViewMatrix() * modelMatrix;
-	MV[3] = g_camera.getViewMatrix() * modelMatrix;
-	V = g_camera.getViewMatrix();
-	glUniformMatrix4fv(g_MVP_Index, 1, GL_FALSE, &MVP[3][0][0]);
-	glUniformMatrix4fv(g_MV_Index, 1, GL_FALSE, &MV[3][0][0]);
-	glUniformMatrix4fv(g_V_Index, 1, GL_FALSE, &V[0][0]);
-
-	glUniform3fv(g_lightPositionIndex, 1, &g_lightPoint.position[0]);
-	glUniform3fv(g_lightAmbientIndex, 1, &g_lightPoint.ambient[0]);
-	glUniform3fv(g_lightDiffuseIndex, 1, &g_lightPoint.diffuse[0]);
-	glUniform3fv(g_lightSpecularIndex, 1, &g_lightPoint.specular[0]);
-	glUniform1i(g_lightTypeIndex, g_lightPoint.type);
-	
+			if (g_moveCamera)
+				g_lastLookTime = event.time;
+		}
+		else if (event.type == INPUT_MOUSE_BUTTON)
+		{
+			if (event.code == GLFW_MOUSE_BUTTON_RIGHT && event.action != GLFW_REPEAT)
+				g_moveCamera = (event.action == GLFW_PRESS);
+		}
+		else
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				if (event.code == keys[i] && event.action != GLFW_REPEAT)
+					g_keyDown[i] = (event.action == GLFW_PRESS);
+			}
+		}
 
-	glUniform3fv(g_materialAmbientIndex, 1, &g_material[0].ambient[0]);
-	glUniform3fv(g_materialDiffuseIndex, 1, &g_material[0].diffuse[0]);
-	glUniform3fv(g_materialSpecularIndex, 1, &g_material[0].specular[0]);
-	glUniform1fv(g_materialShininessIndex, 1, &g_material[0].shininess);
+		g_lastEventTime = event.time;
+		g_inputEvents++;
+	}
 
-	glUniform1i(g_surfaceIsReflective, false);
-	glUniform1i(g_texSamplerIndex, 0);
-	glUniform1i(g_normalSamplerIndex, 1);
+	g_droppedInputEvents = g_inputQueue.getDroppedEvents();
+}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[0]);
+// snapshot the input and every setting the simulation reads
+static void gather_input(SimulationInput* input)
+{
+	g_inputEvents = 0;
+	consume_input();
+
+	input->frame = ++g_renderFrame;
+	input->time = g_frameTimer.getTime();
+	input->eventTime = g_lastEventTime;
+	input->timestep = 1.0 / max(g_simulationRate, 1);
+	input->interpolate = g_interpolation;
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[1]);
+	// update movement variables based on keyboard input
+	input->moveForward = (g_keyDown[0] ? 1.0f : 0.0f) - (g_keyDown[1] ? 1.0f : 0.0f);
+	input->strafeRight = (g_keyDown[3] ? 1.0f : 0.0f) - (g_keyDown[2] ? 1.0f : 0.0f);
+
+	input->cursorX = g_cursorX;
+	input->cursorY = g_cursorY;
+	input->rotating = g_moveCamera;
+	input->lateLatching = g_lateLatching;
+	input->animatedProps = min(max(g_animatedProps, 0), MAX_ANIMATED_PROPS);
+
+	input->directional = g_directional;
+	input->lightPoint = g_lightPoint;
+	input->lightDirectional = g_lightDirectional;
+
+	input->portalCulling = g_portalCulling;
+	input->portalScissor = g_portalScissor;
+	input->occlusionCulling = g_occlusionCulling;
+	input->lodThreshold = g_activeLodThreshold;
+	input->lodHysteresis = g_lodHysteresis;
+	input->renderHeight = static_cast<float>(g_renderHeight);
+}
+
+static bool same_rect(const ScreenRect& a, const ScreenRect& b)
+{
+	return a.minX == b.minX && a.minY == b.minY && a.maxX == b.maxX && a.maxY == b.maxY;
+}
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+// ties are broken by the objects' places in the scene, which is the order the lists are built in, so sort gives
+// what stable_sort would without the buffer stable_sort allocates
+static bool compare_textures(const SceneObject* a, const SceneObject* b)
+{
+	if (a->texture != b->texture)
+		return a->texture < b->texture;
+	if (a->normalMap != b->normalMap)
+		return a->normalMap < b->normalMap;
+	return a < b;
+}
 
-	modelMatrix = reflectMatrix * g_modelMatrix[6];
-	MVP[4] = g_camera.getProjectionMatrix() * g_camera.getViewMatrix() * modelMatrix;
-	MV[4] = g_camera.getViewMatrix() * modelMatrix;
-	V = g_camera.getViewMatrix();
-	glUniformMatrix4fv(g_MVP_Index, 1, GL_FALSE, &MVP[4][0][0]);
-	glUniformMatrix4fv(g_MV_Index, 1, GL_FALSE, &MV[4][0][0]);
-	glUniformMatrix4fv(g_V_Index, 1, GL_FALSE, &V[0][0]);
+// objects sharing a scissor rectangle and textures end up next to each other so they can be drawn as one batch
+static bool compare_state(const SceneObject* a, const SceneObject* b)
+{
+	if (!same_rect(a->scissor, b->scissor))
+	{
+		if (a->scissor.minX != b->scissor.minX)
+			return a->scissor.minX < b->scissor.minX;
+		if (a->scissor.minY != b->scissor.minY)
+			return a->scissor.minY < b->scissor.minY;
+		if (a->scissor.maxX != b->scissor.maxX)
+			return a->scissor.maxX < b->scissor.maxX;
+		return a->scissor.maxY < b->scissor.maxY;
+	}
+	return compare_textures(a, b);
+}
 
-	glUniform3fv(g_lightPositionIndex, 1, &g_lightPoint.position[0]);
-	glUniform3fv(g_lightAmbientIndex, 1, &g_lightPoint.ambient[0]);
-	glUniform3fv(g_lightDiffuseIndex, 1, &g_lightPoint.diffuse[0]);
-	glUniform3fv(g_lightSpecularIndex, 1, &g_lightPoint.specular[0]);
-	glUniform1i(g_lightTypeIndex, g_lightPoint.type);
+// nearest first, so the depth test rejects hidden fragments before they are shaded
+static bool compare_distance(const SceneObject* a, const SceneObject* b)
+{
+	if (a->distance != b->distance)
+		return a->distance < b->distance;
+	return a < b;
+}
 
-	glUniform3fv(g_materialAmbientIndex, 1, &g_material[0].ambient[0]);
-	glUniform3fv(g_materialDiffuseIndex, 1, &g_material[0].diffuse[0]);
-	glUniform3fv(g_materialSpecularIndex, 1, &g_material[0].specular[0]);
-	glUniform1fv(g_materialShininessIndex, 1, &g_material[0].shininess);
+// queue draws for a list of objects, starting a new batch whenever the textures or scissor rectangle change
+// views other than the camera's pass one scissor rectangle for all of their objects
+static void queue_draws(const SceneObject* const* objects, int count, const glm::mat4& V, const glm::mat4& P, vector<DrawBatch>* batches,
+	const ScreenRect* scissor = NULL)
+{
+	for (int i = 0; i < count; i++)
+	{
+		const SceneObject* object = objects[i];
+		const Material& material = g_material[object->material];
+		const ScreenRect& rect = (scissor != NULL) ? *scissor : object->scissor;
+
+		DrawData data;
+		data.modelView = V * g_modelMatrix[object->transform];
+		data.modelViewProjection = P * data.modelView;
+		data.ambient = vec4(material.ambient, object->transparent ? g_alpha : 1.0f);
+		data.diffuse = vec4(material.diffuse, object->reflective ? 1.0f : (object->mirror ? 2.0f : 0.0f));
+		data.specular = vec4(material.specular, material.shininess);
+
+		GLuint drawID = g_drawSubmitter.addDraw(object->mesh, data, object->lod);
+		g_drawnTriangles += g_meshPool.getMesh(object->mesh).lods[object->lod].count / 3;
+
+		if (batches->empty() || batches->back().texture != object->texture || batches->back().normalMap != object->normalMap ||
+			!same_rect(batches->back().scissor, rect))
+		{
+			DrawBatch batch = { drawID, 0, object->texture, object->normalMap, rect };
+			batches->push_back(batch);
+		}
 
-	glUniform1i(g_surfaceIsReflective, false);
+		batches->back().count++;
+	}
+}
 
-	glUniform1i(g_texSamplerIndex, 0);
-	glUniform1i(g_normalSamplerIndex, 1);
+static CulledView* add_view(int type, int index, const glm::mat4& V, const glm::mat4& P)
+{
+	CulledView* view = &g_views[g_numberOfViews++];
+	view->type = type;
+	view->index = index;
+	view->viewMatrix = V;
+	view->projectionMatrix = P;
+	extract_frustum_planes(P * V, view->planes);
+
+	return view;
+}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[0]);
+// set up the reflection's view, when it is due for an update
+// only objects inside the part of the mirrored frustum that projects onto the mirror are drawn
+static void prepare_reflection_view(bool mirrorVisible)
+{
+	g_reflectionUpdated = false;
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[1]);
+	if (!g_planarReflection || g_mirrorObject < 0)
+		return;
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+	g_reflection.resize(g_windowWidth, g_windowHeight, g_reflectionScale);
 
-	modelMatrix = reflectMatrix * g_modelMatrix[7];
-	MVP[5] = g_camera.getProjectionMatrix() * g_camera.getViewMatrix() * modelMatrix;
-	MV[5] = g_camera.getViewMatrix() * modelMatrix;
-	V = g_camera.getViewMatrix();
-	glUniformMatrix4fv(g_MVP_Index, 1, GL_FALSE, &MVP[5][0][0]);
-	glUniformMatrix4fv(g_MV_Index, 1, GL_FALSE, &MV[5][0][0]);
-	glUniformMatrix4fv(g_V_Index, 1, GL_FALSE, &V[0][0]);
+	// the interval keeps counting while the mirror is hidden, it is updated as soon as it comes back
+	if (!g_reflection.isDue(g_activeReflectionInterval) || !mirrorVisible)
+		return;
 
-	glUniform3fv(g_lightPositionIndex, 1, &g_lightPoint.position[0]);
-	glUniform3fv(g_lightAmbientIndex, 1, &g_lightPoint.ambient[0]);
-	glUniform3fv(g_lightDiffuseIndex, 1, &g_lightPoint.diffuse[0]);
-	glUniform3fv(g_lightSpecularIndex, 1, &g_lightPoint.specular[0]);
-	glUniform1i(g_lightTypeIndex, g_lightPoint.type);
+	// the mirror's outline on screen, the reflection is only needed inside it
+	const glm::mat4& mirrorMatrix = g_modelMatrix[g_objects[g_mirrorObject].transform];
+	glm::vec3 corners[4];
+	corners[0] = vec3(mirrorMatrix * vec4(-1.0f, -1.0f, 0.0f, 1.0f));
+	corners[1] = vec3(mirrorMatrix * vec4(1.0f, -1.0f, 0.0f, 1.0f));
+	corners[2] = vec3(mirrorMatrix * vec4(1.0f, 1.0f, 0.0f, 1.0f));
+	corners[3] = vec3(mirrorMatrix * vec4(-1.0f, 1.0f, 0.0f, 1.0f));
 
-	glUniform3fv(g_materialAmbientIndex, 1, &g_material[0].ambient[0]);
-	glUniform3fv(g_materialDiffuseIndex, 1, &g_material[0].diffuse[0]);
-	glUniform3fv(g_materialSpecularIndex, 1, &g_material[0].specular[0]);
-	glUniform1fv(g_materialShininessIndex, 1, &g_material[0].shininess);
+	if (!project_polygon(g_camera.getViewProjectionMatrix(), corners, 4, &g_mirrorRect))
+		return;
 
-	glUniform1i(g_surfaceIsReflective, false);
+	glm::vec3 normal = normalize(vec3(mirrorMatrix[2]));
+	glm::vec4 plane = vec4(normal, -dot(normal, vec3(mirrorMatrix[3])));
+	g_reflection.setView(plane, g_camera.getViewMatrix(), g_camera.getProjectionMatrix());
 
-	glUniform1i(g_texSamplerIndex, 0);
-	glUniform1i(g_normalSamplerIndex, 1);
+	// the oblique near plane lies on the mirror, so the planes also drop everything behind it
+	CulledView* view = add_view(VIEW_REFLECTION, 0, g_reflection.getViewMatrix(), g_reflection.getProjectionMatrix());
+	extract_rect_planes(view->projectionMatrix * view->viewMatrix, g_mirrorRect, view->planes);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[0]);
+	g_reflectionUpdated = true;
+}
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[1]);
+// set up the cube faces due this frame, seen from the torus
+static void prepare_cube_map_views()
+{
+	g_numberOfCubeFaces = 0;
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+	if (!g_dynamicCubeMap || g_cubeMapObject < 0)
+		return;
 
-	modelMatrix = reflectMatrix * g_modelMatrix[8];
-	MVP[6] = g_camera.getProjectionMatrix() * g_camera.getViewMatrix() * modelMatrix;
-	MV[6] = g_camera.getViewMatrix() * modelMatrix;
-	V = g_camera.getViewMatrix();
-	glUniformMatrix4fv(g_MVP_Index, 1, GL_FALSE, &MVP[6][0][0]);
-	glUniformMatrix4fv(g_MV_Index, 1, GL_FALSE, &MV[6][0][0]);
-	glUniformMatrix4fv(g_V_Index, 1, GL_FALSE, &V[0][0]);
+	const AABB& sourceBounds = g_packet->bounds[g_cubeMapObject];
+	g_cubeCapture.setPosition((sourceBounds.min + sourceBounds.max) * 0.5f);
 
-	glUniform3fv(g_lightPositionIndex, 1, &g_lightPoint.position[0]);
-	glUniform3fv(g_lightAmbientIndex, 1, &g_lightPoint.ambient[0]);
-	glUniform3fv(g_lightDiffuseIndex, 1, &g_lightPoint.diffuse[0]);
-	glUniform3fv(g_lightSpecularIndex, 1, &g_lightPoint.specular[0]);
-	glUniform1i(g_lightTypeIndex, g_lightPoint.type);
+	g_numberOfCubeFaces = g_cubeCapture.scheduleFaces(g_cubeFacesPerFrame, g_cubeFaces);
 
-	glUniform3fv(g_materialAmbientIndex, 1, &g_material[0].ambient[0]);
-	glUniform3fv(g_materialDiffuseIndex, 1, &g_material[0].diffuse[0]);
-	glUniform3fv(g_materialSpecularIndex, 1, &g_material[0].specular[0]);
-	glUniform1fv(g_materialShininessIndex, 1, &g_material[0].shininess);
+	for (int i = 0; i < g_numberOfCubeFaces; i++)
+		add_view(VIEW_CUBE_FACE, g_cubeFaces[i], g_cubeCapture.getViewMatrix(g_cubeFaces[i]), g_cubeCapture.getProjectionMatrix());
+}
 
-	glUniform1i(g_surfaceIsReflective, false);
+// fit the shadow maps to the light and set up every face or cascade
+static void prepare_shadow_views()
+{
+	if (!g_shadows)
+		return;
 
-	glUniform1i(g_texSamplerIndex, 0);
-	glUniform1i(g_normalSamplerIndex, 1);
+	// the cascades take their depth range from the whole scene
+	if (g_packet->directional)
+		g_shadowMaps.setDirectionalLight(g_packet->lightDirectional.direction, g_camera.getViewMatrix(), g_camera.getProjectionMatrix(),
+			g_shadowDistance, g_packet->sceneBounds, g_activeShadowMapSize, g_shadowCascades);
+	else
+		g_shadowMaps.setPointLight(g_packet->lightPoint.position, g_shadowRange, g_activeShadowMapSize);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[0]);
+	// without the cache everything is drawn every frame
+	if (!g_shadowCache)
+		g_shadowMaps.invalidate();
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[1]);
+	for (int view = 0; view < g_shadowMaps.getNumberOfViews(); view++)
+		add_view(VIEW_SHADOW, view, g_shadowMaps.getViewMatrix(view), g_shadowMaps.getProjectionMatrix(view));
+}
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+// on a worker, only reads the scene and the packet
+// the mirror leaves out itself and the glass, the cube faces leave out environment mapped objects, which would
+// only capture the inside of themselves, and the glass; glass lets the light through, so it casts no shadow
+static void cull_view(CulledView* view)
+{
+	view->objects.clear();
+	view->dynamicObjects.clear();
 
-	modelMatrix = reflectMatrix * g_modelMatrix[9];
-	MVP[7] = g_camera.getProjectionMatrix() * g_camera.getViewMatrix() * modelMatrix;
-	MV[7] = g_camera.getViewMatrix() * modelMatrix;
-	V = g_camera.getViewMatrix();
-	glUniformMatrix4fv(g_MVP_Index, 1, GL_FALSE, &MVP[7][0][0]);
-	glUniformMatrix4fv(g_MV_Index, 1, GL_FALSE, &MV[7][0][0]);
-	glUniformMatrix4fv(g_V_Index, 1, GL_FALSE, &V[0][0]);
+	for (size_t i = 0; i < g_objects.size(); i++)
+	{
+		const SceneObject& object = g_objects[i];
+
+		if (object.transparent)
+			continue;
+		if (view->type == VIEW_REFLECTION && object.mirror)
+			continue;
+		if (view->type == VIEW_CUBE_FACE && object.reflective)
+			continue;
+
+		if (!aabb_in_frustum(g_packet->bounds[i], view->planes))
+			continue;
+
+		if (view->type == VIEW_SHADOW && object.dynamic)
+			view->dynamicObjects.push_back(&object);
+		else
+			view->objects.push_back(&object);
+	}
 
-	glUniform3fv(g_lightPositionIndex, 1, &g_lightPoint.position[0]);
-	glUniform3fv(g_lightAmbientIndex, 1, &g_lightPoint.ambient[0]);
-	glUniform3fv(g_lightDiffuseIndex, 1, &g_lightPoint.diffuse[0]);
-	glUniform3fv(g_lightSpecularIndex, 1, &g_lightPoint.specular[0]);
-	glUniform1i(g_lightTypeIndex, g_lightPoint.type);
+	// one scissor rectangle for the whole view, so only the textures matter
+	if (view->type != VIEW_SHADOW)
+		sort(view->objects.begin(), view->objects.end(), compare_textures);
+}
 
-	glUniform3fv(g_materialAmbientIndex, 1, &g_material[0].ambient[0]);
-	glUniform3fv(g_materialDiffuseIndex, 1, &g_material[0].diffuse[0]);
-	glUniform3fv(g_materialSpecularIndex, 1, &g_material[0].specular[0]);
-	glUniform1fv(g_materialShininessIndex, 1, &g_material[0].shininess);
+// queue the views in the order they were set up: the reflection, the cube faces, then the shadow casters,
+// static casters only when the view's cache is re-rendered, dynamic casters whenever the view is updated
+static void queue_views()
+{
+	static int frame = 0;
 
-	glUniform1i(g_surfaceIsReflective, false);
+	g_reflectionBatches.clear();
+	g_capturedObjects = 0;
+	g_shadowStaticViews = 0;
+	g_shadowDynamicViews = 0;
 
-	glUniform1i(g_texSamplerIndex, 0);
-	glUniform1i(g_normalSamplerIndex, 1);
+	for (int i = 0; i < SHADOW_MAX_VIEWS; i++)
+	{
+		g_shadowUpdates[i] = 0;
+		g_shadowStaticBatches[i].clear();
+		g_shadowDynamicBatches[i].clear();
+	}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[0]);
+	bool dynamicDue = g_shadows && (frame++ % max(g_shadowInterval, 1)) == 0;
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[1]);
+	for (int i = 0; i < g_numberOfViews; i++)
+	{
+		const CulledView& view = g_views[i];
+		const glm::mat4& V = view.viewMatrix;
+		const glm::mat4& P = view.projectionMatrix;
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+		if (view.type == VIEW_REFLECTION)
+		{
+			queue_draws(view.objects.data(), static_cast<int>(view.objects.size()), V, P, &g_reflectionBatches, &g_mirrorRect);
+			g_reflectedObjects = static_cast<int>(view.objects.size());
+		}
+		else if (view.type == VIEW_CUBE_FACE)
+		{
+			g_cubeFaceBatches[view.index].clear();
+			queue_draws(view.objects.data(), static_cast<int>(view.objects.size()), V, P, &g_cubeFaceBatches[view.index], &g_fullScreen);
+			g_capturedObjects += static_cast<int>(view.objects.size());
+		}
+		else
+		{
+			int updates = g_shadowMaps.scheduleView(view.index, !view.dynamicObjects.empty(), dynamicDue);
+			g_shadowUpdates[view.index] = updates;
+
+			if (updates & SHADOW_UPDATE_STATIC)
+			{
+				queue_draws(view.objects.data(), static_cast<int>(view.objects.size()), V, P, &g_shadowStaticBatches[view.index], &g_fullScreen);
+				g_shadowStaticViews++;
+			}
+
+			if (updates & SHADOW_UPDATE_DYNAMIC)
+			{
+				queue_draws(view.dynamicObjects.data(), static_cast<int>(view.dynamicObjects.size()), V, P, &g_shadowDynamicBatches[view.index], &g_fullScreen);
+				g_shadowDynamicViews++;
+			}
+		}
+	}
+}
 
-	modelMatrix = reflectMatrix * g_modelMatrix[10];
-	MVP[8] = g_camera.getProjectionMatrix() * g_camera.getViewMatrix() * modelMatrix;
-	MV[8] = g_camera.getViewMatrix() * modelMatrix;
-	V = g_camera.getViewMatrix();
-	glUniformMatrix4fv(g_MVP_Index, 1, GL_FALSE, &MVP[8][0][0]);
-	glUniformMatrix4fv(g_MV_Index, 1, GL_FALSE, &MV[8][0][0]);
-	glUniformMatrix4fv(g_V_Index, 1, GL_FALSE, &V[0][0]);
+// cull the scene against the view frustum, the portals and the occluders, on the simulation side
+// only the parts of the scene objects that never change are read, what is visible goes into the packet
+// the tests are jobs writing one slot per object, the lists are compacted in scene order afterwards
+static void cull_scene(const SimulationInput& input, SimulationState* simulation, FramePacket* packet)
+{
+	// the portal views and the occlusion depth buffer only change with the camera, the occluders never move
+	static unsigned int portalVersion = 0;
+	static unsigned int occlusionVersion = 0;
+	static bool occlusionLatching = false;
+	static bool occlusionPortals = false;
 
-	glUniform3fv(g_lightPositionIndex, 1, &g_lightPoint.position[0]);
-	glUniform3fv(g_lightAmbientIndex, 1, &g_lightPoint.ambient[0]);
-	glUniform3fv(g_lightDiffuseIndex, 1, &g_lightPoint.diffuse[0]);
-	glUniform3fv(g_lightSpecularIndex, 1, &g_lightPoint.specular[0]);
-	glUniform1i(g_lightTypeIndex, g_lightPoint.type);
+	const Camera& camera = packet->camera;
+	const glm::mat4* modelMatrices = packet->modelMatrices;
+	const glm::mat4& viewProjection = camera.getViewProjectionMatrix();
 
-	glUniform3fv(g_materialAmbientIndex, 1, &g_material[0].ambient[0]);
-	glUniform3fv(g_materialDiffuseIndex, 1, &g_material[0].diffuse[0]);
-	glUniform3fv(g_materialSpecularIndex, 1, &g_material[0].specular[0]);
-	glUniform1fv(g_materialShininessIndex, 1, &g_material[0].shininess);
+	// a late latched camera may have turned a little further by the time it is drawn
+	glm::vec4 frustumPlanes[6];
 
-	glUniform1i(g_surfaceIsReflective, false);
+	if (input.lateLatching)
+	{
+		glm::mat4 cullProjection = camera.getProjectionMatrix();
+		cullProjection[0][0] *= LATE_LATCH_CULL_SCALE;
+		cullProjection[1][1] *= LATE_LATCH_CULL_SCALE;
+		extract_frustum_planes(cullProjection * camera.getViewMatrix(), frustumPlanes);
+	}
+	else
+	{
+		for (int i = 0; i < 6; i++)
+			frustumPlanes[i] = camera.getFrustumPlanes()[i];
+	}
 
-	glUniform1i(g_texSamplerIndex, 0);
-	glUniform1i(g_normalSamplerIndex, 1);
+	// every list is sized for the whole scene, out of the step's arena
+	LinearArena& arena = simulation->frameArena;
+	int numberOfObjects = static_cast<int>(g_objects.size());
+	unsigned char* passed = arena.allocateArray<unsigned char>(numberOfObjects);	// per object, inside the frustum and seen through a portal
+	unsigned char* portalCulled = arena.allocateArray<unsigned char>(numberOfObjects);
+	ScreenRect* rects = arena.allocateArray<ScreenRect>(numberOfObjects);
+	int* candidates = arena.allocateArray<int>(numberOfObjects);
+	AABB* candidateBounds = arena.allocateArray<AABB>(numberOfObjects);
+	ScreenRect* candidateRects = arena.allocateArray<ScreenRect>(numberOfObjects);
+	AABB* testedBounds = arena.allocateArray<AABB>(numberOfObjects);		// candidates that are not occluders themselves
+	unsigned char* testedVisible = arena.allocateArray<unsigned char>(numberOfObjects);
+	unsigned char* occluded = arena.allocateArray<unsigned char>(numberOfObjects);		// per candidate
+	VisibleObject* candidateVisible = arena.allocateArray<VisibleObject>(numberOfObjects);
+	int numberOfCandidates = 0;
+
+	packet->visible.clear();
+	packet->mirrorVisible = false;
+	packet->portalCulledObjects = 0;
+
+	if (input.portalCulling && camera.getVersion() != portalVersion)
+	{
+		g_portalGraph.update(viewProjection, camera.getPosition());
+		portalVersion = camera.getVersion();
+	}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[0]);
+	g_jobSystem.parallelFor(numberOfObjects, 8, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const AABB& bounds = packet->bounds[i];
+			passed[i] = 0;
+			portalCulled[i] = 0;
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[1]);
+			if (!aabb_in_frustum(bounds, frustumPlanes))
+				continue;
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+			// only objects in cells seen through the portals, clipped to the rectangle they are seen through
+			rects[i] = g_fullScreen;
 
-	modelMatrix = reflectMatrix * g_modelMatrix[12];
-	MVP[10] = g_camera.getProjectionMatrix() * g_camera.getViewMatrix() * modelMatrix;
-	MV[10] = g_camera.getViewMatrix() * modelMatrix;
-	V = g_camera.getViewMatrix();
-	glUniformMatrix4fv(g_MVP_Index, 1, GL_FALSE, &MVP[10][0][0]);
-	glUniformMatrix4fv(g_MV_Index, 1, GL_FALSE, &MV[10][0][0]);
-	glUniformMatrix4fv(g_V_Index, 1, GL_FALSE, &V[0][0]);
+			if (input.portalCulling)
+			{
+				ScreenRect rect;
 
-	glUniform3fv(g_lightPositionIndex, 1, &g_lightPoint.position[0]);
-	glUniform3fv(g_lightAmbientIndex, 1, &g_lightPoint.ambient[0]);
-	glUniform3fv(g_lightDiffuseIndex, 1, &g_lightPoint.diffuse[0]);
-	glUniform3fv(g_lightSpecularIndex, 1, &g_lightPoint.specular[0]);
-	glUniform1i(g_lightTypeIndex, g_lightPoint.type);
+				if (!g_portalGraph.isVisible(i, bounds, &rect))
+				{
+					portalCulled[i] = 1;
+					continue;
+				}
 
-	glUniform3fv(g_materialAmbientIndex, 1, &g_material[0].ambient[0]);
-	glUniform3fv(g_materialDiffuseIndex, 1, &g_material[0].diffuse[0]);
-	glUniform3fv(g_materialSpecularIndex, 1, &g_material[0].specular[0]);
-	glUniform1fv(g_materialShininessIndex, 1, &g_material[0].shininess);
+				if (input.portalScissor)
+					rects[i] = rect;
+			}
 
-	glUniform1i(g_surfaceIsReflective, false);
+			passed[i] = 1;
+		}
+	});
 
-	glUniform1i(g_texSamplerIndex, 0);
-	glUniform1i(g_normalSamplerIndex, 1);
+	for (int i = 0; i < numberOfObjects; i++)
+	{
+		packet->portalCulledObjects += portalCulled[i];
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[5]);
+		if (!passed[i])
+			continue;
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[5]);
+		candidates[numberOfCandidates] = i;
+		candidateBounds[numberOfCandidates] = packet->bounds[i];
+		candidateRects[numberOfCandidates] = rects[i];
+		occluded[numberOfCandidates] = 0;
+		numberOfCandidates++;
+	}
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+	// rasterise the visible occluders, then test everything else against them
+	// occluders are not tested, they would only be hidden by themselves
+	if (input.occlusionCulling)
+	{
+		// the same camera sees the same occluders, their depth buffer is still valid
+		bool rasterize = camera.getVersion() != occlusionVersion || input.lateLatching != occlusionLatching || input.portalCulling != occlusionPortals;
 
-	modelMatrix = reflectMatrix * g_modelMatrix[13];
-	MVP[11] = g_camera.getProjectionMatrix() * g_camera.getViewMatrix() * modelMatrix;
-	MV[11] = g_camera.getViewMatrix() * modelMatrix;
-	V = g_camera.getViewMatrix();
-	glUniformMatrix4fv(g_MVP_Index, 1, GL_FALSE, &MVP[11][0][0]);
-	glUniformMatrix4fv(g_MV_Index, 1, GL_FALSE, &MV[11][0][0]);
-	glUniformMatrix4fv(g_V_Index, 1, GL_FALSE, &V[0][0]);
+		if (rasterize)
+			g_occlusionCuller.beginFrame(viewProjection);
+		else
+			g_occlusionCuller.keepFrame();
 
-	glUniform3fv(g_lightPositionIndex, 1, &g_lightPoint.position[0]);
-	glUniform3fv(g_lightAmbientIndex, 1, &g_lightPoint.ambient[0]);
-	glUniform3fv(g_lightDiffuseIndex, 1, &g_lightPoint.diffuse[0]);
-	glUniform3fv(g_lightSpecularIndex, 1, &g_lightPoint.specular[0]);
-	glUniform1i(g_lightTypeIndex, g_lightPoint.type);
+		int numberOfTested = 0;
 
-	glUniform3fv(g_materialAmbientIndex, 1, &g_material[0].ambient[0]);
-	glUniform3fv(g_materialDiffuseIndex, 1, &g_material[0].diffuse[0]);
-	glUniform3fv(g_materialSpecularIndex, 1, &g_material[0].specular[0]);
-	glUniform1fv(g_materialShininessIndex, 1, &g_material[0].shininess);
+		for (int i = 0; i < numberOfCandidates; i++)
+		{
+			const SceneObject& object = g_objects[candidates[i]];
 
-	glUniform1i(g_surfaceIsReflective, false);
+			if (object.occluder < 0)
+				testedBounds[numberOfTested++] = candidateBounds[i];
+			else if (rasterize)
+				g_occlusionCuller.addOccluder(object.occluder, modelMatrices[object.transform]);
+		}
 
-	glUniform1i(g_texSamplerIndex, 0);
-	glUniform1i(g_normalSamplerIndex, 1);
+		if (rasterize)
+		{
+			g_occlusionCuller.rasterize();
+			occlusionVersion = camera.getVersion();
+			occlusionLatching = input.lateLatching;
+			occlusionPortals = input.portalCulling;
+		}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[5]);
+		if (numberOfTested > 0)
+			g_occlusionCuller.testVisibility(testedBounds, numberOfTested, testedVisible);
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[5]);
+		for (int i = 0, tested = 0; i < numberOfCandidates; i++)
+		{
+			if (g_objects[candidates[i]].occluder < 0)
+				occluded[i] = testedVisible[tested++] ? 0 : 1;
+		}
+	}
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+	glm::vec3 cameraPosition = camera.getPosition();
+	glm::mat4 viewMatrix = camera.getViewMatrix();
+	float fov = camera.getFOV();
 
-	glBindVertexArray(g_VAO[2]);		// make VAO active
+	g_jobSystem.parallelFor(numberOfCandidates, 16, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			if (occluded[i])
+				continue;
+
+			const SceneObject& object = g_objects[candidates[i]];
+			const AABB& bounds = candidateBounds[i];
+			const PoolMesh& poolMesh = g_meshPool.getMesh(object.mesh);
+			const glm::mat4& modelMatrix = modelMatrices[object.transform];
+
+			// level of detail from the distance to the nearest point of the bounds and the largest scale axis
+			float distance = glm::length(cameraPosition - glm::clamp(cameraPosition, bounds.min, bounds.max));
+			float scale = glm::max(glm::length(vec3(modelMatrix[0])), glm::max(glm::length(vec3(modelMatrix[1])), glm::length(vec3(modelMatrix[2]))));
+			int& lod = simulation->lods[candidates[i]];
+			lod = select_lod(poolMesh, scale, distance, fov, input.renderHeight, input.lodThreshold, input.lodHysteresis, lod);
+
+			// transparent objects are ordered by the view depth of their centres
+			VisibleObject& visible = candidateVisible[i];
+			visible.object = candidates[i];
+			visible.lod = lod;
+			visible.distance = distance;
+			visible.depth = -(viewMatrix * vec4((bounds.min + bounds.max) * 0.5f, 1.0f)).z;
+			visible.uvPixels = projected_error(poolMesh.uvScale * scale, distance, fov, input.renderHeight);
+			visible.scissor = candidateRects[i];
+		}
+	});
 
-	glm::mat4 MVP2 = g_camera.getProjectionMatrix() * g_camera.getViewMatrix() * g_modelMatrix[5];
-	glm::mat4 MV2 = g_camera.getViewMatrix() * g_modelMatrix[5];
-	glm::mat4 V2 = g_camera.getViewMatrix();
-	glUniformMatrix4fv(g_MVP_Index, 1, GL_FALSE, &MVP2[0][0]);
-	glUniformMatrix4fv(g_MV_Index, 1, GL_FALSE, &MV2[0][0]);
-	glUniformMatrix4fv(g_V_Index, 1, GL_FALSE, &V2[0][0]);
+	for (int i = 0; i < numberOfCandidates; i++)
+	{
+		if (occluded[i])
+			continue;
 
-	glUniform3fv(g_lightPositionIndex, 1, &g_lightPoint.position[0]);
-	glUniform3fv(g_lightAmbientIndex, 1, &g_lightPoint.ambient[0]);
-	glUniform3fv(g_lightDiffuseIndex, 1, &g_lightPoint.diffuse[0]);
-	glUniform3fv(g_lightSpecularIndex, 1, &g_lightPoint.specular[0]);
-	glUniform1i(g_lightTypeIndex, g_lightPoint.type);
+		packet->visible.push_back(candidateVisible[i]);
 
-	glUniform3fv(g_materialAmbientIndex, 1, &g_material[2].ambient[0]);
-	glUniform3fv(g_materialDiffuseIndex, 1, &g_material[2].diffuse[0]);
-	glUniform3fv(g_materialSpecularIndex, 1, &g_material[2].specular[0]);
-	glUniform1fv(g_materialShininessIndex, 1, &g_material[2].shininess);
+		if (g_objects[candidates[i]].mirror)
+			packet->mirrorVisible = true;
+	}
 
-	glUniform1i(g_surfaceIsReflective, true);
+	if (input.occlusionCulling)
+	{
+		const OcclusionStats& stats = g_occlusionCuller.getStats();
+		packet->occludedObjects = stats.culledObjects;
+		packet->occlusionTime = stats.rasterTime + stats.testTime;
+	}
+	else
+	{
+		packet->occludedObjects = 0;
+		packet->occlusionTime = 0.0f;
+		occlusionVersion = 0;
+	}
 
-	glUniform1i(g_envMapSamplerIndex, 2);
+	packet->visibleCells = input.portalCulling ? g_portalGraph.getStats().visibleCells : 0;
+}
 
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, g_textureID[4]);
+// a clip turning once about an axis over the period, a key every quarter turn so slerp never has to go the
+// long way round
+static int add_spin_clip(Animator* animator, float period, glm::vec3 axis)
+{
+	float times[5];
+	glm::vec4 rotations[5];
 
-	glDrawElements(GL_TRIANGLES, g_mesh.numberOfFaces * 3, GL_UNSIGNED_INT, 0);
+	for (int i = 0; i < 5; i++)
+	{
+		float halfAngle = radians(90.0f * i) * 0.5f;
+		times[i] = period * i / 4.0f;
+		rotations[i] = vec4(axis * sin(halfAngle), cos(halfAngle));
+	}
 
+	int clip = animator->addClip(period);
+	animator->addTrack(clip, CHANNEL_ROTATION, INTERPOLATION_LINEAR, times, rotations, 5);
+	return clip;
 }
 
-void draw_mirror() {
-	glUseProgram(g_shaderProgramID);	// use the shaders associated with the shader program
+// the torus spins on the spot, the props get one clip of each interpolation to cross-fade between
+static void init_animation(SimulationState* simulation)
+{
+	simulation->animator.init(&g_jobSystem);
+	simulation->propAnimator.init(&g_jobSystem);
+	g_animationSimd = simulation->animator.isSimd();
 
-	glBindVertexArray(g_VAO[0]);		// make VAO active
+	int torusSpin = add_spin_clip(&simulation->animator, TORUS_SPIN_PERIOD, vec3(0.0f, 0.0f, 1.0f));
+	int torus = simulation->animator.addInstance(5, simulation->modelMatrices[5]);
+	simulation->animator.play(torus, torusSpin, true);
 
-	glEnable(GL_BLEND);		//enable blending            
-	glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
-	glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ZERO);
+	Animator& props = simulation->propAnimator;
+	simulation->propClips[0] = add_spin_clip(&props, 4.0f, vec3(0.0f, 1.0f, 0.0f));
 
-	mat4 MVP = g_camera.getProjectionMatrix() * g_camera.getViewMatrix() * g_modelMatrix[11];
-	mat4 MV = g_camera.getViewMatrix() * g_modelMatrix[11];
-	mat4 V = g_camera.getViewMatrix();
-	glUniformMatrix4fv(g_MVP_Index, 1, GL_FALSE, &MVP[0][0]);
-	glUniformMatrix4fv(g_MV_Index, 1, GL_FALSE, &MV[0][0]);
-	glUniformMatrix4fv(g_V_Index, 1, GL_FALSE, &V[0][0]);
+	const float bobTimes[4] = { 0.0f, 0.5f, 1.0f, 1.5f };
+	const glm::vec4 bobPositions[4] = { vec4(0.0f), vec4(0.0f, 0.5f, 0.0f, 0.0f), vec4(0.0f), vec4(0.0f, 0.25f, 0.0f, 0.0f) };
+	simulation->propClips[1] = props.addClip(2.0f);
+	props.addTrack(simulation->propClips[1], CHANNEL_TRANSLATION, INTERPOLATION_CUBIC, bobTimes, bobPositions, 4);
 
-	glUniform3fv(g_lightPositionIndex, 1, &g_lightPoint.position[0]);
-	glUniform3fv(g_lightAmbientIndex, 1, &g_lightPoint.ambient[0]);
-	glUniform3fv(g_lightDiffuseIndex, 1, &g_lightPoint.diffuse[0]);
-	glUniform3fv(g_lightSpecularIndex, 1, &g_lightPoint.specular[0]);
-	glUniform1i(g_lightTypeIndex, g_lightPoint.type);
+	const float pulseTimes[4] = { 0.0f, 0.25f, 0.5f, 0.75f };
+	const glm::vec4 pulseScales[4] = { vec4(1.0f), vec4(1.2f), vec4(1.0f), vec4(0.8f) };
+	simulation->propClips[2] = props.addClip(1.0f);
+	props.addTrack(simulation->propClips[2], CHANNEL_SCALE, INTERPOLATION_STEP, pulseTimes, pulseScales, 4);
 
-	glUniform3fv(g_materialAmbientIndex, 1, &g_material[0].ambient[0]);
-	glUniform3fv(g_materialDiffuseIndex, 1, &g_material[0].diffuse[0]);
-	glUniform3fv(g_materialSpecularIndex, 1, &g_material[0].specular[0]);
-	glUniform1fv(g_materialShininessIndex, 1, &g_material[0].shininess);
+	simulation->nextPropBlend = 0;
+}
 
-	glUniform1i(g_surfaceIsReflective, false);
-	glUniform1f(g_alphaIndex, g_alpha);
+// props on a grid through the room, each starting one of the clips part of the way in
+static void place_props(int count, SimulationState* simulation)
+{
+	Animator& props = simulation->propAnimator;
+	int side = static_cast<int>(ceil(sqrt(static_cast<float>(max(count, 1)))));
 
-	glUniform1i(g_texSamplerIndex, 0);
-	glUniform1i(g_normalSamplerIndex, 1);
+	props.clearInstances();
+	simulation->propMatrices.resize(count);
+	simulation->propClip.resize(count);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[0]);
+	for (int i = 0; i < count; i++)
+	{
+		glm::vec3 position = vec3(-11.0f + 22.0f * (i % side) / side, -5.0f, 1.0f + 22.0f * (i / side) / side);
+		int instance = props.addInstance(i, translate(position) * scale(vec3(0.1f)));
+
+		simulation->propClip[i] = static_cast<unsigned char>(i % 3);
+		props.play(instance, simulation->propClips[i % 3], true, 1.0f, 0.37f * i);
+	}
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[1]);
+	simulation->nextPropBlend = 0;
+}
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+// a few props each step move on to their next clip, so about half of them are always cross-fading
+static void blend_props(float step, SimulationState* simulation)
+{
+	int count = static_cast<int>(simulation->propMatrices.size());
+	int blends = static_cast<int>(count * step / (2.0f * PROP_BLEND_TIME));
 
-	glDisable(GL_BLEND);
+	for (int i = 0; i < blends; i++)
+	{
+		int prop = simulation->nextPropBlend;
+		simulation->propClip[prop] = static_cast<unsigned char>((simulation->propClip[prop] + 1) % 3);
+		simulation->propAnimator.blendTo(prop, simulation->propClips[simulation->propClip[prop]], true, PROP_BLEND_TIME);
+		simulation->nextPropBlend = (prop + 1) % count;
+	}
 }
 
-void draw_floor() {
+// one simulation step: input, then the fixed steps the time since the last input covers, then what the camera
+// sees, published as a frame packet with the camera and transforms interpolated between the last two steps
+// the input's timestamp rather than a frame time drives the steps, so inputs skipped while the simulation
+// fell behind do not lose their time
+static void simulate(const SimulationInput& input)
+{
+	double start = glfwGetTime();
+	SimulationState& simulation = g_simulation;
+	double delta = (simulation.frame > 0) ? input.time - simulation.time : 0.0;
 
-	glUseProgram(g_shaderProgramID);	// use the shaders associated with the shader program
+	simulation.frameArena.reset();
 
-	glBindVertexArray(g_VAO[1]);		// make VAO active
+	simulation.time = input.time;
+	simulation.timestep.setStep(input.timestep);
 
-									// set shader variables
-	glm::mat4 MVP = g_camera.getProjectionMatrix() * g_camera.getViewMatrix() * g_modelMatrix[0];
-	glm::mat4 MV = g_camera.getViewMatrix() * g_modelMatrix[0];
-	glm::mat4 V = g_camera.getViewMatrix();
-	glUniformMatrix4fv(g_MVP_Index, 1, GL_FALSE, &MVP[0][0]);
-	glUniformMatrix4fv(g_MV_Index, 1, GL_FALSE, &MV[0][0]);
-	glUniformMatrix4fv(g_V_Index, 1, GL_FALSE, &V[0][0]);
+	// mouse look by how far the cursor moved since the last input, while the right button is held
+	if (input.rotating && simulation.rotating)
+	{
+		simulation.camera.updateRotation(static_cast<float>(simulation.cursorX - input.cursorX) * MOUSE_LOOK_SCALE,
+			static_cast<float>(simulation.cursorY - input.cursorY) * MOUSE_LOOK_SCALE);
+	}
 
-	glUniform3fv(g_lightPositionIndex, 1, &g_lightPoint.position[0]);
-	glUniform3fv(g_lightAmbientIndex, 1, &g_lightPoint.ambient[0]);
-	glUniform3fv(g_lightDiffuseIndex, 1, &g_lightPoint.diffuse[0]);
-	glUniform3fv(g_lightSpecularIndex, 1, &g_lightPoint.specular[0]);
-	glUniform1i(g_lightTypeIndex, g_lightPoint.type);
+	simulation.cursorX = input.cursorX;
+	simulation.cursorY = input.cursorY;
+	simulation.rotating = input.rotating;
 
-	glUniform3fv(g_materialAmbientIndex, 1, &g_material[1].ambient[0]);
-	glUniform3fv(g_materialDiffuseIndex, 1, &g_material[1].diffuse[0]);
-	glUniform3fv(g_materialSpecularIndex, 1, &g_material[1].specular[0]);
-	glUniform1fv(g_materialShininessIndex, 1, &g_material[1].shininess);
+	int steps = simulation.timestep.advance(delta);
+	float step = static_cast<float>(input.timestep);
 
-	glUniform1i(g_surfaceIsReflective, false);
-	glUniform1i(g_texSamplerIndex, 0);
-	glUniform1i(g_normalSamplerIndex, 1);
+	if (static_cast<int>(simulation.propMatrices.size()) != input.animatedProps)
+		place_props(input.animatedProps, &simulation);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, g_textureID[2]);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, g_textureID[3]);
+	for (int i = 0; i < steps; i++)
+	{
+		simulation.previousPosition = simulation.camera.getPosition();
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-}
+		simulation.camera.update(input.moveForward * MOVEMENT_SENSITIVITY * step, input.strafeRight * MOVEMENT_SENSITIVITY * step);
+		simulation.animator.advance(step);
+		simulation.propAnimator.advance(step);
+		blend_props(step, &simulation);
+	}
 
-// function used to render the scene
-static void render_scene()
-{
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);	// clear colour buffer and depth buffer
-	/*
-	// disable depth buffer and draw mirror surface to stencil buffer
-	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);  //disable any modification of all color components
-	glDepthMask(GL_FALSE);                                //disable any modification to depth buffer
-	glEnable(GL_STENCIL_TEST);                            //enable stencil testing
+	float alpha = input.interpolate ? simulation.timestep.getAlpha() : 1.0f;
+
+	// the slot is reused, everything in it is written again
+	FramePacket& packet = g_packetBuffer.beginWrite();
+	packet.frame = ++simulation.frame;
+	packet.inputFrame = input.frame;
+	packet.eventTime = input.eventTime;
+	packet.cursorX = input.cursorX;
+	packet.cursorY = input.cursorY;
+	packet.rotating = input.rotating;
+	packet.steps = steps;
+	packet.droppedSteps = simulation.timestep.getDroppedSteps();
+	packet.alpha = alpha;
+	packet.camera = simulation.camera;
+	packet.camera.setPosition(glm::mix(simulation.previousPosition, simulation.camera.getPosition(), alpha));
+	packet.bounds.resize(g_objects.size());
+
+	// animations are evaluated where the interpolated time falls, part of a step back from the last one
+	float timeOffset = (alpha - 1.0f) * step;
+
+	// the transforms, then the world bounds of every object once they are in place
+	Job* transforms = g_jobSystem.createJob([&simulation, &packet, timeOffset]()
+	{
+		for (int i = 0; i < NUMBER_OF_TRANSFORMS; i++)
+			packet.modelMatrices[i] = simulation.modelMatrices[i];
 
-														  //setup the stencil buffer for a function reference value
-	glStencilOp(GL_REPLACE, GL_REPLACE, GL_REPLACE);
-	glStencilFunc(GL_ALWAYS, 1, 1);
+		simulation.animator.evaluate(timeOffset, packet.modelMatrices);
+	});
 
-	//draw_floor();
+	// nothing waits on the props until the packet is published
+	Job* props = NULL;
 
-	//enable depth buffer, draw reflected geometry where stencil buffer passes
+	if (!simulation.propMatrices.empty())
+	{
+		props = g_jobSystem.createJob([&simulation, timeOffset]()
+		{
+			simulation.propAnimator.evaluate(timeOffset, &simulation.propMatrices[0]);
+		});
 
-	//render where the stencil buffer equal to 1
-	glStencilFunc(GL_EQUAL, 1, 1);
-	glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+		g_jobSystem.run(props);
+	}
 
-	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);   //allow all color components to be modified 
-	glDepthMask(GL_TRUE);                              //allow depth buffer contents to be modified
+	Job* bounds = g_jobSystem.createParallelFor(static_cast<int>(g_objects.size()), 8, [&packet](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+			packet.bounds[i] = transform_aabb(g_meshPool.getMesh(g_objects[i].mesh).bounds, packet.modelMatrices[g_objects[i].transform]);
+	});
 
-	draw_walls(true);
+	g_jobSystem.addDependency(bounds, transforms);
+	g_jobSystem.run(bounds);
+	g_jobSystem.run(transforms);
+	g_jobSystem.wait(bounds);
 
-	glDisable(GL_STENCIL_TEST);		//disable stencil testing
-	
-									//blend in reflection
-	*/
+	packet.sceneBounds.min = vec3(1e30f);
+	packet.sceneBounds.max = vec3(-1e30f);
 
-	draw_floor();
+	for (size_t i = 0; i < packet.bounds.size(); i++)
+	{
+		packet.sceneBounds.min = glm::min(packet.sceneBounds.min, packet.bounds[i].min);
+		packet.sceneBounds.max = glm::max(packet.sceneBounds.max, packet.bounds[i].max);
+	}
 
-	
+	// moving objects are registered again in the cells they now overlap
+	for (size_t i = 0; i < g_objects.size(); i++)
+	{
+		if (g_objects[i].dynamic)
+			g_portalGraph.addObject(static_cast<int>(i), packet.bounds[i]);
+	}
 
-	draw_walls(false);
-	draw_mirror();
+	packet.directional = input.directional;
+	packet.lightPoint = input.lightPoint;
+	packet.lightDirectional = input.lightDirectional;
 
+	cull_scene(input, &simulation, &packet);
 
+	if (props != NULL)
+		g_jobSystem.wait(props);
 
-	glFlush();	// flush the pipeline
+	const AnimationStats& sceneStats = simulation.animator.getStats();
+	const AnimationStats& propStats = simulation.propAnimator.getStats();
+	packet.animatedInstances = sceneStats.instances + (props != NULL ? propStats.instances : 0);
+	packet.blendingInstances = sceneStats.blendingInstances + (props != NULL ? propStats.blendingInstances : 0);
+	packet.animationTime = sceneStats.evaluateTime + (props != NULL ? propStats.evaluateTime : 0.0f);
+
+	packet.arenaUsed = simulation.frameArena.getUsed() / 1024.0f;
+	packet.arenaOverflows = simulation.frameArena.getOverflows();
+	packet.simulationTime = static_cast<float>((glfwGetTime() - start) * 1000.0);
+	g_packetBuffer.publish();
 }
 
-// key press or release callback function
-static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+// steps once for every input the render thread hands over, skipping to the latest if it falls behind
+static void simulation_thread()
 {
-	// quit if the ESCAPE key was press
-	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+	while (g_simulationRunning.load())
 	{
-		// set flag to close the window
-		glfwSetWindowShouldClose(window, GL_TRUE);
-		return;
+		{
+			unique_lock<mutex> lock(g_simulationMutex);
+			g_simulationWake.wait_for(lock, chrono::milliseconds(5), [] { return g_inputBuffer.hasUpdate() || !g_simulationRunning.load(); });
+		}
+
+		if (g_inputBuffer.update())
+			simulate(g_inputBuffer.read());
 	}
 }
 
-static void cursor_position_callback(GLFWwindow* window, double xpos, double ypos)
+static void start_simulation_thread()
 {
-	// variables to store mouse cursor coordinates
-	static double previous_xpos = xpos;
-	static double previous_ypos = ypos;
-	double delta_x = previous_xpos - xpos;
-	double delta_y = previous_ypos - ypos;
+	g_simulationRunning = true;
+	g_simulationThread = thread(simulation_thread);
+}
 
-	if (g_moveCamera)
+static void stop_simulation_thread()
+{
 	{
-		// pass mouse movement to camera class to update its yaw and pitch
-		g_camera.updateRotation(delta_x * ROTATION_SENSITIVITY * g_frameTime, delta_y * ROTATION_SENSITIVITY * g_frameTime);
+		lock_guard<mutex> lock(g_simulationMutex);
+		g_simulationRunning = false;
 	}
 
-	// update previous mouse coordinates
-	previous_xpos = xpos;
-	previous_ypos = ypos;
+	g_simulationWake.notify_one();
+	g_simulationThread.join();
+}
 
-	// pass mouse data to tweak bar
+// hand this frame's input to the simulation, or simulate right away without the thread
+static void publish_input()
+{
+	gather_input(&g_inputBuffer.beginWrite());
+	g_inputBuffer.publish();
+
+	if (g_simulationRunning.load())
+	{
+		// taking the lock orders the publish before a waiting simulation checks for it
+		{
+			lock_guard<mutex> lock(g_simulationMutex);
+		}
+
+		g_simulationWake.notify_one();
+	}
+	else
+	{
+		g_inputBuffer.update();
+		simulate(g_inputBuffer.read());
+	}
+}
+
+// the simulation starts from the scene as init left it, and has published a packet before the first frame
+static void init_simulation()
+{
+	g_simulation.frame = 0;
+	g_simulation.time = 0.0;
+	g_simulation.timestep.init(1.0 / max(g_simulationRate, 1), MAX_SIMULATION_STEPS);
+	g_simulation.camera = g_camera;
+	g_simulation.previousPosition = g_camera.getPosition();
+
+	for (int i = 0; i < NUMBER_OF_TRANSFORMS; i++)
+		g_simulation.modelMatrices[i] = g_modelMatrix[i];
+
+	init_animation(&g_simulation);
+	g_simulation.frameArena.init(FRAME_ARENA_SIZE, MEMORY_FRAME);
+
+	g_simulation.lods.assign(g_objects.size(), 0);
+	g_simulation.cursorX = g_cursorX;
+	g_simulation.cursorY = g_cursorY;
+	g_simulation.rotating = false;
+
+	publish_input();
+}
+
+// build this frame's batches from the objects the simulation found visible
+// the reflection, cube faces and shadow views are culled on the workers while the camera's draws are sorted
+// and queued here, their draws are queued after the camera's once they are done
+static void build_draw_list(const FramePacket& packet)
+{
+	// the lists only last the frame, out of the frame's arena
+	int numberOfVisible = static_cast<int>(packet.visible.size());
+	const SceneObject** opaque = g_frameArena.allocateArray<const SceneObject*>(numberOfVisible);
+	const SceneObject** transparent = g_frameArena.allocateArray<const SceneObject*>(numberOfVisible);
+	float* transparentDepths = g_frameArena.allocateArray<float>(numberOfVisible);
+	GLuint* transparentOrder = g_frameArena.allocateArray<GLuint>(numberOfVisible);
+	const SceneObject** sortedTransparent = g_frameArena.allocateArray<const SceneObject*>(numberOfVisible);
+	int numberOfOpaque = 0;
+	int numberOfTransparent = 0;
+
+	// the texture levels the camera's objects are seen at, the other views make do with what that leaves
+	g_textureStreamer.beginFrame();
+
+	for (size_t i = 0; i < packet.visible.size(); i++)
+	{
+		const VisibleObject& visible = packet.visible[i];
+		SceneObject& object = g_objects[visible.object];
+
+		object.lod = visible.lod;
+		object.distance = visible.distance;
+		object.scissor = visible.scissor;
+
+		if (object.textureStream >= 0)
+			g_textureStreamer.require(object.textureStream, visible.uvPixels);
+		if (object.normalMapStream >= 0)
+			g_textureStreamer.require(object.normalMapStream, visible.uvPixels);
+
+		if (object.transparent)
+		{
+			transparent[numberOfTransparent] = &object;
+			transparentDepths[numberOfTransparent] = visible.depth;
+			numberOfTransparent++;
+		}
+		else
+			opaque[numberOfOpaque++] = &object;
+	}
+
+	g_portalCulledObjects = packet.portalCulledObjects;
+	g_visibleCells = packet.visibleCells;
+	g_occludedObjects = packet.occludedObjects;
+	g_occlusionTime = packet.occlusionTime;
+
+	g_numberOfViews = 0;
+	prepare_reflection_view(packet.mirrorVisible);
+	prepare_cube_map_views();
+	prepare_shadow_views();
+
+	Job* views = g_jobSystem.createParallelFor(g_numberOfViews, 1, [](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+			cull_view(&g_views[i]);
+	});
+
+	// the views' draws follow the camera's and the upload is GL, so this runs here once the culling is done
+	Job* upload = g_jobSystem.createJob([]()
+	{
+		queue_views();
+		g_drawSubmitter.upload();
+	});
+
+	g_jobSystem.addDependency(upload, views);
+	g_jobSystem.runOnMainThread(upload);
+	g_jobSystem.run(views);
+
+	// front to back trades batches for less overdraw, with a pre-pass the order only affects the pre-pass
+	sort(opaque, opaque + numberOfOpaque, g_frontToBack ? compare_distance : compare_state);
+
+	// blending in order needs back to front, weighted blended transparency takes any order and batches by texture
+	double sortStart = glfwGetTime();
+
+	if (g_transparencyMode == TRANSPARENCY_SORTED)
+	{
+		sort_back_to_front(transparentDepths, numberOfTransparent, transparentOrder, &g_frameArena);
+
+		for (int i = 0; i < numberOfTransparent; i++)
+			sortedTransparent[i] = transparent[transparentOrder[i]];
+	}
+	else
+	{
+		copy(transparent, transparent + numberOfTransparent, sortedTransparent);
+		sort(sortedTransparent, sortedTransparent + numberOfTransparent, compare_state);
+	}
+
+	g_transparentSortTime = static_cast<float>((glfwGetTime() - sortStart) * 1000.0);
+	g_numberOfTransparentDraws = numberOfTransparent;
+
+	g_drawSubmitter.clear();
+	g_drawnTriangles = 0;
+	g_opaqueBatches.clear();
+	g_transparentBatches.clear();
+
+	queue_draws(opaque, numberOfOpaque, g_camera.getViewMatrix(), g_camera.getProjectionMatrix(), &g_opaqueBatches);
+	g_numberOfOpaqueBatches = static_cast<int>(g_opaqueBatches.size());
+	queue_draws(sortedTransparent, numberOfTransparent, g_camera.getViewMatrix(), g_camera.getProjectionMatrix(), &g_transparentBatches);
+
+	g_jobSystem.wait(upload);
+}
+
+// depth-only passes leave the textures alone
+static void draw_batches(const vector<DrawBatch>& batches, GLuint width, GLuint height, bool bindTextures = true)
+{
+	for (size_t i = 0; i < batches.size(); i++)
+	{
+		const DrawBatch& batch = batches[i];
+
+		// batches seen through a portal are clipped to the portal's rectangle on screen
+		if (same_rect(batch.scissor, g_fullScreen))
+			glDisable(GL_SCISSOR_TEST);
+		else
+		{
+			GLint x = static_cast<GLint>(floor((batch.scissor.minX * 0.5f + 0.5f) * width));
+			GLint y = static_cast<GLint>(floor((batch.scissor.minY * 0.5f + 0.5f) * height));
+			GLint right = static_cast<GLint>(ceil((batch.scissor.maxX * 0.5f + 0.5f) * width));
+			GLint top = static_cast<GLint>(ceil((batch.scissor.maxY * 0.5f + 0.5f) * height));
+
+			glEnable(GL_SCISSOR_TEST);
+			glScissor(x, y, right - x, top - y);
+		}
+
+		if (bindTextures)
+		{
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, batch.texture);
+
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, batch.normalMap);
+		}
+
+		g_drawSubmitter.drawRange(batch.first, batch.count);
+	}
+
+	glDisable(GL_SCISSOR_TEST);
+}
+
+// scatter coloured fixtures through the room, the same layout every time for a given count
+static void generate_fixtures(int count)
+{
+	unsigned int seed = 12345;
+	auto random = [&seed]()
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return (seed >> 8) / 16777216.0f;
+	};
+
+	g_fixtures.resize(count);
+
+	for (int i = 0; i < count; i++)
+	{
+		PointLight& light = g_fixtures[i];
+		light.position = vec3(-11.5f + 23.0f * random(), -5.5f + 11.0f * random(), 0.5f + 23.0f * random());
+		light.radius = 1.5f + 2.5f * random();
+
+		// saturated colours, dim enough that a few hundred overlapping do not wash the room out
+		vec3 color = vec3(random(), random(), random());
+		light.color = color / glm::max(color.x, glm::max(color.y, color.z)) * 0.6f;
+	}
+
+	g_generatedFixtures = count;
+}
+
+// bin the fixtures into the main camera's clusters
+static void update_fixtures()
+{
+	if (g_numberOfFixtures != g_generatedFixtures)
+		generate_fixtures(g_numberOfFixtures);
+
+	static vector<PointLight> noLights;
+	g_clusteredLights.update(g_clusteredLighting ? g_fixtures : noLights, g_camera.getViewMatrix(), g_camera.getProjectionMatrix());
+
+	const ClusterStats& stats = g_clusteredLights.getStats();
+	g_maxLightsPerCluster = stats.maxPerCluster;
+	g_clusterTime = stats.assignTime;
+}
+
+// write the per-frame shader data for one view into the stream buffer, returns its offset
+// the clustered lights only match the main camera, other views are lit by the main light alone
+static GLuint write_frame_data(const glm::mat4& viewMatrix, float reflectionStrength, bool clustered, GLuint width, GLuint height)
+{
+	GLuint offset = 0;
+	FrameData* frameData = static_cast<FrameData*>(g_streamBuffer.allocate(sizeof(FrameData), g_uniformBufferAlignment, &offset));
+
+	if (frameData)
+	{
+		frameData->viewMatrix = viewMatrix;
+		const Light& light = g_packet->directional ? g_packet->lightDirectional : g_packet->lightPoint;
+		frameData->lightPosition = vec4(light.position, 1.0f);
+		frameData->lightDirection = vec4(light.direction, 0.0f);
+		frameData->lightAmbient = vec4(light.ambient, 0.0f);
+		frameData->lightDiffuse = vec4(light.diffuse, 0.0f);
+		frameData->lightSpecular = light.specular;
+		frameData->lightType = light.type;
+		frameData->reflectionMatrix = g_reflection.getTextureMatrix(viewMatrix);
+		frameData->reflectionParams = vec4(reflectionStrength, 0.0f, 0.0f, 0.0f);
+
+		for (int i = 0; i < 9; i++)
+			frameData->irradiance[i] = vec4(g_environment.irradiance[i], 0.0f);
+
+		GLint environmentMips = g_dynamicCubeMap ? g_cubeCapture.getNumberOfMips() : g_environment.numberOfMips;
+		frameData->environmentParams = vec4(static_cast<float>(environmentMips - 1), 0.0f, 0.0f, 0.0f);
+
+		frameData->clusterParams = g_clusteredLights.getShaderParams();
+		frameData->clusterScreen = vec4(static_cast<float>(width), static_cast<float>(height),
+			clustered && g_clusteredLighting ? 1.0f : 0.0f, static_cast<float>(CLUSTER_SLICES));
+
+		ShadowType shadowType = g_shadows ? g_shadowMaps.getType() : SHADOW_NONE;
+		int cascades = (shadowType == SHADOW_DIRECTIONAL) ? g_shadowMaps.getNumberOfViews() : 0;
+
+		for (int i = 0; i < cascades; i++)
+			frameData->shadowMatrices[i] = g_shadowMaps.getShadowMatrix(i, viewMatrix);
+
+		frameData->shadowParams = vec4(static_cast<float>(shadowType), static_cast<float>(g_shadowPCF),
+			1.0f / max(g_shadowMaps.getSize(), 1u), static_cast<float>(cascades));
+		frameData->shadowBias = vec4(g_shadowMaps.getFarPlane(), g_shadowBias, g_shadowNormalOffset, 0.0f);
+	}
+
+	return offset;
+}
+
+// render the shadow map views due this frame with the depth-only program
+static void render_shadows()
+{
+	if (g_shadowStaticViews + g_shadowDynamicViews == 0)
+		return;
+
+	glUseProgram(g_shadowProgramID);
+	g_meshPool.bindPositions();
+
+	glUniform1i(g_shadowDrawDataBaseIndex, g_drawSubmitter.getDrawDataBase());
+	glUniform1i(g_shadowDrawDataSamplerIndex, 3);
+	glUniform1f(g_shadowFarPlaneIndex, g_shadowMaps.getType() == SHADOW_POINT ? g_shadowMaps.getFarPlane() : 0.0f);
+	g_drawSubmitter.bindDrawData(3);
+
+	GLuint size = g_shadowMaps.getSize();
+
+	for (int view = 0; view < g_shadowMaps.getNumberOfViews(); view++)
+	{
+		if (g_shadowUpdates[view] & SHADOW_UPDATE_STATIC)
+		{
+			g_shadowMaps.beginStatic(view);
+			draw_batches(g_shadowStaticBatches[view], size, size, false);
+		}
+
+		if (g_shadowUpdates[view] & SHADOW_UPDATE_DYNAMIC)
+		{
+			g_shadowMaps.beginDynamic(view);
+			draw_batches(g_shadowDynamicBatches[view], size, size, false);
+		}
+	}
+
+	g_shadowMaps.end(g_windowWidth, g_windowHeight);
+}
+
+// lay down the depth of the opaque objects without shading them, from the position-only vertex stream
+static void render_depth_pre_pass()
+{
+	glUseProgram(g_depthProgramID);
+	g_meshPool.bindPositions();
+
+	glUniform1i(g_depthDrawDataBaseIndex, g_drawSubmitter.getDrawDataBase());
+	glUniform1i(g_depthDrawDataSamplerIndex, 3);
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	g_gpuQueries.begin(GPU_PASS_DEPTH, false);
+	draw_batches(g_opaqueBatches, g_renderWidth, g_renderHeight, false);
+	g_gpuQueries.end(GPU_PASS_DEPTH);
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	glUseProgram(g_shaderProgramID);
+	g_meshPool.bind();
+}
+
+// draw this frame's opaque batches at 4K with each shading mode, and compare the images
+// the timings wait for the GPU, so the frame it runs in hitches
+static void run_shading_benchmark(GLuint frameDataOffset)
+{
+	const int repeats = 8;
+
+	if (g_shadingBenchmark.getWidth() == 0)
+		g_shadingBenchmark.init(SHADING_BENCHMARK_WIDTH, SHADING_BENCHMARK_HEIGHT);
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, 0, g_streamBuffer.getBuffer(), frameDataOffset, sizeof(FrameData));
+
+	for (int mode = 0; mode < NUMBER_OF_SHADING_MODES; mode++)
+	{
+		glUniform1i(g_shadingModeIndex, mode);
+
+		// the first run warms up and is not counted
+		float total = 0.0f;
+		for (int i = 0; i <= repeats; i++)
+		{
+			g_shadingBenchmark.begin();
+			draw_batches(g_opaqueBatches, SHADING_BENCHMARK_WIDTH, SHADING_BENCHMARK_HEIGHT);
+			float time = g_shadingBenchmark.end(g_windowWidth, g_windowHeight);
+
+			if (i > 0)
+				total += time;
+		}
+
+		g_shadingTimes[mode] = total / repeats;
+		g_shadingBenchmark.capture(mode);
+	}
+
+	glUniform1i(g_shadingModeIndex, g_shadingMode);
+
+	g_shadingDifference = g_shadingBenchmark.compare(SHADING_FRAGMENT_TBN, SHADING_VERTEX_TANGENT);
+	g_runShadingBenchmark = false;
+
+	cout << "Shading at " << SHADING_BENCHMARK_WIDTH << "x" << SHADING_BENCHMARK_HEIGHT << ": TBN per fragment "
+		<< g_shadingTimes[SHADING_FRAGMENT_TBN] << " ms, tangent space per vertex " << g_shadingTimes[SHADING_VERTEX_TANGENT]
+		<< " ms; mean error " << g_shadingDifference.meanError << ", max error " << g_shadingDifference.maxError
+		<< ", " << g_shadingDifference.differingPixels << "% of pixels differ" << endl;
+}
+
+// let the governor act on the latest GPU frame time, and work out this frame's resolution and settings
+static void update_governor()
+{
+	g_gpuFrameTime = g_gpuQueries.getFrameTime();
+
+	if (g_governor)
+	{
+		if (g_frameGovernor.update(g_gpuFrameTime, g_targetFrameTime))
+		{
+			cout << "Governor: GPU frame " << g_frameGovernor.getSmoothedTime() << " ms against " << g_targetFrameTime
+				<< " ms, render scale " << g_frameGovernor.getRenderScale() << ", quality level " << g_frameGovernor.getQualityLevel() << endl;
+		}
+
+		g_renderScale = g_frameGovernor.getRenderScale();
+	}
+	else
+		g_frameGovernor.reset();
+
+	g_smoothedFrameTime = g_frameGovernor.getSmoothedTime();
+	g_qualityLevel = g_frameGovernor.getQualityLevel();
+	g_governorDecisions = g_frameGovernor.getNumberOfDecisions();
+
+	g_renderWidth = max(1u, static_cast<GLuint>(g_windowWidth * g_renderScale + 0.5f));
+	g_renderHeight = max(1u, static_cast<GLuint>(g_windowHeight * g_renderScale + 0.5f));
+
+	g_activeReflectionInterval = g_reflectionInterval * g_frameGovernor.getReflectionIntervalScale();
+	g_activeLodThreshold = g_lodThreshold * g_frameGovernor.getLodBias();
+	g_activeShadowMapSize = g_shadowMapSize >> g_frameGovernor.getShadowSizeShift();
+}
+
+// turn the packet's camera by however far the cursor has moved since the input it was simulated from, right
+// before the draws are built from it; events are polled again so movement during the frame's start counts
+// the simulation applies the same movement on its next step, the turn here only lasts for this frame
+static void latch_camera()
+{
+	g_latchedYaw = 0.0f;
+	g_latchedLookTime = g_packet->eventTime;
+
+	if (!g_lateLatching)
+		return;
+
+	glfwPollEvents();
+	consume_input();
+
+	if (g_moveCamera && g_packet->rotating)
+	{
+		float yaw = static_cast<float>(g_packet->cursorX - g_cursorX) * MOUSE_LOOK_SCALE;
+		float pitch = static_cast<float>(g_packet->cursorY - g_cursorY) * MOUSE_LOOK_SCALE;
+
+		g_camera.updateRotation(yaw, pitch);
+		g_camera.update(0.0f, 0.0f);
+		g_latchedYaw = degrees(yaw);
+		g_latchedLookTime = max(g_latchedLookTime, g_lastLookTime);
+	}
+}
+
+// estimate the time from input to photons once the frame is handed to the display: from the newest event that
+// went into it to the swap returning, plus the time to scan out to the middle of the screen
+// buffered frames in the driver are not seen from here, so with vsync the real figure may be a frame or two longer
+static void measure_latency()
+{
+	double now = g_frameTimer.getTime() + g_displayDelay;
+
+	// only frames carrying new input say anything, an idle mouse would just count the time since it stopped
+	if (g_latchedLookTime > g_lastMeasuredLookTime)
+	{
+		g_lookLatency = static_cast<float>((now - g_latchedLookTime) * 1000.0);
+		g_smoothedLookLatency = (g_smoothedLookLatency > 0.0f) ? g_smoothedLookLatency + (g_lookLatency - g_smoothedLookLatency) * LATENCY_SMOOTHING : g_lookLatency;
+		g_lastMeasuredLookTime = g_latchedLookTime;
+	}
+
+	if (g_packet->eventTime > g_lastMoveTime)
+	{
+		g_moveLatency = static_cast<float>((now - g_packet->eventTime) * 1000.0);
+		g_smoothedMoveLatency = (g_smoothedMoveLatency > 0.0f) ? g_smoothedMoveLatency + (g_moveLatency - g_smoothedMoveLatency) * LATENCY_SMOOTHING : g_moveLatency;
+		g_lastMoveTime = g_packet->eventTime;
+	}
+}
+
+// the workers' counters, refreshed by the job system a couple of times a second
+static void update_job_stats()
+{
+	g_jobSystem.updateStats();
+
+	const vector<WorkerStats>& stats = g_jobSystem.getStats();
+	g_jobUtilisation = g_jobSystem.getUtilisation() * 100.0f;
+	g_jobsRun = 0;
+	g_jobSteals = 0;
+
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		g_jobsRun += stats[i].jobs;
+		g_jobSteals += stats[i].steals;
+
+		if (i < MAX_WORKER_STATS)
+			g_workerUtilisation[i] = stats[i].utilisation * 100.0f;
+	}
+}
+
+// the frame arenas as of the packet being drawn, what is left of the meshes on the CPU, the mesh pool, the
+// tracked resources and the streamed textures
+static void update_memory_stats()
+{
+	g_frameArenaUsed = g_frameArena.getUsed() / 1024.0f + g_packet->arenaUsed;
+	g_arenaOverflows = g_frameArena.getOverflows() + g_packet->arenaOverflows;
+	g_meshMemory = get_memory_stats(MEMORY_MESH).bytes / 1024.0f;
+	g_meshPoolFragmentation = g_meshPool.getFragmentation();
+
+	size_t gpuBytes = 0;
+	for (int i = 0; i < NUMBER_OF_RESOURCE_CATEGORIES; i++)
+	{
+		if (i != RESOURCE_CPU_STAGING)
+			gpuBytes += get_resource_stats(i).bytes;
+	}
+
+	size_t residentBytes;
+	g_gpuResourceMemory = gpuBytes / 1024.0f;
+	g_cpuResourceMemory = get_resource_stats(RESOURCE_CPU_STAGING).bytes / 1024.0f;
+	g_residentCopies = get_resident_copies(&residentBytes);
+
+	StreamStats streamStats = g_textureStreamer.getStats();
+	g_streamedMemory = streamStats.residentBytes / 1024.0f;
+	g_streamedFullMemory = streamStats.fullBytes / 1024.0f;
+	g_pendingStreams = streamStats.pending;
+	g_streamLoads = streamStats.loads;
+	g_streamReleases = streamStats.releases;
+
+	// the report allocates, the frames it is printed in are not counted as settled
+	g_timeSinceReport += g_frameTime;
+	if (g_reportResources || (g_reportInterval > 0.0f && g_timeSinceReport >= g_reportInterval))
+	{
+		report_resources(cout);
+		g_reportResources = false;
+		g_timeSinceReport = 0.0;
+	}
+}
+
+// function used to render the scene
+static void render_scene()
+{
+	g_frameArena.reset();			// last frame's lists are no longer needed
+	g_streamBuffer.beginFrame();	// waits if the GPU is still using the region from three frames ago
+	g_gpuQueries.beginFrame();		// collects the timings from a few frames ago
+
+	update_governor();
+	update_job_stats();
+
+	// the latest packet from the simulation, or the last one again if the next is not ready
+	g_packetBuffer.update();
+	g_packet = &g_packetBuffer.read();
+	g_camera = g_packet->camera;
+	latch_camera();
+
+	for (int i = 0; i < NUMBER_OF_TRANSFORMS; i++)
+		g_modelMatrix[i] = g_packet->modelMatrices[i];
+
+	g_packetAge = static_cast<int>(g_renderFrame - g_packet->inputFrame);
+	g_simulationTime = g_packet->simulationTime;
+	g_simulationSteps = g_packet->steps;
+	g_interpolationAlpha = g_packet->alpha;
+	g_droppedSteps = g_packet->droppedSteps;
+	g_animatedInstances = g_packet->animatedInstances;
+	g_blendingInstances = g_packet->blendingInstances;
+	g_animationTime = g_packet->animationTime;
+
+	build_draw_list(*g_packet);
+	update_fixtures();
+
+	// load the texture levels the draw list needs and drop those long unneeded, unit 0 is bound per batch
+	glActiveTexture(GL_TEXTURE0);
+	g_textureStreamer.setBias(g_streamBias);
+	g_textureStreamer.update();
+
+	update_memory_stats();
+
+	// per-frame shader data, everything per-object comes from the draw data
+	float reflectionStrength = g_planarReflection ? g_reflectionStrength : 0.0f;
+	GLuint frameDataOffset = write_frame_data(g_camera.getViewMatrix(), reflectionStrength, true, g_renderWidth, g_renderHeight);
+	GLuint reflectionDataOffset = 0;
+	GLuint benchmarkDataOffset = 0;
+
+	if (g_reflectionUpdated)
+		reflectionDataOffset = write_frame_data(g_reflection.getViewMatrix(), 0.0f, false, g_reflection.getWidth(), g_reflection.getHeight());
+
+	GLuint cubeFaceDataOffsets[CUBE_MAP_FACES];
+	for (int i = 0; i < g_numberOfCubeFaces; i++)
+		cubeFaceDataOffsets[i] = write_frame_data(g_cubeCapture.getViewMatrix(g_cubeFaces[i]), 0.0f, false,
+			g_cubeCapture.getFaceSize(), g_cubeCapture.getFaceSize());
+
+	// the same view at 4K, the clusters are looked up from the fragment's position on screen
+	if (g_runShadingBenchmark)
+		benchmarkDataOffset = write_frame_data(g_camera.getViewMatrix(), reflectionStrength, true, SHADING_BENCHMARK_WIDTH, SHADING_BENCHMARK_HEIGHT);
+
+	g_streamBuffer.flush();		// this frame's data is written, it can now be drawn from
+
+	// shadow maps first, every pass after them is lit by the main light
+	render_shadows();
+
+	glUseProgram(g_shaderProgramID);	// use the shaders associated with the shader program
+	g_meshPool.bind();					// make the shared VAO active
+
+	glUniform1i(g_drawDataBaseIndex, g_drawSubmitter.getDrawDataBase());
+	glUniform1i(g_shadingModeIndex, g_shadingMode);
+
+	glUniform1i(g_texSamplerIndex, 0);
+	glUniform1i(g_normalSamplerIndex, 1);
+	glUniform1i(g_envMapSamplerIndex, 2);
+	glUniform1i(g_drawDataSamplerIndex, 3);
+	glUniform1i(g_reflectionSamplerIndex, 4);
+	glUniform1i(g_lightsSamplerIndex, 5);
+	glUniform1i(g_clusterSamplerIndex, 6);
+	glUniform1i(g_lightIndexSamplerIndex, 7);
+	glUniform1i(g_shadowCascadeSamplerIndex, 8);
+	glUniform1i(g_shadowCubeSamplerIndex, 9);
+
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, g_textureID[4]);
+	g_drawSubmitter.bindDrawData(3);
+	g_clusteredLights.bind(5);
+
+	glActiveTexture(GL_TEXTURE8);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, g_shadowMaps.getCascadeTexture());
+	glActiveTexture(GL_TEXTURE9);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, g_shadowMaps.getCubeTexture());
+
+	// the cube faces due this frame, the environment mapped objects are not in them so the static map stays bound
+	for (int i = 0; i < g_numberOfCubeFaces; i++)
+	{
+		glBindBufferRange(GL_UNIFORM_BUFFER, 0, g_streamBuffer.getBuffer(), cubeFaceDataOffsets[i], sizeof(FrameData));
+
+		g_cubeCapture.bindFace(g_cubeFaces[i]);
+		draw_batches(g_cubeFaceBatches[g_cubeFaces[i]], g_cubeCapture.getFaceSize(), g_cubeCapture.getFaceSize());
+	}
+
+	if (g_numberOfCubeFaces > 0)
+	{
+		g_cubeCapture.unbind(g_windowWidth, g_windowHeight);
+		g_cubeCapture.generateMipmaps();
+	}
+
+	// everything after this sees the room around the torus
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, g_dynamicCubeMap ? g_cubeCapture.getTexture() : g_textureID[4]);
+
+	// the mirrored scene, only every few frames and only where the mirror is on screen
+	if (g_reflectionUpdated)
+	{
+		glActiveTexture(GL_TEXTURE4);
+		glBindTexture(GL_TEXTURE_2D, 0);	// not sampled while it is being rendered to
+
+		glBindBufferRange(GL_UNIFORM_BUFFER, 0, g_streamBuffer.getBuffer(), reflectionDataOffset, sizeof(FrameData));
+
+		g_reflection.bind();
+		draw_batches(g_reflectionBatches, g_reflection.getWidth(), g_reflection.getHeight());
+		g_reflection.unbind(g_windowWidth, g_windowHeight);
+	}
+
+	g_sceneTarget.bind(g_renderWidth, g_renderHeight);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);	// clear colour buffer and depth buffer
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, 0, g_streamBuffer.getBuffer(), frameDataOffset, sizeof(FrameData));
+
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, g_reflection.getTexture());
+
+	// after a pre-pass only the nearest fragment of each pixel passes, and the depth is already written
+	if (g_depthPrePass)
+	{
+		render_depth_pre_pass();
+
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+	}
+
+	g_gpuQueries.begin(GPU_PASS_OPAQUE, true);
+	draw_batches(g_opaqueBatches, g_renderWidth, g_renderHeight);
+	g_gpuQueries.end(GPU_PASS_OPAQUE);
+
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+
+	g_prePassTime = g_depthPrePass ? g_gpuQueries.getTime(GPU_PASS_DEPTH) : 0.0f;
+	g_opaqueTime = g_gpuQueries.getTime(GPU_PASS_OPAQUE);
+	g_shadedFragments = static_cast<int>(g_gpuQueries.getSamples(GPU_PASS_OPAQUE));
+	g_overdraw = static_cast<float>(g_shadedFragments) / (g_renderWidth * g_renderHeight);
+
+	if (g_runShadingBenchmark)
+	{
+		run_shading_benchmark(benchmarkDataOffset);
+		glBindBufferRange(GL_UNIFORM_BUFFER, 0, g_streamBuffer.getBuffer(), frameDataOffset, sizeof(FrameData));
+		g_sceneTarget.bind(g_renderWidth, g_renderHeight);
+	}
+
+	// transparent objects are tested against the opaque depth but do not write it, in a single pass either way
+	g_gpuQueries.begin(GPU_PASS_TRANSPARENT, false);
+
+	if (g_transparencyMode == TRANSPARENCY_OIT)
+	{
+		g_oit.begin(g_sceneTarget.getFramebuffer());
+
+		glUniform1i(g_transparencyModeIndex, 1);
+		draw_batches(g_transparentBatches, g_renderWidth, g_renderHeight);
+		glUniform1i(g_transparencyModeIndex, 0);
+
+		g_oit.end(g_sceneTarget.getFramebuffer());
+		g_oit.composite();
+	}
+	else
+	{
+		glEnable(GL_BLEND);		//enable blending
+		glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
+		glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ZERO);
+		glDepthMask(GL_FALSE);
+
+		draw_batches(g_transparentBatches, g_renderWidth, g_renderHeight);
+
+		glDepthMask(GL_TRUE);
+		glDisable(GL_BLEND);
+	}
+
+	g_gpuQueries.end(GPU_PASS_TRANSPARENT);
+	g_transparentTime = g_gpuQueries.getTime(GPU_PASS_TRANSPARENT);
+
+	g_sceneTarget.present(g_renderWidth, g_renderHeight, g_windowWidth, g_windowHeight);
+
+	g_gpuQueries.endFrame();
+
+	g_streamBuffer.endFrame();	// fence this frame's region, the CPU waits on it when the region comes around again
+}
+
+// key press or release callback function
+static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	// quit if the ESCAPE key was press
+	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+	{
+		// set flag to close the window
+		glfwSetWindowShouldClose(window, GL_TRUE);
+		return;
+	}
+
+	InputEvent event = { INPUT_KEY, g_frameTimer.getTime(), 0.0, 0.0, key, action };
+	g_inputQueue.push(event);
+}
+
+static void cursor_position_callback(GLFWwindow* window, double xpos, double ypos)
+{
+	// the simulation turns the camera by how far the cursor moved between the positions it is handed
+	InputEvent event = { INPUT_CURSOR, g_frameTimer.getTime(), xpos, ypos, 0, 0 };
+	g_inputQueue.push(event);
+
+	// pass mouse data to tweak bar
 	TwEventMousePosGLFW(xpos, ypos);
 }
 
@@ -1000,19 +2385,18 @@ static void mouse_button_callback(GLFWwindow* window, int button, int action, in
 	// pass mouse data to tweak bar
 	TwEventMouseButtonGLFW(button, action);
 
+	InputEvent event = { INPUT_MOUSE_BUTTON, g_frameTimer.getTime(), 0.0, 0.0, button, action };
+	g_inputQueue.push(event);
+
 	if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS)
 	{
 		// use mouse to move camera, hence use disable cursor mode
 		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-		g_moveCamera = true;
 	}
 	else if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_RELEASE)
 	{
 		// use mouse to move camera, hence use disable cursor mode
 		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-
-		g_moveCamera = false;
 	}
 }
 
@@ -1089,32 +2473,213 @@ int main(void)
 	TwAddVarRW(TweakBar, "LightPos: y", TW_TYPE_FLOAT, &g_lightPoint.position[1], " group='Light Position' min=-10.0 max=10.0 step=0.1");
 	TwAddVarRW(TweakBar, "LightPos: z", TW_TYPE_FLOAT, &g_lightPoint.position[2], " group='Light Position' min=-10.0 max=10.0 step=0.1");
 
+	TwAddVarRW(TweakBar, "Directional", TW_TYPE_BOOLCPP, &g_directional, " group='Light Position' ");
+	TwAddVarRW(TweakBar, "Direction", TW_TYPE_DIR3F, &g_lightDirectional.direction, " group='Light Position' ");
+
+	TwAddVarRW(TweakBar, "Clustered", TW_TYPE_BOOLCPP, &g_clusteredLighting, " group='Fixtures' ");
+	TwAddVarRW(TweakBar, "Fixtures", TW_TYPE_INT32, &g_numberOfFixtures, " group='Fixtures' min=0 max=4096 step=64 ");
+	TwAddVarRO(TweakBar, "Max per cluster", TW_TYPE_INT32, &g_maxLightsPerCluster, " group='Fixtures' ");
+	TwAddVarRO(TweakBar, "Assign (ms)", TW_TYPE_FLOAT, &g_clusterTime, " group='Fixtures' ");
+
+	TwAddVarRW(TweakBar, "Threaded", TW_TYPE_BOOLCPP, &g_threadedSimulation, " group='Simulation' ");
+	TwAddVarRW(TweakBar, "Step rate (Hz)", TW_TYPE_INT32, &g_simulationRate, " group='Simulation' min=10 max=240 step=10 ");
+	TwAddVarRW(TweakBar, "Interpolate", TW_TYPE_BOOLCPP, &g_interpolation, " group='Simulation' ");
+	TwAddVarRO(TweakBar, "Steps", TW_TYPE_INT32, &g_simulationSteps, " group='Simulation' ");
+	TwAddVarRO(TweakBar, "Alpha", TW_TYPE_FLOAT, &g_interpolationAlpha, " group='Simulation' ");
+	TwAddVarRO(TweakBar, "Dropped steps", TW_TYPE_INT32, &g_droppedSteps, " group='Simulation' ");
+	TwAddVarRO(TweakBar, "Step (ms)", TW_TYPE_FLOAT, &g_simulationTime, " group='Simulation' ");
+	TwAddVarRO(TweakBar, "Packet age (frames)", TW_TYPE_INT32, &g_packetAge, " group='Simulation' ");
+
+	TwAddVarRW(TweakBar, "Props", TW_TYPE_INT32, &g_animatedProps, " group='Animation' min=0 max=20000 step=1000 ");
+	TwAddVarRO(TweakBar, "Instances", TW_TYPE_INT32, &g_animatedInstances, " group='Animation' ");
+	TwAddVarRO(TweakBar, "Blending", TW_TYPE_INT32, &g_blendingInstances, " group='Animation' ");
+	TwAddVarRO(TweakBar, "Evaluate (ms)", TW_TYPE_FLOAT, &g_animationTime, " group='Animation' ");
+	TwAddVarRO(TweakBar, "AVX2", TW_TYPE_BOOLCPP, &g_animationSimd, " group='Animation' ");
+
+	TwAddVarRO(TweakBar, "Heap allocations", TW_TYPE_INT32, &g_frameAllocations, " group='Memory' ");
+	TwAddVarRO(TweakBar, "Frame arenas (KB)", TW_TYPE_FLOAT, &g_frameArenaUsed, " group='Memory' ");
+	TwAddVarRO(TweakBar, "Arena overflows", TW_TYPE_INT32, &g_arenaOverflows, " group='Memory' ");
+	TwAddVarRO(TweakBar, "Mesh arrays (KB)", TW_TYPE_FLOAT, &g_meshMemory, " group='Memory' ");
+	TwAddVarRO(TweakBar, "Mesh pool fragmentation", TW_TYPE_FLOAT, &g_meshPoolFragmentation, " group='Memory' ");
+	TwAddVarRO(TweakBar, "GPU resources (KB)", TW_TYPE_FLOAT, &g_gpuResourceMemory, " group='Memory' ");
+	TwAddVarRO(TweakBar, "CPU copies (KB)", TW_TYPE_FLOAT, &g_cpuResourceMemory, " group='Memory' ");
+	TwAddVarRO(TweakBar, "Resident after upload", TW_TYPE_INT32, &g_residentCopies, " group='Memory' ");
+	TwAddVarRW(TweakBar, "Report every (s)", TW_TYPE_FLOAT, &g_reportInterval, " group='Memory' min=0.0 max=60.0 step=1.0 ");
+	TwAddVarRW(TweakBar, "Report now", TW_TYPE_BOOLCPP, &g_reportResources, " group='Memory' ");
+
+	TwAddVarRW(TweakBar, "Mip bias", TW_TYPE_INT32, &g_streamBias, " group='Streaming' min=-8 max=8 ");
+	TwAddVarRO(TweakBar, "Resident (KB)", TW_TYPE_FLOAT, &g_streamedMemory, " group='Streaming' ");
+	TwAddVarRO(TweakBar, "Every level (KB)", TW_TYPE_FLOAT, &g_streamedFullMemory, " group='Streaming' ");
+	TwAddVarRO(TweakBar, "Pending loads", TW_TYPE_INT32, &g_pendingStreams, " group='Streaming' ");
+	TwAddVarRO(TweakBar, "Loads", TW_TYPE_INT32, &g_streamLoads, " group='Streaming' ");
+	TwAddVarRO(TweakBar, "Releases", TW_TYPE_INT32, &g_streamReleases, " group='Streaming' ");
+
+	TwAddVarRW(TweakBar, "Late latching", TW_TYPE_BOOLCPP, &g_lateLatching, " group='Input' ");
+	TwAddVarRO(TweakBar, "Events", TW_TYPE_INT32, &g_inputEvents, " group='Input' ");
+	TwAddVarRO(TweakBar, "Dropped events", TW_TYPE_INT32, &g_droppedInputEvents, " group='Input' ");
+	TwAddVarRO(TweakBar, "Latched turn (deg)", TW_TYPE_FLOAT, &g_latchedYaw, " group='Input' ");
+	TwAddVarRO(TweakBar, "Look latency (ms)", TW_TYPE_FLOAT, &g_lookLatency, " group='Input' ");
+	TwAddVarRO(TweakBar, "Look average (ms)", TW_TYPE_FLOAT, &g_smoothedLookLatency, " group='Input' ");
+	TwAddVarRO(TweakBar, "Move latency (ms)", TW_TYPE_FLOAT, &g_moveLatency, " group='Input' ");
+	TwAddVarRO(TweakBar, "Move average (ms)", TW_TYPE_FLOAT, &g_smoothedMoveLatency, " group='Input' ");
+
+	TwAddVarRW(TweakBar, "VSync", TW_TYPE_BOOLCPP, &g_vsync, " group='Timing' ");
+	TwAddVarRW(TweakBar, "Limiter", TW_TYPE_BOOLCPP, &g_frameLimiter, " group='Timing' ");
+	TwAddVarRW(TweakBar, "Limit (fps)", TW_TYPE_INT32, &g_frameLimit, " group='Timing' min=10 max=500 step=5 ");
+	TwAddVarRO(TweakBar, "Frame (ms)", TW_TYPE_FLOAT, &g_frameDelta, " group='Timing' ");
+	TwAddVarRO(TweakBar, "Smoothed (ms)", TW_TYPE_FLOAT, &g_smoothedFrameDelta, " group='Timing' ");
+	TwAddVarRO(TweakBar, "Limiter sleep (ms)", TW_TYPE_FLOAT, &g_limiterSleep, " group='Timing' ");
+	TwAddVarRO(TweakBar, "Limiter spin (ms)", TW_TYPE_FLOAT, &g_limiterSpin, " group='Timing' ");
+
+	TwAddVarRW(TweakBar, "Enabled", TW_TYPE_BOOLCPP, &g_governor, " group='Governor' ");
+	TwAddVarRW(TweakBar, "Target (ms)", TW_TYPE_FLOAT, &g_targetFrameTime, " group='Governor' min=2.0 max=50.0 step=0.5 ");
+	TwAddVarRW(TweakBar, "Render scale", TW_TYPE_FLOAT, &g_renderScale, " group='Governor' min=0.5 max=1.0 step=0.05 ");
+	TwAddVarRO(TweakBar, "GPU frame (ms)", TW_TYPE_FLOAT, &g_gpuFrameTime, " group='Governor' ");
+	TwAddVarRO(TweakBar, "Average (ms)", TW_TYPE_FLOAT, &g_smoothedFrameTime, " group='Governor' ");
+	TwAddVarRO(TweakBar, "Render width", TW_TYPE_UINT32, &g_renderWidth, " group='Governor' ");
+	TwAddVarRO(TweakBar, "Render height", TW_TYPE_UINT32, &g_renderHeight, " group='Governor' ");
+	TwAddVarRO(TweakBar, "Quality level", TW_TYPE_INT32, &g_qualityLevel, " group='Governor' ");
+	TwAddVarRO(TweakBar, "Reflection interval", TW_TYPE_INT32, &g_activeReflectionInterval, " group='Governor' ");
+	TwAddVarRO(TweakBar, "LOD error (px)", TW_TYPE_FLOAT, &g_activeLodThreshold, " group='Governor' ");
+	TwAddVarRO(TweakBar, "Shadow map size", TW_TYPE_INT32, &g_activeShadowMapSize, " group='Governor' ");
+	TwAddVarRO(TweakBar, "Decisions", TW_TYPE_INT32, &g_governorDecisions, " group='Governor' ");
+
+	TwAddVarRW(TweakBar, "Depth pre-pass", TW_TYPE_BOOLCPP, &g_depthPrePass, " group='Overdraw' ");
+	TwAddVarRW(TweakBar, "Front to back", TW_TYPE_BOOLCPP, &g_frontToBack, " group='Overdraw' ");
+	TwAddVarRO(TweakBar, "Shaded fragments", TW_TYPE_INT32, &g_shadedFragments, " group='Overdraw' ");
+	TwAddVarRO(TweakBar, "Fragments per pixel", TW_TYPE_FLOAT, &g_overdraw, " group='Overdraw' ");
+	TwAddVarRO(TweakBar, "Pre-pass (ms)", TW_TYPE_FLOAT, &g_prePassTime, " group='Overdraw' ");
+	TwAddVarRO(TweakBar, "Opaque (ms)", TW_TYPE_FLOAT, &g_opaqueTime, " group='Overdraw' ");
+	TwAddVarRO(TweakBar, "Opaque batches", TW_TYPE_INT32, &g_numberOfOpaqueBatches, " group='Overdraw' ");
+
+	TwAddVarRW(TweakBar, "Shadows", TW_TYPE_BOOLCPP, &g_shadows, " group='Shadows' ");
+	TwAddVarRW(TweakBar, "Map size", TW_TYPE_INT32, &g_shadowMapSize, " group='Shadows' min=128 max=4096 step=128 ");
+	TwAddVarRW(TweakBar, "Cascades", TW_TYPE_INT32, &g_shadowCascades, " group='Shadows' min=1 max=4 ");
+	TwAddVarRW(TweakBar, "PCF radius", TW_TYPE_INT32, &g_shadowPCF, " group='Shadows' min=0 max=3 ");
+	TwAddVarRW(TweakBar, "Distance", TW_TYPE_FLOAT, &g_shadowDistance, " group='Shadows' min=5.0 max=100.0 step=1.0 ");
+	TwAddVarRW(TweakBar, "Depth bias", TW_TYPE_FLOAT, &g_shadowBias, " group='Shadows' min=0.0 max=0.02 step=0.0005 ");
+	TwAddVarRW(TweakBar, "Normal offset", TW_TYPE_FLOAT, &g_shadowNormalOffset, " group='Shadows' min=0.0 max=0.5 step=0.01 ");
+	TwAddVarRW(TweakBar, "Cache static", TW_TYPE_BOOLCPP, &g_shadowCache, " group='Shadows' ");
+	TwAddVarRW(TweakBar, "Dynamic interval", TW_TYPE_INT32, &g_shadowInterval, " group='Shadows' min=1 max=8 ");
+	TwAddVarRO(TweakBar, "Static views", TW_TYPE_INT32, &g_shadowStaticViews, " group='Shadows' ");
+	TwAddVarRO(TweakBar, "Dynamic views", TW_TYPE_INT32, &g_shadowDynamicViews, " group='Shadows' ");
+
 	TwAddVarRW(TweakBar, "Alpha", TW_TYPE_FLOAT, &g_alpha, " group='Glass' min=0.0 max=1.0 step=0.01 ");
 
+	TwEnumVal shadingModes[] = { { SHADING_FRAGMENT_TBN, "TBN per fragment" }, { SHADING_VERTEX_TANGENT, "Tangent space per vertex" } };
+	TwType shadingModeType = TwDefineEnum("ShadingMode", shadingModes, NUMBER_OF_SHADING_MODES);
+	TwAddVarRW(TweakBar, "Shading", shadingModeType, &g_shadingMode, " group='Shading' ");
+	TwAddVarRW(TweakBar, "Run 4K benchmark", TW_TYPE_BOOLCPP, &g_runShadingBenchmark, " group='Shading' ");
+	TwAddVarRO(TweakBar, "Per fragment (ms)", TW_TYPE_FLOAT, &g_shadingTimes[SHADING_FRAGMENT_TBN], " group='Shading' ");
+	TwAddVarRO(TweakBar, "Per vertex (ms)", TW_TYPE_FLOAT, &g_shadingTimes[SHADING_VERTEX_TANGENT], " group='Shading' ");
+	TwAddVarRO(TweakBar, "Mean error", TW_TYPE_FLOAT, &g_shadingDifference.meanError, " group='Shading' ");
+	TwAddVarRO(TweakBar, "Max error", TW_TYPE_FLOAT, &g_shadingDifference.maxError, " group='Shading' ");
+	TwAddVarRO(TweakBar, "Differing (%)", TW_TYPE_FLOAT, &g_shadingDifference.differingPixels, " group='Shading' ");
+
+	TwEnumVal transparencyModes[] = { { TRANSPARENCY_SORTED, "Sorted" }, { TRANSPARENCY_OIT, "Weighted OIT" } };
+	TwType transparencyModeType = TwDefineEnum("TransparencyMode", transparencyModes, 2);
+	TwAddVarRW(TweakBar, "Mode", transparencyModeType, &g_transparencyMode, " group='Transparency' ");
+	TwAddVarRO(TweakBar, "Draws", TW_TYPE_INT32, &g_numberOfTransparentDraws, " group='Transparency' ");
+	TwAddVarRO(TweakBar, "Sort (ms)", TW_TYPE_FLOAT, &g_transparentSortTime, " group='Transparency' ");
+	TwAddVarRO(TweakBar, "GPU (ms)", TW_TYPE_FLOAT, &g_transparentTime, " group='Transparency' ");
+
+	TwAddVarRW(TweakBar, "Error (px)", TW_TYPE_FLOAT, &g_lodThreshold, " group='LOD' min=0.1 max=20.0 step=0.1 ");
+	TwAddVarRW(TweakBar, "Hysteresis", TW_TYPE_FLOAT, &g_lodHysteresis, " group='LOD' min=0.0 max=0.9 step=0.05 ");
+	TwAddVarRO(TweakBar, "Triangles", TW_TYPE_INT32, &g_drawnTriangles, " group='LOD' ");
+
+	TwAddVarRW(TweakBar, "Enabled", TW_TYPE_BOOLCPP, &g_occlusionCulling, " group='Occlusion' ");
+	TwAddVarRO(TweakBar, "Occluded", TW_TYPE_INT32, &g_occludedObjects, " group='Occlusion' ");
+	TwAddVarRO(TweakBar, "Time (ms)", TW_TYPE_FLOAT, &g_occlusionTime, " group='Occlusion' ");
+
+	TwAddVarRW(TweakBar, "Portal culling", TW_TYPE_BOOLCPP, &g_portalCulling, " group='Portals' ");
+	TwAddVarRW(TweakBar, "Scissor", TW_TYPE_BOOLCPP, &g_portalScissor, " group='Portals' ");
+	TwAddVarRO(TweakBar, "Visible cells", TW_TYPE_INT32, &g_visibleCells, " group='Portals' ");
+	TwAddVarRO(TweakBar, "Culled", TW_TYPE_INT32, &g_portalCulledObjects, " group='Portals' ");
+
+	TwAddVarRW(TweakBar, "Planar reflection", TW_TYPE_BOOLCPP, &g_planarReflection, " group='Reflection' ");
+	TwAddVarRW(TweakBar, "Resolution", TW_TYPE_FLOAT, &g_reflectionScale, " group='Reflection' min=0.125 max=1.0 step=0.125 ");
+	TwAddVarRW(TweakBar, "Interval", TW_TYPE_INT32, &g_reflectionInterval, " group='Reflection' min=1 max=8 ");
+	TwAddVarRW(TweakBar, "Strength", TW_TYPE_FLOAT, &g_reflectionStrength, " group='Reflection' min=0.0 max=1.0 step=0.05 ");
+	TwAddVarRO(TweakBar, "Reflected", TW_TYPE_INT32, &g_reflectedObjects, " group='Reflection' ");
+
+	TwAddVarRW(TweakBar, "Dynamic", TW_TYPE_BOOLCPP, &g_dynamicCubeMap, " group='Cube map' ");
+	TwAddVarRW(TweakBar, "Faces per frame", TW_TYPE_INT32, &g_cubeFacesPerFrame, " group='Cube map' min=1 max=6 ");
+	TwAddVarRO(TweakBar, "Captured", TW_TYPE_INT32, &g_capturedObjects, " group='Cube map' ");
+
 	// initialise rendering states
 	init(window);
+	init_simulation();
+
+	// the workers are only known once the job system is up
+	TwAddVarRO(TweakBar, "Workers", TW_TYPE_INT32, &g_numberOfWorkers, " group='Jobs' ");
+	TwAddVarRO(TweakBar, "Utilisation (%)", TW_TYPE_FLOAT, &g_jobUtilisation, " group='Jobs' ");
+	TwAddVarRO(TweakBar, "Jobs run", TW_TYPE_INT32, &g_jobsRun, " group='Jobs' ");
+	TwAddVarRO(TweakBar, "Steals", TW_TYPE_INT32, &g_jobSteals, " group='Jobs' ");
+
+	for (int i = 0; i < min(g_numberOfWorkers, MAX_WORKER_STATS); i++)
+	{
+		string name = "Worker " + to_string(i + 1) + " (%)";
+		TwAddVarRO(TweakBar, name.c_str(), TW_TYPE_FLOAT, &g_workerUtilisation[i], " group='Jobs' ");
+	}
+
+	bool vsync = g_vsync;
 
 	// the rendering loop
 	while (!glfwWindowShouldClose(window))
 	{
-		update_scene(window, g_frameTime);		// update the scene
+		// time since the last frame began, the limiter's wait included
+		g_frameTime = static_cast<float>(g_frameTimer.beginFrame());
+		g_frameDelta = g_frameTime * 1000.0f;
+		g_smoothedFrameDelta = static_cast<float>(g_frameTimer.getSmoothedDelta() * 1000.0);
+
+		// allocations on any thread since the last frame began, none once everything has settled
+		long long heapAllocations = get_heap_allocations();
+		g_frameAllocations = static_cast<int>(heapAllocations - g_heapAllocationCount);
+		g_heapAllocationCount = heapAllocations;
+
+		if (g_vsync != vsync)
+		{
+			vsync = g_vsync;
+			glfwSwapInterval(vsync ? 1 : 0);
+		}
+
+		// start or stop the simulation thread when the setting changes
+		if (g_threadedSimulation != g_simulationRunning.load())
+		{
+			if (g_threadedSimulation)
+				start_simulation_thread();
+			else
+				stop_simulation_thread();
+		}
+
+		publish_input();		// simulate this frame, on the simulation thread while the last one is rendered
 		render_scene();		// render the scene
 
 		TwDraw();			// draw tweak bar(s)
 
 		glfwSwapBuffers(window);	// swap buffers
+		measure_latency();
 		glfwPollEvents();			// poll for events
 
+		// hold the frame back to the limit, sleeping most of the way and spinning the last part
+		if (g_frameLimiter)
+		{
+			g_frameTimer.limit(1.0 / max(g_frameLimit, 1));
+			g_limiterSleep = static_cast<float>(g_frameTimer.getSleepTime() * 1000.0);
+			g_limiterSpin = static_cast<float>(g_frameTimer.getSpinTime() * 1000.0);
+		}
+
 		frameCount++;
 		elapsedTime = glfwGetTime() - lastUpdateTime;	// current time - last update time
 
 		if (elapsedTime >= 1.0f)	// if time since last update >= to 1 second
 		{
-			g_frameTime = 1.0f / frameCount;	// calculate frame time
+			float averageFrameTime = static_cast<float>(elapsedTime / frameCount);	// calculate frame time
 
-			string str = "FPS = " + to_string(frameCount) + "; FT = " + to_string(g_frameTime);
+			char title[64];
+			snprintf(title, sizeof(title), "FPS = %d; FT = %f", frameCount, averageFrameTime);
 
-			glfwSetWindowTitle(window, str.c_str());	// update window title
+			glfwSetWindowTitle(window, title);	// update window title
 
 			FPS = frameCount;
 			frameCount = 0;					// reset frame count
@@ -1122,16 +2687,37 @@ int main(void)
 		}
 	}
 
-	// clean up
-	if (g_texImage[0])
-		delete[] g_texImage[0];
-	if (g_texImage[1])
-		delete[] g_texImage[1];
+	if (g_simulationRunning.load())
+		stop_simulation_thread();
 
+	g_simulation.animator.destroy();
+	g_simulation.propAnimator.destroy();
+	g_simulation.frameArena.destroy();
+	g_frameArena.destroy();
+	g_jobSystem.destroy();
+	g_frameTimer.destroy();
+
+	// clean up
 	glDeleteProgram(g_shaderProgramID);
-	glDeleteBuffers(2, g_VBO);
-	glDeleteVertexArrays(2, g_VAO);
-	glDeleteTextures(4, g_textureID);
+	glDeleteProgram(g_shadowProgramID);
+	glDeleteProgram(g_depthProgramID);
+	g_gpuQueries.destroy();
+	g_oit.destroy();
+	g_shadingBenchmark.destroy();
+	g_sceneTarget.destroy();
+	g_drawSubmitter.destroy();
+	g_reflection.destroy();
+	g_cubeCapture.destroy();
+	g_clusteredLights.destroy();
+	g_shadowMaps.destroy();
+	g_streamBuffer.destroy();
+	for (size_t i = 0; i < g_torusMeshes.size(); i++)		// give the meshes back before the pool goes
+		g_meshPool.unload(g_torusMeshes[i]);
+	g_meshPool.unload(g_quadMesh);
+	g_meshPool.destroy();
+	g_textureStreamer.destroy();
+	glDeleteTextures(1, &g_textureID[4]);
+	untrack_resource(g_environmentResource);
 
 	// uninitialise tweak bar
 	TwTerminate();
@@ -1142,79 +2728,3 @@ int main(void)
 
 	exit(EXIT_SUCCESS);
 }
-
-bool load_mesh(const char* fileName, Mesh* mesh)
-{
-	// load file with assimp 
-	const aiScene* pScene = aiImportFile(fileName, aiProcess_Triangulate
-		| aiProcess_GenSmoothNormals | aiProcess_JoinIdenticalVertices);
-
-	// check whether scene was loaded
-	if (!pScene)
-	{
-		cout << "Could not load mesh." << endl;
-		return false;
-	}
-
-	// get pointer to mesh 0
-	const aiMesh* pMesh = pScene->mMeshes[0];
-
-	// store number of mesh vertices
-	mesh->numberOfVertices = pMesh->mNumVertices;
-
-	// if mesh contains vertex coordinates
-	if (pMesh->HasPositions())
-	{
-		// allocate memory for vertices
-		mesh->pMeshVertices = new Vertex[pMesh->mNumVertices];
-
-		// read vertex coordinates and store in the array
-		for (int i = 0; i < pMesh->mNumVertices; i++)
-		{
-			const aiVector3D* pVertexPos = &(pMesh->mVertices[i]);
-
-			mesh->pMeshVertices[i].position[0] = (GLfloat)pVertexPos->x;
-			mesh->pMeshVertices[i].position[1] = (GLfloat)pVertexPos->y;
-			mesh->pMeshVertices[i].position[2] = (GLfloat)pVertexPos->z;
-		}
-	}
-
-	// if mesh contains normals
-	if (pMesh->HasNormals())
-	{
-		// read normals and store in the array
-		for (int i = 0; i < pMesh->mNumVertices; i++)
-		{
-			const aiVector3D* pVertexNormal = &(pMesh->mNormals[i]);
-
-			mesh->pMeshVertices[i].normal[0] = (GLfloat)pVertexNormal->x;
-			mesh->pMeshVertices[i].normal[1] = (GLfloat)pVertexNormal->y;
-			mesh->pMeshVertices[i].normal[2] = (GLfloat)pVertexNormal->z;
-		}
-	}
-
-	// if mesh contains faces
-	if (pMesh->HasFaces())
-	{
-		// store number of mesh faces
-		mesh->numberOfFaces = pMesh->mNumFaces;
-
-		// allocate memory for vertices
-		mesh->pMeshIndices = new GLint[pMesh->mNumFaces * 3];
-
-		// read normals and store in the array
-		for (int i = 0; i < pMesh->mNumFaces; i++)
-		{
-			const aiFace* pFace = &(pMesh->mFaces[i]);
-
-			mesh->pMeshIndices[i * 3] = (GLint)pFace->mIndices[0];
-			mesh->pMeshIndices[i * 3 + 1] = (GLint)pFace->mIndices[1];
-			mesh->pMeshIndices[i * 3 + 2] = (GLint)pFace->mIndices[2];
-		}
-	}
-
-	// release the scene
-	aiReleaseImport(pScene);
-
-	return true;
-}
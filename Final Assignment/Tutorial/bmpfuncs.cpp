@@ -1,7 +1,7 @@
 #include "bmpfuncs.h"
 
 // reads the contents of a 24-bit RGB bitmap file
-unsigned char* readBitmapRGBImage(const char *filename, int* widthOut, int* heightOut)
+unsigned char* readBitmapRGBImage(const char *filename, int* widthOut, int* heightOut, LinearArena* arena)
 {
 	char fileHeader[54];	// to store the file header, bmp file format bmpheader (14 bytes) + bmpheaderinfo (40 bytes) = 54 bytes 
 	int width, height;		// width and height of image
@@ -41,7 +41,7 @@ unsigned char* readBitmapRGBImage(const char *filename, int* widthOut, int* heig
 
 	// allocate RGB image data
 	imageSize = width * height * 3;
-	imageData = new unsigned char[imageSize];
+	imageData = arena->allocateArray<unsigned char>(imageSize);
 
 	// move read position by offset
 	textureFileStream.seekg(offset, ios::beg);
@@ -6,8 +6,10 @@
 #include <string>
 using namespace std;
 
-// reads the contents of a 24-bit RGB bitmap file
-unsigned char* readBitmapRGBImage(const char *filename, int* widthOut, int* heightOut);
+#include "Allocators.h"
+
+// reads the contents of a 24-bit RGB bitmap file, into memory from the arena
+unsigned char* readBitmapRGBImage(const char *filename, int* widthOut, int* heightOut, LinearArena* arena);
 
 // write to a 24-bit RGB bitmap file
 void writeBitmapRGBImage(const char *filename, char* imageData, int width, int height);
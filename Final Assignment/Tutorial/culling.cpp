@@ -0,0 +1,119 @@
+#include <cmath>
+#include <algorithm>
+
+#include "culling.h"
+
+void extract_frustum_planes(const glm::mat4& viewProjection, glm::vec4 planes[6])
+{
+	ScreenRect screen = { -1.0f, -1.0f, 1.0f, 1.0f };
+	extract_rect_planes(viewProjection, screen, planes);
+}
+
+void extract_rect_planes(const glm::mat4& viewProjection, const ScreenRect& rect, glm::vec4 planes[6])
+{
+	// rows of the matrix (GLM is column-major)
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+	planes[0] = row[0] - row[3] * rect.minX;	// left
+	planes[1] = row[3] * rect.maxX - row[0];	// right
+	planes[2] = row[1] - row[3] * rect.minY;	// bottom
+	planes[3] = row[3] * rect.maxY - row[1];	// top
+	planes[4] = row[3] + row[2];	// near
+	planes[5] = row[3] - row[2];	// far
+
+	for (int i = 0; i < 6; i++)
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+bool project_polygon(const glm::mat4& viewProjection, const glm::vec3* points, int numberOfPoints, ScreenRect* rect)
+{
+	// too many corners to clip here, nothing is culled by it
+	if (numberOfPoints > MAX_POLYGON_POINTS)
+	{
+		rect->minX = rect->minY = -1.0f;
+		rect->maxX = rect->maxY = 1.0f;
+		return true;
+	}
+
+	// the render and simulation threads both project polygons, so no shared scratch
+	// clipping a convex polygon to one plane adds at most one corner
+	glm::vec4 clip[MAX_POLYGON_POINTS];
+	glm::vec4 clipped[MAX_POLYGON_POINTS + 1];
+	int numberOfClipped = 0;
+
+	for (int i = 0; i < numberOfPoints; i++)
+		clip[i] = viewProjection * glm::vec4(points[i], 1.0f);
+
+	// clip against z + w >= 0, edge by edge
+	for (int i = 0; i < numberOfPoints; i++)
+	{
+		const glm::vec4& a = clip[i];
+		const glm::vec4& b = clip[(i + 1) % numberOfPoints];
+		float distanceA = a.z + a.w;
+		float distanceB = b.z + b.w;
+
+		if (distanceA >= 0.0f)
+			clipped[numberOfClipped++] = a;
+		if ((distanceA >= 0.0f) != (distanceB >= 0.0f) && numberOfClipped <= MAX_POLYGON_POINTS)
+			clipped[numberOfClipped++] = a + (b - a) * (distanceA / (distanceA - distanceB));
+	}
+
+	if (numberOfClipped == 0)
+		return false;
+
+	ScreenRect bounds = { 1.0f, 1.0f, -1.0f, -1.0f };
+
+	for (int i = 0; i < numberOfClipped; i++)
+	{
+		// points on the near plane can still have w == 0 with a degenerate projection
+		float w = std::max(clipped[i].w, 1e-6f);
+		float x = clipped[i].x / w;
+		float y = clipped[i].y / w;
+
+		bounds.minX = std::min(bounds.minX, x);
+		bounds.minY = std::min(bounds.minY, y);
+		bounds.maxX = std::max(bounds.maxX, x);
+		bounds.maxY = std::max(bounds.maxY, y);
+	}
+
+	// limit to the screen
+	rect->minX = std::max(bounds.minX, -1.0f);
+	rect->minY = std::max(bounds.minY, -1.0f);
+	rect->maxX = std::min(bounds.maxX, 1.0f);
+	rect->maxY = std::min(bounds.maxY, 1.0f);
+
+	return rect->minX < rect->maxX && rect->minY < rect->maxY;
+}
+
+AABB transform_aabb(const AABB& box, const glm::mat4& matrix)
+{
+	// transform the centre and extent separately, the extent by the absolute matrix
+	glm::vec3 center = (box.min + box.max) * 0.5f;
+	glm::vec3 extent = (box.max - box.min) * 0.5f;
+	glm::vec3 newCenter = glm::vec3(matrix * glm::vec4(center, 1.0f));
+	glm::vec3 newExtent;
+
+	for (int i = 0; i < 3; i++)
+		newExtent[i] = fabs(matrix[0][i]) * extent.x + fabs(matrix[1][i]) * extent.y + fabs(matrix[2][i]) * extent.z;
+
+	AABB result = { newCenter - newExtent, newCenter + newExtent };
+	return result;
+}
+
+bool aabb_in_frustum(const AABB& box, const glm::vec4 planes[6])
+{
+	for (int i = 0; i < 6; i++)
+	{
+		// corner furthest along the plane normal
+		glm::vec3 corner(planes[i].x >= 0.0f ? box.max.x : box.min.x,
+			planes[i].y >= 0.0f ? box.max.y : box.min.y,
+			planes[i].z >= 0.0f ? box.max.z : box.min.z);
+
+		if (glm::dot(glm::vec3(planes[i]), corner) + planes[i].w < 0.0f)
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,41 @@
+#ifndef __CULLING_H
+#define __CULLING_H
+
+#include <glm/glm.hpp>	// include GLM (ideally should only use the GLM headers that are actually used)
+
+#define MAX_POLYGON_POINTS 32		// corners of a polygon project_polygon clips
+
+// axis-aligned bounding box
+typedef struct AABB
+{
+	glm::vec3 min;
+	glm::vec3 max;
+} AABB;
+
+// rectangle on screen in normalised device coordinates
+typedef struct ScreenRect
+{
+	float minX, minY;
+	float maxX, maxY;
+} ScreenRect;
+
+// extract the six clip planes (left, right, bottom, top, near, far) from a view-projection matrix
+// planes are normalised and point into the frustum
+void extract_frustum_planes(const glm::mat4& viewProjection, glm::vec4 planes[6]);
+
+// clip planes of the part of the frustum that projects inside a screen rectangle
+void extract_rect_planes(const glm::mat4& viewProjection, const ScreenRect& rect, glm::vec4 planes[6]);
+
+// screen bounds of a convex polygon after clipping it to the near plane
+// false if none of it is in front of the camera or it projects outside the screen
+// a polygon of more than MAX_POLYGON_POINTS corners is taken to cover the whole screen
+// safe to call from any thread, the clipping works on the stack
+bool project_polygon(const glm::mat4& viewProjection, const glm::vec3* points, int numberOfPoints, ScreenRect* rect);
+
+// bounding box of a box transformed by a matrix
+AABB transform_aabb(const AABB& box, const glm::mat4& matrix);
+
+// false if the box is entirely outside one of the planes
+bool aabb_in_frustum(const AABB& box, const glm::vec4 planes[6]);
+
+#endif
@@ -0,0 +1,649 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#include <emmintrin.h>
+
+#include "environment.h"
+#include "bmpfuncs.h"
+
+#define ENVIRONMENT_CACHE_MAGIC 0x43564E45		// "ENVC"
+#define ENVIRONMENT_CACHE_VERSION 2
+#define ENVIRONMENT_SAMPLES 128				// GGX samples per prefiltered texel
+#define ENVIRONMENT_SH_TEXELS 4096			// texels a job projects, a multiple of four
+#define ENVIRONMENT_MAX_SIZE (1 << (ENVIRONMENT_MAX_MIPS - 1))		// largest face whose chain reaches 1x1
+
+// header at the start of an environment cache file
+typedef struct EnvironmentCacheHeader
+{
+	GLuint magic;
+	GLuint version;
+	unsigned long long sourceHash;	// of the contents of the face bitmaps the cache was built from
+	GLint size;
+	GLint numberOfMips;
+} EnvironmentCacheHeader;
+
+// every texel of the source cube map, structure of arrays padded to a multiple of four
+// padding texels have no solid angle and so never contribute
+typedef struct SourceTexels
+{
+	vector<float> x, y, z;			// unit direction
+	vector<float> solidAngle;
+	vector<float> r, g, b;
+} SourceTexels;
+
+// the source faces box-filtered down to 1x1, RGB in the layout of the prefiltered mips
+typedef struct SourceChain
+{
+	GLint size;
+	int numberOfLevels;
+	vector<float> levels[ENVIRONMENT_MAX_MIPS];
+} SourceChain;
+
+// samples of the GGX lobe around +z, the same for every texel of a mip, structure of arrays
+// samples below the horizon are left out and the rest padded with zero weight to a multiple of four
+typedef struct Lobe
+{
+	float x[ENVIRONMENT_SAMPLES];		// direction of the light, with the view along the normal
+	float y[ENVIRONMENT_SAMPLES];
+	float z[ENVIRONMENT_SAMPLES];
+	float weight[ENVIRONMENT_SAMPLES];	// n.l
+	float level[ENVIRONMENT_SAMPLES];	// of the source chain whose texels are about the sample's share of the lobe
+	int numberOfSamples;
+} Lobe;
+
+// a row of one face of one mip, the unit of work handed to the jobs
+typedef struct PrefilterRow
+{
+	int mip;
+	int face;
+	int row;
+} PrefilterRow;
+
+// 64-bit FNV-1a continued over a file's contents, so an edit that keeps the face sizes still invalidates
+// the cache; a file that cannot be opened leaves the hash as it is
+static unsigned long long file_hash(const char* fileName, unsigned long long hash)
+{
+	ifstream fileStream(fileName, ios::in | ios::binary);
+
+	if (!fileStream.is_open())
+		return hash;
+
+	char buffer[65536];
+
+	while (fileStream.read(buffer, sizeof(buffer)) || fileStream.gcount() > 0)
+	{
+		streamsize count = fileStream.gcount();
+
+		for (streamsize i = 0; i < count; i++)
+			hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// mips down to 1x1, at most ENVIRONMENT_MAX_MIPS
+static int mip_count(GLint size)
+{
+	int numberOfMips = 1;
+	while ((size >> numberOfMips) > 0 && numberOfMips < ENVIRONMENT_MAX_MIPS)
+		numberOfMips++;
+
+	return numberOfMips;
+}
+
+// a face size the prefilter and the cache accept
+static bool valid_size(GLint size)
+{
+	return size > 0 && size <= ENVIRONMENT_MAX_SIZE && (size & (size - 1)) == 0;
+}
+
+// direction through the centre of a texel, following the GL cube map face layout
+static glm::vec3 texel_direction(int face, int x, int y, int size)
+{
+	float s = 2.0f * (x + 0.5f) / size - 1.0f;
+	float t = 2.0f * (y + 0.5f) / size - 1.0f;
+	glm::vec3 direction;
+
+	switch (face)
+	{
+	case 0: direction = glm::vec3(1.0f, -t, -s); break;
+	case 1: direction = glm::vec3(-1.0f, -t, s); break;
+	case 2: direction = glm::vec3(s, 1.0f, t); break;
+	case 3: direction = glm::vec3(s, -1.0f, -t); break;
+	case 4: direction = glm::vec3(s, -t, 1.0f); break;
+	default: direction = glm::vec3(-s, -t, -1.0f); break;
+	}
+
+	return glm::normalize(direction);
+}
+
+// solid angle of a texel, its area on the unit cube face over the cube of its distance
+static float texel_solid_angle(int x, int y, int size)
+{
+	float s = 2.0f * (x + 0.5f) / size - 1.0f;
+	float t = 2.0f * (y + 0.5f) / size - 1.0f;
+	float area = 4.0f / (size * size);
+
+	return area / powf(1.0f + s * s + t * t, 1.5f);
+}
+
+static float horizontal_sum(__m128 v)
+{
+	float lanes[4];
+	_mm_storeu_ps(lanes, v);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+static void build_source(const unsigned char* const faces[6], GLint size, SourceTexels* source, vector<float>* firstMip)
+{
+	size_t count = 6 * size * size;
+	size_t padded = (count + 3) & ~static_cast<size_t>(3);
+
+	source->x.assign(padded, 0.0f);
+	source->y.assign(padded, 0.0f);
+	source->z.assign(padded, 0.0f);
+	source->solidAngle.assign(padded, 0.0f);
+	source->r.assign(padded, 0.0f);
+	source->g.assign(padded, 0.0f);
+	source->b.assign(padded, 0.0f);
+	firstMip->resize(count * 3);
+
+	size_t i = 0;
+	for (int face = 0; face < 6; face++)
+	{
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++, i++)
+			{
+				glm::vec3 direction = texel_direction(face, x, y, size);
+				const unsigned char* texel = faces[face] + (y * size + x) * 3;
+
+				source->x[i] = direction.x;
+				source->y[i] = direction.y;
+				source->z[i] = direction.z;
+				source->solidAngle[i] = texel_solid_angle(x, y, size);
+				source->r[i] = texel[2] / 255.0f;
+				source->g[i] = texel[1] / 255.0f;
+				source->b[i] = texel[0] / 255.0f;
+
+				(*firstMip)[i * 3] = source->r[i];
+				(*firstMip)[i * 3 + 1] = source->g[i];
+				(*firstMip)[i * 3 + 2] = source->b[i];
+			}
+		}
+	}
+}
+
+// accumulate radiance * basis * solid angle over a range of texels, sums holds 9 rgb triples
+static void project_sh(const SourceTexels& source, size_t first, size_t last, float sums[27])
+{
+	__m128 accumulator[27];
+	for (int i = 0; i < 27; i++)
+		accumulator[i] = _mm_setzero_ps();
+
+	for (size_t i = first; i < last; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&source.x[i]);
+		__m128 y = _mm_loadu_ps(&source.y[i]);
+		__m128 z = _mm_loadu_ps(&source.z[i]);
+		__m128 weight = _mm_loadu_ps(&source.solidAngle[i]);
+		__m128 color[3] = { _mm_mul_ps(_mm_loadu_ps(&source.r[i]), weight),
+			_mm_mul_ps(_mm_loadu_ps(&source.g[i]), weight), _mm_mul_ps(_mm_loadu_ps(&source.b[i]), weight) };
+
+		// real spherical harmonics up to band 2
+		__m128 basis[9];
+		basis[0] = _mm_set1_ps(0.282095f);
+		basis[1] = _mm_mul_ps(_mm_set1_ps(0.488603f), y);
+		basis[2] = _mm_mul_ps(_mm_set1_ps(0.488603f), z);
+		basis[3] = _mm_mul_ps(_mm_set1_ps(0.488603f), x);
+		basis[4] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(x, y));
+		basis[5] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(y, z));
+		basis[6] = _mm_mul_ps(_mm_set1_ps(0.315392f), _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_mul_ps(z, z)), _mm_set1_ps(1.0f)));
+		basis[7] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(x, z));
+		basis[8] = _mm_mul_ps(_mm_set1_ps(0.546274f), _mm_sub_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+
+		for (int k = 0; k < 9; k++)
+		{
+			for (int c = 0; c < 3; c++)
+				accumulator[k * 3 + c] = _mm_add_ps(accumulator[k * 3 + c], _mm_mul_ps(basis[k], color[c]));
+		}
+	}
+
+	for (int i = 0; i < 27; i++)
+		sums[i] = horizontal_sum(accumulator[i]);
+}
+
+// texel coordinates of four samples on a level each, for bilinear fetches clamped to the face
+typedef struct Footprint
+{
+	int left[4], right[4], top[4], bottom[4];
+	float fx[4], fy[4];
+} Footprint;
+
+static void find_footprint(const SourceChain& source, const int level[4], __m128 s, __m128 t, Footprint* footprint)
+{
+	__m128 size = _mm_setr_ps(static_cast<float>(max(source.size >> level[0], 1)), static_cast<float>(max(source.size >> level[1], 1)),
+		static_cast<float>(max(source.size >> level[2], 1)), static_cast<float>(max(source.size >> level[3], 1)));
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 zero = _mm_setzero_ps();
+	__m128 last = _mm_sub_ps(size, one);
+
+	__m128 x = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(s, half), half), size), half);
+	__m128 y = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(t, half), half), size), half);
+
+	// floor, SSE2 only truncates: step back one where truncating went up
+	__m128 x0 = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+	__m128 y0 = _mm_cvtepi32_ps(_mm_cvttps_epi32(y));
+	x0 = _mm_sub_ps(x0, _mm_and_ps(_mm_cmpgt_ps(x0, x), one));
+	y0 = _mm_sub_ps(y0, _mm_and_ps(_mm_cmpgt_ps(y0, y), one));
+
+	_mm_storeu_ps(footprint->fx, _mm_sub_ps(x, x0));
+	_mm_storeu_ps(footprint->fy, _mm_sub_ps(y, y0));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(footprint->left), _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(x0, zero), last)));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(footprint->right), _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(x0, one), zero), last)));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(footprint->top), _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(y0, zero), last)));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(footprint->bottom), _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(y0, one), zero), last)));
+}
+
+// a texel as r, g, b, 1, so a weighted sum of texels carries its total weight in the last lane
+static __m128 load_texel(const float* texel)
+{
+	return _mm_setr_ps(texel[0], texel[1], texel[2], 1.0f);
+}
+
+static __m128 lerp(__m128 a, __m128 b, float t)
+{
+	return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(t)));
+}
+
+// bilinear within one face of a level, at one lane of a footprint
+static __m128 sample_level(const SourceChain& source, int level, int face, const Footprint& footprint, int lane)
+{
+	int size = max(source.size >> level, 1);
+	const float* texels = &source.levels[level][face * size * size * 3];
+
+	__m128 a = load_texel(&texels[(footprint.top[lane] * size + footprint.left[lane]) * 3]);
+	__m128 b = load_texel(&texels[(footprint.top[lane] * size + footprint.right[lane]) * 3]);
+	__m128 c = load_texel(&texels[(footprint.bottom[lane] * size + footprint.left[lane]) * 3]);
+	__m128 d = load_texel(&texels[(footprint.bottom[lane] * size + footprint.right[lane]) * 3]);
+
+	return lerp(lerp(a, b, footprint.fx[lane]), lerp(c, d, footprint.fx[lane]), footprint.fy[lane]);
+}
+
+static void build_chain(const vector<float>& firstMip, GLint size, int numberOfLevels, SourceChain* source)
+{
+	source->size = size;
+	source->numberOfLevels = numberOfLevels;
+	source->levels[0] = firstMip;
+
+	for (int level = 1; level < numberOfLevels; level++)
+	{
+		int levelSize = max(size >> level, 1);
+		int parentSize = max(size >> (level - 1), 1);
+		const float* parent = &source->levels[level - 1][0];
+		vector<float>& texels = source->levels[level];
+		texels.resize(6 * levelSize * levelSize * 3);
+
+		for (int face = 0; face < 6; face++)
+		{
+			const float* parentFace = parent + face * parentSize * parentSize * 3;
+
+			for (int y = 0; y < levelSize; y++)
+			{
+				for (int x = 0; x < levelSize; x++)
+				{
+					float* texel = &texels[((face * levelSize + y) * levelSize + x) * 3];
+					int x0 = min(x * 2, parentSize - 1), x1 = min(x * 2 + 1, parentSize - 1);
+					int y0 = min(y * 2, parentSize - 1), y1 = min(y * 2 + 1, parentSize - 1);
+
+					for (int c = 0; c < 3; c++)
+					{
+						texel[c] = 0.25f * (parentFace[(y0 * parentSize + x0) * 3 + c] + parentFace[(y0 * parentSize + x1) * 3 + c]
+							+ parentFace[(y1 * parentSize + x0) * 3 + c] + parentFace[(y1 * parentSize + x1) * 3 + c]);
+					}
+				}
+			}
+		}
+	}
+}
+
+// van der Corput radical inverse in base 2, the second coordinate of a Hammersley point
+static float radical_inverse(unsigned int bits)
+{
+	bits = (bits << 16) | (bits >> 16);
+	bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+	bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+	bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+	bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+
+	return bits * 2.3283064365386963e-10f;
+}
+
+// half vectors from a Hammersley set distributed as D(h) (n.h), with the view along the normal; each
+// sample reads the source level whose texels cover about the solid angle the sample stands for, so the
+// few samples still see every texel of a wide lobe (Colbert and Krivanek 2007)
+static void build_lobe(float alpha, const SourceChain& source, Lobe* lobe)
+{
+	static const float pi = 3.14159265f;
+
+	float alpha2 = alpha * alpha;
+	float texelSolidAngle = 4.0f * pi / (6.0f * source.size * source.size);
+	int n = 0;
+
+	for (int i = 0; i < ENVIRONMENT_SAMPLES; i++)
+	{
+		float phi = 2.0f * pi * i / ENVIRONMENT_SAMPLES;
+		float v = radical_inverse(i);
+		float cosTheta = sqrtf((1.0f - v) / (1.0f + (alpha2 - 1.0f) * v));
+		float sinTheta = sqrtf(max(0.0f, 1.0f - cosTheta * cosTheta));
+		glm::vec3 half(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+
+		// l = reflect(-v, h) with v = n = +z
+		glm::vec3 direction = half * (2.0f * cosTheta) - glm::vec3(0.0f, 0.0f, 1.0f);
+
+		if (direction.z <= 0.0f)
+			continue;
+
+		// the pdf of l is D(h) (n.h) / (4 (v.h)), which with v = n is D(h) / 4
+		float denominator = cosTheta * cosTheta * (alpha2 - 1.0f) + 1.0f;
+		float pdf = alpha2 / (pi * denominator * denominator) / 4.0f;
+		float sampleSolidAngle = 1.0f / (ENVIRONMENT_SAMPLES * pdf);
+		float level = 0.5f * log2f(sampleSolidAngle / texelSolidAngle) + 1.0f;
+
+		lobe->x[n] = direction.x;
+		lobe->y[n] = direction.y;
+		lobe->z[n] = direction.z;
+		lobe->weight[n] = direction.z;
+		lobe->level[n] = min(max(level, 0.0f), static_cast<float>(source.numberOfLevels - 1));
+		n++;
+	}
+
+	for (lobe->numberOfSamples = (n + 3) & ~3; n < lobe->numberOfSamples; n++)
+	{
+		lobe->x[n] = lobe->y[n] = 0.0f;
+		lobe->z[n] = 1.0f;
+		lobe->weight[n] = lobe->level[n] = 0.0f;
+	}
+}
+
+// n.l-weighted average of the lobe's samples turned to a direction, trilinear between the two levels around
+// each sample's fractional one
+// four samples at a time are turned, projected onto the cube (the inverse of texel_direction, with s and t in
+// [-1, 1]) and placed on their levels with SSE; only the texel fetches are scalar, SSE2 has no gather
+static glm::vec3 prefilter_texel(const SourceChain& source, const glm::vec3& normal, const Lobe& lobe)
+{
+	glm::vec3 up = (fabs(normal.z) < 0.999f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+	glm::vec3 tangent = glm::normalize(glm::cross(up, normal));
+	glm::vec3 bitangent = glm::cross(normal, tangent);
+	__m128 sum = _mm_setzero_ps();		// weighted r, g, b and the total weight
+
+	__m128 tx = _mm_set1_ps(tangent.x), ty = _mm_set1_ps(tangent.y), tz = _mm_set1_ps(tangent.z);
+	__m128 bx = _mm_set1_ps(bitangent.x), by = _mm_set1_ps(bitangent.y), bz = _mm_set1_ps(bitangent.z);
+	__m128 nx = _mm_set1_ps(normal.x), ny = _mm_set1_ps(normal.y), nz = _mm_set1_ps(normal.z);
+	__m128 sign = _mm_set1_ps(-0.0f);
+	__m128 zero = _mm_setzero_ps();
+
+	for (int i = 0; i < lobe.numberOfSamples; i += 4)
+	{
+		__m128 sx = _mm_loadu_ps(&lobe.x[i]);
+		__m128 sy = _mm_loadu_ps(&lobe.y[i]);
+		__m128 sz = _mm_loadu_ps(&lobe.z[i]);
+
+		__m128 dx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, sx), _mm_mul_ps(bx, sy)), _mm_mul_ps(nx, sz));
+		__m128 dy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ty, sx), _mm_mul_ps(by, sy)), _mm_mul_ps(ny, sz));
+		__m128 dz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tz, sx), _mm_mul_ps(bz, sy)), _mm_mul_ps(nz, sz));
+
+		__m128 ax = _mm_andnot_ps(sign, dx);
+		__m128 ay = _mm_andnot_ps(sign, dy);
+		__m128 az = _mm_andnot_ps(sign, dz);
+		__m128 positiveX = _mm_cmpgt_ps(dx, zero);
+		__m128 positiveY = _mm_cmpgt_ps(dy, zero);
+		__m128 positiveZ = _mm_cmpgt_ps(dz, zero);
+
+		// the major axis picks the face: x on ties with either, then y on a tie with z
+		__m128 majorX = _mm_and_ps(_mm_cmpge_ps(ax, ay), _mm_cmpge_ps(ax, az));
+		__m128 majorY = _mm_andnot_ps(majorX, _mm_cmpge_ps(ay, az));
+		__m128 majorZ = _mm_andnot_ps(_mm_or_ps(majorX, majorY), _mm_cmpeq_ps(zero, zero));
+
+		// s: -z or z on the x faces, x on the y faces, x or -x on the z faces; t: -y, except z or -z on the y faces
+		__m128 sX = _mm_xor_ps(dz, _mm_and_ps(positiveX, sign));
+		__m128 sZ = _mm_xor_ps(dx, _mm_andnot_ps(positiveZ, sign));
+		__m128 tY = _mm_xor_ps(dz, _mm_andnot_ps(positiveY, sign));
+		__m128 minusY = _mm_xor_ps(dy, sign);
+
+		__m128 major = _mm_or_ps(_mm_and_ps(majorX, ax), _mm_or_ps(_mm_and_ps(majorY, ay), _mm_and_ps(majorZ, az)));
+		__m128 s = _mm_or_ps(_mm_and_ps(majorX, sX), _mm_or_ps(_mm_and_ps(majorY, dx), _mm_and_ps(majorZ, sZ)));
+		__m128 t = _mm_or_ps(_mm_and_ps(majorY, tY), _mm_andnot_ps(majorY, minusY));
+
+		s = _mm_div_ps(s, major);
+		t = _mm_div_ps(t, major);
+
+		// the level below each sample's and the one above it, blend is 0 where there is none above
+		__m128 level = _mm_loadu_ps(&lobe.level[i]);
+		__m128i first = _mm_cvttps_epi32(level);
+		int firstLevel[4], secondLevel[4];
+		float blend[4];
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(firstLevel), first);
+		_mm_storeu_ps(blend, _mm_sub_ps(level, _mm_cvtepi32_ps(first)));
+		for (int lane = 0; lane < 4; lane++)
+			secondLevel[lane] = min(firstLevel[lane] + 1, source.numberOfLevels - 1);
+
+		Footprint firstFootprint, secondFootprint;
+		find_footprint(source, firstLevel, s, t, &firstFootprint);
+		find_footprint(source, secondLevel, s, t, &secondFootprint);
+
+		int maskX = _mm_movemask_ps(majorX), maskY = _mm_movemask_ps(majorY);
+		int maskPositive[3] = { _mm_movemask_ps(positiveX), _mm_movemask_ps(positiveY), _mm_movemask_ps(positiveZ) };
+
+		for (int lane = 0; lane < 4; lane++)
+		{
+			float weight = lobe.weight[i + lane];
+
+			if (weight <= 0.0f)
+				continue;
+
+			int axis = ((maskX >> lane) & 1) ? 0 : ((maskY >> lane) & 1) ? 1 : 2;
+			int face = axis * 2 + (((maskPositive[axis] >> lane) & 1) ? 0 : 1);
+
+			__m128 color = sample_level(source, firstLevel[lane], face, firstFootprint, lane);
+			if (blend[lane] > 0.0f)
+				color = lerp(color, sample_level(source, secondLevel[lane], face, secondFootprint, lane), blend[lane]);
+
+			sum = _mm_add_ps(sum, _mm_mul_ps(color, _mm_set1_ps(weight)));
+		}
+	}
+
+	float total[4];
+	_mm_storeu_ps(total, sum);
+	glm::vec3 color(total[0], total[1], total[2]);
+	float totalWeight = total[3];
+
+	if (totalWeight <= 0.0f)
+		return glm::vec3(0.0f);
+
+	return color / totalWeight;
+}
+
+void prefilter_environment(const unsigned char* const faces[6], GLint size, EnvironmentLighting* lighting, JobSystem* jobSystem)
+{
+	SourceTexels source;
+
+	lighting->size = size;
+	lighting->numberOfMips = mip_count(size);
+
+	build_source(faces, size, &source, &lighting->texels[0]);
+
+	// irradiance, each job projects a slice of the texels into its own sums
+	int numberOfSlices = static_cast<int>((source.x.size() + ENVIRONMENT_SH_TEXELS - 1) / ENVIRONMENT_SH_TEXELS);
+	vector<float> partialSums(numberOfSlices * 27, 0.0f);
+
+	parallel_for(jobSystem, numberOfSlices, 1, [&](int begin, int end)
+	{
+		for (int slice = begin; slice < end; slice++)
+		{
+			size_t first = static_cast<size_t>(slice) * ENVIRONMENT_SH_TEXELS;
+			size_t last = min(source.x.size(), first + ENVIRONMENT_SH_TEXELS);
+			project_sh(source, first, last, &partialSums[slice * 27]);
+		}
+	});
+
+	// convolve with the clamped cosine lobe per band, and divide by pi for a diffuse surface
+	const float band[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+	for (int k = 0; k < 9; k++)
+	{
+		glm::vec3 sum(0.0f);
+		for (int slice = 0; slice < numberOfSlices; slice++)
+			sum += glm::vec3(partialSums[slice * 27 + k * 3], partialSums[slice * 27 + k * 3 + 1], partialSums[slice * 27 + k * 3 + 2]);
+
+		lighting->irradiance[k] = sum * band[k];
+	}
+
+	// specular, the first mip is the source itself; the other mips sample a filtered chain of it
+	SourceChain chain;
+	build_chain(lighting->texels[0], size, lighting->numberOfMips, &chain);
+
+	vector<Lobe> lobes(lighting->numberOfMips);
+	vector<PrefilterRow> rows;
+
+	for (int mip = 1; mip < lighting->numberOfMips; mip++)
+	{
+		int mipSize = max(size >> mip, 1);
+		float roughness = static_cast<float>(mip) / (lighting->numberOfMips - 1);
+
+		lighting->texels[mip].resize(6 * mipSize * mipSize * 3);
+		build_lobe(roughness * roughness, chain, &lobes[mip]);
+
+		for (int face = 0; face < 6; face++)
+		{
+			for (int row = 0; row < mipSize; row++)
+			{
+				PrefilterRow job = { mip, face, row };
+				rows.push_back(job);
+			}
+		}
+	}
+
+	parallel_for(jobSystem, static_cast<int>(rows.size()), 4, [&](int begin, int end)
+	{
+		for (int job = begin; job < end; job++)
+		{
+			const PrefilterRow& row = rows[job];
+			int mipSize = max(size >> row.mip, 1);
+			const Lobe& lobe = lobes[row.mip];
+			float* destination = &lighting->texels[row.mip][((row.face * mipSize + row.row) * mipSize) * 3];
+
+			for (int x = 0; x < mipSize; x++)
+			{
+				glm::vec3 color = prefilter_texel(chain, texel_direction(row.face, x, row.row, mipSize), lobe);
+				destination[x * 3] = color.x;
+				destination[x * 3 + 1] = color.y;
+				destination[x * 3 + 2] = color.z;
+			}
+		}
+	});
+}
+
+static bool read_environment_cache(const char* cacheName, unsigned long long sourceHash, EnvironmentLighting* lighting)
+{
+	ifstream cacheStream(cacheName, ios::in | ios::binary | ios::ate);
+
+	if (!cacheStream.is_open())
+		return false;
+
+	streamoff fileSize = cacheStream.tellg();
+	cacheStream.seekg(0, ios::beg);
+
+	EnvironmentCacheHeader header;
+	cacheStream.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if (!cacheStream || header.magic != ENVIRONMENT_CACHE_MAGIC || header.version != ENVIRONMENT_CACHE_VERSION
+		|| header.sourceHash != sourceHash || !valid_size(header.size) || header.numberOfMips != mip_count(header.size))
+		return false;
+
+	// the size fixes the length of the rest, which has to be all that is left of the file
+	streamoff bytes = sizeof(header) + sizeof(lighting->irradiance);
+	for (int mip = 0; mip < header.numberOfMips; mip++)
+	{
+		streamoff mipSize = max(header.size >> mip, 1);
+		bytes += 6 * mipSize * mipSize * 3 * static_cast<streamoff>(sizeof(float));
+	}
+
+	if (bytes != fileSize)
+		return false;
+
+	lighting->size = header.size;
+	lighting->numberOfMips = header.numberOfMips;
+	cacheStream.read(reinterpret_cast<char*>(lighting->irradiance), sizeof(lighting->irradiance));
+
+	for (int mip = 0; mip < lighting->numberOfMips && cacheStream; mip++)
+	{
+		int mipSize = max(lighting->size >> mip, 1);
+		lighting->texels[mip].resize(6 * mipSize * mipSize * 3);
+		cacheStream.read(reinterpret_cast<char*>(&lighting->texels[mip][0]), sizeof(float) * lighting->texels[mip].size());
+	}
+
+	return static_cast<bool>(cacheStream);
+}
+
+static void write_environment_cache(const char* cacheName, unsigned long long sourceHash, const EnvironmentLighting& lighting)
+{
+	ofstream cacheStream(cacheName, ios::out | ios::binary);
+
+	if (!cacheStream.is_open())
+	{
+		cout << "Failed to write environment cache - " << cacheName << endl;
+		return;
+	}
+
+	EnvironmentCacheHeader header;
+	header.magic = ENVIRONMENT_CACHE_MAGIC;
+	header.version = ENVIRONMENT_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.size = lighting.size;
+	header.numberOfMips = lighting.numberOfMips;
+	cacheStream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	cacheStream.write(reinterpret_cast<const char*>(lighting.irradiance), sizeof(lighting.irradiance));
+
+	for (int mip = 0; mip < lighting.numberOfMips; mip++)
+		cacheStream.write(reinterpret_cast<const char*>(&lighting.texels[mip][0]), sizeof(float) * lighting.texels[mip].size());
+}
+
+bool load_environment_lighting(const char* const faceFiles[6], const char* cacheName, EnvironmentLighting* lighting, LinearArena* scratch,
+	JobSystem* jobSystem)
+{
+	unsigned long long sourceHash = 14695981039346656037ull;
+	for (int i = 0; i < 6; i++)
+		sourceHash = file_hash(faceFiles[i], sourceHash);
+
+	if (read_environment_cache(cacheName, sourceHash, lighting))
+		return true;
+
+	unsigned char* faces[6];
+	int width[6], height[6];
+
+	for (int i = 0; i < 6; i++)
+	{
+		faces[i] = readBitmapRGBImage(faceFiles[i], &width[i], &height[i], scratch);
+
+		if (!faces[i])
+			return false;
+
+		if (width[i] != height[i] || width[i] != width[0] || !valid_size(width[i]))
+		{
+			cout << "Environment faces must be square, the same size and a power of two up to " << ENVIRONMENT_MAX_SIZE << endl;
+			return false;
+		}
+	}
+
+	prefilter_environment(faces, width[0], lighting, jobSystem);
+	write_environment_cache(cacheName, sourceHash, *lighting);
+
+	return true;
+}
@@ -0,0 +1,35 @@
+#ifndef __ENVIRONMENT_H
+#define __ENVIRONMENT_H
+
+#include <vector>
+
+#include <GLEW/glew.h>	// include GLEW
+#include <glm/glm.hpp>	// include GLM (ideally should only use the GLM headers that are actually used)
+
+#include "Allocators.h"
+#include "JobSystem.h"
+
+#define ENVIRONMENT_MAX_MIPS 12
+
+// image-based lighting precomputed from an environment cube map
+typedef struct EnvironmentLighting
+{
+	GLint size;											// face size of the first mip
+	GLint numberOfMips;									// down to 1x1, roughness rises linearly from 0 to 1
+	std::vector<float> texels[ENVIRONMENT_MAX_MIPS];	// RGB, the six faces one after another in GL_TEXTURE_CUBE_MAP_POSITIVE_X + face order
+	glm::vec3 irradiance[9];							// SH9 irradiance already divided by pi, multiply by the diffuse colour
+} EnvironmentLighting;
+
+// project the six 8-bit BGR faces to spherical harmonics and prefilter them into a GGX mip chain
+// the projection sums every texel four at a time with SSE; the prefilter importance-samples the GGX lobe of
+// each texel, reading a box-filtered copy of the source as coarse as the samples are sparse
+// both run on the job system's workers, or on the calling thread without one
+void prefilter_environment(const unsigned char* const faces[6], GLint size, EnvironmentLighting* lighting, JobSystem* jobSystem = NULL);
+
+// the same from the face bitmaps (+X, -X, +Y, -Y, +Z, -Z), reusing the result cached in cacheName if the
+// bitmaps have not changed; the bitmaps are read into the scratch arena, which the caller resets
+// fails if a face cannot be read or the faces are not square power-of-two images of one size
+bool load_environment_lighting(const char* const faceFiles[6], const char* cacheName, EnvironmentLighting* lighting, LinearArena* scratch,
+	JobSystem* jobSystem = NULL);
+
+#endif
@@ -0,0 +1,39 @@
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#include "lod.h"
+
+float projected_error(float error, float distance, float fovY, float viewportHeight)
+{
+	// the camera is inside or touching the object, any error is visible
+	if (distance <= 1e-4f)
+		return (error > 0.0f) ? viewportHeight : 0.0f;
+
+	return error / (2.0f * distance * tan(fovY * 0.5f)) * viewportHeight;
+}
+
+int select_lod(const PoolMesh& mesh, float scale, float distance, float fovY, float viewportHeight,
+	float threshold, float hysteresis, int currentLod)
+{
+	int numberOfLods = static_cast<int>(mesh.numberOfLods);
+	currentLod = min(max(currentLod, 0), numberOfLods - 1);
+
+	// errors grow with the level, so the first level over the threshold ends the search
+	int lod = 0;
+	while (lod + 1 < numberOfLods
+		&& projected_error(mesh.lods[lod + 1].error * scale, distance, fovY, viewportHeight) <= threshold)
+		lod++;
+
+	// the current level has become too coarse, refine straight away
+	if (lod < currentLod)
+		return lod;
+
+	// only coarsen with some margin below the threshold
+	lod = currentLod;
+	while (lod + 1 < numberOfLods
+		&& projected_error(mesh.lods[lod + 1].error * scale, distance, fovY, viewportHeight) <= threshold * (1.0f - hysteresis))
+		lod++;
+
+	return lod;
+}
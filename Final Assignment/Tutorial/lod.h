@@ -0,0 +1,16 @@
+#ifndef __LOD_H
+#define __LOD_H
+
+#include "MeshPool.h"
+
+// size in pixels of an object-space error seen from a distance through a vertical field of view
+float projected_error(float error, float distance, float fovY, float viewportHeight);
+
+// pick the coarsest level whose error projects to no more than threshold pixels
+// scale converts the mesh's object-space errors to world space
+// a coarser level is only taken once its error is below threshold * (1 - hysteresis), so an object
+// sitting near a switching distance does not pop between levels from frame to frame
+int select_lod(const PoolMesh& mesh, float scale, float distance, float fovY, float viewportHeight,
+	float threshold, float hysteresis, int currentLod);
+
+#endif
@@ -0,0 +1,420 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <cmath>
+using namespace std;
+
+#include <assimp/cimport.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "mesh.h"
+#include "tangents.h"
+#include "simplify.h"
+
+#define MESH_CACHE_MAGIC 0x4348534D		// "MSHC"
+#define MESH_CACHE_VERSION 3
+
+// header at the start of a mesh cache file
+typedef struct MeshCacheHeader
+{
+	GLuint magic;
+	GLuint version;
+	unsigned long long sourceHash;	// of the contents of the model file the cache was built from
+	GLuint numberOfMeshes;
+	GLuint numberOfMaterials;
+} MeshCacheHeader;
+
+// header in front of each mesh's vertex and index data in the cache
+typedef struct MeshCacheEntry
+{
+	GLint numberOfVertices;
+	GLint numberOfFaces;
+	GLint materialIndex;
+	GLint numberOfLods;
+	MeshLod lods[MAX_MESH_LODS];
+} MeshCacheEntry;
+
+// 64-bit FNV-1a of a file's contents, so an edit that keeps the size still invalidates the cache
+// 0 if the file cannot be opened
+static unsigned long long file_hash(const char* fileName)
+{
+	ifstream fileStream(fileName, ios::in | ios::binary);
+
+	if (!fileStream.is_open())
+		return 0;
+
+	unsigned long long hash = 14695981039346656037ull;
+	char buffer[65536];
+
+	while (fileStream.read(buffer, sizeof(buffer)) || fileStream.gcount() > 0)
+	{
+		streamsize count = fileStream.gcount();
+
+		for (streamsize i = 0; i < count; i++)
+			hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 1099511628211ull;
+	}
+
+	return hash;
+}
+
+static void free_meshes(vector<Mesh>* meshes)
+{
+	for (size_t i = 0; i < meshes->size(); i++)
+		free_mesh(&(*meshes)[i]);
+
+	meshes->clear();
+}
+
+// an entry's counts size the allocations, so they must describe levels packed one after another from index 0
+// whose data fits in what is left of the file
+static bool valid_cache_entry(const MeshCacheEntry& entry, GLuint numberOfMaterials, streamoff bytesLeft)
+{
+	if (entry.numberOfVertices <= 0 || entry.numberOfFaces <= 0 || entry.numberOfLods < 1 || entry.numberOfLods > MAX_MESH_LODS
+		|| entry.materialIndex < 0 || static_cast<GLuint>(entry.materialIndex) >= numberOfMaterials
+		|| entry.lods[0].firstIndex != 0 || entry.lods[0].numberOfFaces != entry.numberOfFaces)
+		return false;
+
+	streamoff numberOfIndices = 0;
+
+	for (int j = 0; j < entry.numberOfLods; j++)
+	{
+		if (entry.lods[j].firstIndex != numberOfIndices || entry.lods[j].numberOfFaces <= 0
+			|| entry.lods[j].numberOfFaces > entry.numberOfFaces)
+			return false;
+
+		numberOfIndices += static_cast<streamoff>(entry.lods[j].numberOfFaces) * 3;
+	}
+
+	streamoff bytes = entry.numberOfVertices * static_cast<streamoff>(sizeof(Vertex)) + numberOfIndices * static_cast<streamoff>(sizeof(GLint));
+	return bytes <= bytesLeft;
+}
+
+// read a previously imported scene, fails if the cache is missing, stale or damaged
+static bool read_mesh_cache(const string& cacheName, unsigned long long sourceHash, vector<Mesh>* meshes, vector<Material>* materials)
+{
+	ifstream cacheStream(cacheName, ios::in | ios::binary | ios::ate);
+
+	if (!cacheStream.is_open())
+		return false;
+
+	streamoff fileSize = cacheStream.tellg();
+	cacheStream.seekg(0, ios::beg);
+
+	MeshCacheHeader header;
+	cacheStream.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if (!cacheStream || header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION
+		|| header.sourceHash != sourceHash || header.numberOfMeshes == 0)
+		return false;
+
+	bool valid = true;
+
+	for (GLuint i = 0; i < header.numberOfMeshes && valid; i++)
+	{
+		MeshCacheEntry entry;
+		cacheStream.read(reinterpret_cast<char*>(&entry), sizeof(entry));
+
+		if (!cacheStream || !valid_cache_entry(entry, header.numberOfMaterials, fileSize - cacheStream.tellg()))
+		{
+			valid = false;
+			break;
+		}
+
+		Mesh mesh;
+		mesh.numberOfVertices = entry.numberOfVertices;
+		mesh.numberOfFaces = entry.numberOfFaces;
+		mesh.materialIndex = entry.materialIndex;
+		mesh.numberOfLods = entry.numberOfLods;
+		for (int j = 0; j < MAX_MESH_LODS; j++)
+			mesh.lods[j] = entry.lods[j];
+
+		GLint numberOfIndices = mesh_index_count(&mesh);
+		mesh.pMeshVertices = allocate_mesh_vertices(entry.numberOfVertices);
+		mesh.pMeshIndices = allocate_mesh_indices(numberOfIndices);
+
+		cacheStream.read(reinterpret_cast<char*>(mesh.pMeshVertices), sizeof(Vertex) * entry.numberOfVertices);
+		cacheStream.read(reinterpret_cast<char*>(mesh.pMeshIndices), sizeof(GLint) * numberOfIndices);
+		meshes->push_back(mesh);
+
+		// every index has to name one of the mesh's vertices
+		valid = !!cacheStream;
+		for (GLint j = 0; j < numberOfIndices && valid; j++)
+			valid = mesh.pMeshIndices[j] >= 0 && mesh.pMeshIndices[j] < mesh.numberOfVertices;
+	}
+
+	// the materials end the file
+	if (valid && header.numberOfMaterials * static_cast<streamoff>(sizeof(Material)) == fileSize - cacheStream.tellg())
+	{
+		materials->resize(header.numberOfMaterials);
+		if (header.numberOfMaterials > 0)
+			cacheStream.read(reinterpret_cast<char*>(&(*materials)[0]), sizeof(Material) * header.numberOfMaterials);
+	}
+	else
+		valid = false;
+
+	if (!valid || !cacheStream)
+	{
+		free_meshes(meshes);
+		materials->clear();
+		return false;
+	}
+
+	return true;
+}
+
+static void write_mesh_cache(const string& cacheName, unsigned long long sourceHash, const vector<Mesh>& meshes, const vector<Material>& materials)
+{
+	ofstream cacheStream(cacheName, ios::out | ios::binary);
+
+	if (!cacheStream.is_open())
+	{
+		cout << "Failed to write mesh cache - " << cacheName << endl;
+		return;
+	}
+
+	MeshCacheHeader header;
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.numberOfMeshes = static_cast<GLuint>(meshes.size());
+	header.numberOfMaterials = static_cast<GLuint>(materials.size());
+	cacheStream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const Mesh& mesh = meshes[i];
+		MeshCacheEntry entry;
+		entry.numberOfVertices = mesh.numberOfVertices;
+		entry.numberOfFaces = mesh.numberOfFaces;
+		entry.materialIndex = mesh.materialIndex;
+		entry.numberOfLods = mesh.numberOfLods;
+		for (int j = 0; j < MAX_MESH_LODS; j++)
+			entry.lods[j] = mesh.lods[j];
+
+		cacheStream.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+		cacheStream.write(reinterpret_cast<const char*>(mesh.pMeshVertices), sizeof(Vertex) * mesh.numberOfVertices);
+		cacheStream.write(reinterpret_cast<const char*>(mesh.pMeshIndices), sizeof(GLint) * mesh_index_count(&mesh));
+	}
+
+	if (!materials.empty())
+		cacheStream.write(reinterpret_cast<const char*>(&materials[0]), sizeof(Material) * materials.size());
+}
+
+// copy one assimp mesh into our vertex format
+static void import_mesh(const aiMesh* pMesh, Mesh* mesh)
+{
+	mesh->pMeshVertices = NULL;
+	mesh->pMeshIndices = NULL;
+	mesh->numberOfFaces = 0;
+	mesh->materialIndex = pMesh->mMaterialIndex;
+
+	// store number of mesh vertices
+	mesh->numberOfVertices = pMesh->mNumVertices;
+
+	// if mesh contains vertex coordinates
+	if (pMesh->HasPositions())
+	{
+		// allocate memory for vertices
+		mesh->pMeshVertices = allocate_mesh_vertices(pMesh->mNumVertices);
+		memset(mesh->pMeshVertices, 0, sizeof(Vertex) * pMesh->mNumVertices);
+
+		// read vertex coordinates and store in the array
+		for (int i = 0; i < pMesh->mNumVertices; i++)
+		{
+			const aiVector3D* pVertexPos = &(pMesh->mVertices[i]);
+
+			mesh->pMeshVertices[i].position[0] = (GLfloat)pVertexPos->x;
+			mesh->pMeshVertices[i].position[1] = (GLfloat)pVertexPos->y;
+			mesh->pMeshVertices[i].position[2] = (GLfloat)pVertexPos->z;
+		}
+	}
+
+	// if mesh contains normals
+	if (pMesh->HasNormals())
+	{
+		// read normals and store in the array
+		for (int i = 0; i < pMesh->mNumVertices; i++)
+		{
+			const aiVector3D* pVertexNormal = &(pMesh->mNormals[i]);
+
+			mesh->pMeshVertices[i].normal[0] = (GLfloat)pVertexNormal->x;
+			mesh->pMeshVertices[i].normal[1] = (GLfloat)pVertexNormal->y;
+			mesh->pMeshVertices[i].normal[2] = (GLfloat)pVertexNormal->z;
+		}
+	}
+
+	// if mesh contains texture coordinates
+	if (pMesh->HasTextureCoords(0))
+	{
+		// read texture coordinates and store in the array
+		for (int i = 0; i < pMesh->mNumVertices; i++)
+		{
+			const aiVector3D* pVertexTexCoord = &(pMesh->mTextureCoords[0][i]);
+
+			mesh->pMeshVertices[i].texCoord[0] = (GLfloat)pVertexTexCoord->x;
+			mesh->pMeshVertices[i].texCoord[1] = (GLfloat)pVertexTexCoord->y;
+		}
+	}
+
+	// if mesh contains faces
+	if (pMesh->HasFaces())
+	{
+		// store number of mesh faces
+		mesh->numberOfFaces = pMesh->mNumFaces;
+
+		// allocate memory for vertices
+		mesh->pMeshIndices = allocate_mesh_indices(pMesh->mNumFaces * 3);
+
+		// read normals and store in the array
+		for (int i = 0; i < pMesh->mNumFaces; i++)
+		{
+			const aiFace* pFace = &(pMesh->mFaces[i]);
+
+			mesh->pMeshIndices[i * 3] = (GLint)pFace->mIndices[0];
+			mesh->pMeshIndices[i * 3 + 1] = (GLint)pFace->mIndices[1];
+			mesh->pMeshIndices[i * 3 + 2] = (GLint)pFace->mIndices[2];
+		}
+	}
+
+	init_mesh_lods(mesh);
+}
+
+// read the material colours, falling back to a plain grey material
+static void import_material(const aiMaterial* pMaterial, Material* material)
+{
+	aiColor4D colour;
+	float shininess;
+	unsigned int count = 1;
+
+	material->ambient = glm::vec3(0.3f, 0.3f, 0.3f);
+	material->diffuse = glm::vec3(0.7f, 0.7f, 0.7f);
+	material->specular = glm::vec3(1.0f, 1.0f, 1.0f);
+	material->shininess = 40.0f;
+
+	if (aiGetMaterialColor(pMaterial, AI_MATKEY_COLOR_AMBIENT, &colour) == aiReturn_SUCCESS)
+		material->ambient = glm::vec3(colour.r, colour.g, colour.b);
+	if (aiGetMaterialColor(pMaterial, AI_MATKEY_COLOR_DIFFUSE, &colour) == aiReturn_SUCCESS)
+		material->diffuse = glm::vec3(colour.r, colour.g, colour.b);
+	if (aiGetMaterialColor(pMaterial, AI_MATKEY_COLOR_SPECULAR, &colour) == aiReturn_SUCCESS)
+		material->specular = glm::vec3(colour.r, colour.g, colour.b);
+	if (aiGetMaterialFloatArray(pMaterial, AI_MATKEY_SHININESS, &shininess, &count) == aiReturn_SUCCESS && shininess > 0.0f)
+		material->shininess = shininess;
+}
+
+bool load_scene(const char* fileName, vector<Mesh>* meshes, vector<Material>* materials, JobSystem* jobSystem)
+{
+	meshes->clear();
+	materials->clear();
+
+	// reuse the cached import if the model file has not changed
+	string cacheName = string(fileName) + ".cache";
+	unsigned long long sourceHash = file_hash(fileName);
+
+	if (read_mesh_cache(cacheName, sourceHash, meshes, materials))
+		return true;
+
+	// load file with assimp
+	const aiScene* pScene = aiImportFile(fileName, aiProcess_Triangulate
+		| aiProcess_GenSmoothNormals | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType);
+
+	// check whether scene was loaded
+	if (!pScene)
+	{
+		cout << "Could not load mesh." << endl;
+		return false;
+	}
+
+	// read every triangle mesh in the scene
+	for (unsigned int i = 0; i < pScene->mNumMeshes; i++)
+	{
+		const aiMesh* pMesh = pScene->mMeshes[i];
+
+		// skip point and line meshes split off by the importer
+		if (!pMesh->HasPositions() || !pMesh->HasFaces() || pMesh->mFaces[0].mNumIndices != 3)
+			continue;
+
+		Mesh mesh;
+		import_mesh(pMesh, &mesh);
+
+		// compute tangent space, may split vertices along UV seams
+		generate_tangents(&mesh, jobSystem);
+
+		// simplified levels over the final vertices
+		generate_lods(&mesh, MAX_MESH_LODS, jobSystem);
+		meshes->push_back(mesh);
+	}
+
+	materials->resize(pScene->mNumMaterials);
+	for (unsigned int i = 0; i < pScene->mNumMaterials; i++)
+		import_material(pScene->mMaterials[i], &(*materials)[i]);
+
+	// release the scene
+	aiReleaseImport(pScene);
+
+	write_mesh_cache(cacheName, sourceHash, *meshes, *materials);
+
+	return !meshes->empty();
+}
+
+void init_mesh_lods(Mesh* mesh)
+{
+	mesh->lods[0].firstIndex = 0;
+	mesh->lods[0].numberOfFaces = mesh->numberOfFaces;
+	mesh->lods[0].error = 0.0f;
+	mesh->numberOfLods = 1;
+}
+
+GLint mesh_index_count(const Mesh* mesh)
+{
+	const MeshLod& last = mesh->lods[mesh->numberOfLods - 1];
+	return last.firstIndex + last.numberOfFaces * 3;
+}
+
+GLfloat mesh_uv_scale(const Mesh* mesh)
+{
+	double positionArea = 0.0;
+	double uvArea = 0.0;
+	const GLint* indices = mesh->pMeshIndices + mesh->lods[0].firstIndex;
+
+	for (GLint face = 0; face < mesh->lods[0].numberOfFaces; face++)
+	{
+		const Vertex& a = mesh->pMeshVertices[indices[face * 3]];
+		const Vertex& b = mesh->pMeshVertices[indices[face * 3 + 1]];
+		const Vertex& c = mesh->pMeshVertices[indices[face * 3 + 2]];
+
+		glm::vec3 ab = glm::vec3(b.position[0], b.position[1], b.position[2]) - glm::vec3(a.position[0], a.position[1], a.position[2]);
+		glm::vec3 ac = glm::vec3(c.position[0], c.position[1], c.position[2]) - glm::vec3(a.position[0], a.position[1], a.position[2]);
+		glm::vec2 uvAB = glm::vec2(b.texCoord[0], b.texCoord[1]) - glm::vec2(a.texCoord[0], a.texCoord[1]);
+		glm::vec2 uvAC = glm::vec2(c.texCoord[0], c.texCoord[1]) - glm::vec2(a.texCoord[0], a.texCoord[1]);
+
+		positionArea += 0.5 * glm::length(glm::cross(ab, ac));
+		uvArea += 0.5 * fabs(uvAB.x * uvAC.y - uvAB.y * uvAC.x);
+	}
+
+	return (uvArea > 0.0) ? static_cast<GLfloat>(sqrt(positionArea / uvArea)) : 0.0f;
+}
+
+Vertex* allocate_mesh_vertices(GLint count)
+{
+	return memory_allocate_array<Vertex>(count, MEMORY_MESH);
+}
+
+GLint* allocate_mesh_indices(GLint count)
+{
+	return memory_allocate_array<GLint>(count, MEMORY_MESH);
+}
+
+void free_mesh(Mesh* mesh)
+{
+	memory_free(mesh->pMeshVertices);
+	memory_free(mesh->pMeshIndices);
+
+	mesh->pMeshVertices = NULL;
+	mesh->pMeshIndices = NULL;
+	mesh->numberOfVertices = 0;
+	mesh->numberOfFaces = 0;
+	init_mesh_lods(mesh);
+}
@@ -0,0 +1,74 @@
+#ifndef __MESH_H
+#define __MESH_H
+
+#include <vector>
+
+#include <GLEW/glew.h>	// include GLEW
+#include <glm/glm.hpp>	// include GLM (ideally should only use the GLM headers that are actually used)
+
+#include "Allocators.h"
+#include "JobSystem.h"
+
+#define MAX_MESH_LODS 5		// levels of detail per mesh, level 0 is the full mesh
+
+// struct for vertex attributes
+typedef struct Vertex
+{
+	GLfloat position[3];
+	GLfloat normal[3];
+	GLfloat tangent[4];		// xyz = tangent, w = bitangent sign (+1 or -1)
+	GLfloat texCoord[2];
+} Vertex;
+
+// a level of detail, a range of the mesh's indices over the same vertices
+typedef struct MeshLod
+{
+	GLint firstIndex;			// first index of the level in pMeshIndices
+	GLint numberOfFaces;		// number of faces in the level
+	GLfloat error;				// object-space distance the level deviates from the full mesh
+} MeshLod;
+
+// struct for mesh properties
+// the arrays of loaded meshes are tagged MEMORY_MESH, see allocate_mesh_vertices and allocate_mesh_indices
+typedef struct Mesh
+{
+	Vertex* pMeshVertices;		// pointer to mesh vertices
+	GLint numberOfVertices;		// number of vertices in the mesh
+	GLint* pMeshIndices;		// pointer to mesh indices, every level one after another
+	GLint numberOfFaces;		// number of faces in the mesh (level 0)
+	GLint materialIndex;		// index of the mesh's material in its scene
+	MeshLod lods[MAX_MESH_LODS];
+	GLint numberOfLods;			// number of levels in lods, at least 1
+} Mesh;
+
+typedef struct Material
+{
+	glm::vec3 ambient;
+	glm::vec3 diffuse;
+	glm::vec3 specular;
+	float shininess;
+} Material;
+
+// load every mesh and material of a model file, generating tangents on import
+// the imported result is written to a cache file next to the model and reused on later runs
+// the import's loops run on the job system's workers, or on the calling thread without one
+bool load_scene(const char* fileName, std::vector<Mesh>* meshes, std::vector<Material>* materials, JobSystem* jobSystem = NULL);
+
+// describe a mesh's indices as a single level of detail
+void init_mesh_lods(Mesh* mesh);
+
+// number of indices over every level of a mesh
+GLint mesh_index_count(const Mesh* mesh);
+
+// object-space length one unit of texture coordinate covers, from the areas of the full level's faces
+// in both spaces; 0 if the texture coordinates do not cover any area
+GLfloat mesh_uv_scale(const Mesh* mesh);
+
+// vertex and index arrays counted against MEMORY_MESH, left uninitialised
+Vertex* allocate_mesh_vertices(GLint count);
+GLint* allocate_mesh_indices(GLint count);
+
+// release the vertex and index arrays of a mesh
+void free_mesh(Mesh* mesh);
+
+#endif
@@ -0,0 +1,39 @@
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#include "simd.h"
+
+bool cpu_has_avx2()
+{
+	int info[4];
+
+#if defined(_MSC_VER)
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+	if (!osxsave || !fma || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+#else
+	unsigned int a, b, c, d;
+	__cpuid(1, a, b, c, d);
+	bool osxsave = (c & (1 << 27)) != 0;
+	bool fma = (c & (1 << 12)) != 0;
+	if (!osxsave || !fma)
+		return false;
+
+	unsigned int xcr0Low, xcr0High;
+	__asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+	if ((xcr0Low & 6) != 6)
+		return false;
+
+	__cpuid_count(7, 0, a, b, c, d);
+	info[1] = static_cast<int>(b);
+#endif
+
+	return (info[1] & (1 << 5)) != 0;
+}
@@ -0,0 +1,17 @@
+#ifndef __SIMD_H
+#define __SIMD_H
+
+#include <immintrin.h>
+
+// functions using AVX2 and FMA are compiled for them on their own, the rest of the program only assumes SSE2,
+// so they must only be called once cpu_has_avx2 has said so
+#if defined(_MSC_VER)
+#define AVX2_FUNCTION
+#else
+#define AVX2_FUNCTION __attribute__((target("avx2,fma")))
+#endif
+
+// AVX2 and FMA supported by the CPU and enabled by the OS
+bool cpu_has_avx2();
+
+#endif
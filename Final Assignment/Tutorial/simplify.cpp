@@ -0,0 +1,377 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#include <glm/glm.hpp>	// include GLM (ideally should only use the GLM headers that are actually used)
+
+#include "simplify.h"
+
+// sum of squared distances to a set of area-weighted planes, as a symmetric 4x4 matrix
+typedef struct Quadric
+{
+	double a2, b2, c2, d2;
+	double ab, ac, ad, bc, bd, cd;
+	double weight;			// total area of the planes
+} Quadric;
+
+// moving vertex "from" onto its neighbour "to"
+typedef struct Collapse
+{
+	GLint from;
+	GLint to;
+	double cost;
+} Collapse;
+
+static const double normalWeight = 0.5;		// cost of a 90 degree normal change, in squared edge lengths
+static const float minFlipCosine = 0.2f;	// reject collapses that turn a triangle further than ~78 degrees
+static const GLint minLodFaces = 32;		// not worth another level below this
+
+static inline glm::vec3 to_vec3(const GLfloat* v)
+{
+	return glm::vec3(v[0], v[1], v[2]);
+}
+
+static void quadric_add_plane(Quadric* q, const glm::vec3& n, float d, float weight)
+{
+	q->a2 += weight * n.x * n.x;
+	q->b2 += weight * n.y * n.y;
+	q->c2 += weight * n.z * n.z;
+	q->d2 += weight * d * d;
+	q->ab += weight * n.x * n.y;
+	q->ac += weight * n.x * n.z;
+	q->ad += weight * n.x * d;
+	q->bc += weight * n.y * n.z;
+	q->bd += weight * n.y * d;
+	q->cd += weight * n.z * d;
+	q->weight += weight;
+}
+
+static void quadric_add(Quadric* q, const Quadric& r)
+{
+	q->a2 += r.a2; q->b2 += r.b2; q->c2 += r.c2; q->d2 += r.d2;
+	q->ab += r.ab; q->ac += r.ac; q->ad += r.ad;
+	q->bc += r.bc; q->bd += r.bd; q->cd += r.cd;
+	q->weight += r.weight;
+}
+
+// mean squared distance from p to the quadric's planes
+static double quadric_error(const Quadric& q, const glm::vec3& p)
+{
+	double x = p.x, y = p.y, z = p.z;
+	double error = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z + q.d2
+		+ 2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z)
+		+ 2.0 * (q.ad * x + q.bd * y + q.cd * z);
+
+	// rounding can leave a tiny negative value
+	return (q.weight > 0.0) ? max(error, 0.0) / q.weight : 0.0;
+}
+
+// lexicographic position order, used to find vertices that were split for their attributes
+static bool position_less(const Vertex& a, const Vertex& b)
+{
+	if (a.position[0] != b.position[0])
+		return a.position[0] < b.position[0];
+	if (a.position[1] != b.position[1])
+		return a.position[1] < b.position[1];
+	return a.position[2] < b.position[2];
+}
+
+// vertices that must not move: attribute seams, open borders and non-manifold edges
+static void find_locked_vertices(const Vertex* vertices, GLint numberOfVertices, const GLint* indices, GLint numberOfFaces,
+	vector<GLint>* positionIDs, vector<char>* locked)
+{
+	// the lowest vertex index with the same position stands for the position
+	vector<GLint> order(numberOfVertices);
+	for (GLint i = 0; i < numberOfVertices; i++)
+		order[i] = i;
+
+	sort(order.begin(), order.end(), [&](GLint a, GLint b) { return position_less(vertices[a], vertices[b]); });
+
+	positionIDs->resize(numberOfVertices);
+	for (GLint i = 0; i < numberOfVertices; i++)
+	{
+		bool same = i > 0 && !position_less(vertices[order[i - 1]], vertices[order[i]]);
+		(*positionIDs)[order[i]] = same ? (*positionIDs)[order[i - 1]] : order[i];
+	}
+
+	// a position referenced through more than one vertex is a seam
+	vector<char> referenced(numberOfVertices, 0);
+	vector<GLint> wedges(numberOfVertices, 0);
+	for (GLint i = 0; i < numberOfFaces * 3; i++)
+	{
+		if (!referenced[indices[i]])
+			wedges[(*positionIDs)[indices[i]]]++;
+		referenced[indices[i]] = 1;
+	}
+
+	// manifold edges are shared by exactly two triangles
+	vector<long long> edges(numberOfFaces * 3);
+	for (GLint f = 0; f < numberOfFaces; f++)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			long long a = (*positionIDs)[indices[f * 3 + e]];
+			long long b = (*positionIDs)[indices[f * 3 + (e + 1) % 3]];
+			edges[f * 3 + e] = min(a, b) * numberOfVertices + max(a, b);
+		}
+	}
+
+	sort(edges.begin(), edges.end());
+
+	vector<char> lockedPositions(numberOfVertices, 0);
+	for (size_t begin = 0; begin < edges.size();)
+	{
+		size_t end = begin;
+		while (end < edges.size() && edges[end] == edges[begin])
+			end++;
+
+		if (end - begin != 2)
+		{
+			lockedPositions[edges[begin] / numberOfVertices] = 1;
+			lockedPositions[edges[begin] % numberOfVertices] = 1;
+		}
+
+		begin = end;
+	}
+
+	locked->resize(numberOfVertices);
+	for (GLint i = 0; i < numberOfVertices; i++)
+	{
+		GLint position = (*positionIDs)[i];
+		(*locked)[i] = (lockedPositions[position] || wedges[position] > 1) ? 1 : 0;
+	}
+}
+
+GLint simplify_mesh(const Vertex* vertices, GLint numberOfVertices, const GLint* indices, GLint numberOfFaces,
+	GLint targetFaces, GLint* destination, float* error)
+{
+	vector<GLint> current(indices, indices + numberOfFaces * 3);
+	GLint faces = numberOfFaces;
+	double maxCost = 0.0;
+
+	vector<GLint> positionIDs;
+	vector<char> locked;
+	find_locked_vertices(vertices, numberOfVertices, indices, numberOfFaces, &positionIDs, &locked);
+
+	// plane quadrics gathered per position, so split vertices see the whole neighbourhood
+	Quadric zero = {};
+	vector<Quadric> quadrics(numberOfVertices, zero);
+	for (GLint f = 0; f < numberOfFaces; f++)
+	{
+		glm::vec3 p0 = to_vec3(vertices[indices[f * 3]].position);
+		glm::vec3 p1 = to_vec3(vertices[indices[f * 3 + 1]].position);
+		glm::vec3 p2 = to_vec3(vertices[indices[f * 3 + 2]].position);
+		glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+		float area = glm::length(n) * 0.5f;
+
+		if (area <= 0.0f)
+			continue;
+
+		n = glm::normalize(n);
+		for (int c = 0; c < 3; c++)
+			quadric_add_plane(&quadrics[positionIDs[indices[f * 3 + c]]], n, -glm::dot(n, p0), area);
+	}
+
+	for (GLint i = 0; i < numberOfVertices; i++)
+		quadrics[i] = quadrics[positionIDs[i]];
+
+	vector<GLint> offsets(numberOfVertices + 1);
+	vector<GLint> adjacency;
+	vector<Collapse> collapses;
+	vector<GLint> collapseTo(numberOfVertices);
+	vector<char> touched(numberOfVertices);
+
+	while (faces > targetFaces)
+	{
+		// triangles around each vertex
+		fill(offsets.begin(), offsets.end(), 0);
+		for (GLint i = 0; i < faces * 3; i++)
+			offsets[current[i] + 1]++;
+		for (GLint i = 0; i < numberOfVertices; i++)
+			offsets[i + 1] += offsets[i];
+
+		adjacency.resize(faces * 3);
+		vector<GLint> cursor(offsets.begin(), offsets.end() - 1);
+		for (GLint i = 0; i < faces * 3; i++)
+			adjacency[cursor[current[i]]++] = i / 3;
+
+		// cost of collapsing each edge in either direction, the surviving vertex keeps its attributes
+		collapses.clear();
+		for (GLint i = 0; i < faces * 3; i++)
+		{
+			GLint a = current[i];
+			GLint b = current[(i % 3 == 2) ? i - 2 : i + 1];
+
+			for (int direction = 0; direction < 2; direction++)
+			{
+				GLint from = direction ? b : a;
+				GLint to = direction ? a : b;
+
+				if (locked[from])
+					continue;
+
+				glm::vec3 edge = to_vec3(vertices[to].position) - to_vec3(vertices[from].position);
+				float normalChange = 1.0f - glm::dot(to_vec3(vertices[from].normal), to_vec3(vertices[to].normal));
+
+				Collapse collapse;
+				collapse.from = from;
+				collapse.to = to;
+				collapse.cost = quadric_error(quadrics[from], to_vec3(vertices[to].position))
+					+ normalWeight * normalChange * glm::dot(edge, edge);
+				collapses.push_back(collapse);
+			}
+		}
+
+		if (collapses.empty())
+			break;
+
+		sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		// each collapse removes about two faces, only take collapses close to the cheapest ones needed this pass
+		size_t goal = min(collapses.size(), static_cast<size_t>((faces - targetFaces) / 2 + 1));
+		double costLimit = collapses[goal - 1].cost * 1.5;
+
+		for (GLint i = 0; i < numberOfVertices; i++)
+			collapseTo[i] = i;
+		fill(touched.begin(), touched.end(), 0);
+
+		int numberOfCollapses = 0;
+		GLint remainingFaces = faces;
+
+		for (size_t i = 0; i < collapses.size() && remainingFaces > targetFaces; i++)
+		{
+			const Collapse& collapse = collapses[i];
+
+			if (collapse.cost > costLimit)
+				break;
+
+			// one collapse per neighbourhood per pass, so every check below sees unmodified triangles
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			glm::vec3 target = to_vec3(vertices[collapse.to].position);
+			int removedFaces = 0;
+			bool valid = true;
+
+			for (GLint j = offsets[collapse.from]; j < offsets[collapse.from + 1] && valid; j++)
+			{
+				const GLint* triangle = &current[adjacency[j] * 3];
+
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+				{
+					removedFaces++;
+					continue;
+				}
+
+				// the triangle must not flip or fold over
+				glm::vec3 p[3], q[3];
+				for (int c = 0; c < 3; c++)
+				{
+					p[c] = to_vec3(vertices[triangle[c]].position);
+					q[c] = (triangle[c] == collapse.from) ? target : p[c];
+				}
+
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				float lengths = glm::length(before) * glm::length(after);
+
+				if (lengths <= 0.0f || glm::dot(before, after) < minFlipCosine * lengths)
+					valid = false;
+			}
+
+			// an edge on more than two triangles would become non-manifold
+			if (!valid || removedFaces != 2)
+				continue;
+
+			collapseTo[collapse.from] = collapse.to;
+			quadric_add(&quadrics[collapse.to], quadrics[collapse.from]);
+
+			for (GLint j = offsets[collapse.from]; j < offsets[collapse.from + 1]; j++)
+			{
+				for (int c = 0; c < 3; c++)
+					touched[current[adjacency[j] * 3 + c]] = 1;
+			}
+
+			remainingFaces -= removedFaces;
+			maxCost = max(maxCost, collapse.cost);
+			numberOfCollapses++;
+		}
+
+		if (numberOfCollapses == 0)
+			break;
+
+		// apply the collapses and drop the triangles that became degenerate
+		GLint written = 0;
+		for (GLint f = 0; f < faces; f++)
+		{
+			GLint a = collapseTo[current[f * 3]];
+			GLint b = collapseTo[current[f * 3 + 1]];
+			GLint c = collapseTo[current[f * 3 + 2]];
+
+			if (a == b || b == c || a == c)
+				continue;
+
+			current[written * 3] = a;
+			current[written * 3 + 1] = b;
+			current[written * 3 + 2] = c;
+			written++;
+		}
+
+		faces = written;
+	}
+
+	copy(current.begin(), current.begin() + faces * 3, destination);
+	*error = static_cast<float>(sqrt(maxCost));
+
+	return faces;
+}
+
+void generate_lods(Mesh* mesh, int maxLods, JobSystem* jobSystem)
+{
+	init_mesh_lods(mesh);
+	maxLods = min(maxLods, MAX_MESH_LODS);
+
+	GLint numberOfFaces = mesh->numberOfFaces;
+	vector<vector<GLint> > levels(maxLods);
+	vector<GLint> levelFaces(maxLods, 0);
+	vector<float> levelErrors(maxLods, 0.0f);
+	int numberOfLevels = 1;
+
+	while (numberOfLevels < maxLods && (numberOfFaces >> numberOfLevels) >= minLodFaces)
+		levels[numberOfLevels++].resize(numberOfFaces * 3);
+
+	// every level is simplified from the full mesh, each in its own job
+	parallel_for(jobSystem, numberOfLevels - 1, 1, [&](int begin, int end)
+	{
+		for (int l = begin + 1; l <= end; l++)
+		{
+			levelFaces[l] = simplify_mesh(mesh->pMeshVertices, mesh->numberOfVertices, mesh->pMeshIndices, numberOfFaces,
+				numberOfFaces >> l, &levels[l][0], &levelErrors[l]);
+		}
+	});
+
+	// keep the levels that remove a useful share of the previous level's faces
+	vector<GLint> indices(mesh->pMeshIndices, mesh->pMeshIndices + numberOfFaces * 3);
+	GLint previousFaces = numberOfFaces;
+	float previousError = 0.0f;
+
+	for (int l = 1; l < maxLods && !levels[l].empty(); l++)
+	{
+		if (levelFaces[l] > previousFaces * 3 / 4)
+			continue;
+
+		MeshLod& lod = mesh->lods[mesh->numberOfLods++];
+		lod.firstIndex = static_cast<GLint>(indices.size());
+		lod.numberOfFaces = levelFaces[l];
+		lod.error = max(levelErrors[l], previousError);
+
+		indices.insert(indices.end(), levels[l].begin(), levels[l].begin() + levelFaces[l] * 3);
+		previousFaces = lod.numberOfFaces;
+		previousError = lod.error;
+	}
+
+	memory_free(mesh->pMeshIndices);
+	mesh->pMeshIndices = allocate_mesh_indices(static_cast<GLint>(indices.size()));
+	copy(indices.begin(), indices.end(), mesh->pMeshIndices);
+}
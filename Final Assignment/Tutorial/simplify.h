@@ -0,0 +1,19 @@
+#ifndef __SIMPLIFY_H
+#define __SIMPLIFY_H
+
+#include "mesh.h"
+
+// simplify an indexed triangle list towards targetFaces with quadric-error edge collapses
+// vertices are only ever collapsed onto a neighbour, so the result indexes the same vertex array and
+// keeps its attributes; vertices on UV/normal seams and open borders never move
+// destination must hold numberOfFaces * 3 indices, returns the number of faces written
+// error receives the object-space distance the result deviates from the input
+GLint simplify_mesh(const Vertex* vertices, GLint numberOfVertices, const GLint* indices, GLint numberOfFaces,
+	GLint targetFaces, GLint* destination, float* error);
+
+// append up to maxLods - 1 simplified levels to a mesh, each with about half the faces of the previous one
+// stops early once a level no longer removes a useful number of faces; pMeshIndices is reallocated
+// the levels are simplified in parallel on the job system's workers, or one by one without one
+void generate_lods(Mesh* mesh, int maxLods = MAX_MESH_LODS, JobSystem* jobSystem = NULL);
+
+#endif
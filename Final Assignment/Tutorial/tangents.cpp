@@ -0,0 +1,221 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#include <glm/glm.hpp>	// include GLM (ideally should only use the GLM headers that are actually used)
+
+#include "tangents.h"
+
+static const int elementsPerJob = 1024;		// triangles or vertices a job works through, fewer are not worth a job
+
+// tangent frame of a single triangle
+typedef struct TriangleFrame
+{
+	glm::vec3 tangent;		// direction of increasing u
+	glm::vec3 bitangent;	// direction of increasing v
+	float sign;				// handedness of the UV mapping (+1 or -1), 0 if the UVs are degenerate
+} TriangleFrame;
+
+static inline glm::vec3 to_vec3(const GLfloat* v)
+{
+	return glm::vec3(v[0], v[1], v[2]);
+}
+
+// any unit vector perpendicular to n, used where the UVs give no usable direction
+static glm::vec3 perpendicular(const glm::vec3& n)
+{
+	glm::vec3 axis = (fabs(n.x) < 0.9f) ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	return glm::normalize(glm::cross(axis, n));
+}
+
+// angle between two edges leaving the same corner
+static float corner_angle(const glm::vec3& a, const glm::vec3& b)
+{
+	float la = glm::length(a);
+	float lb = glm::length(b);
+
+	if (la <= 0.0f || lb <= 0.0f)
+		return 0.0f;
+
+	float c = glm::dot(a, b) / (la * lb);
+	return acos(std::max(-1.0f, std::min(1.0f, c)));
+}
+
+void generate_tangents(Mesh* mesh, JobSystem* jobSystem)
+{
+	int numberOfFaces = mesh->numberOfFaces;
+	vector<TriangleFrame> frames(numberOfFaces);
+	vector<float> cornerAngles(numberOfFaces * 3);
+
+	// per-triangle tangent, bitangent and handedness from the position and UV derivatives
+	parallel_for(jobSystem, numberOfFaces, elementsPerJob, [&](int begin, int end)
+	{
+		for (int f = begin; f < end; f++)
+		{
+			const GLint* index = &mesh->pMeshIndices[f * 3];
+			const Vertex& v0 = mesh->pMeshVertices[index[0]];
+			const Vertex& v1 = mesh->pMeshVertices[index[1]];
+			const Vertex& v2 = mesh->pMeshVertices[index[2]];
+
+			glm::vec3 p0 = to_vec3(v0.position);
+			glm::vec3 e1 = to_vec3(v1.position) - p0;
+			glm::vec3 e2 = to_vec3(v2.position) - p0;
+
+			cornerAngles[f * 3] = corner_angle(e1, e2);
+			cornerAngles[f * 3 + 1] = corner_angle(p0 - to_vec3(v1.position), to_vec3(v2.position) - to_vec3(v1.position));
+			cornerAngles[f * 3 + 2] = corner_angle(p0 - to_vec3(v2.position), to_vec3(v1.position) - to_vec3(v2.position));
+
+			float du1 = v1.texCoord[0] - v0.texCoord[0];
+			float dv1 = v1.texCoord[1] - v0.texCoord[1];
+			float du2 = v2.texCoord[0] - v0.texCoord[0];
+			float dv2 = v2.texCoord[1] - v0.texCoord[1];
+			float det = du1 * dv2 - du2 * dv1;
+
+			TriangleFrame& frame = frames[f];
+
+			if (fabs(det) < 1e-12f)
+			{
+				frame.tangent = glm::vec3(0.0f);
+				frame.bitangent = glm::vec3(0.0f);
+				frame.sign = 0.0f;
+				continue;
+			}
+
+			frame.tangent = (e1 * dv2 - e2 * dv1) / det;
+			frame.bitangent = (e2 * du1 - e1 * du2) / det;
+			frame.sign = (glm::dot(glm::cross(glm::cross(e1, e2), frame.tangent), frame.bitangent) < 0.0f) ? -1.0f : 1.0f;
+		}
+	});
+
+	// split vertices shared by triangles of both handedness, the mirrored side gets its own copy
+	vector<unsigned char> handedness(mesh->numberOfVertices, 0);	// bit 0 = positive, bit 1 = negative
+
+	for (int f = 0; f < numberOfFaces; f++)
+	{
+		if (frames[f].sign == 0.0f)
+			continue;
+
+		for (int c = 0; c < 3; c++)
+			handedness[mesh->pMeshIndices[f * 3 + c]] |= (frames[f].sign > 0.0f) ? 1 : 2;
+	}
+
+	vector<GLint> mirrorOf(mesh->numberOfVertices, -1);
+	GLint numberOfVertices = mesh->numberOfVertices;
+
+	for (GLint v = 0; v < mesh->numberOfVertices; v++)
+	{
+		if (handedness[v] == 3)
+			mirrorOf[v] = numberOfVertices++;
+	}
+
+	if (numberOfVertices != mesh->numberOfVertices)
+	{
+		Vertex* pVertices = allocate_mesh_vertices(numberOfVertices);
+		copy(mesh->pMeshVertices, mesh->pMeshVertices + mesh->numberOfVertices, pVertices);
+
+		for (GLint v = 0; v < mesh->numberOfVertices; v++)
+		{
+			if (mirrorOf[v] >= 0)
+				pVertices[mirrorOf[v]] = pVertices[v];
+		}
+
+		for (int f = 0; f < numberOfFaces; f++)
+		{
+			if (frames[f].sign >= 0.0f)
+				continue;
+
+			for (int c = 0; c < 3; c++)
+			{
+				GLint& index = mesh->pMeshIndices[f * 3 + c];
+				if (mirrorOf[index] >= 0)
+					index = mirrorOf[index];
+			}
+		}
+
+		memory_free(mesh->pMeshVertices);
+		mesh->pMeshVertices = pVertices;
+		mesh->numberOfVertices = numberOfVertices;
+	}
+
+	// vertex -> triangle corner adjacency, so each vertex can be resolved independently
+	vector<int> cornerStart(numberOfVertices + 1, 0);
+	vector<int> corners(numberOfFaces * 3);
+
+	for (int i = 0; i < numberOfFaces * 3; i++)
+		cornerStart[mesh->pMeshIndices[i] + 1]++;
+	for (GLint v = 0; v < numberOfVertices; v++)
+		cornerStart[v + 1] += cornerStart[v];
+
+	vector<int> cornerFill(cornerStart.begin(), cornerStart.end() - 1);
+	for (int i = 0; i < numberOfFaces * 3; i++)
+		corners[cornerFill[mesh->pMeshIndices[i]]++] = i;
+
+	// angle-weighted average of the triangle frames projected onto each vertex normal
+	parallel_for(jobSystem, numberOfVertices, elementsPerJob, [&](int begin, int end)
+	{
+		for (int v = begin; v < end; v++)
+		{
+			Vertex& vertex = mesh->pMeshVertices[v];
+			glm::vec3 normal = to_vec3(vertex.normal);
+			float length = glm::length(normal);
+
+			// a missing or degenerate normal is replaced by the area-weighted normal of the vertex's triangles,
+			// or +z if they have no area either, so the frame never goes NaN
+			if (!(length > 1e-6f) || !isfinite(length))
+			{
+				normal = glm::vec3(0.0f);
+
+				for (int i = cornerStart[v]; i < cornerStart[v + 1]; i++)
+				{
+					const GLint* index = &mesh->pMeshIndices[(corners[i] / 3) * 3];
+					glm::vec3 p0 = to_vec3(mesh->pMeshVertices[index[0]].position);
+					normal += glm::cross(to_vec3(mesh->pMeshVertices[index[1]].position) - p0, to_vec3(mesh->pMeshVertices[index[2]].position) - p0);
+				}
+
+				if (!(glm::length(normal) > 1e-12f))
+					normal = glm::vec3(0.0f, 0.0f, 1.0f);
+
+				normal = glm::normalize(normal);
+				vertex.normal[0] = normal.x;
+				vertex.normal[1] = normal.y;
+				vertex.normal[2] = normal.z;
+			}
+			else
+				normal /= length;
+
+			glm::vec3 tangent(0.0f);
+			glm::vec3 bitangent(0.0f);
+
+			for (int i = cornerStart[v]; i < cornerStart[v + 1]; i++)
+			{
+				const TriangleFrame& frame = frames[corners[i] / 3];
+
+				if (frame.sign == 0.0f)
+					continue;
+
+				glm::vec3 t = frame.tangent - normal * glm::dot(normal, frame.tangent);
+				glm::vec3 b = frame.bitangent - normal * glm::dot(normal, frame.bitangent);
+				float lt = glm::length(t);
+				float lb = glm::length(b);
+
+				if (lt > 0.0f)
+					tangent += t * (cornerAngles[corners[i]] / lt);
+				if (lb > 0.0f)
+					bitangent += b * (cornerAngles[corners[i]] / lb);
+			}
+
+			// Gram-Schmidt orthogonalise, falling back to an arbitrary frame when the UVs give none
+			tangent -= normal * glm::dot(normal, tangent);
+			if (glm::length(tangent) > 1e-6f)
+				tangent = glm::normalize(tangent);
+			else
+				tangent = perpendicular(normal);
+
+			vertex.tangent[0] = tangent.x;
+			vertex.tangent[1] = tangent.y;
+			vertex.tangent[2] = tangent.z;
+			vertex.tangent[3] = (glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f) ? -1.0f : 1.0f;
+		}
+	});
+}
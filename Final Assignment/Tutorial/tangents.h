@@ -0,0 +1,14 @@
+#ifndef __TANGENTS_H
+#define __TANGENTS_H
+
+#include "mesh.h"
+
+// generate MikkTSpace-style per-vertex tangents and bitangent signs for an indexed triangle mesh
+// vertices shared by triangles of opposite UV handedness (mirrored UVs / seams) are split, so the
+// vertex and index arrays of the mesh may be reallocated
+// vertices with a zero or non-finite normal are given the area-weighted normal of their triangles (+z if
+// those have no area)
+// the per-triangle and per-vertex passes run on the job system's workers, or on the calling thread without one
+void generate_tangents(Mesh* mesh, JobSystem* jobSystem = NULL);
+
+#endif